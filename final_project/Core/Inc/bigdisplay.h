@@ -2,12 +2,12 @@
 #define BIGDISPLAY_H
 
 // #include "main.h"
-#include "spi.h"
+#include "spi_bus.h"
 
 #define TFT_WIDTH   480
 #define TFT_HEIGHT  320
 
-#define TFT_SPI_HANDLE      hspi1
+#define TFT_SPI_HANDLE      (*spi_bus_handle(SPI_DEV_TFT))
 
 #define TFT_CS_GPIO_Port    GPIOD
 #define TFT_CS_Pin          GPIO_PIN_0
@@ -33,6 +33,7 @@
 // TFT Register Values
 #define TFT_PIXEL_FORMAT_16BIT      0x55
 #define TFT_MADCTL_MV_BGR           0x28  // MADCTL_MV | MADCTL_BGR : landscape, connector on the left
+#define TFT_MADCTL_MY_MX            0xC0  // row and column order reversed: turned 180 degrees
 
 // Timing Delays (ms)
 #define TFT_RESET_DELAY             20
@@ -46,6 +47,18 @@
 #define TFT_ADDRESS_WINDOW_BUF_SIZE 4
 #define TFT_PRINTF_BUFFER_SIZE      128
 
+// Pixel data is double-buffered through SPI TX DMA in strips of this size;
+// shorter transfers are not worth the DMA setup and go out blocking
+#define TFT_DMA_STRIP_BYTES         (TFT_MAX_LINE_BUFFER_WIDTH * 2 * 2)
+#define TFT_DMA_MIN_BYTES           64
+
+// Retained mode: the panel is shadowed by 16x16 two-colour tiles; tiles that
+// need more colours borrow RGB565 storage from a shared pool (at most 255).
+#define TFT_TILE_SIZE               16  // one uint16_t mask word per tile row
+#define TFT_TILES_X                 (TFT_WIDTH / TFT_TILE_SIZE)
+#define TFT_TILES_Y                 (TFT_HEIGHT / TFT_TILE_SIZE)
+#define TFT_SHADOW_SLOTS            96
+
 // Font Constants
 #define TFT_FONT_TABLE_SIZE         95
 #define TFT_FONT_GLYPH_WIDTH        5
@@ -80,10 +93,49 @@
 #define COLOR_NAVY      0x000F
 
 void TFT_Init(void);
+// TFT_Init as steps for the boot sequencer (see boot.h)
+uint32_t TFT_InitStep(uint8_t *phase);
+// The panel turned 180 degrees by MADCTL row/column order, so drawing code
+// and buffers stay in reading order; touch coordinates follow. Kept across
+// TFT_Init; what is on the panel stays put, so redraw after a change.
+void TFT_SetRotation180(uint8_t on);
+uint8_t TFT_Rotation180(void);
 void TFT_FillScreen(uint16_t color);
 void TFT_DrawPixel(uint16_t x, uint16_t y, uint16_t color);
 void TFT_FillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t color);
 
 void TFT_DrawRGB888Buffer(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *buffer, uint8_t scale);
+// buffer holds big-endian RGB565, the panel's own byte order
+void TFT_DrawRGB565Buffer(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *buffer, uint8_t scale);
+
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint8_t scale;
+    uint8_t wrap;
+    uint16_t fg;
+    uint16_t bg;
+    uint8_t use_bg;
+} TFT_TextCfg;
+
+void TFT_TextInit(TFT_TextCfg *t);
+void TFT_TextSetCursor(TFT_TextCfg *t, uint16_t x, uint16_t y);
+void TFT_TextSetScale(TFT_TextCfg *t, uint8_t s);
+void TFT_TextSetWrap(TFT_TextCfg *t, uint8_t w);
+void TFT_TextSetColors(TFT_TextCfg *t, uint16_t fg, uint16_t bg, uint8_t use_bg);
+uint8_t TFT_TextDrawChar(TFT_TextCfg *t, char c);
+uint16_t TFT_TextDrawString(TFT_TextCfg *t, const char *s);
+int TFT_TextPrintf(TFT_TextCfg *t, const char *fmt, ...);
+uint16_t TFT_DrawStringAt(uint16_t x, uint16_t y, const char *s, uint16_t color, uint8_t scale);
+
+int TFT_PrintfAt(uint16_t x, uint16_t y, uint16_t color, uint8_t scale, const char *fmt, ...);
+
+// Retained mode: draws land in the tile shadow and reach the panel on
+// TFT_Flush(), which sends only tiles whose content changed since the last
+// flush. Change is judged by a 32-bit signature per tile rather than a
+// second copy of the pixels, which would not fit in RAM. The RGB888/RGB565
+// buffer blits still write straight to the panel.
+void TFT_SetRetained(uint8_t on);
+void TFT_Flush(void);
 
 #endif // BIGDISPLAY_H
\ No newline at end of file
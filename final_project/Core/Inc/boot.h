@@ -0,0 +1,55 @@
+/*
+ * boot.h
+ *
+ * Start-up sequencer. A device bring-up is written as a step function: each
+ * call does what it can without waiting, moves its phase on and says how
+ * long to wait before the next call. boot_poll runs every device whose wait
+ * is over, so one device's reset pulses and settling times pass while the
+ * others work instead of adding up. Retries are the step function's own
+ * business and have to be bounded; a device that gives up is marked failed
+ * and the rest carry on.
+ *
+ * Time comes from HAL_GetTick, so a step that takes a while itself (a
+ * register table over I2C) holds the others up by that much.
+ */
+
+#ifndef INC_BOOT_H_
+#define INC_BOOT_H_
+
+#include <stdint.h>
+
+#define BOOT_DONE 0xffffffffu
+#define BOOT_FAILED 0xfffffffeu
+
+// One step of a bring-up. *phase starts at 0 and is the step's to move on;
+// returns the ms to wait before the next step, or BOOT_DONE / BOOT_FAILED
+typedef uint32_t (*BootStep)(uint8_t *phase);
+
+typedef enum { BOOT_PENDING, BOOT_OK, BOOT_ERROR } BootStatus;
+
+typedef struct {
+  const char *name;
+  BootStep step;
+
+  // filled in by the sequencer, times in ms since boot_start
+  BootStatus status;
+  uint8_t phase;
+  uint16_t steps;
+  uint32_t wake_ms; // next step due
+  uint32_t done_ms;
+  uint32_t busy_ms; // inside its steps, the rest of done_ms is waiting
+} BootTask;
+
+// Every task starts at once, the first steps in table order
+void boot_start(BootTask *tasks, uint8_t count);
+// Runs each task whose wait is over; 0 once all of them are done
+uint8_t boot_poll(void);
+// ms since boot_start, or the whole boot once boot_poll has returned 0
+uint32_t boot_elapsed_ms(void);
+// One line per task over printf
+void boot_report(void);
+
+// One bring-up on its own, HAL_Delay between steps; 1 if it came up
+uint8_t boot_run_one(BootStep step);
+
+#endif /* INC_BOOT_H_ */
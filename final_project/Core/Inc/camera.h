@@ -18,8 +18,9 @@
 #include <string.h>
 #include "usart.h"
 #include "gpio.h"
-#include "spi.h"
+#include "spi_bus.h"
 #include "i2c.h"
+#include "jpegdec.h"
 
 #ifndef _SENSOR_
 #define _SENSOR_
@@ -35,6 +36,7 @@ struct sensor_reg { // sensor struct that known code uses
 #define OV5642_I2C_ADDR 0x3C << 1
 #define OV5642_CHIPID_HIGH 0x300a
 #define OV5642_CHIPID_LOW  0x300b
+#define OV5642_RESET_MS 5 // after a 0x3008 software reset
 
 #define ARDUCHIP_TEST1       	0x00  //TEST register
 #define ARDUCHIP_TIM       		0x03  //Timming control
@@ -50,27 +52,112 @@ struct sensor_reg { // sensor struct that known code uses
 #define BURST_FIFO_READ			0x3C  //Burst FIFO read operation
 #define SINGLE_FIFO_READ		0x3D  //Single FIFO read operation
 
+#define FIFO_SIZE1				0x42  //Camera write FIFO size[7:0] for burst to read
+#define FIFO_SIZE2				0x43  //Camera write FIFO size[15:8]
+#define FIFO_SIZE3				0x44  //Camera write FIFO size[18:16]
+
 /********/
 // SPI BUSINESS
 /*******/
 #define  CS_PORT	GPIOA
 #define  CS_PIN     GPIO_PIN_4
+#define  CAM_SPI_HANDLE (*spi_bus_handle(SPI_DEV_CAMERA))
 
 /********/
 // BUFFA
 /*******/
-#define yuyv_data_length       153600 // 320 x 240 x 2 for yuyv data type // i don't actually use this, just for reference
+#define CAM_FRAME_W            320
+#define CAM_FRAME_H            240
+#define CAM_STREAM_RING_LINES  8      // converted lines per TFT window when streaming
+#define CAM_FIFO_CHUNK         (2 * CAM_FRAME_W * 2) // bytes per FIFO DMA burst, whole lines
+// a TFT window of lines can arrive on a bus of its own while the window
+// draws, behind the chunk still being converted
+#define CAM_FIFO_RING_CHUNKS   (CAM_STREAM_RING_LINES / 2 + 1)
+#define CAM_POLL_FIRST_MS      8      // first CAP_DONE check after the trigger
+#define CAM_POLL_MAX_MS        32     // the check interval doubles up to this
+#define CAM_DRAIN_BUDGET_MS    20     // TFT windows per capture step stop after this
+#define yuyv_data_length       153600 // 320 x 240 x 2 for yuyv data type, caps the FIFO read
 #define rgb888_data_length     230400 // 320 x 240 x 2 for yuyv data type
+#define rgb565_data_length     153600 // 320 x 240 x 2, big-endian RGB565 as the TFT takes it
+
+/********/
+// JPEG
+/*******/
+#define OV5642_320x240         0 // JPEG output sizes, OV5642_set_JPEG_size
+#define OV5642_640x480         1
+#define OV5642_1024x768        2
+#define OV5642_1280x960        3
+#define OV5642_1600x1200       4
+#define OV5642_2048x1536       5
+#define OV5642_2592x1944       6
+#define CAM_JPEG_FIFO_MAX      0x7fffff // a full FIFO means the frame overflowed
+
+/********/
+// SENSOR WINDOW
+/*******/
+#define CAM_FIELD_X            80   // preview field of view in the array,
+#define CAM_FIELD_Y            8    // as the preview table sets 0x3800-0x3807
+#define CAM_FIELD_W            1280
+#define CAM_FIELD_H            960
 
 /********/
 // FUNCTIONS + buffer + One Register Table
 /*******/
 
+// What the sensor sends; see cam_set_format
+typedef enum {
+  CAM_FMT_YUV422, // YUYV, converted to RGB565 on the MCU
+  CAM_FMT_RGB565, // big-endian from the ISP, straight to the TFT
+  CAM_FMT_Y8,     // luma only, one byte per pixel, shown as grey
+  CAM_FMT_JPEG,   // compression engine, decoded by jpegdec
+} CamFormat;
+
+// How the picture leaves the sensor, relative to the scene seen the right
+// way up; see cam_set_orientation
+typedef enum {
+  CAM_ORIENT_UPRIGHT = 0,
+  CAM_ORIENT_MIRROR = 1, // left and right swapped
+  CAM_ORIENT_FLIP = 2,   // top and bottom swapped
+  CAM_ORIENT_ROTATE180 = CAM_ORIENT_MIRROR | CAM_ORIENT_FLIP,
+} CamOrientation;
+
+typedef enum {
+  CAM_CAPTURE_IDLE,
+  CAM_CAPTURE_START, // trigger on the next step
+  CAM_CAPTURE_WAIT,  // exposing, CAP_DONE polled with backoff
+  CAM_CAPTURE_DRAIN, // FIFO lines going to the TFT, for a budget per step
+  CAM_CAPTURE_DONE,  // for one step, then idle
+} CamCaptureState;
+
+// Times in ms from the trigger, for the last capture
+typedef struct {
+  uint32_t captures;
+  uint32_t polls;          // CAP_DONE reads, all captures
+  uint32_t wait_ms;        // until CAP_DONE was seen
+  uint32_t first_pixel_ms; // until the first TFT window went out
+  uint32_t total_ms;       // until the whole picture was on the TFT
+  uint32_t max_total_ms;
+} CamCaptureStats;
+
+// Continuous preview, times in ms. The frame exposes from the first VSYNC
+// after its trigger and is read out by CAP_DONE, so the time from exposure
+// to glass lies between done_to_shown_ms and latency_ms.
+typedef struct {
+  uint32_t frames;           // on the TFT since cam_preview_start
+  uint32_t fps_x10;          // frames per 10 s, first frame to last
+  uint32_t frame_ms;         // between the last two frames on the TFT
+  uint32_t latency_ms;       // last frame: trigger to its last pixel shown
+  uint32_t max_latency_ms;
+  uint32_t done_to_shown_ms; // last frame: CAP_DONE to its last pixel shown
+  uint32_t max_step_ms;      // longest cam_preview_step
+} CamPreviewStats;
+
 //buffer
-extern uint8_t camera_buf[rgb888_data_length];
+extern uint8_t camera_buf[rgb565_data_length];
 
 // register table
 extern const struct sensor_reg OV5642_QVGA_Preview[];
+extern const struct sensor_reg OV5642_JPEG_Capture_QSXGA[];
 
 void CS_HIGH(void);
 void CS_LOW(void);
@@ -80,20 +167,99 @@ void bus_write(uint8_t addr, uint8_t data);
 
 void wrSensorReg16_8(uint16_t regID, uint8_t regDat); // i2c functions
 void rdSensorReg16_8(uint16_t regID, uint8_t* regDat);
+// A 0xffff, 0xff terminated table, as auto-increment bursts (see camera.c)
 void wrSensorRegs16_8(const struct sensor_reg* regs);
 
 uint8_t get_bit(uint8_t addr, uint8_t bit);
 
 uint8_t read_fifo(void);
+uint32_t read_fifo_length(void);
 void set_fifo_burst(void);
 void flush_fifo(void);
 void start_capture(void);
 void clear_fifo_flag(void);
 
-void ArduCam_Init_YCbCr(void);
+// FIFO reader: SPI RX DMA into a ring of chunks of up to CAM_FIFO_CHUNK
+// bytes. cam_fifo_read hands out the next chunk (valid until the next call)
+// or NULL at the end; cam_fifo_pause frees the bus for other devices until
+// the next read. The readers below only pause when the TFT shares the bus.
+void cam_fifo_open(uint32_t length, uint16_t chunk);
+const uint8_t* cam_fifo_read(uint16_t* len);
+void cam_fifo_pause(void);
+void cam_fifo_close(void);
+// From HAL_SPI_ErrorCallback: 1 if hspi failed one of the FIFO reads, which
+// then ends at that chunk
+uint8_t cam_spi_error(SPI_HandleTypeDef* hspi);
+
+// ArduCHIP and OV5642 probes are retried CAM_PROBE_TRIES times, then the
+// camera is given up on; returns 1 if it came up
+#define CAM_PROBE_TRIES 10
+#define CAM_PROBE_RETRY_MS 100
+uint8_t ArduCam_Init_YCbCr(void);
+// ArduCam_Init_YCbCr as steps for the boot sequencer (see boot.h)
+uint32_t ArduCam_InitStep_YCbCr(uint8_t* phase);
+// YCbCr output: the window (x, y, w, h) of the CAM_FIELD_W x CAM_FIELD_H
+// field scaled by the OV5642 ISP to out_w x out_h, so a smaller window is a
+// digital zoom. The scaler only shrinks, out_w must be even and the output
+// fit CAM_FRAME_W x CAM_FRAME_H; returns 0 and leaves the sensor alone if
+// not. Capture, FIFO and conversion then move out_w x out_h pixels.
+uint8_t cam_set_output(uint16_t out_w, uint16_t out_h, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+uint8_t cam_set_output_size(uint16_t out_w, uint16_t out_h); // whole field
+void cam_output_size(uint16_t* w, uint16_t* h);
+// Asks for an output format and returns the one in effect. The raw formats
+// (YUV422, RGB565, Y8) share the YCbCr bring-up and switch between captures;
+// JPEG comes only with ArduCam_Init_JPEG, which excludes the raw ones. A
+// format the bring-up cannot give leaves the sensor as it was.
+CamFormat cam_set_format(CamFormat want);
+CamFormat cam_format(void);
+// The OV5642 reads its array mirrored and/or flipped so the frame arrives
+// in display order, whatever the format: no path past the sensor reorders
+// pixels. Kept across bring-ups, which apply it; upright by default.
+void cam_set_orientation(CamOrientation o);
+CamOrientation cam_orientation(void);
+// Same bring-up with the compression engine on; size is one of OV5642_WxH
+uint8_t ArduCam_Init_JPEG(uint8_t size);
+void OV5642_set_JPEG_size(uint8_t size);
 
 void convert_24(uint8_t Y, uint8_t Cb, uint8_t Cr, uint8_t array[3]);
+// YUYV straight to big-endian RGB565, integer/LUT math (DSP SIMD on target),
+// pixels in order. pixels must be even.
+void yuyv_to_rgb565(const uint8_t* yuyv, uint8_t* rgb565, uint32_t pixels);
 void SingleCapTransfer_YCbCr(int debug_terminal, int debug_python, uint8_t* camera_buf);
+// Every step-th pixel of a YUYV line as RGB565
+void yuyv_sample_rgb565(const uint8_t* yuyv, uint8_t* rgb565, uint32_t pixels, uint8_t step);
+// Capture straight to the TFT at (x, y), 1/scale size, without camera_buf,
+// in any raw format; returns at once if cam_capture_start refuses
+void SingleCapStream_YCbCr(uint16_t x, uint16_t y, uint8_t scale);
+
+// Non-blocking SingleCapStream_YCbCr: start, then call cam_capture_step from
+// the main loop. Each step does a bounded piece of work and leaves the bus
+// free if the TFT shares it; it returns 1 on the step that put the last line
+// on the TFT. cam_capture_start returns 0 if it refused: a capture already
+// running, the preview running, or the JPEG format.
+uint8_t cam_capture_start(uint16_t x, uint16_t y, uint8_t scale);
+uint8_t cam_capture_step(void);
+CamCaptureState cam_capture_state(void);
+const CamCaptureStats* cam_capture_stats(void);
+
+// Live preview at (x, y), 1/scale size, in any raw format. The FIFO and
+// camera_buf double-buffer it: once a frame is out of the FIFO the next is
+// triggered, and it exposes while camera_buf goes to the TFT. Triggers are
+// at least interval_ms apart, 0 for back to back. cam_preview_step is
+// bounded like cam_capture_step, frees a shared bus and returns 1 on the step
+// that finished a frame on the TFT. While it runs, single captures, a second
+// start and changes of output size, format or orientation are refused with
+// a log line; stop it first.
+uint8_t cam_preview_start(uint16_t x, uint16_t y, uint8_t scale, uint32_t interval_ms);
+void cam_preview_stop(void);
+uint8_t cam_preview_step(void);
+uint8_t cam_preview_running(void);
+const CamPreviewStats* cam_preview_stats(void);
+
+// JPEG format capture decoded onto the TFT at (x, y), scaled down by 2, 4 or 8
+// as needed to fit max_w x max_h. Reads only the compressed length from the
+// FIFO and keeps no frame buffer; info may be NULL.
+JpegDecResult SingleCapJpeg(uint16_t x, uint16_t y, uint16_t max_w, uint16_t max_h, JpegDecInfo* info);
 
 #endif /* INC_CAMERA_H_ */
 
@@ -0,0 +1,84 @@
+/*
+ * i2c_bus.h
+ *
+ * Interrupt driven transaction queue for one I2C bus (I2C2: Si7021, Seesaw
+ * soil probe, BH1750). Drivers fill in an I2cJob they own and submit it.
+ * A job is an optional write, an optional gap while the device converts,
+ * and an optional read; without a write the gap comes before the read.
+ * done() runs in interrupt context once the job has finished, whatever the
+ * outcome.
+ *
+ * Jobs for one device run in submission order, one at a time. While a job
+ * sits in its gap the bus goes to the next queued job for another device,
+ * so conversions on different sensors overlap; the read is issued as soon
+ * as the gap is over and the bus is free.
+ *
+ * Transfers use the HAL _IT calls and complete from the I2C event/error
+ * interrupts; gaps and per-transfer timeouts are served by i2c_bus_tick()
+ * from SysTick, so nothing spins while a sensor converts. A transfer that
+ * outlives its timeout (a hung clock stretch, say) is aborted with STOP.
+ */
+
+#ifndef INC_I2C_BUS_H_
+#define INC_I2C_BUS_H_
+
+#include "stm32l4xx_hal.h"
+#include <stdint.h>
+
+#define I2C_BUS_TIMEOUT_MS 10 // per transfer, when the job leaves it at 0
+
+typedef enum {
+  I2C_JOB_IDLE = 0, // never submitted
+  I2C_JOB_QUEUED,
+  I2C_JOB_WRITE,
+  I2C_JOB_GAP,
+  I2C_JOB_READ,
+  // finished
+  I2C_JOB_OK,
+  I2C_JOB_NACK,
+  I2C_JOB_TIMEOUT,
+  I2C_JOB_ERROR,
+} I2cJobStatus;
+
+typedef struct I2cJob I2cJob;
+typedef void (*I2cJobDone)(I2cJob *job);
+
+struct I2cJob {
+  uint16_t addr; // HAL style, 7-bit address << 1
+  const uint8_t *tx;
+  uint8_t tx_len;
+  uint8_t *rx;
+  uint8_t rx_len;
+  uint16_t gap_ms;     // after the write: bus released, device kept
+  uint16_t timeout_ms; // per transfer, 0 = I2C_BUS_TIMEOUT_MS
+  I2cJobDone done;     // interrupt context, may submit again
+  void *ctx;           // for done()
+
+  // owned by the bus manager
+  volatile I2cJobStatus status;
+  uint32_t queued_ms;
+  uint32_t phase_ms; // start of the current transfer or gap
+  I2cJob *next;
+};
+
+typedef struct {
+  uint32_t jobs; // finished, any outcome
+  uint32_t nacks;
+  uint32_t timeouts;
+  uint32_t max_wait_ms; // submit to done
+  uint8_t max_depth;    // unfinished jobs at once
+} I2cBusStats;
+
+void i2c_bus_init(I2C_HandleTypeDef *hi2c);
+// HAL_BUSY if the job is still queued or running
+HAL_StatusTypeDef i2c_bus_submit(I2cJob *job);
+// Sleeps until the job has finished; for boot code and blocking wrappers
+I2cJobStatus i2c_bus_wait(I2cJob *job);
+uint8_t i2c_job_done(const I2cJob *job);
+uint8_t i2c_bus_idle(void);
+const I2cBusStats *i2c_bus_stats(void);
+
+// From SysTick_Handler, every millisecond
+void i2c_bus_tick(void);
+
+#endif /* INC_I2C_BUS_H_ */
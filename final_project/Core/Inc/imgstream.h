@@ -0,0 +1,86 @@
+/*
+ * imgstream.h
+ *
+ * Camera frames over the log channel as checked packets. A frame goes out as
+ * a BEGIN packet, one CHUNK per IMGSTREAM_CHUNK_MAX bytes of pixels and an
+ * END packet carrying the CRC32 of the whole frame; every packet has a
+ * sequence number and its own CRC32, so the host can tell a dropped or
+ * damaged packet from a good frame and resynchronise on the next one. Each
+ * packet is a single log_write, queued whole between log messages and trace
+ * frames and sent by the log ring's TX DMA; Sim/'s plantpot_imgrecv picks
+ * the packets out of the stream and writes the frames as PPM or PNG files.
+ *
+ * RGB565 chunks can be compressed losslessly (IMG_CODEC_DRLE): each pixel
+ * is predicted from the one before it, repeats become runs and small
+ * per-channel differences one byte. A chunk that does not get smaller is
+ * sent as it is.
+ *
+ * Packet, little endian: IMG_SYNC0 IMG_SYNC1, type u8, flags u8 (0),
+ * sequence u16, frame u16, payload length u16, payload, then CRC32
+ * (IEEE 802.3) of everything from the type byte to the end of the payload.
+ *   BEGIN  width u16, height u16, format u8, codec u8, chunk u16, bytes u32
+ *   CHUNK  offset u32, raw length u16, codec u8, data
+ *   END    frame CRC32 u32, chunks u16
+ *
+ * DRLE, per chunk, from a previous pixel of 0; pixels are big endian as the
+ * TFT takes them:
+ *   0x00-0x7f  one pixel: r += (c >> 5) - 2, g += (c >> 2 & 7) - 4,
+ *              b += (c & 3) - 2, each wrapping in its field
+ *   0x80-0xbf  the previous pixel (c & 0x3f) + 1 times
+ *   0xc0-0xff  (c & 0x3f) + 1 literal pixels follow, two bytes each
+ */
+
+#ifndef INC_IMGSTREAM_H_
+#define INC_IMGSTREAM_H_
+
+#include <stdint.h>
+
+#define IMG_SYNC0 0xA5
+#define IMG_SYNC1 0x5A
+#define IMGSTREAM_CHUNK_MAX 640 // raw bytes per CHUNK, one 320 pixel line
+#define IMG_HEADER_SIZE 10
+#define IMG_PAYLOAD_MAX (7 + IMGSTREAM_CHUNK_MAX)
+
+typedef enum {
+  IMG_BEGIN = 1,
+  IMG_CHUNK,
+  IMG_END,
+} ImgPacketType;
+
+typedef enum {
+  IMG_RGB565 = 1, // big endian
+  IMG_YUYV,
+} ImgFormat;
+
+typedef enum {
+  IMG_CODEC_RAW = 0,
+  IMG_CODEC_DRLE,
+} ImgCodec;
+
+typedef struct {
+  uint32_t frames;
+  uint32_t packets;
+  uint32_t raw_bytes;  // pixel bytes of the frames
+  uint32_t wire_bytes; // packet bytes queued
+  uint32_t retries;    // packets refused by the log ring and queued again
+} ImgStreamStats;
+
+// Frames in pieces as the pixels become available; each call returns once
+// its packets are queued, sleeping while the log ring is full. Main context
+// only, after log_init. codec is what the chunks may use, not a promise.
+void imgstream_begin(uint16_t width, uint16_t height, ImgFormat format,
+                     ImgCodec codec);
+void imgstream_write(const uint8_t *data, uint32_t len);
+void imgstream_end(void);
+// A whole frame: begin, write and end
+void imgstream_send(const uint8_t *pixels, uint16_t width, uint16_t height,
+                    ImgFormat format, ImgCodec codec);
+const ImgStreamStats *imgstream_stats(void);
+
+uint32_t img_crc32(uint32_t crc, const uint8_t *data, uint32_t len);
+// DRLE of len bytes of RGB565 (len even) into out, at most max bytes; the
+// encoded length, or 0 if it would not be shorter than max
+uint32_t img_drle_encode(const uint8_t *in, uint32_t len, uint8_t *out,
+                         uint32_t max);
+
+#endif /* INC_IMGSTREAM_H_ */
@@ -0,0 +1,60 @@
+/*
+ * jpegdec.h
+ *
+ * Streaming baseline JPEG decoder for the OV5642's compressed output. The
+ * input is pulled a chunk at a time through a callback with the shape of
+ * cam_fifo_read, so the frame goes from the ArduCHIP FIFO to the TFT
+ * without ever being held whole; the output is handed back one MCU row at
+ * a time as a strip of big-endian RGB565 lines, the TFT's byte order.
+ *
+ * Huffman-coded baseline (SOF0/SOF1) with 8-bit samples, greyscale or
+ * YCbCr with the luma at 1x1, 2x1 (the OV5642's 4:2:2) or 2x2 and the
+ * chroma at 1x1, and restart intervals. Progressive and arithmetic coding
+ * are refused. Larger frames are scaled down by 2, 4 or 8 to fit: each
+ * 8x8 block is averaged down after the IDCT, and at 1/8 only the DC
+ * coefficients are used. Colour conversion and the integer IDCT are
+ * libjpeg's (islow), with chroma replicated rather than interpolated.
+ *
+ * One decode at a time; about 23 KB of static state, most of it the strip.
+ */
+
+#ifndef INC_JPEGDEC_H_
+#define INC_JPEGDEC_H_
+
+#include <stdint.h>
+
+#define JPEGDEC_OUT_W_MAX 480 // strip width, the TFT's
+#define JPEGDEC_STRIP_H_MAX 16
+
+typedef enum {
+  JPEGDEC_OK = 0,
+  JPEGDEC_ERR_INPUT,       // the stream ended before the last MCU
+  JPEGDEC_ERR_DATA,        // malformed
+  JPEGDEC_ERR_UNSUPPORTED, // progressive, arithmetic, 12-bit, sampling
+  JPEGDEC_ERR_SIZE,        // no scale fits the frame in the bounds
+} JpegDecResult;
+
+typedef struct {
+  uint16_t width, height; // of the JPEG
+  uint16_t out_w, out_h;  // as decoded
+  uint8_t scale;          // 1, 2, 4 or 8
+  uint8_t components;
+  uint8_t h_max, v_max; // luma sampling, 2 and 1 for 4:2:2
+  uint16_t restart_interval;
+  uint32_t bytes; // taken from the input up to the last MCU
+  uint32_t mcus;
+} JpegDecInfo;
+
+// Next chunk of the stream and its length, NULL at the end
+typedef const uint8_t *(*JpegDecRead)(uint16_t *len);
+// Lines y .. y + h - 1 of the picture, w pixels each, packed
+typedef void (*JpegDecStrip)(uint16_t y, uint16_t w, uint16_t h,
+                             const uint8_t *rgb565);
+
+// Decodes one frame, scaled by the smallest factor that fits it in
+// max_w x max_h (max_w at most JPEGDEC_OUT_W_MAX). Input past the last MCU
+// is not read. info, if given, is filled in as far as the header got.
+JpegDecResult jpegdec_decode(JpegDecRead read, uint16_t max_w, uint16_t max_h,
+                             JpegDecStrip strip, JpegDecInfo *info);
+
+#endif /* INC_JPEGDEC_H_ */
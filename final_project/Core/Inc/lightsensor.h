@@ -1,6 +1,11 @@
 #include "i2c.h"
+#include "i2c_bus.h"
 
 #define BH1750_ADDR (0x23 << 1)
 
 void bh1750_init(uint32_t address);
 uint16_t bh1750_read(uint32_t address);
+// Asynchronous read on the I2C2 bus manager: *out gets the raw count (0 on
+// failure) and done, if given, runs in interrupt context after it
+HAL_StatusTypeDef bh1750_start_read(uint32_t address, uint16_t *out,
+                                    I2cJobDone done);
@@ -0,0 +1,62 @@
+/*
+ * log.h
+ *
+ * Non-blocking log channel on LPUART1. A writer copies its message into a
+ * ring and returns; TX DMA drains the ring in the background, one
+ * contiguous run per transfer. A message that does not fit is dropped
+ * whole and counted, so a burst of logging costs the caller a copy instead
+ * of 87 us per byte at 115200 baud. printf reaches it through _write() at
+ * LOG_INFO.
+ *
+ * Safe from interrupt handlers without masking: ring space is claimed with
+ * a compare-and-swap, and claimed bytes are handed to the DMA when the
+ * outermost writer on the stack has finished copying (on one core a writer
+ * that preempts another always finishes first). From an ISR use
+ * log_write/log_printf, never printf (newlib's stdout buffer is shared),
+ * and keep to integer conversions (newlib's %f may allocate).
+ */
+
+#ifndef INC_LOG_H_
+#define INC_LOG_H_
+
+#include "stm32l4xx_hal.h"
+#include <stdint.h>
+
+#define LOG_RING_SIZE 2048 // bytes, a power of two
+#define LOG_LINE_MAX 128   // log_printf's buffer, on the caller's stack
+
+typedef enum {
+  LOG_ERR = 0,
+  LOG_WARN,
+  LOG_INFO,
+  LOG_DEBUG,
+} LogLevel;
+
+typedef struct {
+  uint32_t messages; // accepted into the ring
+  uint32_t bytes;
+  uint32_t dropped; // messages that did not fit
+  uint32_t dropped_bytes;
+  uint32_t truncated; // log_printf lines cut to LOG_LINE_MAX - 1
+  uint32_t transfers; // DMA transfers started
+  uint16_t max_used;  // ring high-water mark, bytes
+} LogStats;
+
+// Messages written before this wait in the ring until it is called
+void log_init(UART_HandleTypeDef *huart);
+// Messages above level are discarded without being counted; default INFO
+void log_set_level(LogLevel level);
+uint8_t log_enabled(LogLevel level);
+// 1 if the message was queued
+uint8_t log_write(LogLevel level, const char *text, uint32_t len);
+uint8_t log_printf(LogLevel level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+// Sleeps until everything queued so far has been sent; main context only,
+// with interrupts enabled
+void log_flush(void);
+// Sleeps until a message of len bytes fits in the ring; 0 if it never will
+// (no UART yet, or longer than the ring). Main context only, as log_flush
+uint8_t log_wait_room(uint32_t len);
+const LogStats *log_stats(void);
+
+#endif /* INC_LOG_H_ */
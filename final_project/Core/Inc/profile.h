@@ -0,0 +1,22 @@
+/*
+ * profile.h
+ *
+ * Phase markers for the main loop. They compile to nothing on target; the
+ * host simulator (see Sim/) builds with PLANTPOT_SIM and books bus traffic
+ * and time against the phase that is active.
+ */
+
+#ifndef INC_PROFILE_H_
+#define INC_PROFILE_H_
+
+#ifdef PLANTPOT_SIM
+void sim_profile_phase(const char *name);
+void sim_profile_loop_end(void);
+#define PROFILE_PHASE(name) sim_profile_phase(name)
+#define PROFILE_LOOP_END() sim_profile_loop_end()
+#else
+#define PROFILE_PHASE(name) ((void)0)
+#define PROFILE_LOOP_END() ((void)0)
+#endif
+
+#endif /* INC_PROFILE_H_ */
@@ -10,7 +10,11 @@
 
 #include "gpio.h"
 
+#define PUMP_PRIME_MS 2000 // fills the tubing at power up
+
 void pump_init(void);
+// pump_init as steps for the boot sequencer (see boot.h)
+uint32_t pump_prime_step(uint8_t *phase);
 
 void pump_on(void);
 
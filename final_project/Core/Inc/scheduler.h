@@ -0,0 +1,45 @@
+/*
+ * scheduler.h
+ *
+ * Tick-based cooperative scheduler for the main loop. Each task is released
+ * every period_us and has to finish within deadline_us of its release. Of
+ * the released tasks the lowest priority number runs first, then the
+ * earliest deadline. Tasks are never preempted, so a task that can take
+ * long should do a bounded piece of work per run and come back.
+ *
+ * Time comes from the clock passed to sched_init (microseconds, wrapping),
+ * which lets the host run it on a virtual clock.
+ */
+
+#ifndef INC_SCHEDULER_H_
+#define INC_SCHEDULER_H_
+
+#include <stdint.h>
+
+typedef struct {
+  const char *name;
+  void (*run)(void);
+  uint32_t period_us;
+  uint32_t deadline_us; // after release; 0 means one period
+  uint32_t offset_us;   // first release after sched_init
+  uint8_t priority;     // 0 is the most urgent
+
+  // filled in by the scheduler
+  uint32_t release_us;
+  uint32_t runs;
+  uint32_t misses;      // finished past the deadline, or release skipped
+  uint32_t last_us;     // run time of the last run
+  uint32_t max_us;      // longest run
+  uint32_t max_late_us; // longest wait from release to start
+  uint64_t total_us;
+} SchedTask;
+
+void sched_init(SchedTask *tasks, uint8_t count, uint32_t (*now_us)(void));
+// Runs the most urgent released task; 0 if nothing was due
+uint8_t sched_run_once(void);
+// Microseconds until the next release, 0 if one is due
+uint32_t sched_idle_us(void);
+// One line per task over printf
+void sched_report(void);
+
+#endif /* INC_SCHEDULER_H_ */
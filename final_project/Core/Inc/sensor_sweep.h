@@ -0,0 +1,39 @@
+/*
+ * sensor_sweep.h
+ *
+ * One reading of every I2C2 sensor with the conversions overlapped. The
+ * sweep queues everything up front: the Si7021 RH conversion in no-hold
+ * mode (the temperature comes with it), the Seesaw touch and temperature
+ * reads and the BH1750 data register. While one device converts the bus
+ * manager serves the others, so results land in completion order and a
+ * sweep takes about as long as its slowest conversion instead of the sum.
+ */
+
+#ifndef INC_SENSOR_SWEEP_H_
+#define INC_SENSOR_SWEEP_H_
+
+#include "stm32l4xx_hal.h"
+#include <stdint.h>
+
+typedef struct {
+  float air_rh;
+  float air_temp_c;
+  uint16_t soil_cap;
+  float soil_temp_c;
+  uint16_t light; // BH1750 raw count
+} SensorReadings;
+
+typedef struct {
+  uint32_t sweeps;
+  uint32_t failed_reads; // not queued, or finished without data (0 stored)
+  uint32_t last_ms;      // start to last result
+  uint32_t max_ms;
+} SensorSweepStats;
+
+// Fields of *out are written from interrupt context as results come in;
+// read them once sensor_sweep_busy() is 0. HAL_BUSY if a sweep is running.
+HAL_StatusTypeDef sensor_sweep_start(SensorReadings *out);
+uint8_t sensor_sweep_busy(void);
+const SensorSweepStats *sensor_sweep_stats(void);
+
+#endif /* INC_SENSOR_SWEEP_H_ */
@@ -10,11 +10,13 @@
 #define INC_SI7021_H
 
 #include "stm32l4xx_hal.h"
+#include "i2c_bus.h"
 
 /* Addresses and commands from Si7021 datasheet */
 #define SI7021_ADDR               (0x40 << 1)   // 7-bit address shifted left for HAL
 #define SI7021_CMD_MEAS_RH_HOLD   0xE5
 #define SI7021_CMD_MEAS_TEMP_HOLD 0xE3
+#define SI7021_CMD_MEAS_RH_NOHOLD 0xF5
 #define SI7021_CMD_READ_PREV_TEMP 0xE0
 
 /* Conversion constants from Si7021 datasheet */
@@ -23,6 +25,15 @@
 #define SI7021_TEMP_CONV_CONST    (175.72f)
 #define SI7021_TEMP_CONV_OFFSET   (46.85f)
 
+/* RH holds the clock for ~23 ms (12-bit RH plus 14-bit temperature) */
+#define SI7021_HOLD_TIMEOUT_MS    50
+
+/* No-hold RH: the same ~23 ms, with the bus free. A read before the end is
+   NACKed, so it is polled a few more times before giving up. */
+#define SI7021_NOHOLD_CONV_MS     23
+#define SI7021_NOHOLD_POLL_MS     2
+#define SI7021_NOHOLD_POLLS       3
+
 /* Public I2C handle */
 extern I2C_HandleTypeDef hi2c2;
 
@@ -30,4 +41,13 @@ extern I2C_HandleTypeDef hi2c2;
 float si7021_read_humidity(void);
 float si7021_read_temperature(void);
 
+/* Asynchronous reads on the I2C2 bus manager: *out gets the converted value
+   (0 on failure) and done, if given, runs in interrupt context after it */
+HAL_StatusTypeDef si7021_start_humidity(float *out, I2cJobDone done);
+HAL_StatusTypeDef si7021_start_temperature(float *out, I2cJobDone done);
+
+/* RH in no-hold mode, then the temperature taken with it (READ_PREV_TEMP)
+   instead of a second conversion; done runs once, after both */
+HAL_StatusTypeDef si7021_start_measurement(float *rh, float *temp, I2cJobDone done);
+
 #endif /* INC_SI7021_H */
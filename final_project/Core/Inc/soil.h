@@ -9,6 +9,7 @@
 #define INC_SOIL_H
 
 #include "stm32l4xx_hal.h"
+#include "i2c_bus.h"
 #include <stdint.h>
 
 /* I2C address (7-bit left aligned for HAL) */
@@ -26,4 +27,10 @@ extern I2C_HandleTypeDef hi2c2;
 uint16_t soil_read_capacitance(void);
 float    soil_read_temperature(void);
 
+/* Asynchronous reads on the I2C2 bus manager: *out gets the value (0 on
+   failure) and done, if given, runs in interrupt context after it. The
+   first call also queues the software reset. */
+HAL_StatusTypeDef soil_start_capacitance(uint16_t *out, I2cJobDone done);
+HAL_StatusTypeDef soil_start_temperature(float *out, I2cJobDone done);
+
 #endif /* INC_SOIL_H */
@@ -0,0 +1,44 @@
+/*
+ * spi_bus.h
+ *
+ * Which SPI each SPI device is wired to. The board as built has the TFT and
+ * the ArduCHIP both on SPI1, so every FIFO read and every pixel push take
+ * turns on one wire. BOARD_TFT_SPI / BOARD_CAM_SPI (1, 2 or 3) move a device
+ * to SPI2 (PB13 SCK, PD3 MISO, PB15 MOSI) or SPI3 (PB3, PB4, PB5); chip
+ * selects and the TFT's DC stay where they are.
+ *
+ * Drivers reach their bus through spi_bus_handle, never through hspi1, and
+ * ask spi_bus_shared before holding it: a device with a bus to itself keeps
+ * its chip select low and its DMA running while the other device's DMA runs
+ * on the other bus. Each bus has its own DMA channels (spi.c) and the HAL's
+ * completion callbacks say which bus finished, so the drivers match them
+ * against their own handle.
+ */
+
+#ifndef INC_SPI_BUS_H_
+#define INC_SPI_BUS_H_
+
+#include "spi.h"
+#include <stdint.h>
+
+// Board config: the SPI instance each device is wired to
+#ifndef BOARD_TFT_SPI
+#define BOARD_TFT_SPI 1
+#endif
+#ifndef BOARD_CAM_SPI
+#define BOARD_CAM_SPI 1
+#endif
+
+typedef enum { SPI_DEV_TFT, SPI_DEV_CAMERA, SPI_DEV_COUNT } SpiDev;
+
+// Wires every device as the board config says; after MX_SPIx_Init, before
+// the devices' own init
+void spi_bus_init(void);
+// Moves dev to hspi, clocked like SPI1, the bus the devices are brought up
+// on. Only with dev idle: before its init, or with no transfer running
+void spi_bus_assign(SpiDev dev, SPI_HandleTypeDef *hspi);
+SPI_HandleTypeDef *spi_bus_handle(SpiDev dev);
+// 1 if another device is on dev's bus
+uint8_t spi_bus_shared(SpiDev dev);
+
+#endif /* INC_SPI_BUS_H_ */
@@ -21,12 +21,28 @@ typedef struct {
   uint8_t touched;
 } TOUCH_TouchPoint;
 
+// INT edges queued by the EXTI callback for the main context. The ring is
+// single-producer (the ISR) / single-consumer (the touch task) and lock-free.
+#define TOUCH_QUEUE_LEN 16 // power of two
+
+typedef struct {
+  uint32_t stamp; // DWT->CYCCNT at the edge
+} TOUCH_Event;
+
 HAL_StatusTypeDef TOUCH_Init(void);
+// TOUCH_Init as steps for the boot sequencer (see boot.h)
+uint32_t TOUCH_InitStep(uint8_t *phase);
 
 HAL_StatusTypeDef TOUCH_ReadTouch(TOUCH_TouchPoint *p);
 
 uint8_t TOUCH_HasNewData(void);
 
+// Producer side, ISR only; 0 when the queue was full and the event dropped
+uint8_t TOUCH_PushEvent(uint32_t stamp);
+// Consumer side, main context only; 0 when empty
+uint8_t TOUCH_PopEvent(TOUCH_Event *e);
+uint32_t TOUCH_DroppedEvents(void);
+
 
 #ifdef __cplusplus
 }
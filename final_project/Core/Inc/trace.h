@@ -0,0 +1,69 @@
+/*
+ * trace.h
+ *
+ * Binary trace records on the log channel. TRACE() keeps its format string
+ * in the trace_fmt section and records only the string's offset there, a
+ * cycle-count delta and the raw arguments, as varints, into a frame buffer;
+ * nothing is formatted on the target. Full frames go out through the log
+ * ring between text messages, and Sim/'s plantpot_tracedump turns them back
+ * into the text printf would have printed, reading the format strings from
+ * the section in the ELF.
+ *
+ * Arguments are integers of at most 32 bits (%d %i %u %x %X %o %c); %s and
+ * floating point cannot be deferred. Safe from interrupt handlers: a record
+ * is copied in with interrupts masked for a few dozen cycles. Build with
+ * TRACE_TEXT defined to format on the target through log_printf instead.
+ *
+ * Frame: TRACE_FRAME_START, varint length of the rest, varints of the core
+ * clock in kHz, of the records lost before this frame and of the CYCCNT the
+ * first delta counts from, then records of varint (offset << 3 | argument
+ * count), varint CYCCNT delta from the previous record and one zigzag
+ * varint per argument.
+ */
+
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+
+#include "log.h"
+#include <stdint.h>
+
+#define TRACE_FRAME_MAX 256    // record bytes per frame
+#define TRACE_FRAME_START 0x1E // ASCII RS, never part of log text
+#define TRACE_ARGS_MAX 7
+
+typedef struct {
+  uint32_t records;
+  uint32_t bytes; // record bytes, frame headers not counted
+  uint32_t frames;
+  uint32_t lost; // records dropped: both buffers busy, or frame refused
+} TraceStats;
+
+#ifdef TRACE_TEXT
+#define TRACE(level, fmt, ...) log_printf((level), fmt, ##__VA_ARGS__)
+#else
+#define TRACE(level, fmt, ...)                                               \
+  do {                                                                       \
+    static const char trace_fmt_[]                                           \
+        __attribute__((section("trace_fmt"), used)) = fmt;                   \
+    const uint32_t trace_args_[] = {0, ##__VA_ARGS__};                       \
+    enum { trace_n_ = sizeof(trace_args_) / sizeof(trace_args_[0]) - 1 };    \
+    _Static_assert(trace_n_ <= TRACE_ARGS_MAX, "too many TRACE arguments");  \
+    if (0) {                                                                 \
+      trace_check_format(fmt, ##__VA_ARGS__);                                \
+    }                                                                        \
+    if (log_enabled(level)) {                                                \
+      trace_record(trace_fmt_, trace_args_ + 1, trace_n_);                   \
+    }                                                                        \
+  } while (0)
+#endif
+
+// fmt must live in the trace_fmt section; use TRACE()
+void trace_record(const char *fmt, const uint32_t *args, uint32_t count);
+// Sends the records buffered so far as one frame
+void trace_flush(void);
+const TraceStats *trace_stats(void);
+// Never called: lets the compiler check TRACE arguments against the format
+void trace_check_format(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+#endif /* INC_TRACE_H_ */
@@ -0,0 +1,64 @@
+/*
+ * widget.h
+ *
+ * Declarative dashboard widgets. A screen is a table of buttons, labels and
+ * value fields drawn by one renderer and hit-tested through a grid of
+ * WIDGET_CELL-pixel cells, so a touch costs the same however many widgets
+ * the screen has. A widget is only redrawn when its text changed; the TFT's
+ * retained tile shadow keeps the raster in between.
+ */
+
+#ifndef INC_WIDGET_H_
+#define INC_WIDGET_H_
+
+#include "bigdisplay.h"
+
+#include <stdint.h>
+
+#define WIDGET_CELL       TFT_TILE_SIZE
+#define WIDGET_GRID_W     (TFT_WIDTH / WIDGET_CELL)
+#define WIDGET_GRID_H     (TFT_HEIGHT / WIDGET_CELL)
+#define WIDGET_CELL_SLOTS 2    // buttons that may share one cell
+#define WIDGET_NONE       0xFF
+#define WIDGET_TEXT_MAX   32
+
+typedef enum {
+  WIDGET_LABEL,  // fixed text
+  WIDGET_VALUE,  // text from value/format, cleared to bg and redrawn on change
+  WIDGET_BUTTON, // filled box with a black border and a centred caption
+} WidgetKind;
+
+typedef struct {
+  const char *name; // for the log
+  WidgetKind kind;
+  uint16_t x, y, w, h;
+  uint16_t color; // text colour, or fill colour for buttons
+  uint8_t scale;
+  const char *text; // caption, label, or printf format for value
+  const int *value; // WIDGET_VALUE: formatted with text
+  void (*format)(char *out, uint8_t size); // WIDGET_VALUE: instead of value
+  void (*on_press)(void);                  // WIDGET_BUTTON
+
+  // render cache
+  uint8_t drawn;
+  char shown[WIDGET_TEXT_MAX];
+} Widget;
+
+typedef struct {
+  Widget *widgets;
+  uint8_t count;
+  uint16_t bg;
+  uint8_t cell[WIDGET_GRID_H][WIDGET_GRID_W][WIDGET_CELL_SLOTS];
+} WidgetScreen;
+
+// Builds the hit grid; returns the number of buttons that did not fit
+uint8_t widget_screen_init(WidgetScreen *s, Widget *widgets, uint8_t count,
+                           uint16_t bg);
+// Draws every widget whose text changed since it was last drawn
+void widget_render(WidgetScreen *s);
+// Forget what is on the panel, e.g. after a clear
+void widget_invalidate(WidgetScreen *s);
+// The button under (x, y), or NULL
+Widget *widget_hit(const WidgetScreen *s, uint16_t x, uint16_t y);
+
+#endif /* INC_WIDGET_H_ */
@@ -1,18 +1,26 @@
 #include "bigdisplay.h"
+#include "boot.h"
+#include "camera.h"
 #include "spi.h"
 #include "stm32l4xx_hal.h"
+#include "trace.h"
 #include <stdarg.h> // for TFT_TextPrintf
 #include <stdio.h>  // for printf
-
-extern SPI_HandleTypeDef TFT_SPI_HANDLE;
+#include <string.h> // for memcpy, memset
 
 static void BigDisplay_GPIO_Init(void);
 
+static uint8_t tft_retained;
+static uint8_t tft_madctl = TFT_MADCTL_MV_BGR;
+
+static void tft_dma_wait(void);
+
 static void TFT_Select(void) {
   HAL_GPIO_WritePin(TFT_CS_GPIO_Port, TFT_CS_Pin, GPIO_PIN_RESET);
 }
 
 static void TFT_Unselect(void) {
+  tft_dma_wait();
   HAL_GPIO_WritePin(TFT_CS_GPIO_Port, TFT_CS_Pin, GPIO_PIN_SET);
 }
 
@@ -24,41 +32,103 @@ static void TFT_DC_Data(void) {
   HAL_GPIO_WritePin(TFT_DC_GPIO_Port, TFT_DC_Pin, GPIO_PIN_SET);
 }
 
-static void TFT_Reset(void) {
-  HAL_GPIO_WritePin(TFT_RST_GPIO_Port, TFT_RST_Pin, GPIO_PIN_RESET);
-  HAL_Delay(20);
-  HAL_GPIO_WritePin(TFT_RST_GPIO_Port, TFT_RST_Pin, GPIO_PIN_SET);
-  HAL_Delay(150);
-}
-
 static void tft_writeCommand(uint8_t cmd) {
+  tft_dma_wait();
   TFT_DC_Command();
   HAL_StatusTypeDef status =
       HAL_SPI_Transmit(&TFT_SPI_HANDLE, &cmd, 1, HAL_MAX_DELAY);
   if (status != HAL_OK) {
-    printf("[TFT][ERR] SPI transmit for CMD 0x%02X failed (status=%d)\r\n", cmd,
-           status);
+    TRACE(LOG_ERR,
+          "[TFT][ERR] SPI transmit for CMD 0x%02X failed (status=%d)\r\n",
+          cmd, status);
   }
 }
 
 static void tft_writeData(const uint8_t *data, uint16_t size) {
+  tft_dma_wait();
   TFT_DC_Data();
   HAL_StatusTypeDef status =
       HAL_SPI_Transmit(&TFT_SPI_HANDLE, (uint8_t *)data, size, HAL_MAX_DELAY);
   if (status != HAL_OK) {
-    printf("[TFT][ERR] SPI transmit for DATA block failed (status=%d)\r\n",
-           status);
+    TRACE(LOG_ERR,
+          "[TFT][ERR] SPI transmit for DATA block failed (status=%d)\r\n",
+          status);
   }
 }
 
 static void tft_writeData8(uint8_t data) {
+  tft_dma_wait();
   TFT_DC_Data();
   // printf("[TFT] DATA 0x%02X\r\n", data);
   HAL_StatusTypeDef status =
       HAL_SPI_Transmit(&TFT_SPI_HANDLE, &data, 1, HAL_MAX_DELAY);
   if (status != HAL_OK) {
-    printf("[TFT][ERR] SPI transmit for DATA 0x%02X failed (status=%d)\r\n",
-           data, status);
+    TRACE(LOG_ERR,
+          "[TFT][ERR] SPI transmit for DATA 0x%02X failed (status=%d)\r\n",
+          data, status);
+  }
+}
+
+/********/
+// DMA strips
+/*******/
+// Two strip buffers ping-pong: the CPU fills one while SPI TX DMA drains the
+// other. Completion is signalled by HAL_SPI_TxCpltCallback; anything that
+// touches DC or CS first waits for the strip in flight.
+static uint8_t strips[2][TFT_DMA_STRIP_BYTES];
+static const uint8_t *strip_in_flight;
+static volatile uint8_t tft_dma_busy;
+
+static void tft_dma_wait(void) {
+  __disable_irq();
+  while (tft_dma_busy) {
+    __WFI(); // the completion interrupt wakes the core even while masked
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
+  strip_in_flight = NULL;
+}
+
+// The strip that is safe to fill: never the one DMA is still reading
+static uint8_t *tft_strip(void) {
+  return strip_in_flight == strips[0] ? strips[1] : strips[0];
+}
+
+// Sends pixel data after the previous strip has gone out, returns at once
+static void tft_send_strip(const uint8_t *data, uint16_t size) {
+  // No TX channel linked to the SPI handle: plain blocking transfers
+  if (size < TFT_DMA_MIN_BYTES || !TFT_SPI_HANDLE.hdmatx) {
+    tft_writeData(data, size);
+    return;
+  }
+  tft_dma_wait();
+  TFT_DC_Data();
+  tft_dma_busy = 1;
+  strip_in_flight = data;
+  HAL_StatusTypeDef status =
+      HAL_SPI_Transmit_DMA(&TFT_SPI_HANDLE, (uint8_t *)data, size);
+  if (status != HAL_OK) {
+    tft_dma_busy = 0;
+    TRACE(LOG_ERR, "[TFT][ERR] SPI DMA transmit failed (status=%d)\r\n",
+          status);
+  }
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+  if (hspi == &TFT_SPI_HANDLE) {
+    tft_dma_busy = 0;
+  }
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+  if (cam_spi_error(hspi)) {
+    return; // a FIFO read, maybe on the TFT's bus
+  }
+  if (hspi == &TFT_SPI_HANDLE) {
+    tft_dma_busy = 0;
+    TRACE(LOG_ERR, "[TFT][ERR] SPI DMA error (code=0x%lX)\r\n",
+          (unsigned long)hspi->ErrorCode);
   }
 }
 
@@ -87,6 +157,377 @@ static void TFT_SetAddressWindow(uint16_t x0, uint16_t y0, uint16_t x1,
   // TFT_Unselect();
 }
 
+static void tft_fill_direct(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                            uint16_t color) {
+  if (w > TFT_MAX_LINE_BUFFER_WIDTH) {
+    w = TFT_MAX_LINE_BUFFER_WIDTH;
+  }
+
+  // Narrow rectangles send several rows per transfer; the colour never
+  // changes, so the one strip is sent repeatedly
+  uint16_t rows_per_chunk = TFT_DMA_STRIP_BYTES / 2 / w;
+  if (rows_per_chunk > h) {
+    rows_per_chunk = h;
+  }
+  tft_dma_wait();
+  uint8_t *strip = tft_strip();
+  for (uint16_t i = 0; i < w * rows_per_chunk; i++) {
+    strip[2 * i + 0] = color >> 8;
+    strip[2 * i + 1] = color & 0xFF;
+  }
+
+  TFT_Select();
+
+  TFT_SetAddressWindow(x, y, x + w - 1, y + h - 1);
+
+  // Memory write
+  tft_writeCommand(0x2C);
+
+  for (uint16_t row = 0; row < h; row += rows_per_chunk) {
+    uint16_t rows = h - row < rows_per_chunk ? h - row : rows_per_chunk;
+    tft_send_strip(strip, w * rows * 2);
+  }
+
+  TFT_Unselect();
+}
+
+/********/
+// Retained mode
+/*******/
+// A full 480x320 RGB565 shadow is 300 KB, which does not fit in RAM3 next to
+// camera_buf. Dashboard tiles rarely hold more than two colours (text on a
+// background), so every 16x16 tile keeps a 1-bit mask plus fg/bg colours and
+// only tiles with a third colour borrow RGB565 storage from a small pool.
+// What the panel shows is remembered as a 32-bit signature per tile, not as
+// pixels: a solid tile by its colour, any other by an FNV-1a hash. Two
+// contents with one hash would leave the older on the panel; that is the
+// price of not keeping a second shadow, and the solid flag keeps the two
+// kinds of signature apart.
+#define TILE_PIXELS (TFT_TILE_SIZE * TFT_TILE_SIZE)
+#define TILE_MONO 0xFF    // slot value of a tile without pixel storage
+#define TILE_DIRTY 0x01   // drawn into since the last flush
+#define TILE_SENT 0x02    // sig describes what the panel shows
+#define TILE_DIRECT 0x04  // panel written behind the shadow, draw through
+#define TILE_SOLID 0x08   // sig is the colour of a solid tile, not a hash
+
+typedef struct {
+  uint16_t mask[TFT_TILE_SIZE]; // bit x of row y set: pixel is fg
+  uint32_t sig;
+  uint16_t bg;
+  uint16_t fg;
+  uint8_t slot;
+  uint8_t flags;
+} TFT_Tile;
+
+typedef struct {
+  uint8_t x0, x1, y0, y1; // inclusive, in tiles
+} TFT_TileRect;
+
+static TFT_Tile tiles[TFT_TILES_Y][TFT_TILES_X];
+static uint16_t tile_pool[TFT_SHADOW_SLOTS][TILE_PIXELS];
+static uint8_t free_slots[TFT_SHADOW_SLOTS];
+static uint16_t free_count;
+
+static void tile_release(TFT_Tile *t) {
+  if (t->slot != TILE_MONO) {
+    free_slots[free_count++] = t->slot;
+    t->slot = TILE_MONO;
+  }
+}
+
+static void tile_set_solid(TFT_Tile *t, uint16_t color) {
+  tile_release(t);
+  memset(t->mask, 0, sizeof(t->mask));
+  t->bg = t->fg = color;
+}
+
+// Expands a mono tile into pool storage; NULL when the pool is empty
+static uint16_t *tile_pixels(TFT_Tile *t) {
+  if (t->slot == TILE_MONO) {
+    if (free_count == 0) {
+      return NULL;
+    }
+    t->slot = free_slots[--free_count];
+    uint16_t *px = tile_pool[t->slot];
+    for (uint8_t y = 0; y < TFT_TILE_SIZE; y++) {
+      for (uint8_t x = 0; x < TFT_TILE_SIZE; x++) {
+        *px++ = (t->mask[y] >> x) & 1u ? t->fg : t->bg;
+      }
+    }
+  }
+  return tile_pool[t->slot];
+}
+
+// One address window for the whole rectangle, rows packed into DMA strips
+static void tft_send_tiles(const TFT_TileRect *r) {
+  uint16_t x0 = r->x0 * TFT_TILE_SIZE;
+  uint16_t y0 = r->y0 * TFT_TILE_SIZE;
+  uint16_t w = (r->x1 - r->x0 + 1) * TFT_TILE_SIZE;
+  uint16_t h = (r->y1 - r->y0 + 1) * TFT_TILE_SIZE;
+  uint16_t rows_per_chunk = TFT_DMA_STRIP_BYTES / 2 / w;
+
+  TFT_Select();
+  TFT_SetAddressWindow(x0, y0, x0 + w - 1, y0 + h - 1);
+  tft_writeCommand(0x2C);
+
+  uint8_t *strip = tft_strip();
+  uint8_t *out = strip;
+  uint16_t rows = 0;
+  for (uint16_t y = y0; y < y0 + h; y++) {
+    uint8_t ry = y % TFT_TILE_SIZE;
+    const TFT_Tile *t = &tiles[y / TFT_TILE_SIZE][r->x0];
+    for (uint8_t tx = r->x0; tx <= r->x1; tx++, t++) {
+      const uint16_t *px =
+          t->slot == TILE_MONO ? NULL : tile_pool[t->slot] + ry * TFT_TILE_SIZE;
+      for (uint8_t i = 0; i < TFT_TILE_SIZE; i++) {
+        uint16_t c = px ? px[i] : (t->mask[ry] >> i) & 1u ? t->fg : t->bg;
+        *out++ = c >> 8;
+        *out++ = c & 0xFF;
+      }
+    }
+    if (++rows == rows_per_chunk || y == y0 + h - 1) {
+      tft_send_strip(strip, (uint16_t)(out - strip));
+      out = strip = tft_strip();
+      rows = 0;
+    }
+  }
+
+  TFT_Unselect();
+}
+
+// Paints [x0,x1) x [y0,y1), tile-local, into a tile. Returns 0 when the tile
+// needs a third colour and the pool is empty.
+static uint8_t tile_paint(TFT_Tile *t, uint8_t x0, uint8_t y0, uint8_t x1,
+                          uint8_t y1, uint16_t color) {
+  if (t->slot == TILE_MONO) {
+    uint16_t bits = (uint16_t)(((1u << (x1 - x0)) - 1u) << x0);
+    uint16_t any = 0, all = 0xFFFF;
+    if (t->fg == t->bg) {
+      memset(t->mask, 0, sizeof(t->mask)); // solid, the mask carries nothing
+      t->fg = color;
+    } else if (color != t->fg && color != t->bg) {
+      for (uint8_t y = 0; y < TFT_TILE_SIZE; y++) {
+        any |= t->mask[y];
+        all &= t->mask[y];
+      }
+      if (any == 0) {
+        t->fg = color; // fg unused, recycle it
+      } else if (all == 0xFFFF) {
+        t->bg = color; // bg unused, recycle it
+      }
+    }
+    if (color == t->bg) {
+      for (uint8_t y = y0; y < y1; y++) {
+        t->mask[y] &= (uint16_t)~bits;
+      }
+      return 1;
+    }
+    if (color == t->fg) {
+      for (uint8_t y = y0; y < y1; y++) {
+        t->mask[y] |= bits;
+      }
+      return 1;
+    }
+  }
+
+  uint16_t *px = tile_pixels(t);
+  if (!px) {
+    return 0;
+  }
+  for (uint8_t y = y0; y < y1; y++) {
+    for (uint8_t x = x0; x < x1; x++) {
+      px[y * TFT_TILE_SIZE + x] = color;
+    }
+  }
+  return 1;
+}
+
+static void shadow_fill(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                        uint16_t color) {
+  uint16_t xe = x + w, ye = y + h;
+  for (uint16_t ty = y / TFT_TILE_SIZE; ty <= (ye - 1) / TFT_TILE_SIZE; ty++) {
+    uint16_t ty0 = ty * TFT_TILE_SIZE;
+    uint16_t y0 = y > ty0 ? y : ty0;
+    uint16_t y1 = ye < ty0 + TFT_TILE_SIZE ? ye : ty0 + TFT_TILE_SIZE;
+
+    for (uint16_t tx = x / TFT_TILE_SIZE; tx <= (xe - 1) / TFT_TILE_SIZE;
+         tx++) {
+      TFT_Tile *t = &tiles[ty][tx];
+      uint16_t tx0 = tx * TFT_TILE_SIZE;
+      uint16_t x0 = x > tx0 ? x : tx0;
+      uint16_t x1 = xe < tx0 + TFT_TILE_SIZE ? xe : tx0 + TFT_TILE_SIZE;
+
+      if (x1 - x0 == TFT_TILE_SIZE && y1 - y0 == TFT_TILE_SIZE) {
+        // Covers the whole tile: solid again, and tracked again
+        tile_set_solid(t, color);
+        t->flags = (t->flags & ~TILE_DIRECT) | TILE_DIRTY;
+        continue;
+      }
+      if (!(t->flags & TILE_DIRECT)) {
+        if (tile_paint(t, x0 - tx0, y0 - ty0, x1 - tx0, y1 - ty0, color)) {
+          t->flags |= TILE_DIRTY;
+          continue;
+        }
+        // Pool exhausted: settle the tile on the panel and draw through
+        if (t->flags & TILE_DIRTY) {
+          TFT_TileRect r = {tx, tx, ty, ty};
+          tft_send_tiles(&r);
+        }
+        t->flags = TILE_DIRECT;
+      }
+      tft_fill_direct(x0, y0, x1 - x0, y1 - y0, color);
+    }
+  }
+}
+
+// The region was written straight to the panel; stop tracking those tiles
+static void shadow_mark_direct(uint16_t x, uint16_t y, uint16_t w,
+                               uint16_t h) {
+  for (uint16_t ty = y / TFT_TILE_SIZE; ty <= (y + h - 1) / TFT_TILE_SIZE;
+       ty++) {
+    for (uint16_t tx = x / TFT_TILE_SIZE; tx <= (x + w - 1) / TFT_TILE_SIZE;
+         tx++) {
+      tile_release(&tiles[ty][tx]);
+      tiles[ty][tx].flags = TILE_DIRECT;
+    }
+  }
+}
+
+// Folds a pool tile back to mono when two colours are enough again
+static void tile_compact(TFT_Tile *t) {
+  const uint16_t *px = tile_pool[t->slot];
+  uint16_t bg = px[0], fg = px[0];
+  for (uint16_t i = 1; i < TILE_PIXELS; i++) {
+    if (px[i] != bg && px[i] != fg) {
+      if (fg != bg) {
+        return;
+      }
+      fg = px[i];
+    }
+  }
+  for (uint8_t y = 0; y < TFT_TILE_SIZE; y++) {
+    uint16_t m = 0;
+    for (uint8_t x = 0; x < TFT_TILE_SIZE; x++) {
+      m |= (uint16_t)((*px++ == fg && fg != bg) << x);
+    }
+    t->mask[y] = m;
+  }
+  t->bg = bg;
+  t->fg = fg;
+  tile_release(t);
+}
+
+// Clears the dirty flag and decides whether the tile must be resent
+static uint8_t tile_take_dirty(TFT_Tile *t) {
+  if (!(t->flags & TILE_DIRTY)) {
+    return 0;
+  }
+  t->flags &= ~TILE_DIRTY;
+  if (t->flags & TILE_DIRECT) {
+    return 0;
+  }
+
+  if (t->slot != TILE_MONO) {
+    tile_compact(t);
+  }
+  uint32_t sig = 2166136261u; // FNV-1a
+  uint8_t solid = 0;
+  if (t->slot != TILE_MONO) {
+    const uint16_t *px = tile_pool[t->slot];
+    for (uint16_t i = 0; i < TILE_PIXELS; i++) {
+      sig = (sig ^ px[i]) * 16777619u;
+    }
+  } else {
+    uint16_t any = 0, all = 0xFFFF;
+    for (uint8_t y = 0; y < TFT_TILE_SIZE; y++) {
+      any |= t->mask[y];
+      all &= t->mask[y];
+    }
+    if (any == 0 || all == 0xFFFF || t->fg == t->bg) {
+      tile_set_solid(t, any == 0 ? t->bg : t->fg);
+      sig = t->bg;
+      solid = TILE_SOLID;
+    } else {
+      for (uint8_t y = 0; y < TFT_TILE_SIZE; y++) {
+        sig = (sig ^ t->mask[y]) * 16777619u;
+      }
+      sig = (sig ^ ((uint32_t)t->fg << 16 | t->bg)) * 16777619u;
+    }
+  }
+
+  if ((t->flags & TILE_SENT) && (t->flags & TILE_SOLID) == solid &&
+      t->sig == sig) {
+    return 0;
+  }
+  t->sig = sig;
+  t->flags = (t->flags & ~TILE_SOLID) | TILE_SENT | solid;
+  return 1;
+}
+
+void TFT_Flush(void) {
+  if (!tft_retained) {
+    return;
+  }
+
+  // Runs of changed tiles in a row are merged with the run of identical
+  // extent directly above, so a changed block goes out as one rectangle.
+  TFT_TileRect open[TFT_TILES_X], next[TFT_TILES_X];
+  uint8_t n_open = 0;
+
+  for (uint8_t ty = 0; ty <= TFT_TILES_Y; ty++) {
+    uint8_t n_next = 0;
+    for (uint8_t tx = 0; ty < TFT_TILES_Y && tx < TFT_TILES_X; tx++) {
+      if (!tile_take_dirty(&tiles[ty][tx])) {
+        continue;
+      }
+      TFT_TileRect run = {tx, tx, ty, ty};
+      while (run.x1 + 1 < TFT_TILES_X &&
+             tile_take_dirty(&tiles[ty][run.x1 + 1])) {
+        run.x1++;
+      }
+      tx = run.x1 + 1; // already settled by the loop above
+
+      for (uint8_t i = 0; i < n_open; i++) {
+        if (open[i].x0 == run.x0 && open[i].x1 == run.x1) {
+          run.y0 = open[i].y0;
+          open[i].x0 = TFT_TILES_X; // continued below
+          break;
+        }
+      }
+      next[n_next++] = run;
+    }
+
+    for (uint8_t i = 0; i < n_open; i++) {
+      if (open[i].x0 != TFT_TILES_X) {
+        tft_send_tiles(&open[i]);
+      }
+    }
+    memcpy(open, next, n_next * sizeof(next[0]));
+    n_open = n_next;
+  }
+}
+
+void TFT_SetRetained(uint8_t on) {
+  if (on && !tft_retained) {
+    // Nothing is known about the panel until a tile is drawn and flushed
+    for (uint8_t ty = 0; ty < TFT_TILES_Y; ty++) {
+      for (uint8_t tx = 0; tx < TFT_TILES_X; tx++) {
+        TFT_Tile *t = &tiles[ty][tx];
+        t->slot = TILE_MONO;
+        tile_set_solid(t, COLOR_BLACK);
+        t->flags = 0;
+      }
+    }
+    for (uint16_t i = 0; i < TFT_SHADOW_SLOTS; i++) {
+      free_slots[i] = (uint8_t)(TFT_SHADOW_SLOTS - 1 - i);
+    }
+    free_count = TFT_SHADOW_SLOTS;
+  } else if (!on && tft_retained) {
+    TFT_Flush();
+  }
+  tft_retained = on ? 1u : 0u;
+}
+
 static void BigDisplay_GPIO_Init(void) {
 
   GPIO_InitTypeDef gi = {0};
@@ -119,45 +560,65 @@ static void BigDisplay_GPIO_Init(void) {
   HAL_GPIO_WritePin(TFT_LED_GPIO_Port, TFT_LED_Pin, GPIO_PIN_RESET);
 }
 
-void TFT_Init(void) {
-
-  BigDisplay_GPIO_Init();
-
-  // Turn on backlight
-  HAL_GPIO_WritePin(TFT_LED_GPIO_Port, TFT_LED_Pin, GPIO_PIN_SET);
+// Reset pulse, SLEEP OUT and set up, with the waits the ILI9488 needs
+// after each handed back to the caller
+uint32_t TFT_InitStep(uint8_t *phase) {
+  switch ((*phase)++) {
+  case 0:
+    BigDisplay_GPIO_Init();
+
+    // Turn on backlight
+    HAL_GPIO_WritePin(TFT_LED_GPIO_Port, TFT_LED_Pin, GPIO_PIN_SET);
+
+    // Reset
+    __HAL_SPI_DISABLE(&TFT_SPI_HANDLE);
+    HAL_GPIO_WritePin(TFT_RST_GPIO_Port, TFT_RST_Pin, GPIO_PIN_RESET);
+    return 20;
+  case 1:
+    HAL_GPIO_WritePin(TFT_RST_GPIO_Port, TFT_RST_Pin, GPIO_PIN_SET);
+    return 150;
+  case 2:
+    __HAL_SPI_ENABLE(&TFT_SPI_HANDLE);
+
+    // Send SLEEP OUT
+    TFT_Select();
+    tft_writeCommand(0x11);
+    TFT_Unselect();
+    return 120;
+  case 3:
+    TFT_Select();
+
+    // Set pixel format
+    tft_writeCommand(0x3A);
+    tft_writeData8(0x55); // 16-bit color
+
+    // Set MADCTL
+    tft_writeCommand(0x36);
+    // 0x28 = MADCTL_MV | MADCTL_BGR : landscape, connector on the left,
+    // with MY | MX on top when turned (TFT_SetRotation180)
+    tft_writeData8(tft_madctl);
+
+    // Display on
+    tft_writeCommand(0x29);
+    TFT_Unselect();
+    return 20;
+  default:
+    return BOOT_DONE;
+  }
+}
 
-  // Reset
-  __HAL_SPI_DISABLE(&TFT_SPI_HANDLE);
-  TFT_Reset();
-  __HAL_SPI_ENABLE(&TFT_SPI_HANDLE);
+void TFT_Init(void) { boot_run_one(TFT_InitStep); }
 
-  // Select
+void TFT_SetRotation180(uint8_t on) {
+  tft_madctl = on ? TFT_MADCTL_MV_BGR | TFT_MADCTL_MY_MX : TFT_MADCTL_MV_BGR;
   TFT_Select();
-
-  // Send SLEEP OUT
-  tft_writeCommand(0x11);
-  HAL_Delay(120);
-
-  // Set pixel format
-  tft_writeCommand(0x3A);
-  tft_writeData8(0x55); // 16-bit color
-
-  // Set MADCTL
-  tft_writeCommand(0x36);
-  // 0x28 = MADCTL_MV | MADCTL_BGR : landscape, connector on the left
-  tft_writeData8(0x28);
-
-  // Display on
-  tft_writeCommand(0x29);
-  HAL_Delay(20);
-
-  // Unselect
+  tft_writeCommand(TFT_CMD_MADCTL);
+  tft_writeData8(tft_madctl);
   TFT_Unselect();
-
-  // Clear screen
-  // TFT_FillScreen(COLOR_BLACK);
 }
 
+uint8_t TFT_Rotation180(void) { return tft_madctl != TFT_MADCTL_MV_BGR; }
+
 void TFT_FillScreen(uint16_t color) {
   // Use logical dimensions so this stays correct for any orientation
   TFT_FillRect(0, 0, TFT_WIDTH, TFT_HEIGHT, color);
@@ -168,6 +629,11 @@ void TFT_DrawPixel(uint16_t x, uint16_t y, uint16_t color) {
     return;
   }
 
+  if (tft_retained) {
+    shadow_fill(x, y, 1, 1, color);
+    return;
+  }
+
   uint8_t data[2];
   data[0] = color >> 8;
   data[1] = color & 0xFF;
@@ -196,33 +662,15 @@ void TFT_FillRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
     h = TFT_HEIGHT - y;
   }
 
-  uint32_t numPixels = (uint32_t)w * (uint32_t)h;
-
-  (void)numPixels;
-
-  static uint8_t lineBuf[480 * 2];
-  if (w > 480) {
-    w = 480;
-  }
-
-  for (uint16_t i = 0; i < w; i++) {
-    lineBuf[2 * i + 0] = color >> 8;
-    lineBuf[2 * i + 1] = color & 0xFF;
+  if (w == 0 || h == 0) {
+    return;
   }
 
-  TFT_Select();
-
-  TFT_SetAddressWindow(x, y, x + w - 1, y + h - 1);
-
-  // Memory write
-  tft_writeCommand(0x2C);
-
-  // Send line by line
-  for (uint16_t row = 0; row < h; row++) {
-    tft_writeData(lineBuf, w * 2);
+  if (tft_retained) {
+    shadow_fill(x, y, w, h, color);
+    return;
   }
-
-  TFT_Unselect();
+  tft_fill_direct(x, y, w, h, color);
 }
 
 static const uint8_t font5x7[95][5] = {
@@ -276,16 +724,6 @@ static const uint8_t font5x7[95][5] = {
     {0x10, 0x08, 0x08, 0x10, 0x08},
 };
 
-typedef struct {
-  uint16_t x;
-  uint16_t y;
-  uint8_t scale;
-  uint8_t wrap;
-  uint16_t fg;
-  uint16_t bg;
-  uint8_t use_bg;
-} TFT_TextCfg;
-
 void TFT_TextInit(TFT_TextCfg *t) {
   if (!t)
     return;
@@ -328,33 +766,115 @@ void TFT_TextSetColors(TFT_TextCfg *t, uint16_t fg, uint16_t bg,
   t->use_bg = use_bg ? 1u : 0u;
 }
 
-static void TFT_DrawPixelScaled(uint16_t x, uint16_t y, uint8_t s,
-                                uint16_t color) {
-  for (uint8_t dy = 0; dy < s; ++dy) {
-    for (uint8_t dx = 0; dx < s; ++dx) {
-      TFT_DrawPixel((uint16_t)(x + dx), (uint16_t)(y + dy), color);
+/********/
+// Glyph runs
+/*******/
+// A string is rasterised one line segment at a time. Transparent text goes
+// out as one TFT_FillRect per horizontal run of lit font pixels; text with a
+// background is streamed through a single address window. In retained mode
+// both land in the tile shadow through TFT_FillRect.
+static uint8_t tft_glyph_lit(const char *s, uint16_t col, uint8_t row) {
+  uint8_t c = col % TFT_CHAR_WIDTH_PIXELS;
+  if (c >= TFT_FONT_GLYPH_WIDTH) {
+    return 0;
+  }
+  const uint8_t *glyph =
+      font5x7[(uint8_t)s[col / TFT_CHAR_WIDTH_PIXELS] - TFT_FONT_ASCII_OFFSET];
+  return (glyph[c] >> row) & 1u;
+}
+
+static void tft_text_runs(const TFT_TextCfg *t, uint16_t x, uint16_t y,
+                          const char *s, uint8_t n) {
+  uint8_t sc = t->scale;
+  uint16_t cols = (uint16_t)n * TFT_CHAR_WIDTH_PIXELS;
+
+  if (t->use_bg) {
+    TFT_FillRect(x, y, cols * sc, TFT_FONT_GLYPH_HEIGHT * sc, t->bg);
+  }
+  for (uint8_t row = 0; row < TFT_FONT_GLYPH_HEIGHT; row++) {
+    uint16_t start = 0, len = 0;
+    for (uint16_t col = 0; col <= cols; col++) {
+      if (col < cols && tft_glyph_lit(s, col, row)) {
+        if (len++ == 0) {
+          start = col;
+        }
+      } else if (len) {
+        TFT_FillRect(x + start * sc, y + row * sc, len * sc, sc, t->fg);
+        len = 0;
+      }
     }
   }
 }
 
-uint8_t TFT_TextDrawChar(TFT_TextCfg *t, char c) {
-  if (!t)
-    return 0;
+static void tft_text_stream(const TFT_TextCfg *t, uint16_t x, uint16_t y,
+                            const char *s, uint8_t n) {
+  uint8_t sc = t->scale;
+  uint16_t w = (uint16_t)n * TFT_CHAR_WIDTH_PIXELS * sc;
+  uint16_t h = TFT_FONT_GLYPH_HEIGHT * sc;
+  if (x + w > TFT_WIDTH) {
+    w = TFT_WIDTH - x;
+  }
+  if (y + h > TFT_HEIGHT) {
+    h = TFT_HEIGHT - y;
+  }
+  uint16_t rows_per_chunk = TFT_DMA_STRIP_BYTES / 2 / w;
 
-  if (c == '\r')
+  TFT_Select();
+  TFT_SetAddressWindow(x, y, x + w - 1, y + h - 1);
+  tft_writeCommand(0x2C);
+
+  // Each font row is rasterised once and repeated sc times; a repeat may copy
+  // from the strip in flight, DMA only reads it
+  uint8_t *strip = tft_strip();
+  uint8_t *built = strip;
+  uint16_t rows = 0;
+  for (uint16_t py = 0; py < h; py++) {
+    uint8_t *line = strip + rows * w * 2;
+    if (py % sc == 0) {
+      for (uint16_t px = 0; px < w; px++) {
+        uint16_t c =
+            tft_glyph_lit(s, px / sc, (uint8_t)(py / sc)) ? t->fg : t->bg;
+        line[2 * px + 0] = c >> 8;
+        line[2 * px + 1] = c & 0xFF;
+      }
+      built = line;
+    } else if (line != built) {
+      memcpy(line, built, w * 2);
+    }
+    if (++rows == rows_per_chunk || py == h - 1) {
+      tft_send_strip(strip, rows * w * 2);
+      strip = tft_strip();
+      rows = 0;
+    }
+  }
+
+  TFT_Unselect();
+}
+
+static void tft_text_segment(const TFT_TextCfg *t, uint16_t x, uint16_t y,
+                             const char *s, uint8_t n) {
+  if (t->use_bg && !tft_retained) {
+    tft_text_stream(t, x, y, s, n);
+  } else {
+    tft_text_runs(t, x, y, s, n);
+  }
+}
+
+// Applies newlines and wrapping to the cursor. Returns the cell width if *c
+// is drawn at the cursor, 0 if it only moved the cursor or falls off screen.
+static uint8_t tft_text_place(TFT_TextCfg *t, char *c) {
+  if (*c == '\r')
     return 0;
-  if (c == '\n') {
+  if (*c == '\n') {
     t->x = 0;
     t->y = (uint16_t)(t->y + (8u * t->scale));
     return 0;
   }
 
-  if ((uint8_t)c < 32u || (uint8_t)c > 126u) {
-    c = '?';
+  if ((uint8_t)*c < 32u || (uint8_t)*c > 126u) {
+    *c = '?';
   }
 
-  const uint8_t *glyph = font5x7[(uint8_t)c - 32u];
-
   uint8_t char_w = (uint8_t)(6u * t->scale);
   uint8_t char_h = (uint8_t)(8u * t->scale);
 
@@ -366,39 +886,52 @@ uint8_t TFT_TextDrawChar(TFT_TextCfg *t, char c) {
   if (t->x >= TFT_WIDTH || t->y >= TFT_HEIGHT) {
     return 0;
   }
+  return char_w;
+}
 
-  for (uint8_t col = 0; col < 5u; ++col) {
-    uint8_t bits = glyph[col];
-    for (uint8_t row = 0; row < 7u; ++row) {
-      uint16_t px = (uint16_t)(t->x + col * t->scale);
-      uint16_t py = (uint16_t)(t->y + row * t->scale);
-
-      if (bits & (1u << row)) {
-        TFT_DrawPixelScaled(px, py, t->scale, t->fg);
-      } else if (t->use_bg) {
-        TFT_DrawPixelScaled(px, py, t->scale, t->bg);
-      }
-    }
-  }
+uint8_t TFT_TextDrawChar(TFT_TextCfg *t, char c) {
+  if (!t)
+    return 0;
 
-  if (t->use_bg) {
-    for (uint8_t row = 0; row < 7u; ++row) {
-      uint16_t px = (uint16_t)(t->x + 5u * t->scale);
-      uint16_t py = (uint16_t)(t->y + row * t->scale);
-      TFT_DrawPixelScaled(px, py, t->scale, t->bg);
-    }
+  uint8_t char_w = tft_text_place(t, &c);
+  if (char_w) {
+    tft_text_segment(t, t->x, t->y, &c, 1);
+    t->x = (uint16_t)(t->x + char_w);
   }
-
-  t->x = (uint16_t)(t->x + char_w);
   return char_w;
 }
 
 uint16_t TFT_TextDrawString(TFT_TextCfg *t, const char *s) {
   if (!t || !s)
     return 0;
+
+  // Characters are collected while they sit side by side on one line
+  char seg[TFT_MAX_LINE_BUFFER_WIDTH / TFT_CHAR_WIDTH_PIXELS];
+  uint8_t n = 0;
+  uint16_t seg_x = 0, seg_y = 0;
   uint16_t px = 0;
+
   while (*s) {
-    px += TFT_TextDrawChar(t, *s++);
+    char c = *s++;
+    uint8_t char_w = tft_text_place(t, &c);
+    if (!char_w) {
+      continue;
+    }
+    if (n && (t->y != seg_y || t->x != seg_x + n * char_w ||
+              n == sizeof(seg))) {
+      tft_text_segment(t, seg_x, seg_y, seg, n);
+      n = 0;
+    }
+    if (n == 0) {
+      seg_x = t->x;
+      seg_y = t->y;
+    }
+    seg[n++] = c;
+    t->x = (uint16_t)(t->x + char_w);
+    px += char_w;
+  }
+  if (n) {
+    tft_text_segment(t, seg_x, seg_y, seg, n);
   }
   return px;
 }
@@ -455,44 +988,64 @@ int TFT_PrintfAt(uint16_t x, uint16_t y, uint16_t color, uint8_t scale,
   return n;
 }
 
-void TFT_DrawRGB888Buffer(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
-                          const uint8_t *buffer, uint8_t scale) {
-  if (!buffer)
-    return;
-
-  // Treat scale <= 1 as no scaling
-  if (scale == 0)
-    scale = 1;
-
+// Clips a buffer blit to the panel and opens its address window; returns 0
+// when there is nothing to draw
+static uint8_t tft_blit_begin(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                              uint8_t scale, uint16_t *destW,
+                              uint16_t *destH) {
   // If starting outside display, nothing to do
   if (x >= TFT_WIDTH || y >= TFT_HEIGHT)
-    return;
-
-  // Source (original) dimensions
-  uint16_t srcW = w;
-  uint16_t srcH = h;
+    return 0;
 
   // Destination (scaled) dimensions, ceil(src / scale)
-  uint16_t destW = (srcW + scale - 1) / scale;
-  uint16_t destH = (srcH + scale - 1) / scale;
+  *destW = (w + scale - 1) / scale;
+  *destH = (h + scale - 1) / scale;
 
   // Clip scaled width/height to screen bounds
-  if (x + destW > TFT_WIDTH)
-    destW = TFT_WIDTH - x;
-  if (y + destH > TFT_HEIGHT)
-    destH = TFT_HEIGHT - y;
+  if (x + *destW > TFT_WIDTH)
+    *destW = TFT_WIDTH - x;
+  if (y + *destH > TFT_HEIGHT)
+    *destH = TFT_HEIGHT - y;
 
-  if (destW == 0 || destH == 0)
-    return;
+  if (*destW == 0 || *destH == 0)
+    return 0;
+
+  if (tft_retained) {
+    // Settle pending tiles first, the blit overwrites part of some of them
+    TFT_Flush();
+    shadow_mark_direct(x, y, *destW, *destH);
+  }
 
   TFT_Select();
 
-  TFT_SetAddressWindow(x, y, x + destW - 1, y + destH - 1);
+  TFT_SetAddressWindow(x, y, x + *destW - 1, y + *destH - 1);
 
   // Begin memory write
   tft_writeCommand(0x2C);
+  return 1;
+}
 
-  // Nearest-neighbor downscale: sample every "scale" pixels
+void TFT_DrawRGB888Buffer(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                          const uint8_t *buffer, uint8_t scale) {
+  if (!buffer)
+    return;
+
+  // Treat scale <= 1 as no scaling
+  if (scale == 0)
+    scale = 1;
+
+  // Source (original) dimensions
+  uint16_t srcW = w;
+  uint16_t destW, destH;
+  if (!tft_blit_begin(x, y, w, h, scale, &destW, &destH))
+    return;
+
+  // Nearest-neighbor downscale: sample every "scale" pixels, converted rows
+  // are packed into a strip that goes out while the next one is filled
+  uint16_t rows_per_chunk = TFT_DMA_STRIP_BYTES / 2 / destW;
+  uint8_t *strip = tft_strip();
+  uint8_t *out = strip;
+  uint16_t rows = 0;
   for (uint16_t row = 0; row < destH; row++) {
     uint16_t srcRow = row * scale;
     const uint8_t *rowPtr = buffer + (srcRow * srcW * 3);
@@ -507,8 +1060,58 @@ void TFT_DrawRGB888Buffer(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
 
       uint16_t rgb565 = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
 
-      uint8_t out[2] = {(uint8_t)(rgb565 >> 8), (uint8_t)(rgb565 & 0xFF)};
-      tft_writeData(out, 2);
+      *out++ = (uint8_t)(rgb565 >> 8);
+      *out++ = (uint8_t)(rgb565 & 0xFF);
+    }
+    if (++rows == rows_per_chunk || row == destH - 1) {
+      tft_send_strip(strip, (uint16_t)(out - strip));
+      out = strip = tft_strip();
+      rows = 0;
+    }
+  }
+
+  TFT_Unselect();
+}
+
+void TFT_DrawRGB565Buffer(uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                          const uint8_t *buffer, uint8_t scale) {
+  if (!buffer)
+    return;
+
+  if (scale == 0)
+    scale = 1;
+
+  uint16_t destW, destH;
+  if (!tft_blit_begin(x, y, w, h, scale, &destW, &destH))
+    return;
+
+  if (scale == 1 && destW == w) {
+    // Already in panel byte order and contiguous: DMA straight from the
+    // buffer, whole rows at a time
+    uint16_t rows_per_chunk = 0xFFFF / 2 / w;
+    for (uint16_t row = 0; row < destH; row += rows_per_chunk) {
+      uint16_t rows = destH - row < rows_per_chunk ? destH - row : rows_per_chunk;
+      tft_send_strip(buffer + (uint32_t)row * w * 2, rows * w * 2);
+    }
+    TFT_Unselect();
+    return;
+  }
+
+  // Nearest-neighbor downscale, sampled pixels packed into strips
+  uint16_t rows_per_chunk = TFT_DMA_STRIP_BYTES / 2 / destW;
+  uint8_t *strip = tft_strip();
+  uint8_t *out = strip;
+  uint16_t rows = 0;
+  for (uint16_t row = 0; row < destH; row++) {
+    const uint8_t *src = buffer + (uint32_t)row * scale * w * 2;
+    for (uint16_t col = 0; col < destW; col++, src += scale * 2) {
+      *out++ = src[0];
+      *out++ = src[1];
+    }
+    if (++rows == rows_per_chunk || row == destH - 1) {
+      tft_send_strip(strip, (uint16_t)(out - strip));
+      out = strip = tft_strip();
+      rows = 0;
     }
   }
 
@@ -0,0 +1,98 @@
+/*
+ * boot.c
+ *
+ * See boot.h. Times are HAL_GetTick milliseconds relative to boot_start and
+ * compared by signed difference.
+ */
+
+#include "boot.h"
+
+#include "main.h"
+#include "profile.h"
+
+#include <stdio.h>
+
+#define DUE(t, now) ((int32_t)((now) - (t)) >= 0)
+
+static BootTask *tasks;
+static uint8_t task_count;
+static uint32_t started;
+static uint32_t elapsed;
+static uint8_t finished;
+
+static uint32_t now_ms(void) { return HAL_GetTick() - started; }
+
+void boot_start(BootTask *t, uint8_t count) {
+  tasks = t;
+  task_count = count;
+  started = HAL_GetTick();
+  finished = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    t[i].status = BOOT_PENDING;
+    t[i].phase = 0;
+    t[i].steps = 0;
+    t[i].wake_ms = t[i].done_ms = t[i].busy_ms = 0;
+  }
+}
+
+uint8_t boot_poll(void) {
+  uint8_t pending = 0;
+  for (uint8_t i = 0; i < task_count; i++) {
+    BootTask *t = &tasks[i];
+    if (t->status != BOOT_PENDING) {
+      continue;
+    }
+    uint32_t now = now_ms();
+    if (!DUE(t->wake_ms, now)) {
+      pending = 1;
+      continue;
+    }
+
+    PROFILE_PHASE(t->name);
+    uint32_t wait = t->step(&t->phase);
+    uint32_t end = now_ms();
+    t->steps++;
+    t->busy_ms += end - now;
+    if (wait == BOOT_DONE || wait == BOOT_FAILED) {
+      t->status = wait == BOOT_DONE ? BOOT_OK : BOOT_ERROR;
+      t->done_ms = end;
+      continue;
+    }
+    // the wait runs from the end of the step, as a HAL_Delay after it would
+    t->wake_ms = end + wait;
+    pending = 1;
+  }
+  if (!pending && !finished) {
+    elapsed = now_ms();
+    finished = 1;
+  }
+  return pending;
+}
+
+uint32_t boot_elapsed_ms(void) { return finished ? elapsed : now_ms(); }
+
+void boot_report(void) {
+  printf("Boot: %lu ms\r\n", (unsigned long)boot_elapsed_ms());
+  printf("device    status  done ms  busy ms  steps\r\n");
+  for (uint8_t i = 0; i < task_count; i++) {
+    BootTask *t = &tasks[i];
+    printf("%-9s %-6s %8lu %8lu %6u\r\n", t->name,
+           t->status == BOOT_OK      ? "ok"
+           : t->status == BOOT_ERROR ? "FAILED"
+                                     : "...",
+           (unsigned long)t->done_ms, (unsigned long)t->busy_ms, t->steps);
+  }
+}
+
+uint8_t boot_run_one(BootStep step) {
+  uint8_t phase = 0;
+  for (;;) {
+    uint32_t wait = step(&phase);
+    if (wait == BOOT_DONE || wait == BOOT_FAILED) {
+      return wait == BOOT_DONE;
+    }
+    if (wait) {
+      HAL_Delay(wait);
+    }
+  }
+}
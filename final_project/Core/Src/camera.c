@@ -7,9 +7,23 @@
  */
 
 #include "camera.h"
+#include "bigdisplay.h"
+#include "boot.h"
+#include "imgstream.h"
+#include "log.h"
+#include "trace.h"
 
-// set up buffer
-uint8_t camera_buf[rgb888_data_length];
+#include <string.h>
+
+// set up buffer, RGB565 big-endian so the TFT can take it as is
+uint8_t camera_buf[rgb565_data_length];
+
+// YCbCr output size as programmed, at most CAM_FRAME_W x CAM_FRAME_H
+static uint16_t cam_out_w = CAM_FRAME_W, cam_out_h = CAM_FRAME_H;
+// Output format as programmed, see cam_set_format
+static CamFormat cam_fmt = CAM_FMT_YUV422;
+// Picture orientation, see cam_set_orientation
+static CamOrientation cam_orient = CAM_ORIENT_UPRIGHT;
 
 // this register table sets up YCbCr output, from application notes
 const struct sensor_reg OV5642_QVGA_Preview[] = {
@@ -173,6 +187,125 @@ const struct sensor_reg OV5642_QVGA_Preview[] = {
     {0xffff, 0xff},
 };
 
+// JPEG mode and output sizes, from the archer_files driver (ArduCAM's
+// OV5642 tables): capture at QSXGA with the compression engine on, then
+// one of the tables below picks the output size. The array window stays
+// the full 2592x1944 so the field of view does not change with the size.
+const struct sensor_reg OV5642_JPEG_Capture_QSXGA[] = {
+    {0x3503, 0x07}, {0x3000, 0x00}, {0x3001, 0x00}, {0x3002, 0x00},
+    {0x3003, 0x00}, {0x3005, 0xff}, {0x3006, 0xff}, {0x3007, 0x3f},
+    {0x350c, 0x07}, {0x350d, 0xd0}, {0x3602, 0xe4}, {0x3612, 0xac},
+    {0x3613, 0x44}, {0x3621, 0x27}, {0x3622, 0x08}, {0x3623, 0x22},
+    {0x3604, 0x60}, {0x3705, 0xda}, {0x370a, 0x80}, {0x3801, 0x8a},
+    {0x3803, 0x0a}, {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07},
+    {0x3807, 0x98}, {0x3808, 0x0a}, {0x3809, 0x20}, {0x380a, 0x07},
+    {0x380b, 0x98}, {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07},
+    {0x380f, 0xd0}, {0x3810, 0xc2}, {0x3815, 0x44}, {0x3818, 0xc8},
+    {0x3824, 0x01}, {0x3827, 0x0a}, {0x3a00, 0x78}, {0x3a0d, 0x10},
+    {0x3a0e, 0x0d}, {0x3a10, 0x32}, {0x3a1b, 0x3c}, {0x3a1e, 0x32},
+    {0x3a11, 0x80}, {0x3a1f, 0x20}, {0x3a00, 0x78}, {0x460b, 0x35},
+    {0x471d, 0x00}, {0x4713, 0x03}, {0x471c, 0x50}, {0x5682, 0x0a},
+    {0x5683, 0x20}, {0x5686, 0x07}, {0x5687, 0x98}, {0x5001, 0x4f},
+    {0x589b, 0x00}, {0x589a, 0xc0}, {0x4407, 0x08}, {0x589b, 0x00},
+    {0x589a, 0xc0}, {0x3002, 0x0c}, {0x3002, 0x00}, {0x3503, 0x00},
+    {0x5025, 0x80}, {0x3a0f, 0x48}, {0x3a10, 0x40}, {0x3a1b, 0x4a},
+    {0x3a1e, 0x3e}, {0x3a11, 0x70}, {0x3a1f, 0x20},
+
+    {0xffff, 0xff},
+};
+
+static const struct sensor_reg ov5642_320x240[] = {
+    {0x3800, 0x01}, {0x3801, 0xa8}, {0x3802, 0x00}, {0x3803, 0x0a},
+    {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07}, {0x3807, 0x98},
+    {0x3808, 0x01}, {0x3809, 0x40}, {0x380a, 0x00}, {0x380b, 0xf0},
+    {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07}, {0x380f, 0xd0},
+    {0x5001, 0x7f}, {0x5680, 0x00}, {0x5681, 0x00}, {0x5682, 0x0a},
+    {0x5683, 0x20}, {0x5684, 0x00}, {0x5685, 0x00}, {0x5686, 0x07},
+    {0x5687, 0x98}, {0x3011, 0x0f},
+
+    {0xffff, 0xff},
+};
+
+static const struct sensor_reg ov5642_640x480[] = {
+    {0x3800, 0x01}, {0x3801, 0xa8}, {0x3802, 0x00}, {0x3803, 0x0a},
+    {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07}, {0x3807, 0x98},
+    {0x3808, 0x02}, {0x3809, 0x80}, {0x380a, 0x01}, {0x380b, 0xe0},
+    {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07}, {0x380f, 0xd0},
+    {0x5001, 0x7f}, {0x5680, 0x00}, {0x5681, 0x00}, {0x5682, 0x0a},
+    {0x5683, 0x20}, {0x5684, 0x00}, {0x5685, 0x00}, {0x5686, 0x07},
+    {0x5687, 0x98}, {0x3801, 0xb0},
+
+    {0xffff, 0xff},
+};
+
+static const struct sensor_reg ov5642_1024x768[] = {
+    {0x3800, 0x01}, {0x3801, 0xb0}, {0x3802, 0x00}, {0x3803, 0x0a},
+    {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07}, {0x3807, 0x98},
+    {0x3808, 0x04}, {0x3809, 0x00}, {0x380a, 0x03}, {0x380b, 0x00},
+    {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07}, {0x380f, 0xd0},
+    {0x5001, 0x7f}, {0x5680, 0x00}, {0x5681, 0x00}, {0x5682, 0x0a},
+    {0x5683, 0x20}, {0x5684, 0x00}, {0x5685, 0x00}, {0x5686, 0x07},
+    {0x5687, 0x98},
+
+    {0xffff, 0xff},
+};
+
+static const struct sensor_reg ov5642_1280x960[] = {
+    {0x3800, 0x01}, {0x3801, 0xb0}, {0x3802, 0x00}, {0x3803, 0x0a},
+    {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07}, {0x3807, 0x98},
+    {0x3808, 0x05}, {0x3809, 0x00}, {0x380a, 0x03}, {0x380b, 0xc0},
+    {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07}, {0x380f, 0xd0},
+    {0x5001, 0x7f}, {0x5680, 0x00}, {0x5681, 0x00}, {0x5682, 0x0a},
+    {0x5683, 0x20}, {0x5684, 0x00}, {0x5685, 0x00}, {0x5686, 0x07},
+    {0x5687, 0x98},
+
+    {0xffff, 0xff},
+};
+
+static const struct sensor_reg ov5642_1600x1200[] = {
+    {0x3800, 0x01}, {0x3801, 0xb0}, {0x3802, 0x00}, {0x3803, 0x0a},
+    {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07}, {0x3807, 0x98},
+    {0x3808, 0x06}, {0x3809, 0x40}, {0x380a, 0x04}, {0x380b, 0xb0},
+    {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07}, {0x380f, 0xd0},
+    {0x5001, 0x7f}, {0x5680, 0x00}, {0x5681, 0x00}, {0x5682, 0x0a},
+    {0x5683, 0x20}, {0x5684, 0x00}, {0x5685, 0x00}, {0x5686, 0x07},
+    {0x5687, 0x98},
+
+    {0xffff, 0xff},
+};
+
+static const struct sensor_reg ov5642_2048x1536[] = {
+    {0x3800, 0x01}, {0x3801, 0xb0}, {0x3802, 0x00}, {0x3803, 0x0a},
+    {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07}, {0x3807, 0x98},
+    {0x3808, 0x08}, {0x3809, 0x00}, {0x380a, 0x06}, {0x380b, 0x00},
+    {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07}, {0x380f, 0xd0},
+    {0x3810, 0xc2}, {0x3815, 0x44}, {0x3818, 0xa8}, {0x3824, 0x01},
+    {0x3827, 0x0a}, {0x3a00, 0x78}, {0x3a0d, 0x10}, {0x3a0e, 0x0d},
+    {0x3a00, 0x78}, {0x460b, 0x35}, {0x471d, 0x00}, {0x471c, 0x50},
+    {0x5682, 0x0a}, {0x5683, 0x20}, {0x5686, 0x07}, {0x5687, 0x98},
+    {0x589b, 0x00}, {0x589a, 0xc0}, {0x589b, 0x00}, {0x589a, 0xc0},
+    {0x3002, 0x0c}, {0x3002, 0x00}, {0x4300, 0x32}, {0x460b, 0x35},
+    {0x3002, 0x0c}, {0x3002, 0x00}, {0x4713, 0x02}, {0x4600, 0x80},
+    {0x4721, 0x02}, {0x471c, 0x40}, {0x4408, 0x00}, {0x460c, 0x22},
+    {0x3815, 0x04}, {0x3818, 0xc8}, {0x501f, 0x00}, {0x5002, 0xe0},
+    {0x440a, 0x01}, {0x4402, 0x90}, {0x3811, 0xf0}, {0x3818, 0xa8},
+    {0x3621, 0x10},
+
+    {0xffff, 0xff},
+};
+
+static const struct sensor_reg ov5642_2592x1944[] = {
+    {0x3800, 0x01}, {0x3801, 0xb0}, {0x3802, 0x00}, {0x3803, 0x0a},
+    {0x3804, 0x0a}, {0x3805, 0x20}, {0x3806, 0x07}, {0x3807, 0x98},
+    {0x3808, 0x0a}, {0x3809, 0x20}, {0x380a, 0x07}, {0x380b, 0x98},
+    {0x380c, 0x0c}, {0x380d, 0x80}, {0x380e, 0x07}, {0x380f, 0xd0},
+    {0x5001, 0x7f}, {0x5680, 0x00}, {0x5681, 0x00}, {0x5682, 0x0a},
+    {0x5683, 0x20}, {0x5684, 0x00}, {0x5685, 0x00}, {0x5686, 0x07},
+    {0x5687, 0x98},
+
+    {0xffff, 0xff},
+};
+
 // most of these functions are from arduino and stm32 example driver
 // repositories
 void CS_HIGH(void) { HAL_GPIO_WritePin(CS_PORT, CS_PIN, GPIO_PIN_SET); }
@@ -185,8 +318,8 @@ uint8_t bus_read(uint8_t addr) {
   uint8_t dummy = 0;
 
   CS_LOW();
-  HAL_SPI_Transmit(&hspi1, &taddr, 1, HAL_MAX_DELAY);
-  HAL_SPI_TransmitReceive(&hspi1, &dummy, &data, 1, HAL_MAX_DELAY);
+  HAL_SPI_Transmit(&CAM_SPI_HANDLE, &taddr, 1, HAL_MAX_DELAY);
+  HAL_SPI_TransmitReceive(&CAM_SPI_HANDLE, &dummy, &data, 1, HAL_MAX_DELAY);
   CS_HIGH();
 
   return data;
@@ -195,8 +328,8 @@ uint8_t bus_read(uint8_t addr) {
 void bus_write(uint8_t addr, uint8_t data) {
   uint8_t taddr = addr | 0x80;
   CS_LOW();
-  HAL_SPI_Transmit(&hspi1, &taddr, 1, HAL_MAX_DELAY);
-  HAL_SPI_Transmit(&hspi1, &data, 1, HAL_MAX_DELAY);
+  HAL_SPI_Transmit(&CAM_SPI_HANDLE, &taddr, 1, HAL_MAX_DELAY);
+  HAL_SPI_Transmit(&CAM_SPI_HANDLE, &data, 1, HAL_MAX_DELAY);
   CS_HIGH();
 }
 
@@ -212,19 +345,76 @@ void rdSensorReg16_8(uint16_t regID, uint8_t *regDat) {
                    regDat, 1, HAL_MAX_DELAY);
 }
 
-void wrSensorRegs16_8(const struct sensor_reg *regs) {
+/********/
+// Register table loader
+/*******/
+// A table is loaded as bursts: the writes between two barrier registers are
+// collected by address, later values replacing earlier ones, and go out as
+// one auto-increment I2C write per run of consecutive addresses. Barrier
+// registers act the moment they are written (resets, clock gates, group
+// hold), so they keep their place in the table and are never merged.
+#define LOAD_REGS_MAX 256 // distinct registers between barriers, else flushed
+#define LOAD_BURST_MAX 32
 
-  uint16_t reg_addr = regs->reg;
-  uint8_t reg_val = regs->val;
+static struct sensor_reg load_regs[LOAD_REGS_MAX]; // sorted by address
+static uint16_t load_n;
 
-  while ((reg_addr != 0xffff) || (reg_val != 0xff)) {
-    HAL_I2C_Mem_Write(&hi2c4, OV5642_I2C_ADDR, reg_addr, I2C_MEMADD_SIZE_16BIT,
-                      &reg_val, 1, HAL_MAX_DELAY);
-    HAL_Delay(1);
-    regs++;
-    reg_addr = regs->reg;
-    reg_val = regs->val;
+static uint8_t load_barrier(uint16_t reg) {
+  return (reg >= 0x3000 && reg <= 0x3008) || reg == 0x3212;
+}
+
+static void load_put(uint16_t reg, uint8_t val) {
+  uint16_t lo = 0, hi = load_n;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (load_regs[mid].reg < reg) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < load_n && load_regs[lo].reg == reg) {
+    load_regs[lo].val = val;
+    return;
+  }
+  memmove(&load_regs[lo + 1], &load_regs[lo],
+          (load_n - lo) * sizeof(load_regs[0]));
+  load_regs[lo].reg = reg;
+  load_regs[lo].val = val;
+  load_n++;
+}
+
+static void load_flush(void) {
+  uint8_t burst[LOAD_BURST_MAX];
+  uint16_t i = 0;
+  while (i < load_n) {
+    uint16_t first = load_regs[i].reg, n = 0;
+    while (i < load_n && n < LOAD_BURST_MAX &&
+           load_regs[i].reg == first + n) {
+      burst[n++] = (uint8_t)load_regs[i++].val;
+    }
+    HAL_I2C_Mem_Write(&hi2c4, OV5642_I2C_ADDR, first, I2C_MEMADD_SIZE_16BIT,
+                      burst, n, HAL_MAX_DELAY);
   }
+  load_n = 0;
+}
+
+void wrSensorRegs16_8(const struct sensor_reg *regs) {
+  for (; regs->reg != 0xffff || regs->val != 0xff; regs++) {
+    if (load_barrier(regs->reg)) {
+      load_flush();
+      wrSensorReg16_8(regs->reg, (uint8_t)regs->val);
+      if (regs->reg == 0x3008 && (regs->val & 0x80)) {
+        HAL_Delay(OV5642_RESET_MS);
+      }
+      continue;
+    }
+    if (load_n == LOAD_REGS_MAX) {
+      load_flush();
+    }
+    load_put(regs->reg, (uint8_t)regs->val);
+  }
+  load_flush();
 }
 
 uint8_t get_bit(uint8_t addr, uint8_t bit) {
@@ -241,7 +431,7 @@ uint8_t read_fifo(void) {
 // puts into burst mode
 void set_fifo_burst(void) {
   uint8_t data = BURST_FIFO_READ; // 0x3C
-  HAL_SPI_Transmit(&hspi1, &data, 1, HAL_MAX_DELAY);
+  HAL_SPI_Transmit(&CAM_SPI_HANDLE, &data, 1, HAL_MAX_DELAY);
 }
 
 void flush_fifo(void) {
@@ -254,67 +444,276 @@ void start_capture(void) {
 
 void clear_fifo_flag(void) { bus_write(ARDUCHIP_TRIG, CAP_DONE_MASK); }
 
-void ArduCam_Init_YCbCr(void) {
-  int terminal_debug = 1; // use for debugging
-
-  GPIO_InitTypeDef GPIO_InitStruct = {0};
+// CS pin, ArduCHIP reset, then the SPI test register and the OV5642 chip
+// id, each tried CAM_PROBE_TRIES times; common to both output modes. Leaves
+// *phase at CAM_DETECTED once both answer.
+#define CAM_DETECTED 4
+static uint8_t probe_tries;
 
-  // Configure the pin (e.g., PA5)
-  GPIO_InitStruct.Pin = CS_PIN;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(CS_PORT, &GPIO_InitStruct);
+static uint32_t arducam_detect_step(uint8_t *phase) {
+  int terminal_debug = 1; // use for debugging
+  switch (*phase) {
+  case 0: {
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
 
-  if (terminal_debug)
-    printf("\r\nbeginning\r\n");
-  uint8_t vid, pid;
-  uint8_t temp = 0;
+    // Configure the pin (e.g., PA5)
+    GPIO_InitStruct.Pin = CS_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(CS_PORT, &GPIO_InitStruct);
 
-  bus_write(0x07, 0x80); // in arduino code for some reason
-  HAL_Delay(100);
-  bus_write(0x07, 0x00);
-  HAL_Delay(100);
+    if (terminal_debug)
+      printf("\r\nbeginning\r\n");
 
-  // example driver code had these tests
-  while (1) {
+    bus_write(0x07, 0x80); // in arduino code for some reason
+    probe_tries = 0;
+    *phase = 1;
+    return 100;
+  }
+  case 1:
+    bus_write(0x07, 0x00);
+    *phase = 2;
+    return 100;
+  case 2: {
+    // example driver code had these tests
     bus_write(ARDUCHIP_TEST1, 0x55);
-    temp = bus_read(ARDUCHIP_TEST1);
+    uint8_t temp = bus_read(ARDUCHIP_TEST1);
     printf("temp: %02X\r\n", temp);
     if (temp == 0x55) {
       if (terminal_debug)
         printf("\r\nSPI is ready\r\n");
-      break;
-    } else {
-      if (terminal_debug)
-        printf("\r\nSPI communication error\r\n");
+      probe_tries = 0;
+      *phase = 3;
+      return 0;
     }
-    HAL_Delay(1000);
+    if (terminal_debug)
+      printf("\r\nSPI communication error\r\n");
+    break;
   }
-  while (1) {
-
+  case 3: {
+    uint8_t vid, pid;
     rdSensorReg16_8(OV5642_CHIPID_HIGH, &vid);
     rdSensorReg16_8(OV5642_CHIPID_LOW, &pid);
     if ((vid == 0x56) && (pid == 0x42)) {
       if (terminal_debug)
         printf("\r\nACK CMD OV5642 detected.\r\n");
-      break;
-    } else {
-      if (terminal_debug)
-        printf("\r\nACK CMD Can't find OV5642 module!\r\n");
+      *phase = CAM_DETECTED;
+      return 0;
     }
-    HAL_Delay(1000);
+    if (terminal_debug)
+      printf("\r\nACK CMD Can't find OV5642 module!\r\n");
+    break;
+  }
+  default:
+    return BOOT_DONE;
+  }
+  if (++probe_tries >= CAM_PROBE_TRIES) {
+    log_printf(LOG_ERR, "[CAM][ERR] no %s after %u tries\r\n",
+               *phase == 2 ? "ArduCHIP" : "OV5642", probe_tries);
+    return BOOT_FAILED;
+  }
+  return CAM_PROBE_RETRY_MS;
+}
+
+// 0x3818 bit 6 reads the array mirrored, bit 5 flipped. The module is
+// mounted upside down, so the scene is upright with mirror off and flip on,
+// as the JPEG table's 0xa8 has it; the preview table's 0xc1 turns it 180.
+// 0x3621 stays as the mode tables set it: ArduCAM's OV5642_set_Mirror_Flip
+// toggles its bit 5 with the mirror bit, but the preview and JPEG tables
+// here pair the two the opposite ways.
+#define OV5642_MIRROR 0x40
+#define OV5642_FLIP 0x20
+#define OV5642_UPRIGHT OV5642_FLIP
+
+static void orientation_apply(void) {
+  uint8_t r3818;
+  rdSensorReg16_8(0x3818, &r3818);
+  uint8_t bits = OV5642_UPRIGHT;
+  if (cam_orient & CAM_ORIENT_MIRROR) {
+    bits ^= OV5642_MIRROR;
+  }
+  if (cam_orient & CAM_ORIENT_FLIP) {
+    bits ^= OV5642_FLIP;
+  }
+  wrSensorReg16_8(0x3818,
+                  (uint8_t)((r3818 & ~(OV5642_MIRROR | OV5642_FLIP)) | bits));
+}
+
+uint32_t ArduCam_InitStep_YCbCr(uint8_t *phase) {
+  switch (*phase) {
+  case CAM_DETECTED:
+    // figuring out how to output ycbcr instead of jpeg was difficult
+    // due to there being no non-jpeg exampels and the application
+    // notes not being clear
+    wrSensorReg16_8(0x3008, 0x80);
+    break;
+  case CAM_DETECTED + 1:
+    wrSensorRegs16_8(OV5642_QVGA_Preview);
+    break;
+  case CAM_DETECTED + 2:
+    bus_write(ARDUCHIP_TIM, VSYNC_LEVEL_MASK);
+    cam_out_w = CAM_FRAME_W; // what the preview table leaves in 0x3808-0x380b
+    cam_out_h = CAM_FRAME_H;
+    cam_fmt = CAM_FMT_YUV422; // 0x4300 = 0x30 in the table
+    orientation_apply();
+    return BOOT_DONE;
+  default:
+    return arducam_detect_step(phase);
+  }
+  (*phase)++;
+  return 100;
+}
+
+uint8_t ArduCam_Init_YCbCr(void) {
+  return boot_run_one(ArduCam_InitStep_YCbCr);
+}
+
+// A running preview splits the frame in the FIFO by the current line width
+// and bytes per pixel: changing them under it garbles that frame
+static uint8_t refused_for_preview(const char *what) {
+  if (!cam_preview_running()) {
+    return 0;
+  }
+  log_printf(LOG_ERR, "[CAM][ERR] no %s change while the preview runs\r\n",
+             what);
+  return 1;
+}
+
+// The window (0x3800-0x3807) and the output size (0x3808-0x380b) are
+// consecutive registers: one auto-increment write sets all of them, so no
+// capture sees a window from one setting and a size from the other. The
+// preview table has the ISP scaler on (0x5001 bit 5).
+uint8_t cam_set_output(uint16_t out_w, uint16_t out_h, uint16_t x, uint16_t y,
+                       uint16_t w, uint16_t h) {
+  if (!out_w || !out_h || (out_w & 1) || out_w > CAM_FRAME_W ||
+      out_h > CAM_FRAME_H || w < out_w || h < out_h || x > CAM_FIELD_W - w ||
+      y > CAM_FIELD_H - h || w > CAM_FIELD_W || h > CAM_FIELD_H) {
+    log_printf(LOG_ERR, "[CAM][ERR] output %ux%u from %ux%u at %u,%u\r\n",
+               out_w, out_h, w, h, x, y);
+    return 0;
+  }
+  if (refused_for_preview("output")) {
+    return 0;
+  }
+  uint16_t v[6] = {CAM_FIELD_X + x, CAM_FIELD_Y + y, w, h, out_w, out_h};
+  uint8_t regs[12];
+  for (int i = 0; i < 6; i++) {
+    regs[2 * i] = (uint8_t)(v[i] >> 8);
+    regs[2 * i + 1] = (uint8_t)v[i];
+  }
+  HAL_I2C_Mem_Write(&hi2c4, OV5642_I2C_ADDR, 0x3800, I2C_MEMADD_SIZE_16BIT,
+                    regs, sizeof(regs), HAL_MAX_DELAY);
+  cam_out_w = out_w;
+  cam_out_h = out_h;
+  return 1;
+}
+
+uint8_t cam_set_output_size(uint16_t out_w, uint16_t out_h) {
+  return cam_set_output(out_w, out_h, 0, 0, CAM_FIELD_W, CAM_FIELD_H);
+}
+
+void cam_output_size(uint16_t *w, uint16_t *h) {
+  *w = cam_out_w;
+  *h = cam_out_h;
+}
+
+// 0x4300 picks what the output formatter sends, 0x501f which ISP output
+// feeds it: YUV for YUV422 and Y8, RGB for RGB565, which with sequence 1
+// comes big-endian with R first, as the TFT takes it
+static const struct {
+  uint8_t r4300, r501f;
+} raw_formats[] = {
+    [CAM_FMT_YUV422] = {0x30, 0x00},
+    [CAM_FMT_RGB565] = {0x61, 0x01},
+    [CAM_FMT_Y8] = {0x10, 0x00},
+};
+
+CamFormat cam_set_format(CamFormat want) {
+  if (want == cam_fmt || refused_for_preview("format")) {
+    return cam_fmt;
+  }
+  if (want > CAM_FMT_JPEG || want == CAM_FMT_JPEG ||
+      cam_fmt == CAM_FMT_JPEG) {
+    log_printf(LOG_ERR, "[CAM][ERR] format %d needs another bring-up, "
+                        "staying at %d\r\n",
+               (int)want, (int)cam_fmt);
+    return cam_fmt;
+  }
+  wrSensorReg16_8(0x4300, raw_formats[want].r4300);
+  wrSensorReg16_8(0x501f, raw_formats[want].r501f);
+  cam_fmt = want;
+  return cam_fmt;
+}
+
+CamFormat cam_format(void) { return cam_fmt; }
+
+void cam_set_orientation(CamOrientation o) {
+  if (refused_for_preview("orientation")) {
+    return;
+  }
+  cam_orient = (CamOrientation)(o & CAM_ORIENT_ROTATE180);
+  orientation_apply();
+}
+
+CamOrientation cam_orientation(void) { return cam_orient; }
+
+static uint8_t cam_bytes_per_pixel(void) {
+  return cam_fmt == CAM_FMT_Y8 ? 1 : 2;
+}
+
+// archer_files' ArduCam_Init: the preview table for the sensor setup, the
+// JPEG table on top of it, then the size
+uint8_t ArduCam_Init_JPEG(uint8_t size) {
+  if (!boot_run_one(arducam_detect_step)) {
+    return 0;
   }
 
-  // figuring out how to output ycbcr instead of jpeg was difficult
-  // due to there being no non-jpeg exampels and the application
-  // notes not being clear
   wrSensorReg16_8(0x3008, 0x80);
   HAL_Delay(100);
   wrSensorRegs16_8(OV5642_QVGA_Preview);
   HAL_Delay(100);
+  wrSensorRegs16_8(OV5642_JPEG_Capture_QSXGA);
+  HAL_Delay(100);
+  OV5642_set_JPEG_size(size);
+  HAL_Delay(100);
+
+  wrSensorReg16_8(0x3818, 0xa8); // compression on
+  wrSensorReg16_8(0x3621, 0x10);
+  orientation_apply();
+  wrSensorReg16_8(0x3801, 0xb0);
+  wrSensorReg16_8(0x4407, 0x04); // quantisation scale, lower is finer
 
   bus_write(ARDUCHIP_TIM, VSYNC_LEVEL_MASK);
+  cam_fmt = CAM_FMT_JPEG;
+  return 1;
+}
+
+void OV5642_set_JPEG_size(uint8_t size) {
+  switch (size) {
+  case OV5642_640x480:
+    wrSensorRegs16_8(ov5642_640x480);
+    break;
+  case OV5642_1024x768:
+    wrSensorRegs16_8(ov5642_1024x768);
+    break;
+  case OV5642_1280x960:
+    wrSensorRegs16_8(ov5642_1280x960);
+    break;
+  case OV5642_1600x1200:
+    wrSensorRegs16_8(ov5642_1600x1200);
+    break;
+  case OV5642_2048x1536:
+    wrSensorRegs16_8(ov5642_2048x1536);
+    break;
+  case OV5642_2592x1944:
+    wrSensorRegs16_8(ov5642_2592x1944);
+    break;
+  case OV5642_320x240:
+  default:
+    wrSensorRegs16_8(ov5642_320x240);
+    break;
+  }
 }
 
 void convert_24(
@@ -350,136 +749,832 @@ void convert_24(
   array[2] = (uint8_t)B;
 }
 
-void SingleCapTransfer_YCbCr(
-    int debug_terminal, int debug_python,
-    uint8_t *camera_buf) { // passing in camera_buf[rgb888_data_length] makes
-                           // compiler mad
-  uint8_t temp[4];
-  uint8_t first_8_yuyv_values[8];
-  uint16_t first_8_rgb_values[8] = {
-      0, 0, 0, 0, 0, 0, 0, 0}; // unnecessary but vestigial from debugging
-  uint8_t rgb_24_vals_1[3];
-  uint8_t rgb_24_vals_2[3];
+/********/
+// YUYV -> RGB565
+/*******/
+// Same OV5642 application note coefficients as convert_24, in integers:
+// R and B offsets are whole pixels (floor, like the float cast after the
+// clamp), G keeps 16 fractional bits until the sum with Y. Tables are built
+// once, on first use.
+static int16_t yuv_r_cr[256];
+static int16_t yuv_b_cb[256];
+static int32_t yuv_g_cr[256];
+static int32_t yuv_g_cb[256];
+static uint8_t yuv_tables_ready;
+
+static void yuv_tables_init(void) {
+  for (int i = 0; i < 256; i++) {
+    int32_t d = i - 128;
+    // floor(k * d / 1000) with integer division rounding toward zero
+    yuv_r_cr[i] = (int16_t)((1371 * d - (d < 0 ? 999 : 0)) / 1000);
+    yuv_b_cb[i] = (int16_t)((1732 * d - (d < 0 ? 999 : 0)) / 1000);
+    yuv_g_cr[i] = (int32_t)(-698 * (int64_t)d * 65536 / 1000);
+    yuv_g_cb[i] = (int32_t)(-336 * (int64_t)d * 65536 / 1000);
+  }
+  yuv_tables_ready = 1;
+}
+
+#if !defined(__ARM_FEATURE_DSP)
+static inline uint16_t yuv_clamp(int32_t v) {
+  return v < 0 ? 0 : v > 255 ? 255 : (uint16_t)v;
+}
+#endif
+
+// Two pixels sharing one Cb/Cr pair, as RGB565 in the low and high halfword
+static inline uint32_t yuyv_quad_to_rgb565(const uint8_t *q) {
+  int32_t r_off = yuv_r_cr[q[3]];
+  int32_t g_off = (yuv_g_cr[q[3]] + yuv_g_cb[q[1]]) >> 16;
+  int32_t b_off = yuv_b_cb[q[1]];
+#if defined(__ARM_FEATURE_DSP)
+  // Both pixels at once: Y0/Y1 in halfwords, 16-bit adds, saturate to 8 bits
+  uint32_t yy = q[0] | ((uint32_t)q[2] << 16);
+  uint32_t r = __USAT16(__SADD16(yy, (uint16_t)r_off * 0x00010001u), 8);
+  uint32_t g = __USAT16(__SADD16(yy, (uint16_t)g_off * 0x00010001u), 8);
+  uint32_t b = __USAT16(__SADD16(yy, (uint16_t)b_off * 0x00010001u), 8);
+  return ((r & 0x00F800F8u) << 8) | ((g & 0x00FC00FCu) << 3) |
+         ((b >> 3) & 0x001F001Fu);
+#else
+  uint32_t px[2];
+  for (int i = 0; i < 2; i++) {
+    int32_t y = q[2 * i];
+    uint16_t r = yuv_clamp(y + r_off);
+    uint16_t g = yuv_clamp(y + g_off);
+    uint16_t b = yuv_clamp(y + b_off);
+    px[i] = ((r & 0xF8u) << 8) | ((g & 0xFCu) << 3) | (b >> 3);
+  }
+  return px[0] | (px[1] << 16);
+#endif
+}
 
+void yuyv_to_rgb565(const uint8_t *yuyv, uint8_t *rgb565, uint32_t pixels) {
+  if (!yuv_tables_ready) {
+    yuv_tables_init();
+  }
+  uint8_t *out = rgb565;
+  for (uint32_t i = 0; i + 2 <= pixels; i += 2, yuyv += 4, out += 4) {
+    uint32_t px = yuyv_quad_to_rgb565(yuyv);
+    // Big-endian pixels
+#if defined(__ARM_FEATURE_DSP)
+    px = __REV16(px);
+    memcpy(out, &px, 4);
+#else
+    out[0] = (uint8_t)(px >> 8);
+    out[1] = (uint8_t)px;
+    out[2] = (uint8_t)(px >> 24);
+    out[3] = (uint8_t)(px >> 16);
+#endif
+  }
+}
+
+// One pixel of a YUYV line, scalar
+static inline uint16_t yuyv_pixel_to_rgb565(const uint8_t *yuyv, uint32_t p) {
+  const uint8_t *q = yuyv + (p & ~1u) * 2;
+  int32_t y = q[(p & 1) * 2];
+#if defined(__ARM_FEATURE_DSP)
+  uint32_t r = __USAT(y + yuv_r_cr[q[3]], 8);
+  uint32_t g = __USAT(y + ((yuv_g_cr[q[3]] + yuv_g_cb[q[1]]) >> 16), 8);
+  uint32_t b = __USAT(y + yuv_b_cb[q[1]], 8);
+#else
+  uint16_t r = yuv_clamp(y + yuv_r_cr[q[3]]);
+  uint16_t g = yuv_clamp(y + ((yuv_g_cr[q[3]] + yuv_g_cb[q[1]]) >> 16));
+  uint16_t b = yuv_clamp(y + yuv_b_cb[q[1]]);
+#endif
+  return (uint16_t)(((r & 0xF8u) << 8) | ((g & 0xFCu) << 3) | (b >> 3));
+}
+
+void yuyv_sample_rgb565(const uint8_t *yuyv, uint8_t *rgb565, uint32_t pixels,
+                        uint8_t step) {
+  if (step <= 1) {
+    yuyv_to_rgb565(yuyv, rgb565, pixels);
+    return;
+  }
+  if (!yuv_tables_ready) {
+    yuv_tables_init();
+  }
+  for (uint32_t p = 0; p < pixels; p += step, rgb565 += 2) {
+    uint16_t px = yuyv_pixel_to_rgb565(yuyv, p);
+    rgb565[0] = (uint8_t)(px >> 8);
+    rgb565[1] = (uint8_t)px;
+  }
+}
+
+/********/
+// Raw formats -> RGB565
+/*******/
+// Every step-th of pixels pixels in the current format as big-endian
+// RGB565, in order. RGB565 is only ever copied.
+static void raw_to_rgb565(const uint8_t *in, uint8_t *rgb565, uint32_t pixels,
+                          uint8_t step) {
+  if (cam_fmt == CAM_FMT_YUV422) {
+    yuyv_sample_rgb565(in, rgb565, pixels, step);
+    return;
+  }
+  if (cam_fmt == CAM_FMT_RGB565 && step <= 1) {
+    memcpy(rgb565, in, pixels * 2);
+    return;
+  }
+  if (!step) {
+    step = 1;
+  }
+  for (uint32_t p = 0; p < pixels; p += step, rgb565 += 2) {
+    if (cam_fmt == CAM_FMT_RGB565) {
+      rgb565[0] = in[2 * p];
+      rgb565[1] = in[2 * p + 1];
+    } else {
+      uint8_t y = in[p];
+      rgb565[0] = (uint8_t)((y & 0xF8u) | y >> 5);
+      rgb565[1] = (uint8_t)((y & 0x1Cu) << 3 | y >> 3);
+    }
+  }
+}
+
+uint32_t read_fifo_length(void) {
+  uint32_t len1, len2, len3, len = 0;
+  len1 = bus_read(FIFO_SIZE1);
+  len2 = bus_read(FIFO_SIZE2);
+  len3 = bus_read(FIFO_SIZE3) & 0x7f;
+  len = ((len3 << 16) | (len2 << 8) | len1) & 0x07fffff;
+  return len;
+}
+
+/********/
+// FIFO reader
+/*******/
+// Burst reads land in a ring of chunks by SPI RX DMA. The completion
+// interrupt starts the next chunk while a slot is free, so the wire keeps
+// running while the caller converts the chunk it was handed. Pausing stops
+// the chaining and lets the CS go high so the TFT can have a shared bus; the
+// next read resumes the burst where the ArduCHIP read pointer stopped.
+static uint8_t fifo_ring[CAM_FIFO_RING_CHUNKS][CAM_FIFO_CHUNK];
+static uint16_t fifo_chunk_len[CAM_FIFO_RING_CHUNKS];
+static volatile uint8_t fifo_head;  // slot the next DMA fills
+static volatile uint8_t fifo_ready; // filled slots not handed out yet
+static volatile uint8_t fifo_dma_busy;
+static volatile uint8_t fifo_error;
+static uint8_t fifo_tail; // slot handed out next
+static uint8_t fifo_held; // the caller still reads the last slot handed out
+static uint8_t fifo_paused;
+static uint32_t fifo_remaining; // bytes not requested from the FIFO yet
+static uint16_t fifo_chunk;     // bytes per DMA read, the last may be short
+
+// Starts the next chunk if there is one and a slot for it. Runs from the
+// RX completion interrupt or with interrupts masked.
+static void fifo_kick(void) {
+  if (fifo_paused || fifo_dma_busy || fifo_error || !fifo_remaining ||
+      fifo_ready + fifo_held >= CAM_FIFO_RING_CHUNKS) {
+    return;
+  }
+  uint16_t n = fifo_remaining < fifo_chunk ? fifo_remaining : fifo_chunk;
+  fifo_chunk_len[fifo_head] = n;
+  fifo_dma_busy = 1;
+  if (HAL_SPI_Receive_DMA(&CAM_SPI_HANDLE, fifo_ring[fifo_head], n) != HAL_OK) {
+    fifo_dma_busy = 0;
+    fifo_error = 1; // reported by cam_fifo_read, not from here
+    return;
+  }
+  fifo_remaining -= n;
+}
+
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) {
+  if (hspi == &CAM_SPI_HANDLE && fifo_dma_busy) {
+    fifo_head = (fifo_head + 1) % CAM_FIFO_RING_CHUNKS;
+    fifo_ready++;
+    fifo_dma_busy = 0;
+    fifo_kick();
+  }
+}
+
+uint8_t cam_spi_error(SPI_HandleTypeDef *hspi) {
+  if (hspi != &CAM_SPI_HANDLE || !fifo_dma_busy) {
+    return 0;
+  }
+  // the chunk is lost and the rest of the burst with it; the reader gets
+  // NULL and reports it
+  fifo_dma_busy = 0;
+  fifo_error = 1;
+  return 1;
+}
+
+void cam_fifo_open(uint32_t length, uint16_t chunk) {
+  fifo_chunk = chunk && chunk < CAM_FIFO_CHUNK ? chunk : CAM_FIFO_CHUNK;
+  fifo_head = fifo_tail = 0;
+  fifo_ready = fifo_held = 0;
+  fifo_error = 0;
+  fifo_paused = 0;
+  fifo_remaining = length;
+  CS_LOW();
+  set_fifo_burst();
+  __disable_irq();
+  fifo_kick();
+  __enable_irq();
+}
+
+const uint8_t *cam_fifo_read(uint16_t *len) {
+  if (fifo_paused) {
+    fifo_paused = 0;
+    if (fifo_remaining) {
+      CS_LOW();
+      set_fifo_burst();
+    }
+  }
+
+  __disable_irq();
+  if (fifo_held) {
+    fifo_held = 0;
+    fifo_tail = (fifo_tail + 1) % CAM_FIFO_RING_CHUNKS;
+  }
+  fifo_kick();
+  while (!fifo_ready && fifo_dma_busy) {
+    __WFI(); // the completion interrupt wakes the core even while masked
+    __enable_irq();
+    __disable_irq();
+  }
+  const uint8_t *chunk = NULL;
+  *len = 0;
+  if (fifo_ready) {
+    chunk = fifo_ring[fifo_tail];
+    *len = fifo_chunk_len[fifo_tail];
+    fifo_ready--;
+    fifo_held = 1;
+    fifo_kick();
+  }
+  __enable_irq();
+
+  if (!chunk && fifo_error) {
+    log_printf(LOG_ERR, "[CAM][ERR] FIFO DMA read failed, %lu bytes left\r\n",
+               (unsigned long)fifo_remaining);
+  }
+  return chunk;
+}
+
+void cam_fifo_pause(void) {
+  __disable_irq();
+  fifo_paused = 1;
+  while (fifo_dma_busy) {
+    __WFI();
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
+  CS_HIGH();
+}
+
+void cam_fifo_close(void) {
+  cam_fifo_pause();
+  fifo_remaining = 0;
+  fifo_ready = fifo_held = 0;
+}
+
+// Before drawing: on a bus of its own the burst carries on under the TFT's
+// DMA, on a shared one the read in flight lands and the TFT gets the bus
+static void fifo_yield(void) {
+  if (spi_bus_shared(SPI_DEV_CAMERA)) {
+    cam_fifo_pause();
+  }
+}
+
+/********/
+// CAPTURE STATE MACHINE
+/*******/
+// The ArduCHIP has no interrupt line on this board, so CAP_DONE is polled:
+// first after CAM_POLL_FIRST_MS, then at doubling intervals up to
+// CAM_POLL_MAX_MS. The frame is ready as soon as the bit is set.
+static struct {
+  CamCaptureState state;
+  uint16_t x, y;
+  uint8_t scale;
+  uint32_t started;   // HAL_GetTick() at trigger
+  uint32_t next_poll; // tick of the next CAP_DONE check
+  uint32_t poll_ms;
+  // drain position, kept across steps
+  const uint8_t *chunk;
+  uint16_t chunk_len, off;
+  uint16_t j; // FIFO line
+  uint8_t filled;
+} cap;
+
+static CamCaptureStats cap_stats;
+
+static void capture_trigger(void) {
   flush_fifo();
   clear_fifo_flag();
   start_capture();
+  cap.started = HAL_GetTick();
+  TRACE(LOG_INFO, "[CAM] capture triggered\r\n");
+  cap.poll_ms = CAM_POLL_FIRST_MS;
+  cap.next_poll = cap.started + cap.poll_ms;
+}
+
+// One CAP_DONE check if it is due; 1 once the frame is in the FIFO
+static uint8_t capture_poll(void) {
+  uint32_t now = HAL_GetTick();
+  if ((int32_t)(now - cap.next_poll) < 0) {
+    return 0;
+  }
+  cap_stats.polls++;
+  if (get_bit(ARDUCHIP_TRIG, CAP_DONE_MASK)) {
+    cap_stats.wait_ms = now - cap.started;
+    TRACE(LOG_INFO, "[CAM] CAP_DONE after %lu ms\r\n",
+          (unsigned long)cap_stats.wait_ms);
+    return 1;
+  }
+  if (cap.poll_ms < CAM_POLL_MAX_MS) {
+    cap.poll_ms *= 2;
+  }
+  cap.next_poll = now + cap.poll_ms;
+  return 0;
+}
+
+// Triggers one capture and waits until the frame is in the FIFO
+static void capture_frame(int debug_terminal) {
+  capture_trigger();
   if (debug_terminal)
     printf("\r\n before while \r\n"); // debugging
-  while (!get_bit(ARDUCHIP_TRIG, CAP_DONE_MASK)) {
-    HAL_Delay(1000);
+  while (!capture_poll()) {
+    HAL_Delay(1);
   }
   if (debug_terminal)
     printf("\r\n after while \r\n"); // debugging
-  HAL_Delay(5);
-  HAL_Delay(750);
+}
 
-  uint32_t length =
-      320 * 240 * 2; // yuyv is a x2 multiplier, 4 bytes create 2 rgb pixels
+void SingleCapTransfer_YCbCr(
+    int debug_terminal, int debug_python,
+    uint8_t *camera_buf) { // passing in camera_buf[rgb888_data_length] makes
+                           // compiler mad
+  uint8_t rgb_24_vals_1[3];
+  uint8_t rgb_24_vals_2[3];
 
-  CS_LOW();
-  // HAL_Delay(50);
-  set_fifo_burst();
-  // HAL_Delay(50);
+  // the preview owns the FIFO and camera_buf
+  if (cam_preview_running()) {
+    log_printf(LOG_ERR, "[CAM][ERR] no capture while the preview runs\r\n");
+    return;
+  }
+  if (cam_fmt == CAM_FMT_JPEG) {
+    log_printf(LOG_ERR, "[CAM][ERR] JPEG goes through SingleCapJpeg\r\n");
+    return;
+  }
+  capture_frame(debug_terminal);
 
-  // debugging
-  uint8_t start_flag[] = "START\n";
-  if (debug_python)
-    HAL_UART_Transmit(&hlpuart1, start_flag, sizeof(start_flag) - 1,
-                      HAL_MAX_DELAY);
-
-  uint8_t y0, y1, cb, cr;
-  for (uint32_t i = 0; i + 4 <= length; i += 4) {
-    HAL_SPI_Receive(&hspi1, temp, 4, HAL_MAX_DELAY); // & removed bc buffer
-    y0 = temp[0];
-    cb = temp[1];
-    y1 = temp[2];
-    cr = temp[3];
-
-    convert_24(y0, cb, cr, rgb_24_vals_1);
-    convert_24(y1, cb, cr, rgb_24_vals_2);
-
-    int camera_index = (i * 3) / 2;
-
-    // for some reason the image was coming out rotated 180 degrees
-    // this code rotates it to be correct
-    int index;
-    int sign;
-    if (1) {
-      index = rgb888_data_length - 1;
-      sign = -1;
-    } else {
-      index = 0;
-      sign = 1;
-    }
+  // yuyv is a x2 multiplier, 4 bytes create 2 rgb pixels
+  uint8_t bpp = cam_bytes_per_pixel();
+  uint32_t pixels = (uint32_t)cam_out_w * cam_out_h;
+  uint32_t length = read_fifo_length();
+  if (length > pixels * bpp)
+    length = pixels * bpp; // anything past one frame is not ours
+  length &= ~3u;
 
-    camera_buf[index + sign * (camera_index)] =
-        rgb_24_vals_1[2]; // do 012 if no flip, 210 if flip
-    camera_buf[index + sign * (camera_index + 1)] = rgb_24_vals_1[1];
-    camera_buf[index + sign * (camera_index + 2)] = rgb_24_vals_1[0];
-    camera_buf[index + sign * (camera_index + 3)] = rgb_24_vals_2[2];
-    camera_buf[index + sign * (camera_index + 4)] = rgb_24_vals_2[1];
-    camera_buf[index + sign * (camera_index + 5)] = rgb_24_vals_2[0];
-
-    /******/
-    // DEBUGGING
-    /******/
-    if (debug_python)
-      HAL_UART_Transmit(&hlpuart1, rgb_24_vals_1, 3,
-                        HAL_MAX_DELAY); // debugging
-    if (debug_python)
-      HAL_UART_Transmit(&hlpuart1, rgb_24_vals_2, 3, HAL_MAX_DELAY);
-    if (debug_terminal && 0)
-      printf("\r\n%lx\r\n", i); // old debugging statement
-    if (i <= 4) {
-      first_8_yuyv_values[i] = temp[0];
-      first_8_yuyv_values[i + 1] = temp[1];
-      first_8_yuyv_values[i + 2] = temp[2];
-      first_8_yuyv_values[i + 3] = temp[3];
-    }
-    if (i == 0) {
-      if (debug_terminal)
-        printf("\r\n%x, %x, %x\r\n", rgb_24_vals_1[0], rgb_24_vals_1[1],
-               rgb_24_vals_1[2]);
-      if (debug_terminal)
-        printf("\r\n%x, %x, %x\r\n", rgb_24_vals_2[0], rgb_24_vals_2[1],
-               rgb_24_vals_2[2]);
-      first_8_rgb_values[i] = rgb_24_vals_1[0];
-      first_8_rgb_values[i + 1] = rgb_24_vals_1[1];
-      first_8_rgb_values[i + 2] = rgb_24_vals_1[2];
-      first_8_rgb_values[i + 3] = rgb_24_vals_2[0];
-      first_8_rgb_values[i + 4] = rgb_24_vals_2[1];
-      first_8_rgb_values[i + 5] = rgb_24_vals_2[2];
+  cam_fifo_open(length, CAM_FIFO_CHUNK);
+
+  const uint8_t *chunk;
+  uint16_t n;
+  uint32_t i = 0;
+  while ((chunk = cam_fifo_read(&n)) != NULL) {
+    // the sensor sends the frame the right way up (cam_set_orientation),
+    // so it goes into the buffer in order
+    raw_to_rgb565(chunk, camera_buf + i / bpp * 2, n / bpp, 1);
+
+    // the float conversion is only kept for the first pixels' debug print
+    if (i == 0 && n >= 4 && debug_terminal && cam_fmt == CAM_FMT_YUV422) {
+      convert_24(chunk[0], chunk[1], chunk[3], rgb_24_vals_1);
+      convert_24(chunk[2], chunk[1], chunk[3], rgb_24_vals_2);
+      printf("\r\n%x, %x, %x\r\n", rgb_24_vals_1[0], rgb_24_vals_1[1],
+             rgb_24_vals_1[2]);
+      printf("\r\n%x, %x, %x\r\n", rgb_24_vals_2[0], rgb_24_vals_2[1],
+             rgb_24_vals_2[2]);
     }
+    i += n;
   }
 
-  CS_HIGH();
+  cam_fifo_close();
 
   /******/
   // DEBUGGING
   /******/
 
-  uint8_t end_flag[] = "END\n";
-  if (debug_python)
-    HAL_UART_Transmit(&hlpuart1, end_flag, sizeof(end_flag) - 1,
-                      HAL_MAX_DELAY); // avoid null terminator
+  // The converted frame to plantpot_imgrecv, checked and compressed, once
+  // the burst is closed: about 4 s at 115200 baud for the 20 s the RGB888
+  // dump between START and END used to take with the FIFO held open
   if (debug_python)
-    HAL_UART_Transmit(&hlpuart1, first_8_yuyv_values, 8, HAL_MAX_DELAY);
-  uint8_t rgb_vals_8bit[16] = {0};
-  for (int i = 0; i < 8; i++) {
-    // send first 6 rgb values, doesn't fill full 8 bc I had a prior rgb565
-    // setup that worked with 8 first 8 was uint16_t back when was using rgb565
-    // which was uint16_t, uart can only send 1 byte at a time, so i split up
-    // into higher and lower, vestigial debugging structure
-    rgb_vals_8bit[0] = first_8_rgb_values[0]; // rgb_24_vals_1[0];
-    rgb_vals_8bit[1] = first_8_rgb_values[1]; // rgb_24_vals_1[1];
-    rgb_vals_8bit[2] = first_8_rgb_values[2]; // rgb_24_vals_1[2];
-    rgb_vals_8bit[3] = first_8_rgb_values[3]; // rgb_24_vals_2[0];
-    rgb_vals_8bit[4] = first_8_rgb_values[4]; // rgb_24_vals_2[1];
-    rgb_vals_8bit[5] = first_8_rgb_values[5]; // rgb_24_vals_2[2];
-  }
-  if (debug_python)
-    HAL_UART_Transmit(&hlpuart1, rgb_vals_8bit, 16, HAL_MAX_DELAY);
+    imgstream_send(camera_buf, cam_out_w, cam_out_h, IMG_RGB565,
+                   IMG_CODEC_DRLE);
   if (debug_terminal)
     printf("\r\nend\r\n");
 }
+
+// The ring of converted lines, sized for scale 1; together with the FIFO
+// ring about 11 KB instead of a 150 KB frame buffer
+static uint8_t stream_ring[CAM_STREAM_RING_LINES * CAM_FRAME_W * 2];
+
+uint8_t cam_capture_start(uint16_t x, uint16_t y, uint8_t scale) {
+  if (cap.state == CAM_CAPTURE_WAIT || cap.state == CAM_CAPTURE_DRAIN) {
+    return 0; // one at a time
+  }
+  if (cam_preview_running()) {
+    log_printf(LOG_ERR, "[CAM][ERR] no capture while the preview runs\r\n");
+    return 0;
+  }
+  if (cam_fmt == CAM_FMT_JPEG) {
+    log_printf(LOG_ERR, "[CAM][ERR] JPEG goes through SingleCapJpeg\r\n");
+    return 0;
+  }
+  cap.x = x;
+  cap.y = y;
+  cap.scale = scale ? scale : 1;
+  cap.state = CAM_CAPTURE_START;
+  return 1;
+}
+
+CamCaptureState cam_capture_state(void) { return cap.state; }
+
+const CamCaptureStats *cam_capture_stats(void) { return &cap_stats; }
+
+static void capture_first_pixel(void) {
+  if (!cap_stats.first_pixel_ms) {
+    cap_stats.first_pixel_ms = HAL_GetTick() - cap.started;
+    TRACE(LOG_INFO, "[CAM] first pixel at %lu ms\r\n",
+          (unsigned long)cap_stats.first_pixel_ms);
+  }
+}
+
+// Converts FIFO lines into the ring until one TFT window has gone out or the
+// frame ends; returns 1 at the end. A shared bus is free again on return.
+// RGB565 lines are copied into the ring as they are rather than drawn from
+// the FIFO chunks: a chunk is two lines, and a TFT window per two lines costs
+// more SPI time in window setup and burst restarts than the copy saves.
+static uint8_t capture_drain(void) {
+  uint8_t scale = cap.scale;
+  uint16_t dest_w = (cam_out_w + scale - 1) / scale;
+  uint16_t last_row = (cam_out_h - 1) / scale;
+  uint32_t line_bytes = dest_w * 2;
+  uint32_t in_line = (uint32_t)cam_out_w * cam_bytes_per_pixel();
+
+  // FIFO line j is row j of the picture, already the right way up, so the
+  // ring fills top-down in FIFO order
+  for (;;) {
+    if (cap.off >= cap.chunk_len) {
+      cap.chunk = cam_fifo_read(&cap.chunk_len);
+      cap.off = 0;
+      if (!cap.chunk) {
+        break;
+      }
+    }
+    const uint8_t *line = cap.chunk + cap.off;
+    uint16_t row = cap.j;
+    cap.off += in_line;
+    cap.j++;
+    if (row % scale) {
+      continue; // decimated away
+    }
+    uint16_t dest_row = row / scale;
+    raw_to_rgb565(line, stream_ring + cap.filled * line_bytes, cam_out_w,
+                  scale);
+    cap.filled++;
+
+    if (cap.filled == CAM_STREAM_RING_LINES || dest_row == last_row) {
+      uint16_t top = dest_row + 1 - cap.filled;
+      fifo_yield();
+      capture_first_pixel();
+      TFT_DrawRGB565Buffer(cap.x, cap.y + top, dest_w, cap.filled,
+                           stream_ring, 1);
+      cap.filled = 0;
+      return 0;
+    }
+  }
+
+  cam_fifo_close();
+  if (cap.filled) {
+    // short FIFO: show what arrived rather than drop it
+    uint16_t top = (cap.j - 1) / scale + 1 - cap.filled;
+    TFT_DrawRGB565Buffer(cap.x, cap.y + top, dest_w, cap.filled, stream_ring,
+                         1);
+    cap.filled = 0;
+  }
+  return 1;
+}
+
+uint8_t cam_capture_step(void) {
+  switch (cap.state) {
+  case CAM_CAPTURE_START:
+    cap_stats.wait_ms = cap_stats.first_pixel_ms = 0;
+    capture_trigger();
+    cap.state = CAM_CAPTURE_WAIT;
+    return 0;
+
+  case CAM_CAPTURE_WAIT: {
+    if (!capture_poll()) {
+      return 0;
+    }
+    // whole lines, and chunks of whole lines
+    uint32_t line = (uint32_t)cam_out_w * cam_bytes_per_pixel();
+    uint32_t length = read_fifo_length();
+    if (length > line * cam_out_h)
+      length = line * cam_out_h;
+    cam_fifo_open(length - length % line, CAM_FIFO_CHUNK / line * line);
+    cap.chunk = NULL;
+    cap.chunk_len = cap.off = 0;
+    cap.j = 0;
+    cap.filled = 0;
+    cap.state = CAM_CAPTURE_DRAIN;
+    // The open FIFO holds the ArduCHIP CS low: drain now, since a drain
+    // step only returns with a shared bus handed back
+  }
+    /* fall through */
+  case CAM_CAPTURE_DRAIN: {
+    uint32_t step_start = HAL_GetTick();
+    while (!capture_drain()) {
+      if (HAL_GetTick() - step_start >= CAM_DRAIN_BUDGET_MS) {
+        return 0;
+      }
+    }
+    cap_stats.total_ms = HAL_GetTick() - cap.started;
+    if (cap_stats.total_ms > cap_stats.max_total_ms) {
+      cap_stats.max_total_ms = cap_stats.total_ms;
+    }
+    cap_stats.captures++;
+    TRACE(LOG_INFO, "[CAM] capture %lu done in %lu ms\r\n",
+          (unsigned long)cap_stats.captures, (unsigned long)cap_stats.total_ms);
+    cap.state = CAM_CAPTURE_DONE;
+    return 1;
+  }
+
+  case CAM_CAPTURE_DONE:
+    cap.state = CAM_CAPTURE_IDLE;
+    return 0;
+
+  default:
+    return 0;
+  }
+}
+
+void SingleCapStream_YCbCr(uint16_t x, uint16_t y, uint8_t scale) {
+  if (!cam_capture_start(x, y, scale)) {
+    return;
+  }
+  while (!cam_capture_step()) {
+    if (cap.state == CAM_CAPTURE_WAIT) {
+      HAL_Delay(1);
+    }
+  }
+}
+
+/********/
+// CONTINUOUS PREVIEW
+/*******/
+// Two frame buffers: the ArduCHIP FIFO and camera_buf. A frame done in the
+// FIFO is copied into camera_buf as it came, the next capture is triggered
+// straight away, and while that one exposes camera_buf goes to the TFT a
+// batch of lines at a time. A frame that is done before camera_buf has gone
+// out waits in the FIFO. With the camera on a bus of its own each batch is
+// drawn as soon as its rows are in, the rest of the frame arriving
+// meanwhile. Each step spends at most CAM_DRAIN_BUDGET_MS on the bus and
+// shares the capture's trigger and CAP_DONE polling.
+typedef enum {
+  PV_FIFO_IDLE,     // nothing triggered
+  PV_FIFO_EXPOSING, // triggered, CAP_DONE polled
+  PV_FIFO_FULL,     // frame done, camera_buf still going out
+  PV_FIFO_READING,  // being copied into camera_buf
+} PreviewFifo;
+
+static struct {
+  uint8_t on, scale;
+  uint16_t x, y;
+  uint32_t interval_ms;
+  uint32_t triggers;
+  uint32_t last_trigger;
+  // the frame in the FIFO
+  PreviewFifo fifo;
+  uint32_t fifo_trigger, fifo_done; // ticks at trigger and CAP_DONE
+  uint32_t length, read;            // bytes, and copied so far
+  // the frame in camera_buf
+  uint8_t ram_full;
+  uint16_t w, h, line; // pixels, rows, bytes per row as captured
+  uint16_t avail;      // rows copied in so far
+  uint16_t row;        // next row to draw
+  uint32_t ram_trigger, ram_done;
+  uint32_t first_shown, last_shown;
+} pv;
+
+static CamPreviewStats pv_stats;
+
+uint8_t cam_preview_start(uint16_t x, uint16_t y, uint8_t scale,
+                          uint32_t interval_ms) {
+  if (cap.state == CAM_CAPTURE_START || cap.state == CAM_CAPTURE_WAIT ||
+      cap.state == CAM_CAPTURE_DRAIN) {
+    return 0;
+  }
+  if (cam_preview_running()) {
+    // restarting would drop a FIFO read that is still open
+    log_printf(LOG_ERR, "[CAM][ERR] preview already running\r\n");
+    return 0;
+  }
+  if (cam_fmt == CAM_FMT_JPEG) {
+    log_printf(LOG_ERR, "[CAM][ERR] no preview in JPEG format\r\n");
+    return 0;
+  }
+  memset(&pv, 0, sizeof(pv));
+  memset(&pv_stats, 0, sizeof(pv_stats));
+  pv.x = x;
+  pv.y = y;
+  pv.scale = scale ? scale : 1;
+  pv.interval_ms = interval_ms;
+  pv.on = 1;
+  return 1;
+}
+
+void cam_preview_stop(void) {
+  if (pv.on && pv.fifo == PV_FIFO_READING) {
+    cam_fifo_close();
+  }
+  pv.on = 0; // a capture still exposing is flushed by the next trigger
+}
+
+uint8_t cam_preview_running(void) { return pv.on; }
+
+const CamPreviewStats *cam_preview_stats(void) { return &pv_stats; }
+
+// Whole lines of the frame CAP_DONE reported, copied into camera_buf from
+// here on; camera_buf is this frame's until its last row is drawn
+static void preview_open(void) {
+  uint32_t line = (uint32_t)cam_out_w * cam_bytes_per_pixel();
+  uint32_t length = read_fifo_length();
+  if (length > line * cam_out_h)
+    length = line * cam_out_h;
+  pv.w = cam_out_w;
+  pv.line = (uint16_t)line;
+  pv.length = length - length % line;
+  pv.read = 0;
+  pv.h = (uint16_t)(pv.length / line);
+  pv.avail = pv.row = 0;
+  pv.ram_trigger = pv.fifo_trigger;
+  pv.ram_done = pv.fifo_done;
+  pv.ram_full = 1;
+  cam_fifo_open(pv.length, CAM_FIFO_CHUNK);
+  pv.fifo = PV_FIFO_READING;
+}
+
+// One FIFO chunk into camera_buf; at the end the FIFO is free for the next
+// frame
+static void preview_read(void) {
+  uint16_t n;
+  const uint8_t *chunk =
+      pv.read < pv.length ? cam_fifo_read(&n) : NULL;
+  if (chunk) {
+    memcpy(camera_buf + pv.read, chunk, n);
+    pv.read += n;
+    pv.avail = (uint16_t)(pv.read / pv.line);
+    return;
+  }
+  cam_fifo_close();
+  pv.h = pv.avail; // a short FIFO shows what arrived
+  if (!pv.h) {
+    pv.ram_full = 0;
+    log_printf(LOG_ERR, "[CAM][ERR] preview frame empty\r\n");
+  }
+  pv.fifo = PV_FIFO_IDLE;
+}
+
+// The rows of the next TFT batch are in camera_buf: a whole batch, or the
+// rest of the frame
+static uint8_t preview_batch_ready(void) {
+  uint32_t end = pv.row + (uint32_t)CAM_STREAM_RING_LINES * pv.scale;
+  return pv.row < pv.avail && pv.avail >= (end < pv.h ? end : pv.h);
+}
+
+// One batch of camera_buf rows to the TFT; 1 once the frame is all out.
+// RGB565 at full size goes out of camera_buf as it is.
+static uint8_t preview_draw(void) {
+  uint8_t scale = pv.scale;
+  uint16_t dest_w = (pv.w + scale - 1) / scale;
+  uint8_t direct = cam_fmt == CAM_FMT_RGB565 && scale == 1;
+  uint16_t first = pv.row;
+  uint8_t lines = 0;
+  while (lines < CAM_STREAM_RING_LINES && pv.row < pv.avail) {
+    if (!direct) {
+      raw_to_rgb565(camera_buf + (uint32_t)pv.row * pv.line,
+                    stream_ring + (uint32_t)lines * dest_w * 2, pv.w, scale);
+    }
+    lines++;
+    pv.row += scale;
+  }
+  if (lines) {
+    TFT_DrawRGB565Buffer(pv.x, pv.y + first / scale, dest_w, lines,
+                         direct ? camera_buf + (uint32_t)first * pv.line
+                                : stream_ring,
+                         1);
+  }
+  return pv.row >= pv.h && pv.fifo != PV_FIFO_READING;
+}
+
+static void preview_shown(void) {
+  uint32_t now = HAL_GetTick();
+  pv.ram_full = 0;
+  pv_stats.frames++;
+  pv_stats.latency_ms = now - pv.ram_trigger;
+  pv_stats.done_to_shown_ms = now - pv.ram_done;
+  if (pv_stats.latency_ms > pv_stats.max_latency_ms) {
+    pv_stats.max_latency_ms = pv_stats.latency_ms;
+  }
+  if (pv_stats.frames == 1) {
+    pv.first_shown = now;
+  } else {
+    pv_stats.frame_ms = now - pv.last_shown;
+    pv_stats.fps_x10 =
+        (pv_stats.frames - 1) * 10000u / (now - pv.first_shown);
+  }
+  pv.last_shown = now;
+  TRACE(LOG_INFO, "[CAM] preview frame %lu, %lu ms after its trigger\r\n",
+        (unsigned long)pv_stats.frames, (unsigned long)pv_stats.latency_ms);
+}
+
+uint8_t cam_preview_step(void) {
+  if (!pv.on) {
+    return 0;
+  }
+  uint32_t start = HAL_GetTick();
+  uint8_t shown = 0;
+  while (!shown) {
+    // Keep a frame filling: trigger as soon as the FIFO is free and due
+    if (pv.fifo == PV_FIFO_IDLE &&
+        (!pv.triggers || HAL_GetTick() - pv.last_trigger >= pv.interval_ms)) {
+      capture_trigger();
+      pv.fifo_trigger = pv.last_trigger = cap.started;
+      pv.triggers++;
+      pv.fifo = PV_FIFO_EXPOSING;
+    }
+    if (pv.fifo == PV_FIFO_EXPOSING && capture_poll()) {
+      pv.fifo_done = HAL_GetTick();
+      pv.fifo = PV_FIFO_FULL;
+    }
+    if (pv.fifo == PV_FIFO_FULL && !pv.ram_full) {
+      preview_open();
+    }
+
+    // On a shared bus the frame is all in before the TFT gets the bus
+    if (pv.fifo == PV_FIFO_READING &&
+        (spi_bus_shared(SPI_DEV_CAMERA) || !preview_batch_ready())) {
+      preview_read();
+    } else if (pv.ram_full) {
+      if (preview_draw()) {
+        preview_shown();
+        shown = 1;
+      }
+    } else {
+      break; // exposing, nothing to move
+    }
+    if (HAL_GetTick() - start >= CAM_DRAIN_BUDGET_MS) {
+      break;
+    }
+  }
+  if (pv.fifo == PV_FIFO_READING) {
+    fifo_yield();
+  }
+  uint32_t took = HAL_GetTick() - start;
+  if (took > pv_stats.max_step_ms) {
+    pv_stats.max_step_ms = took;
+  }
+  return shown;
+}
+
+/********/
+// JPEG
+/*******/
+// Only the compressed length comes out of the FIFO, straight into the
+// decoder; each strip goes to the TFT with the burst paused if they share a
+// bus, the chunk the decoder is in the middle of stays valid meanwhile
+static uint16_t jpeg_x, jpeg_y;
+
+static void jpeg_strip(uint16_t y, uint16_t w, uint16_t h,
+                       const uint8_t *rgb565) {
+  fifo_yield();
+  TFT_DrawRGB565Buffer(jpeg_x, jpeg_y + y, w, h, rgb565, 1);
+}
+
+JpegDecResult SingleCapJpeg(uint16_t x, uint16_t y, uint16_t max_w,
+                            uint16_t max_h, JpegDecInfo *info) {
+  if (cam_fmt != CAM_FMT_JPEG) {
+    log_printf(LOG_ERR, "[CAM][ERR] not in JPEG format\r\n");
+    return JPEGDEC_ERR_UNSUPPORTED;
+  }
+  capture_frame(0);
+
+  uint32_t length = read_fifo_length();
+  if (!length || length >= CAM_JPEG_FIFO_MAX) {
+    log_printf(LOG_ERR, "[CAM][ERR] JPEG FIFO length %lu\r\n",
+               (unsigned long)length);
+    return JPEGDEC_ERR_INPUT;
+  }
+
+  jpeg_x = x;
+  jpeg_y = y;
+  cam_fifo_open(length, CAM_FIFO_CHUNK);
+  JpegDecResult r = jpegdec_decode(cam_fifo_read, max_w, max_h, jpeg_strip,
+                                   info);
+  cam_fifo_close();
+  if (r != JPEGDEC_OK) {
+    log_printf(LOG_ERR, "[CAM][ERR] JPEG decode failed (%d), %lu bytes\r\n",
+               (int)r, (unsigned long)length);
+  } else {
+    TRACE(LOG_INFO, "[CAM] JPEG %lu bytes\r\n", (unsigned long)length);
+  }
+  return r;
+}
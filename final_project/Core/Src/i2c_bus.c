@@ -0,0 +1,228 @@
+/*
+ * i2c_bus.c
+ *
+ * See i2c_bus.h. The queue is a singly linked list of caller-owned jobs,
+ * at most one of them on the wire and any number parked in their gaps.
+ * Main context only touches it with interrupts masked. The I2C interrupts
+ * and SysTick share one priority, so they never preempt each other.
+ */
+
+#include "i2c_bus.h"
+
+#include <stddef.h>
+
+static I2C_HandleTypeDef *bus;
+static I2cJob *head, *tail; // unfinished jobs, in submission order
+static I2cJob *current;     // the one on the wire
+static uint8_t depth;
+static I2cBusStats stats;
+
+static uint16_t timeout_of(const I2cJob *j) {
+  return j->timeout_ms ? j->timeout_ms : I2C_BUS_TIMEOUT_MS;
+}
+
+static void unlink(I2cJob *j) {
+  I2cJob *prev = NULL;
+  for (I2cJob *p = head; p != j; p = p->next) {
+    prev = p;
+  }
+  if (prev) {
+    prev->next = j->next;
+  } else {
+    head = j->next;
+  }
+  if (tail == j) {
+    tail = prev;
+  }
+  j->next = NULL;
+}
+
+// Takes the job off the queue and reports it
+static void complete(I2cJob *j, I2cJobStatus st) {
+  unlink(j);
+  if (current == j) {
+    current = NULL;
+  }
+  depth--;
+
+  uint32_t waited = HAL_GetTick() - j->queued_ms;
+  stats.jobs++;
+  if (st == I2C_JOB_NACK) {
+    stats.nacks++;
+  } else if (st == I2C_JOB_TIMEOUT) {
+    stats.timeouts++;
+  }
+  if (waited > stats.max_wait_ms) {
+    stats.max_wait_ms = waited;
+  }
+  j->status = st;
+  if (j->done) {
+    j->done(j);
+  }
+}
+
+// Puts the job on the wire; on refusal it fails and the bus stays free
+static void transfer(I2cJob *j, I2cJobStatus phase) {
+  HAL_StatusTypeDef st;
+  current = j;
+  j->status = phase;
+  j->phase_ms = HAL_GetTick();
+  if (phase == I2C_JOB_WRITE) {
+    st = HAL_I2C_Master_Transmit_IT(bus, j->addr, (uint8_t *)j->tx,
+                                    j->tx_len);
+  } else {
+    st = HAL_I2C_Master_Receive_IT(bus, j->addr, j->rx, j->rx_len);
+  }
+  if (st != HAL_OK) {
+    complete(j, I2C_JOB_ERROR);
+  }
+}
+
+static void park(I2cJob *j) {
+  j->status = I2C_JOB_GAP;
+  j->phase_ms = HAL_GetTick();
+}
+
+static void read_or_finish(I2cJob *j) {
+  if (j->rx_len) {
+    transfer(j, I2C_JOB_READ);
+  } else {
+    complete(j, I2C_JOB_OK);
+  }
+}
+
+// A queued job may start once no earlier job holds its device
+static uint8_t device_free(const I2cJob *j) {
+  for (const I2cJob *p = head; p != j; p = p->next) {
+    if (p->addr == j->addr) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Hands the idle bus to the first job that can use it: one whose gap has
+// run out, or a queued one for a free device. Jobs that only park or fail
+// leave the bus idle, so keep going until something is on the wire.
+static void schedule(void) {
+  while (!current) {
+    uint32_t now = HAL_GetTick();
+    I2cJob *j = head;
+    while (j && !(j->status == I2C_JOB_GAP
+                      ? now - j->phase_ms > j->gap_ms // at least gap_ms
+                      : j->status == I2C_JOB_QUEUED && device_free(j))) {
+      j = j->next;
+    }
+    if (!j) {
+      return;
+    }
+    if (j->status == I2C_JOB_GAP) {
+      read_or_finish(j);
+    } else if (j->tx_len) {
+      transfer(j, I2C_JOB_WRITE);
+    } else if (j->gap_ms) {
+      park(j);
+    } else {
+      read_or_finish(j);
+    }
+  }
+}
+
+void i2c_bus_init(I2C_HandleTypeDef *hi2c) {
+  bus = hi2c;
+  head = tail = current = NULL;
+  depth = 0;
+  stats = (I2cBusStats){0};
+}
+
+HAL_StatusTypeDef i2c_bus_submit(I2cJob *job) {
+  if (!bus || (job->rx_len && !job->rx) || (job->tx_len && !job->tx)) {
+    return HAL_ERROR;
+  }
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (job->status != I2C_JOB_IDLE && !i2c_job_done(job)) {
+    __set_PRIMASK(primask);
+    return HAL_BUSY;
+  }
+  job->status = I2C_JOB_QUEUED;
+  job->queued_ms = HAL_GetTick();
+  job->next = NULL;
+  if (tail) {
+    tail->next = job;
+  } else {
+    head = job;
+  }
+  tail = job;
+  if (++depth > stats.max_depth) {
+    stats.max_depth = depth;
+  }
+  schedule();
+  __set_PRIMASK(primask);
+  return HAL_OK;
+}
+
+I2cJobStatus i2c_bus_wait(I2cJob *job) {
+  while (!i2c_job_done(job)) {
+    __WFI();
+  }
+  return job->status;
+}
+
+uint8_t i2c_job_done(const I2cJob *job) { return job->status >= I2C_JOB_OK; }
+
+uint8_t i2c_bus_idle(void) { return head == NULL; }
+
+const I2cBusStats *i2c_bus_stats(void) { return &stats; }
+
+void i2c_bus_tick(void) {
+  if (!bus) {
+    return;
+  }
+  if (!current) {
+    schedule(); // gaps running out
+  } else if (HAL_GetTick() - current->phase_ms > timeout_of(current)) {
+    // finished in HAL_I2C_AbortCpltCallback
+    HAL_I2C_Master_Abort_IT(bus, current->addr);
+  }
+}
+
+/********/
+// HAL callbacks
+/*******/
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  I2cJob *j = current;
+  if (hi2c != bus || !j || j->status != I2C_JOB_WRITE) {
+    return;
+  }
+  current = NULL;
+  if (j->gap_ms) {
+    park(j);
+  } else {
+    read_or_finish(j);
+  }
+  schedule();
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+  if (hi2c == bus && current && current->status == I2C_JOB_READ) {
+    complete(current, I2C_JOB_OK);
+    schedule();
+  }
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+  if (hi2c == bus && current) {
+    complete(current, HAL_I2C_GetError(hi2c) & HAL_I2C_ERROR_AF
+                          ? I2C_JOB_NACK
+                          : I2C_JOB_ERROR);
+    schedule();
+  }
+}
+
+void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c) {
+  if (hi2c == bus && current) {
+    complete(current, I2C_JOB_TIMEOUT);
+    schedule();
+  }
+}
@@ -0,0 +1,220 @@
+/*
+ * imgstream.c
+ *
+ * See imgstream.h. Packets are built in one buffer and handed to log_write
+ * whole; the log ring holds three full CHUNK packets, so the DMA drains one
+ * while the next frame line is compressed.
+ */
+
+#include "imgstream.h"
+
+#include "log.h"
+
+#include <string.h>
+
+#define PACKET_MAX (IMG_HEADER_SIZE + IMG_PAYLOAD_MAX + 4)
+
+static uint8_t packet[PACKET_MAX];
+static uint16_t seq;
+static uint16_t frame;
+static uint8_t codec;
+static uint8_t format;
+static uint32_t offset; // pixel bytes sent of the current frame
+static uint32_t frame_crc;
+static uint16_t chunks;
+static ImgStreamStats stats;
+
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+/********/
+// CRC32
+/*******/
+// Reflected 0xEDB88320, a nibble at a time: 64 bytes of table instead of 1 KB
+static const uint32_t crc_nibble[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+    0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t img_crc32(uint32_t crc, const uint8_t *data, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ crc_nibble[crc & 15];
+    crc = (crc >> 4) ^ crc_nibble[crc & 15];
+  }
+  return ~crc;
+}
+
+/********/
+// DRLE
+/*******/
+static uint16_t pixel_at(const uint8_t *in, uint32_t i) {
+  return (uint16_t)(in[2 * i] << 8 | in[2 * i + 1]);
+}
+
+// The one byte code taking prev to px, or -1 if a channel moved too far
+static int small_delta(uint16_t prev, uint16_t px) {
+  int dr = ((px >> 11) - (prev >> 11)) & 0x1f;
+  int dg = ((px >> 5) - (prev >> 5)) & 0x3f;
+  int db = (px - prev) & 0x1f;
+  // back to signed, within each field's width
+  dr = (dr + 2) & 0x1f;
+  dg = (dg + 4) & 0x3f;
+  db = (db + 2) & 0x1f;
+  if (dr > 3 || dg > 7 || db > 3) {
+    return -1;
+  }
+  return dr << 5 | dg << 2 | db;
+}
+
+uint32_t img_drle_encode(const uint8_t *in, uint32_t len, uint8_t *out,
+                         uint32_t max) {
+  uint32_t pixels = len / 2, i = 0, n = 0;
+  uint16_t prev = 0;
+  while (i < pixels) {
+    uint16_t px = pixel_at(in, i);
+    uint32_t run = 0;
+    while (i + run < pixels && run < 64 && pixel_at(in, i + run) == prev) {
+      run++;
+    }
+    if (run) {
+      if (n + 1 >= max) {
+        return 0;
+      }
+      out[n++] = (uint8_t)(0x80 | (run - 1));
+      i += run;
+      continue;
+    }
+    int code = small_delta(prev, px);
+    if (code >= 0) {
+      if (n + 1 >= max) {
+        return 0;
+      }
+      out[n++] = (uint8_t)code;
+      prev = px;
+      i++;
+      continue;
+    }
+    // literals until a pixel the other codes can take
+    uint32_t lit = 1;
+    prev = px;
+    while (i + lit < pixels && lit < 64) {
+      uint16_t next = pixel_at(in, i + lit);
+      if (next == prev || small_delta(prev, next) >= 0) {
+        break;
+      }
+      prev = next;
+      lit++;
+    }
+    if (n + 1 + 2 * lit >= max) {
+      return 0;
+    }
+    out[n++] = (uint8_t)(0xc0 | (lit - 1));
+    memcpy(out + n, in + 2 * i, 2 * lit);
+    n += 2 * lit;
+    i += lit;
+  }
+  return n;
+}
+
+/********/
+// Packets
+/*******/
+// Header and CRC around the payload already in place, then into the ring
+static void queue(ImgPacketType type, uint16_t payload_len) {
+  packet[0] = IMG_SYNC0;
+  packet[1] = IMG_SYNC1;
+  packet[2] = (uint8_t)type;
+  packet[3] = 0;
+  put16(packet + 4, seq++);
+  put16(packet + 6, frame);
+  put16(packet + 8, payload_len);
+  uint32_t len = IMG_HEADER_SIZE + payload_len;
+  put32(packet + len, img_crc32(0, packet + 2, len - 2));
+  len += 4;
+
+  // LOG_ERR so the level filter passes it; an interrupt may take the room
+  // between the wait and the write, in which case the packet waits again
+  while (log_wait_room(len)) {
+    if (log_write(LOG_ERR, (const char *)packet, len)) {
+      stats.packets++;
+      stats.wire_bytes += len;
+      return;
+    }
+    stats.retries++;
+  }
+}
+
+void imgstream_begin(uint16_t width, uint16_t height, ImgFormat fmt,
+                     ImgCodec c) {
+  frame++;
+  format = (uint8_t)fmt;
+  codec = fmt == IMG_RGB565 ? (uint8_t)c : IMG_CODEC_RAW;
+  offset = 0;
+  frame_crc = 0;
+  chunks = 0;
+
+  uint8_t *p = packet + IMG_HEADER_SIZE;
+  put16(p, width);
+  put16(p + 2, height);
+  p[4] = format;
+  p[5] = codec;
+  put16(p + 6, IMGSTREAM_CHUNK_MAX);
+  put32(p + 8, (uint32_t)width * height * 2);
+  queue(IMG_BEGIN, 12);
+}
+
+void imgstream_write(const uint8_t *data, uint32_t len) {
+  while (len) {
+    uint16_t n =
+        len < IMGSTREAM_CHUNK_MAX ? (uint16_t)len : IMGSTREAM_CHUNK_MAX;
+    uint8_t *p = packet + IMG_HEADER_SIZE;
+    put32(p, offset);
+    put16(p + 4, n);
+    uint32_t coded = 0;
+    if (codec == IMG_CODEC_DRLE) {
+      coded = img_drle_encode(data, n, p + 7, n);
+    }
+    if (coded) {
+      p[6] = IMG_CODEC_DRLE;
+    } else {
+      p[6] = IMG_CODEC_RAW;
+      memcpy(p + 7, data, n);
+      coded = n;
+    }
+    queue(IMG_CHUNK, (uint16_t)(7 + coded));
+
+    frame_crc = img_crc32(frame_crc, data, n);
+    offset += n;
+    chunks++;
+    stats.raw_bytes += n;
+    data += n;
+    len -= n;
+  }
+}
+
+void imgstream_end(void) {
+  uint8_t *p = packet + IMG_HEADER_SIZE;
+  put32(p, frame_crc);
+  put16(p + 4, chunks);
+  queue(IMG_END, 6);
+  stats.frames++;
+}
+
+void imgstream_send(const uint8_t *pixels, uint16_t width, uint16_t height,
+                    ImgFormat fmt, ImgCodec c) {
+  imgstream_begin(width, height, fmt, c);
+  imgstream_write(pixels, (uint32_t)width * height * 2);
+  imgstream_end();
+}
+
+const ImgStreamStats *imgstream_stats(void) { return &stats; }
@@ -0,0 +1,713 @@
+/*
+ * jpegdec.c
+ *
+ * See jpegdec.h. The decoder is a straight pass over the markers; the scan
+ * is decoded MCU by MCU into per-component sample blocks (already scaled),
+ * which are colour converted into the strip, and the strip goes out at the
+ * end of each MCU row.
+ */
+
+#include "jpegdec.h"
+
+#include <string.h>
+
+#define FAST_BITS 9 // Huffman codes up to this long take one table lookup
+#define CONST_BITS 13
+#define PASS1_BITS 2
+
+#define FIX_0_298631336 2446
+#define FIX_0_390180644 3196
+#define FIX_0_541196100 4433
+#define FIX_0_765366865 6270
+#define FIX_0_899976223 7373
+#define FIX_1_175875602 9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+
+#define DESCALE(x, n) (((x) + (1 << ((n)-1))) >> (n))
+
+typedef struct {
+  uint16_t fast[1 << FAST_BITS]; // (length << 8) | symbol, 0 if longer
+  int32_t maxcode[17];           // largest code of each length, -1 if none
+  int32_t valoff[17];            // vals index of a code, minus the code
+  uint8_t vals[256];
+  uint8_t present;
+} Huffman;
+
+typedef struct {
+  uint8_t id;
+  uint8_t h, v; // sampling factors
+  uint8_t tq;   // quantisation table
+  uint8_t td, ta;
+  int32_t pred; // DC predictor
+  uint8_t px[16 * 16]; // this MCU's samples, scaled, h * 8 / scale wide
+} Component;
+
+// Zigzag position k -> natural (row-major) index
+static const uint8_t zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static struct {
+  // input
+  JpegDecRead read;
+  const uint8_t *in;
+  uint16_t in_len, in_at;
+  uint8_t eof;
+  uint32_t bytes;
+  // entropy-coded bits, MSB first
+  uint32_t bits;
+  int8_t nbits;
+  uint8_t marker; // met inside the scan, 0 if none
+  int32_t pad;    // zero bits made up past the end of the input
+  uint8_t bad;    // a Huffman code that matched nothing
+
+  uint16_t quant[4][64]; // natural order
+  Huffman huff[2][2];    // [DC, AC][table]
+  Component comp[3];
+  uint8_t ncomp;
+  uint8_t h_max, v_max;
+  uint16_t restart_interval;
+} d;
+
+static uint8_t strip_buf[JPEGDEC_STRIP_H_MAX * JPEGDEC_OUT_W_MAX * 2];
+
+/********/
+// Input
+/*******/
+static int next_byte(void) {
+  while (d.in_at >= d.in_len) {
+    if (d.eof || !(d.in = d.read(&d.in_len))) {
+      d.eof = 1;
+      d.in_len = d.in_at = 0;
+      return -1;
+    }
+    d.in_at = 0;
+  }
+  d.bytes++;
+  return d.in[d.in_at++];
+}
+
+static int next_u16(void) {
+  int hi = next_byte(), lo = next_byte();
+  return hi < 0 || lo < 0 ? -1 : hi << 8 | lo;
+}
+
+static void skip(int n) {
+  while (n-- > 0 && next_byte() >= 0) {
+  }
+}
+
+// The next marker code, skipping anything that is not one
+static int next_marker(void) {
+  int b;
+  do {
+    while ((b = next_byte()) >= 0 && b != 0xFF) {
+    }
+    while (b == 0xFF) {
+      b = next_byte();
+    }
+  } while (b == 0x00); // a stuffed 0xFF, not a marker
+  return b;
+}
+
+/********/
+// Bits
+/*******/
+// Past a marker the scan is padded with zero bits, as libjpeg does; past
+// the end of the input too, but those are counted
+static void fill(void) {
+  while (d.nbits <= 24) {
+    int b = 0;
+    if (!d.marker) {
+      b = next_byte();
+      if (b == 0xFF) {
+        int m;
+        do {
+          m = next_byte();
+        } while (m == 0xFF);
+        if (m != 0) {
+          d.marker = (uint8_t)m;
+          b = 0;
+        }
+      }
+    }
+    if (d.eof) {
+      d.marker = 0xD9; // behave as if the image ended here
+      d.pad += 8;
+      b = 0;
+    }
+    d.bits |= (uint32_t)b << (24 - d.nbits);
+    d.nbits += 8;
+  }
+}
+
+static void consume(int n) {
+  d.bits <<= n;
+  d.nbits -= n;
+}
+
+static int decode_huffman(const Huffman *h) {
+  fill();
+  uint16_t e = h->fast[d.bits >> (32 - FAST_BITS)];
+  if (e) {
+    consume(e >> 8);
+    return e & 0xFF;
+  }
+  for (int len = FAST_BITS + 1; len <= 16; len++) {
+    int32_t code = (int32_t)(d.bits >> (32 - len));
+    if (code <= h->maxcode[len]) {
+      consume(len);
+      return h->vals[code + h->valoff[len]];
+    }
+  }
+  d.bad = 1;
+  return 0;
+}
+
+// The s-bit magnitude category value that follows a Huffman symbol
+static int32_t receive_extend(int s) {
+  if (!s) {
+    return 0;
+  }
+  fill();
+  int32_t v = (int32_t)(d.bits >> (32 - s));
+  consume(s);
+  return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+}
+
+/********/
+// Tables
+/*******/
+static JpegDecResult read_dqt(int len) {
+  while (len > 0) {
+    int pq_tq = next_byte();
+    if (pq_tq < 0) {
+      return JPEGDEC_ERR_INPUT;
+    }
+    if (pq_tq >> 4) {
+      return JPEGDEC_ERR_UNSUPPORTED; // 16-bit tables go with 12-bit data
+    }
+    uint16_t *q = d.quant[pq_tq & 3];
+    for (int k = 0; k < 64; k++) {
+      q[zigzag[k]] = (uint16_t)next_byte();
+    }
+    len -= 65;
+  }
+  return d.eof ? JPEGDEC_ERR_INPUT : JPEGDEC_OK;
+}
+
+static JpegDecResult read_dht(int len) {
+  while (len > 0) {
+    int tc_th = next_byte();
+    uint8_t counts[17];
+    int total = 0;
+    for (int l = 1; l <= 16; l++) {
+      counts[l] = (uint8_t)next_byte();
+      total += counts[l];
+    }
+    if (d.eof) {
+      return JPEGDEC_ERR_INPUT;
+    }
+    if ((tc_th >> 4) > 1 || total > 256) {
+      return JPEGDEC_ERR_DATA;
+    }
+    if ((tc_th & 15) > 1) {
+      return JPEGDEC_ERR_UNSUPPORTED; // tables 2 and 3 are not baseline
+    }
+    Huffman *h = &d.huff[tc_th >> 4][tc_th & 1];
+    for (int i = 0; i < total; i++) {
+      h->vals[i] = (uint8_t)next_byte();
+    }
+    memset(h->fast, 0, sizeof(h->fast));
+    int32_t code = 0;
+    int k = 0;
+    for (int l = 1; l <= 16; l++) {
+      h->valoff[l] = k - code;
+      for (int i = 0; i < counts[l]; i++, code++, k++) {
+        if (code >= 1 << l) {
+          return JPEGDEC_ERR_DATA; // more codes than the length can hold
+        }
+        if (l <= FAST_BITS) {
+          int shift = FAST_BITS - l;
+          for (int f = 0; f < 1 << shift; f++) {
+            h->fast[(code << shift) + f] = (uint16_t)(l << 8 | h->vals[k]);
+          }
+        }
+      }
+      h->maxcode[l] = counts[l] ? code - 1 : -1;
+      code <<= 1;
+    }
+    h->present = 1;
+    len -= 17 + total;
+  }
+  return d.eof ? JPEGDEC_ERR_INPUT : JPEGDEC_OK;
+}
+
+static JpegDecResult read_sof(JpegDecInfo *info) {
+  int p = next_byte(), height = next_u16(), width = next_u16();
+  int n = next_byte();
+  if (n < 0) {
+    return JPEGDEC_ERR_INPUT;
+  }
+  if (p != 8 || (n != 1 && n != 3)) {
+    return JPEGDEC_ERR_UNSUPPORTED;
+  }
+  if (!width || !height) {
+    return JPEGDEC_ERR_UNSUPPORTED; // height from a DNL marker
+  }
+  d.ncomp = (uint8_t)n;
+  for (int i = 0; i < n; i++) {
+    Component *c = &d.comp[i];
+    c->id = (uint8_t)next_byte();
+    int hv = next_byte();
+    c->h = (uint8_t)(hv >> 4);
+    c->v = (uint8_t)(hv & 15);
+    c->tq = (uint8_t)(next_byte() & 3);
+  }
+  if (d.eof) {
+    return JPEGDEC_ERR_INPUT;
+  }
+  if (n == 1) {
+    d.comp[0].h = d.comp[0].v = 1; // one block per MCU whatever it says
+  } else if (d.comp[0].h < 1 || d.comp[0].h > 2 || d.comp[0].v < 1 ||
+             d.comp[0].v > 2 || d.comp[1].h != 1 || d.comp[1].v != 1 ||
+             d.comp[2].h != 1 || d.comp[2].v != 1) {
+    return JPEGDEC_ERR_UNSUPPORTED;
+  }
+  d.h_max = d.comp[0].h;
+  d.v_max = d.comp[0].v;
+  info->width = (uint16_t)width;
+  info->height = (uint16_t)height;
+  info->components = (uint8_t)n;
+  info->h_max = d.h_max;
+  info->v_max = d.v_max;
+  return JPEGDEC_OK;
+}
+
+static JpegDecResult read_sos(void) {
+  int n = next_byte();
+  if (n != d.ncomp) {
+    return n < 0 ? JPEGDEC_ERR_INPUT : JPEGDEC_ERR_UNSUPPORTED;
+  }
+  for (int i = 0; i < n; i++) {
+    int id = next_byte(), t = next_byte();
+    Component *c = NULL;
+    for (int j = 0; j < d.ncomp; j++) {
+      if (d.comp[j].id == id) {
+        c = &d.comp[j];
+      }
+    }
+    if (!c || (t >> 4) > 1 || (t & 15) > 1) {
+      return d.eof ? JPEGDEC_ERR_INPUT : JPEGDEC_ERR_DATA;
+    }
+    c->td = (uint8_t)(t >> 4);
+    c->ta = (uint8_t)(t & 15);
+    if (!d.huff[0][c->td].present || !d.huff[1][c->ta].present) {
+      return JPEGDEC_ERR_DATA;
+    }
+  }
+  skip(3); // spectral selection and approximation: fixed in baseline
+  return d.eof ? JPEGDEC_ERR_INPUT : JPEGDEC_OK;
+}
+
+/********/
+// Blocks
+/*******/
+static uint8_t clamp(int32_t v) {
+  return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// libjpeg's jpeg_idct_islow: coefficients dequantised, in natural order
+static void idct_islow(const int32_t *coef, uint8_t *out) {
+  int32_t ws[64];
+  for (int col = 0; col < 8; col++) {
+    const int32_t *in = coef + col;
+    int32_t *w = ws + col;
+    if (!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56])) {
+      int32_t dc = in[0] * (1 << PASS1_BITS);
+      for (int r = 0; r < 8; r++) {
+        w[8 * r] = dc;
+      }
+      continue;
+    }
+    int32_t z2 = in[16], z3 = in[48];
+    int32_t z1 = (z2 + z3) * FIX_0_541196100;
+    int32_t tmp2 = z1 + z3 * -FIX_1_847759065;
+    int32_t tmp3 = z1 + z2 * FIX_0_765366865;
+    z2 = in[0];
+    z3 = in[32];
+    int32_t tmp0 = (z2 + z3) * (1 << CONST_BITS);
+    int32_t tmp1 = (z2 - z3) * (1 << CONST_BITS);
+    int32_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    int32_t tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+    tmp0 = in[56];
+    tmp1 = in[40];
+    tmp2 = in[24];
+    tmp3 = in[8];
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    int32_t z4 = tmp1 + tmp3;
+    int32_t z5 = (z3 + z4) * FIX_1_175875602;
+    tmp0 *= FIX_0_298631336;
+    tmp1 *= FIX_2_053119869;
+    tmp2 *= FIX_3_072711026;
+    tmp3 *= FIX_1_501321110;
+    z1 *= -FIX_0_899976223;
+    z2 *= -FIX_2_562915447;
+    z3 = z3 * -FIX_1_961570560 + z5;
+    z4 = z4 * -FIX_0_390180644 + z5;
+    tmp0 += z1 + z3;
+    tmp1 += z2 + z4;
+    tmp2 += z2 + z3;
+    tmp3 += z1 + z4;
+
+    w[0] = DESCALE(tmp10 + tmp3, CONST_BITS - PASS1_BITS);
+    w[56] = DESCALE(tmp10 - tmp3, CONST_BITS - PASS1_BITS);
+    w[8] = DESCALE(tmp11 + tmp2, CONST_BITS - PASS1_BITS);
+    w[48] = DESCALE(tmp11 - tmp2, CONST_BITS - PASS1_BITS);
+    w[16] = DESCALE(tmp12 + tmp1, CONST_BITS - PASS1_BITS);
+    w[40] = DESCALE(tmp12 - tmp1, CONST_BITS - PASS1_BITS);
+    w[24] = DESCALE(tmp13 + tmp0, CONST_BITS - PASS1_BITS);
+    w[32] = DESCALE(tmp13 - tmp0, CONST_BITS - PASS1_BITS);
+  }
+
+  for (int row = 0; row < 8; row++) {
+    const int32_t *w = ws + 8 * row;
+    uint8_t *o = out + 8 * row;
+    int32_t z2 = w[2], z3 = w[6];
+    int32_t z1 = (z2 + z3) * FIX_0_541196100;
+    int32_t tmp2 = z1 + z3 * -FIX_1_847759065;
+    int32_t tmp3 = z1 + z2 * FIX_0_765366865;
+    int32_t tmp0 = (w[0] + w[4]) * (1 << CONST_BITS);
+    int32_t tmp1 = (w[0] - w[4]) * (1 << CONST_BITS);
+    int32_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    int32_t tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+    tmp0 = w[7];
+    tmp1 = w[5];
+    tmp2 = w[3];
+    tmp3 = w[1];
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    int32_t z4 = tmp1 + tmp3;
+    int32_t z5 = (z3 + z4) * FIX_1_175875602;
+    tmp0 *= FIX_0_298631336;
+    tmp1 *= FIX_2_053119869;
+    tmp2 *= FIX_3_072711026;
+    tmp3 *= FIX_1_501321110;
+    z1 *= -FIX_0_899976223;
+    z2 *= -FIX_2_562915447;
+    z3 = z3 * -FIX_1_961570560 + z5;
+    z4 = z4 * -FIX_0_390180644 + z5;
+    tmp0 += z1 + z3;
+    tmp1 += z2 + z4;
+    tmp2 += z2 + z3;
+    tmp3 += z1 + z4;
+
+    const int n = CONST_BITS + PASS1_BITS + 3;
+    o[0] = clamp(DESCALE(tmp10 + tmp3, n) + 128);
+    o[7] = clamp(DESCALE(tmp10 - tmp3, n) + 128);
+    o[1] = clamp(DESCALE(tmp11 + tmp2, n) + 128);
+    o[6] = clamp(DESCALE(tmp11 - tmp2, n) + 128);
+    o[2] = clamp(DESCALE(tmp12 + tmp1, n) + 128);
+    o[5] = clamp(DESCALE(tmp12 - tmp1, n) + 128);
+    o[3] = clamp(DESCALE(tmp13 + tmp0, n) + 128);
+    o[4] = clamp(DESCALE(tmp13 - tmp0, n) + 128);
+  }
+}
+
+// One block of c into out (stride samples per row), 8 / scale square
+static JpegDecResult decode_block(Component *c, uint8_t scale, uint8_t *out,
+                                  uint16_t stride) {
+  const Huffman *dc = &d.huff[0][c->td], *ac = &d.huff[1][c->ta];
+  const uint16_t *q = d.quant[c->tq];
+  int32_t coef[64];
+
+  int t = decode_huffman(dc);
+  if (t > 11) {
+    return JPEGDEC_ERR_DATA;
+  }
+  c->pred += receive_extend(t);
+  int32_t dc_value = c->pred * q[0];
+
+  if (scale == 8) {
+    // the block's mean is all that is kept: step over the AC codes
+    for (int k = 1; k < 64; k++) {
+      int rs = decode_huffman(ac), s = rs & 15;
+      if (!s) {
+        if (rs != 0xF0) {
+          break;
+        }
+        k += 15;
+      } else {
+        k += rs >> 4;
+        fill();
+        consume(s);
+      }
+    }
+    *out = clamp(DESCALE(dc_value, 3) + 128);
+    return d.bad ? JPEGDEC_ERR_DATA : JPEGDEC_OK;
+  }
+
+  memset(coef, 0, sizeof(coef));
+  coef[0] = dc_value;
+  for (int k = 1; k < 64; k++) {
+    int rs = decode_huffman(ac), s = rs & 15;
+    if (!s) {
+      if (rs != 0xF0) {
+        break;
+      }
+      k += 15;
+      continue;
+    }
+    k += rs >> 4;
+    if (k > 63) {
+      return JPEGDEC_ERR_DATA;
+    }
+    coef[zigzag[k]] = receive_extend(s) * q[zigzag[k]];
+  }
+  if (d.bad) {
+    return JPEGDEC_ERR_DATA;
+  }
+
+  uint8_t px[64];
+  idct_islow(coef, px);
+  if (scale == 1) {
+    for (int r = 0; r < 8; r++) {
+      memcpy(out + r * stride, px + r * 8, 8);
+    }
+    return JPEGDEC_OK;
+  }
+  // average scale x scale squares
+  uint8_t n = 8 / scale, area = scale * scale;
+  for (uint8_t y = 0; y < n; y++) {
+    for (uint8_t x = 0; x < n; x++) {
+      uint32_t sum = area / 2;
+      for (uint8_t j = 0; j < scale; j++) {
+        for (uint8_t i = 0; i < scale; i++) {
+          sum += px[(y * scale + j) * 8 + x * scale + i];
+        }
+      }
+      out[y * stride + x] = (uint8_t)(sum / area);
+    }
+  }
+  return JPEGDEC_OK;
+}
+
+/********/
+// Colour
+/*******/
+static void put_rgb565(uint8_t *p, int32_t r, int32_t g, int32_t b) {
+  uint16_t px = (uint16_t)((clamp(r) >> 3) << 11 | (clamp(g) >> 2) << 5 |
+                           clamp(b) >> 3);
+  p[0] = (uint8_t)(px >> 8);
+  p[1] = (uint8_t)px;
+}
+
+// The MCU's samples, mw x mh scaled pixels, into the strip at column x0
+static void mcu_to_strip(uint16_t x0, uint8_t mw, uint8_t mh, uint16_t out_w,
+                         uint8_t rows) {
+  uint8_t cols = x0 + mw > out_w ? (uint8_t)(out_w - x0) : mw;
+  const Component *yc = &d.comp[0];
+  uint8_t y_stride = mw;
+  uint8_t c_stride = mw / d.h_max;
+  for (uint8_t y = 0; y < rows && y < mh; y++) {
+    uint8_t *o = strip_buf + ((uint32_t)y * out_w + x0) * 2;
+    const uint8_t *ys = yc->px + y * y_stride;
+    if (d.ncomp == 1) {
+      for (uint8_t x = 0; x < cols; x++, o += 2) {
+        put_rgb565(o, ys[x], ys[x], ys[x]);
+      }
+      continue;
+    }
+    uint8_t cy = (uint8_t)(y / d.v_max);
+    const uint8_t *cbs = d.comp[1].px + cy * c_stride;
+    const uint8_t *crs = d.comp[2].px + cy * c_stride;
+    for (uint8_t x = 0; x < cols; x++, o += 2) {
+      uint8_t cx = (uint8_t)(x / d.h_max);
+      int32_t cb = cbs[cx] - 128, cr = crs[cx] - 128;
+      int32_t l = ys[x];
+      // libjpeg's jdcolor.c fixed point, 16 fraction bits
+      int32_t r = l + ((91881 * cr + 32768) >> 16);
+      int32_t g = l + ((-22554 * cb - 46802 * cr + 32768) >> 16);
+      int32_t b = l + ((116130 * cb + 32768) >> 16);
+      put_rgb565(o, r, g, b);
+    }
+  }
+}
+
+/********/
+// Scan
+/*******/
+static JpegDecResult restart(void) {
+  if (!d.marker) {
+    int m = next_marker();
+    d.marker = (uint8_t)(m < 0 ? 0xD9 : m);
+  }
+  if (d.marker < 0xD0 || d.marker > 0xD7) {
+    return d.eof ? JPEGDEC_ERR_INPUT : JPEGDEC_ERR_DATA;
+  }
+  d.marker = 0;
+  d.bits = 0;
+  d.nbits = 0;
+  d.pad = 0;
+  for (int i = 0; i < d.ncomp; i++) {
+    d.comp[i].pred = 0;
+  }
+  return JPEGDEC_OK;
+}
+
+static JpegDecResult decode_scan(JpegDecInfo *info, JpegDecStrip strip) {
+  uint8_t s = info->scale, n = 8 / s;
+  uint8_t mw = d.h_max * n, mh = d.v_max * n;
+  uint16_t mcus_x = (info->width + 8 * d.h_max - 1) / (8 * d.h_max);
+  uint16_t mcus_y = (info->height + 8 * d.v_max - 1) / (8 * d.v_max);
+  uint16_t todo = d.restart_interval;
+
+  d.bits = 0;
+  d.nbits = 0;
+  d.marker = 0;
+  d.bad = 0;
+  for (int i = 0; i < d.ncomp; i++) {
+    d.comp[i].pred = 0;
+  }
+  for (uint16_t my = 0; my < mcus_y; my++) {
+    uint16_t top = my * mh;
+    uint8_t rows = top + mh > info->out_h ? (uint8_t)(info->out_h - top) : mh;
+    for (uint16_t mx = 0; mx < mcus_x; mx++) {
+      if (d.restart_interval) {
+        if (!todo) {
+          JpegDecResult r = restart();
+          if (r != JPEGDEC_OK) {
+            return r;
+          }
+          todo = d.restart_interval;
+        }
+        todo--;
+      }
+      for (int i = 0; i < d.ncomp; i++) {
+        Component *c = &d.comp[i];
+        uint8_t stride = c->h * n;
+        for (uint8_t by = 0; by < c->v; by++) {
+          for (uint8_t bx = 0; bx < c->h; bx++) {
+            JpegDecResult r =
+                decode_block(c, s, c->px + by * n * stride + bx * n, stride);
+            if (r != JPEGDEC_OK) {
+              return r;
+            }
+          }
+        }
+      }
+      if (d.pad > d.nbits) {
+        return JPEGDEC_ERR_INPUT; // decoded from made-up bits
+      }
+      info->mcus++;
+      mcu_to_strip(mx * mw, mw, mh, info->out_w, rows);
+    }
+    info->bytes = d.bytes;
+    strip(top, info->out_w, rows, strip_buf);
+  }
+  return JPEGDEC_OK;
+}
+
+/********/
+// Markers
+/*******/
+JpegDecResult jpegdec_decode(JpegDecRead read, uint16_t max_w, uint16_t max_h,
+                             JpegDecStrip strip, JpegDecInfo *info) {
+  JpegDecInfo local;
+  if (!info) {
+    info = &local;
+  }
+  memset(info, 0, sizeof(*info));
+  memset(&d, 0, sizeof(d));
+  d.read = read;
+  if (max_w > JPEGDEC_OUT_W_MAX) {
+    max_w = JPEGDEC_OUT_W_MAX;
+  }
+
+  if (next_byte() != 0xFF || next_byte() != 0xD8) {
+    return d.eof ? JPEGDEC_ERR_INPUT : JPEGDEC_ERR_DATA;
+  }
+  uint8_t have_frame = 0;
+  for (;;) {
+    int m = next_marker();
+    if (m < 0) {
+      return JPEGDEC_ERR_INPUT;
+    }
+    if (m == 0xD9) {
+      return JPEGDEC_ERR_DATA; // ended without a scan
+    }
+    if (m == 0x01 || (m >= 0xD0 && m <= 0xD7)) {
+      continue; // no length
+    }
+    int len = next_u16() - 2;
+    if (len < 0) {
+      return d.eof ? JPEGDEC_ERR_INPUT : JPEGDEC_ERR_DATA;
+    }
+    JpegDecResult r = JPEGDEC_OK;
+    switch (m) {
+    case 0xC0: // baseline
+    case 0xC1: // extended, Huffman: the same for 8-bit samples
+      r = read_sof(info);
+      have_frame = 1;
+      break;
+    case 0xC4:
+      r = read_dht(len);
+      break;
+    case 0xDB:
+      r = read_dqt(len);
+      break;
+    case 0xDD:
+      d.restart_interval = (uint16_t)next_u16();
+      info->restart_interval = d.restart_interval;
+      skip(len - 2);
+      break;
+    case 0xDA:
+      if (!have_frame) {
+        return JPEGDEC_ERR_DATA;
+      }
+      r = read_sos();
+      if (r != JPEGDEC_OK) {
+        return r;
+      }
+      {
+        uint8_t s = 1;
+        while (s < 8 && ((info->width + s - 1) / s > max_w ||
+                         (info->height + s - 1) / s > max_h)) {
+          s *= 2;
+        }
+        info->scale = s;
+        info->out_w = (uint16_t)((info->width + s - 1) / s);
+        info->out_h = (uint16_t)((info->height + s - 1) / s);
+        if (info->out_w > max_w || info->out_h > max_h) {
+          return JPEGDEC_ERR_SIZE;
+        }
+      }
+      return decode_scan(info, strip);
+    default:
+      if ((m >= 0xC2 && m <= 0xCF) && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+        return JPEGDEC_ERR_UNSUPPORTED; // progressive, lossless, arithmetic
+      }
+      skip(len); // APPn, COM and the like
+      break;
+    }
+    if (r != JPEGDEC_OK) {
+      return r;
+    }
+    if (d.eof) {
+      return JPEGDEC_ERR_INPUT;
+    }
+  }
+}
@@ -10,14 +10,57 @@
 
 #include "stdint.h"
 
+static uint8_t power_on = 0x01;  // Power on command
+static uint8_t cont_hres = 0x10; // Continuous H-Resolution Mode
+
+static I2cJob cmd_job;
+static I2cJob read_job;
+static uint8_t data[2];
+static uint16_t *read_out;
+static I2cJobDone read_user_done;
+
+static void bh1750_command(uint32_t address, uint8_t *op) {
+    cmd_job.addr = address;
+    cmd_job.tx = op;
+    cmd_job.tx_len = 1;
+    if (i2c_bus_submit(&cmd_job) == HAL_OK) {
+        i2c_bus_wait(&cmd_job);
+    }
+}
+
 void bh1750_init(uint32_t address) {
-    I2C2_write(address, 0x01); // Power on command
+    bh1750_command(address, &power_on);
     // Set the sensor to continuous high-resolution mode
-    I2C2_write(address, 0x10); // Continuous H-Resolution Mode
+    bh1750_command(address, &cont_hres);
+}
+
+static void read_done(I2cJob *job) {
+    if (read_out) {
+        *read_out = job->status == I2C_JOB_OK ? (data[0] << 8) | data[1] : 0;
+    }
+    if (read_user_done) {
+        read_user_done(job);
+    }
+}
+
+// In continuous mode the data register always holds the latest result, so
+// a read is a single 2-byte transfer
+HAL_StatusTypeDef bh1750_start_read(uint32_t address, uint16_t *out,
+                                    I2cJobDone done) {
+    read_out = out;
+    read_user_done = done;
+    read_job.addr = address;
+    read_job.rx = data;
+    read_job.rx_len = 2;
+    read_job.done = read_done;
+    return i2c_bus_submit(&read_job);
 }
 
 uint16_t bh1750_read(uint32_t address) {
-    uint8_t data[2] = {0};
+    uint16_t value = 0;
 
-    return I2C2_read(address);
+    if (bh1750_start_read(address, &value, NULL) == HAL_OK) {
+        i2c_bus_wait(&read_job);
+    }
+    return value;
 }
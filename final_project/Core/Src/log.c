@@ -0,0 +1,173 @@
+/*
+ * log.c
+ *
+ * See log.h. The ring is tracked with free-running byte counts; a count's
+ * ring index is count & RING_MASK. Writers move `reserved`, the outermost
+ * writer moves `committed` up to it, and the DMA completion moves `sent`.
+ * tx_busy is held from the start of a transfer to its completion callback,
+ * so only one context ever programs the DMA.
+ */
+
+#include "log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RING_MASK (LOG_RING_SIZE - 1)
+
+static uint8_t ring[LOG_RING_SIZE];
+static volatile uint32_t reserved;  // claimed by writers
+static volatile uint32_t committed; // copied in, free for the DMA to send
+static volatile uint32_t sent;      // transfers completed
+static volatile uint32_t sending;   // length of the transfer in flight
+static volatile uint8_t writers;    // log_write calls on the stack
+static volatile uint8_t tx_busy;
+static UART_HandleTypeDef *uart;
+static volatile LogLevel max_level = LOG_INFO;
+static LogStats stats;
+
+static void count(volatile uint32_t *counter, uint32_t n) {
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+// Starts a transfer of what is committed and not yet sent, unless one is
+// already running; its completion comes back here for the rest
+static void kick(void) {
+  while (uart && !__atomic_exchange_n(&tx_busy, 1, __ATOMIC_ACQUIRE)) {
+    uint32_t from = sent;
+    uint32_t to = committed;
+    uint32_t len = to - from;
+    uint32_t room = LOG_RING_SIZE - (from & RING_MASK); // up to the wrap
+    if (len > room) {
+      len = room;
+    }
+    if (len) {
+      sending = len;
+      if (HAL_UART_Transmit_DMA(uart, &ring[from & RING_MASK],
+                                (uint16_t)len) == HAL_OK) {
+        count(&stats.transfers, 1);
+        return;
+      }
+    }
+    __atomic_store_n(&tx_busy, 0, __ATOMIC_RELEASE);
+    // A writer that published while the flag was held left it to us
+    if (committed == to) {
+      return;
+    }
+  }
+}
+
+// Everything claimed is copied once the outermost writer gets here: any
+// writer that preempted it ran to completion first
+static void publish(void) {
+  if (__atomic_sub_fetch(&writers, 1, __ATOMIC_RELEASE)) {
+    return;
+  }
+  uint32_t end = reserved;
+  uint32_t c = committed;
+  // a writer preempting this one may already have published further
+  while ((int32_t)(end - c) > 0 &&
+         !__atomic_compare_exchange_n(&committed, &c, end, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+}
+
+void log_init(UART_HandleTypeDef *huart) {
+  uart = huart;
+  kick();
+}
+
+void log_set_level(LogLevel level) { max_level = level; }
+
+uint8_t log_enabled(LogLevel level) { return level <= max_level; }
+
+uint8_t log_write(LogLevel level, const char *text, uint32_t len) {
+  if (level > max_level || !len) {
+    return 0;
+  }
+  __atomic_add_fetch(&writers, 1, __ATOMIC_ACQUIRE);
+
+  uint32_t start = reserved;
+  uint8_t fits;
+  do {
+    fits = start + len - sent <= LOG_RING_SIZE;
+  } while (fits && !__atomic_compare_exchange_n(&reserved, &start,
+                                                start + len, 1,
+                                                __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED));
+
+  if (fits) {
+    uint32_t at = start & RING_MASK;
+    uint32_t first = len < LOG_RING_SIZE - at ? len : LOG_RING_SIZE - at;
+    memcpy(&ring[at], text, first);
+    memcpy(ring, text + first, len - first);
+    uint32_t used = start + len - sent;
+    if (used > stats.max_used) {
+      stats.max_used = (uint16_t)used; // a racing writer may win; it is a mark
+    }
+  }
+  publish();
+
+  if (!fits) {
+    count(&stats.dropped, 1);
+    count(&stats.dropped_bytes, len);
+    return 0;
+  }
+  count(&stats.messages, 1);
+  count(&stats.bytes, len);
+  kick();
+  return 1;
+}
+
+uint8_t log_printf(LogLevel level, const char *fmt, ...) {
+  if (level > max_level) {
+    return 0;
+  }
+  char line[LOG_LINE_MAX];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (n < 0) {
+    return 0;
+  }
+  if ((uint32_t)n >= sizeof(line)) {
+    n = sizeof(line) - 1;
+    count(&stats.truncated, 1);
+  }
+  return log_write(level, line, (uint32_t)n);
+}
+
+void log_flush(void) {
+  uint32_t until = committed;
+  while (uart && (int32_t)(until - sent) > 0) {
+    kick(); // in case the last transfer was refused
+    __WFI();
+  }
+}
+
+uint8_t log_wait_room(uint32_t len) {
+  if (!uart || len > LOG_RING_SIZE) {
+    return 0;
+  }
+  while (reserved + len - sent > LOG_RING_SIZE) {
+    kick();
+    __WFI();
+  }
+  return 1;
+}
+
+const LogStats *log_stats(void) { return &stats; }
+
+/********/
+// HAL callbacks
+/*******/
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  if (huart != uart || !tx_busy) {
+    return;
+  }
+  sent += sending;
+  __atomic_store_n(&tx_busy, 0, __ATOMIC_RELEASE);
+  kick();
+}
@@ -19,6 +19,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "adc.h"
+#include "dma.h"
 #include "gpio.h"
 #include "i2c.h"
 #include "spi.h"
@@ -49,6 +50,24 @@
 #include "pump.h"
 // camera
 #include "camera.h"
+// main loop phase markers (host simulator only)
+#include "profile.h"
+// cooperative scheduler
+#include "scheduler.h"
+// dashboard widgets
+#include "widget.h"
+// I2C2 transaction queue
+#include "i2c_bus.h"
+// TFT and camera SPI wiring
+#include "spi_bus.h"
+// overlapped I2C2 sensor sweep
+#include "sensor_sweep.h"
+// LPUART1 log ring
+#include "log.h"
+// binary trace records on the log ring
+#include "trace.h"
+// overlapped device bring-up
+#include "boot.h"
 
 /* USER CODE END Includes */
 
@@ -71,9 +90,6 @@
 
 /* USER CODE BEGIN PV */
 
-// idle = 1: idle and free to receive fast interrupts
-int idle = 1;
-
 // Tamagotchi feeling: 1 happy, 0 sad
 int tamagotchi_feeling = 1;
 
@@ -91,9 +107,12 @@ void draw_screen(void);
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
 
-int __io_putchar(int ch) {
-  HAL_UART_Transmit(&hlpuart1, (uint8_t *)&ch, 1, 10);
-  return ch;
+// printf ends in newlib's _write (weak in syscalls.c): queue the text on
+// the log ring instead of sending it a byte at a time
+int _write(int file, char *ptr, int len) {
+  (void)file;
+  log_write(LOG_INFO, ptr, (uint32_t)len);
+  return len;
 }
 
 float hum_air = 0.0f;
@@ -111,31 +130,329 @@ int water_interval_days = 7;
 int wet_threshold = 800;
 int light_threshold = 1000;
 
-// Button dimensions
-int button_width = 40;
-int button_height = 30;
-
-// Water interval buttons (horizontal layout, positioned to right of camera)
-int water_interval_minus_x = 290;
-int water_interval_minus_y = 100;
-int water_interval_plus_x = 430;
-int water_interval_plus_y = 100;
-
-// Wet threshold buttons (horizontal layout)
-int wet_threshold_minus_x = 290;
-int wet_threshold_minus_y = 140;
-int wet_threshold_plus_x = 430;
-int wet_threshold_plus_y = 140;
-
-// Light threshold buttons (horizontal layout)
-int light_threshold_minus_x = 290;
-int light_threshold_minus_y = 180;
-int light_threshold_plus_x = 430;
-int light_threshold_plus_y = 180;
-
-// Water now button
-int water_now_x = 290;
-int water_now_y = 220;
+int moisture_good = 1;
+int light_good = 1;
+
+// Watering: the pump runs WATER_PUMP_MS once water_requested is set
+#define WATER_PUMP_MS 2000
+uint8_t water_requested = 0;
+static uint8_t pump_running = 0;
+static uint32_t pump_started = 0;
+
+// Live preview, frames back to back; the next one exposes while the last
+// is drawn
+#define PREVIEW_INTERVAL_MS 0
+
+// Button actions
+static void water_interval_minus(void) {
+  if (water_interval_days > 1) {
+    water_interval_days--;
+  }
+}
+static void water_interval_plus(void) { water_interval_days++; }
+static void wet_threshold_minus(void) {
+  if (wet_threshold > 100) {
+    wet_threshold -= 50;
+  }
+}
+static void wet_threshold_plus(void) { wet_threshold += 50; }
+static void light_threshold_minus(void) {
+  if (light_threshold > 100) {
+    light_threshold -= 100;
+  }
+}
+static void light_threshold_plus(void) { light_threshold += 100; }
+static void water_now(void) {
+  water_requested = 1; // the watering task runs the pump
+}
+
+// Value fields that need more than one int
+static void format_water(char *out, uint8_t size) {
+  snprintf(out, size, "Water: %s (%d)", moisture_good ? "Wet" : "Dry",
+           cap_soil);
+}
+static void format_light(char *out, uint8_t size) {
+  snprintf(out, size, "Light: %s (%d)", light_good ? "Bright" : "Dim",
+           light_value);
+}
+static void format_temp(char *out, uint8_t size) {
+  snprintf(out, size, "%d C %d F", avg_temp, avg_temp_f);
+}
+static void format_mood(char *out, uint8_t size) {
+  snprintf(out, size, "%s",
+           tamagotchi_feeling == 1 ? "Plant is happy :)" : "Plant is sad :(");
+}
+
+#define BUTTON(n, bx, by, bw, fill, caption, fn)                               \
+  {.name = n, .kind = WIDGET_BUTTON, .x = bx, .y = by, .w = bw, .h = 30,       \
+   .color = fill, .scale = 2, .text = caption, .on_press = fn}
+#define VALUE(vx, vy, vw, vh, vscale, fmt, v, fn)                              \
+  {.name = fmt, .kind = WIDGET_VALUE, .x = vx, .y = vy, .w = vw, .h = vh,      \
+   .color = COLOR_BLACK, .scale = vscale, .text = fmt, .value = v,             \
+   .format = fn}
+
+// The dashboard; the settings column sits to the right of the camera
+static Widget dashboard_widgets[] = {
+    {.name = "title", .kind = WIDGET_LABEL, .x = 50, .y = 10,
+     .color = COLOR_BLACK, .scale = 3, .text = "TAMAGOTCHI FLOWER POT"},
+    VALUE(10, 70, 300, 30, 3, "mood", NULL, format_mood),
+
+    BUTTON("Water interval minus", 290, 100, 40, COLOR_RED, "-",
+           water_interval_minus),
+    VALUE(335, 100, 70, 20, 2, "%d days", &water_interval_days, NULL),
+    BUTTON("Water interval plus", 430, 100, 40, COLOR_GREEN, "+",
+           water_interval_plus),
+    BUTTON("Wet threshold minus", 290, 140, 40, COLOR_RED, "-",
+           wet_threshold_minus),
+    VALUE(335, 140, 70, 20, 2, "W: %d", &wet_threshold, NULL),
+    BUTTON("Wet threshold plus", 430, 140, 40, COLOR_GREEN, "+",
+           wet_threshold_plus),
+    BUTTON("Light threshold minus", 290, 180, 40, COLOR_RED, "-",
+           light_threshold_minus),
+    VALUE(335, 180, 90, 20, 2, "L: %d", &light_threshold, NULL),
+    BUTTON("Light threshold plus", 430, 180, 40, COLOR_GREEN, "+",
+           light_threshold_plus),
+    BUTTON("Water now", 290, 220, 180, COLOR_GREEN, "Water", water_now),
+
+    VALUE(10, 240, 230, 20, 2, "water", NULL, format_water),
+    VALUE(10, 260, 260, 20, 2, "light", NULL, format_light),
+    VALUE(10, 280, 170, 20, 2, "Humidity: %d%%", &hum_air_int, NULL),
+    VALUE(10, 300, 150, 20, 2, "temp", NULL, format_temp),
+};
+
+static WidgetScreen dashboard;
+
+// Touch-to-action latency, INT edge to the button handled
+static struct {
+  uint32_t actions;
+  uint32_t last_us;
+  uint32_t max_us;
+  uint64_t total_us;
+} touch_stats;
+
+#define TOUCH_REPEAT_MS 200 // a held finger repeats a button this often
+
+// Scheduler clock: DWT cycles folded into microseconds, since CYCCNT itself
+// wraps every ~134 s at 32 MHz
+static uint32_t clock_us(void) {
+  static uint32_t last_cycles;
+  static uint64_t cycles;
+  uint32_t now = DWT->CYCCNT;
+  cycles += now - last_cycles;
+  last_cycles = now;
+  return (uint32_t)(cycles / (SystemCoreClock / 1000000U));
+}
+
+// One bounded preview step: a trigger, a CAP_DONE poll or up to
+// CAM_DRAIN_BUDGET_MS of FIFO reads and lines to the TFT
+static void task_camera(void) { cam_preview_step(); }
+
+// Sensor sweep: every SENSOR_PERIOD_MS one overlapped sweep of the I2C2
+// sensors runs from the bus manager's interrupts; the sensors task picks
+// the values up once the last one is in
+#define SENSOR_PERIOD_MS 1000
+static SensorReadings readings;
+static uint8_t sweep_running;
+static uint32_t sweep_started;
+
+static void sensors_update(void) {
+  hum_air = readings.air_rh;
+  temp_air = readings.air_temp_c;
+  cap_soil = readings.soil_cap;
+  temp_soil = readings.soil_temp_c;
+  light_value = readings.light;
+  hum_air_int = (int)hum_air;
+  temp_air_int = (int)temp_air;
+  temp_soil_int = (int)temp_soil;
+  avg_temp = (temp_air_int + temp_soil_int) / 2;
+  avg_temp_f = (temp_air_int + temp_soil_int) / 2 * 9 / 5 + 32;
+
+  moisture_good = 1;
+  if (cap_soil < wet_threshold) {
+    moisture_good = 0;
+  }
+
+  light_good = 1;
+  if (light_value < light_threshold) {
+    light_good = 0;
+  }
+
+  tamagotchi_feeling = light_good;
+}
+
+static void task_sensors(void) {
+  if (sweep_running) {
+    if (sensor_sweep_busy()) {
+      return;
+    }
+    sweep_running = 0;
+    sensors_update();
+  }
+  if (!sensor_sweep_stats()->sweeps ||
+      HAL_GetTick() - sweep_started >= SENSOR_PERIOD_MS) {
+    sweep_started = HAL_GetTick();
+    sweep_running = sensor_sweep_start(&readings) == HAL_OK;
+  }
+}
+
+static void task_telemetry(void) {
+  static uint32_t runs;
+  // print values of sensors, formatted on the host (Sim/ plantpot_tracedump)
+  TRACE(LOG_INFO, "AirRH: %d %%  \r\n", hum_air_int);
+  TRACE(LOG_INFO, "AirTemp: %d C \r\n", temp_air_int);
+  TRACE(LOG_INFO, "SoilCap: %u  \r\n", cap_soil);
+  TRACE(LOG_INFO, "SoilTemp: %d C\r\n", temp_soil_int);
+  TRACE(LOG_INFO, "Light: %u  \r\n", light_value);
+  if (cam_preview_running()) {
+    const CamPreviewStats *ps = cam_preview_stats();
+    TRACE(LOG_INFO,
+          "Preview: %lu.%lu fps, %lu ms latency (max %lu), %lu ms max "
+          "step\r\n",
+          (unsigned long)(ps->fps_x10 / 10), (unsigned long)(ps->fps_x10 % 10),
+          (unsigned long)ps->latency_ms, (unsigned long)ps->max_latency_ms,
+          (unsigned long)ps->max_step_ms);
+  }
+  if (++runs % 60 == 0) {
+    sched_report();
+    printf("Touch: %lu actions, avg %lu us, max %lu us, %lu dropped\r\n",
+           (unsigned long)touch_stats.actions,
+           (unsigned long)(touch_stats.actions
+                               ? touch_stats.total_us / touch_stats.actions
+                               : 0),
+           (unsigned long)touch_stats.max_us,
+           (unsigned long)TOUCH_DroppedEvents());
+    const I2cBusStats *bs = i2c_bus_stats();
+    const SensorSweepStats *ss = sensor_sweep_stats();
+    printf("I2C2: sweep %lu ms (max %lu), %lu jobs, %lu nacks, "
+           "%lu timeouts, max wait %lu ms\r\n",
+           (unsigned long)ss->last_ms, (unsigned long)ss->max_ms,
+           (unsigned long)bs->jobs,
+           (unsigned long)bs->nacks, (unsigned long)bs->timeouts,
+           (unsigned long)bs->max_wait_ms);
+    const LogStats *ls = log_stats();
+    printf("Log: %lu bytes, %lu dropped (%lu bytes), ring max %u\r\n",
+           (unsigned long)ls->bytes, (unsigned long)ls->dropped,
+           (unsigned long)ls->dropped_bytes, ls->max_used);
+    const TraceStats *ts = trace_stats();
+    printf("Trace: %lu records, %lu bytes, %lu frames, %lu lost\r\n",
+           (unsigned long)ts->records, (unsigned long)ts->bytes,
+           (unsigned long)ts->frames, (unsigned long)ts->lost);
+  }
+  trace_flush();
+}
+
+static void task_watering(void) {
+  uint32_t now = HAL_GetTick();
+  if (pump_running) {
+    if (now - pump_started >= WATER_PUMP_MS) {
+      pump_off();
+      pump_running = 0;
+    }
+    return;
+  }
+  if (water_requested) {
+    water_requested = 0;
+    pump_on();
+    pump_running = 1;
+    pump_started = now;
+  }
+}
+
+static void touch_dispatch(const TOUCH_TouchPoint *tp) {
+  Widget *w = widget_hit(&dashboard, tp->x, tp->y);
+  if (w && w->on_press) {
+    printf("%s pressed\r\n", w->name);
+    w->on_press();
+  }
+}
+
+// Drains the queued INT edges with one controller read; the oldest edge
+// dates the action
+static void task_touch(void) {
+  static uint32_t last_action;
+  TOUCH_Event e, first;
+  if (!TOUCH_PopEvent(&first)) {
+    return;
+  }
+  while (TOUCH_PopEvent(&e)) {
+  }
+
+  TOUCH_TouchPoint tp;
+  if (TOUCH_ReadTouch(&tp) != HAL_OK || !tp.touched) {
+    return;
+  }
+  uint32_t now = HAL_GetTick();
+  if (touch_stats.actions && now - last_action < TOUCH_REPEAT_MS) {
+    return;
+  }
+  last_action = now;
+  touch_dispatch(&tp);
+
+  uint32_t us = (DWT->CYCCNT - first.stamp) / (SystemCoreClock / 1000000U);
+  touch_stats.actions++;
+  touch_stats.last_us = us;
+  touch_stats.total_us += us;
+  if (us > touch_stats.max_us) {
+    touch_stats.max_us = us;
+  }
+  printf("Touch: x=%u y=%u, handled %lu us after INT\r\n", tp.x, tp.y,
+         (unsigned long)us);
+}
+
+static void task_ui(void) {
+  widget_render(&dashboard);
+  TFT_Flush();
+  PROFILE_LOOP_END(); // one profiler loop per UI frame
+}
+
+// Periods, deadlines and offsets in us; priority 0 runs first. The camera
+// tasks come last so they can be left out when the camera did not come up.
+static SchedTask tasks[] = {
+    {"touch", task_touch, 10000, 0, 0, 0},
+    {"watering", task_watering, 100000, 0, 0, 0},
+    {"ui", task_ui, 250000, 0, 0, 1},
+    {"sensors", task_sensors, 50000, 0, 0, 3},
+    {"telemetry", task_telemetry, 1000000, 0, 500000, 4},
+    {"camera", task_camera, 20000, 50000, 0, 2},
+};
+#define CAMERA_TASKS 1
+
+static uint32_t soil_probe_step(uint8_t *phase) {
+  (void)phase;
+  if (HAL_I2C_IsDeviceReady(&hi2c2, SOIL_ADDR, 3, 100) == HAL_OK) {
+    printf("Soil sensor detected\r\n");
+    return BOOT_DONE;
+  }
+  printf("Soil sensor NOT detected\r\n");
+  return BOOT_FAILED;
+}
+
+static uint32_t light_init_step(uint8_t *phase) {
+  (void)phase;
+  bh1750_init(BH1750_ADDR);
+  return BOOT_DONE;
+}
+
+// Device bring-ups, run side by side by the boot sequencer
+enum { BOOT_CAMERA, BOOT_PUMP, BOOT_TFT, BOOT_TOUCH, BOOT_SOIL, BOOT_LIGHT };
+static BootTask boot_tasks[] = {
+    [BOOT_CAMERA] = {"camera", ArduCam_InitStep_YCbCr},
+    [BOOT_PUMP] = {"pump", pump_prime_step},
+    [BOOT_TFT] = {"tft", TFT_InitStep},
+    [BOOT_TOUCH] = {"touch", TOUCH_InitStep},
+    [BOOT_SOIL] = {"soil", soil_probe_step},
+    [BOOT_LIGHT] = {"light", light_init_step},
+};
+
+static void dashboard_show(void) {
+  TFT_SetRetained(1);
+  TFT_FillScreen(COLOR_WHITE);
+  widget_screen_init(&dashboard, dashboard_widgets,
+                     sizeof(dashboard_widgets) / sizeof(dashboard_widgets[0]),
+                     COLOR_WHITE);
+  widget_render(&dashboard);
+  TFT_Flush();
+}
 /* USER CODE END 0 */
 
 /**
@@ -170,6 +487,7 @@ int main(void) {
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_ADC1_Init();
   MX_SPI1_Init();
   MX_SPI2_Init();
@@ -186,29 +504,22 @@ int main(void) {
   MX_USB_OTG_FS_USB_Init();
   /* USER CODE BEGIN 2 */
 
-  ArduCam_Init_YCbCr();
+  // Cycle counter for touch stamps, trace records and the scheduler clock;
+  // running before anything can stamp with it, and never reset
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
-  printf("Hello from Nucleo-L4R5ZI-P!\r\n");
-  // pump
-  pump_init();
+  // printf output from here on leaves through LPUART1 TX DMA
+  log_init(&hlpuart1);
 
-  // screen
-  TFT_Init();
+  printf("Hello from Nucleo-L4R5ZI-P!\r\n");
 
-  if (HAL_I2C_IsDeviceReady(&hi2c2, SOIL_ADDR, 3, 100) == HAL_OK)
-    printf("Soil sensor detected\r\n");
-  else
-    printf("Soil sensor NOT detected\r\n");
-
-  if (TOUCH_Init() != HAL_OK) {
-    printf("Touch controller init FAILED\r\n");
-  } else {
-    printf("Touch controller init OK\r\n");
-  }
+  // sensor drivers queue their transfers on I2C2
+  i2c_bus_init(&hi2c2);
+  // TFT and camera on the SPI buses the board config wires them to
+  spi_bus_init();
 
   uint16_t read_value = 0;
-  // initialize
-  bh1750_init(BH1750_ADDR);
 
   hum_air = 0.0f;
   temp_air = 0.0f;
@@ -216,9 +527,45 @@ int main(void) {
   temp_soil = 0.0f;
   light_value = 0;
 
-  TFT_FillScreen(COLOR_WHITE);
+  // Camera, pump, screen and sensors come up side by side: the pump primes
+  // while the camera loads its tables and the TFT wakes. The dashboard goes
+  // up as soon as the TFT is ready; the rest finish behind it.
+  uint8_t dashboard_up = 0;
+  boot_start(boot_tasks, sizeof(boot_tasks) / sizeof(boot_tasks[0]));
+  while (boot_poll()) {
+    if (!dashboard_up && boot_tasks[BOOT_TFT].status == BOOT_OK) {
+      dashboard_show();
+      dashboard_up = 1;
+    }
+    __WFI();
+  }
+  if (!dashboard_up) {
+    dashboard_show();
+  }
+  boot_report();
 
-  int photo_cycle = 0;
+  if (boot_tasks[BOOT_TOUCH].status != BOOT_OK) {
+    printf("Touch controller init FAILED\r\n");
+  } else {
+    printf("Touch controller init OK\r\n");
+  }
+
+  uint8_t task_count = sizeof(tasks) / sizeof(tasks[0]);
+  if (boot_tasks[BOOT_CAMERA].status == BOOT_OK) {
+    // the preview is shown at 160x120: have the ISP scale it, not the MCU
+    cam_set_output_size(CAM_FRAME_W / 2, CAM_FRAME_H / 2);
+    // and let it do the colour conversion too: RGB565 goes to the TFT as is
+    cam_set_format(CAM_FMT_RGB565);
+    cam_preview_start(20, 100, 1, PREVIEW_INTERVAL_MS);
+  } else {
+    task_count -= CAMERA_TASKS;
+  }
+
+  // Taps during boot landed on a screen that was not up yet: not presses
+  TOUCH_Event boot_tap;
+  while (TOUCH_PopEvent(&boot_tap)) {
+  }
+  sched_init(tasks, task_count, clock_us);
 
   /* USER CODE END 2 */
 
@@ -229,157 +576,10 @@ int main(void) {
 
     /* USER CODE BEGIN 3 */
 
-    // Take a photo and draw it every 10 cycles
-    if (photo_cycle <= 0) {
-      SingleCapTransfer_YCbCr(0, 0, camera_buf);
-      TFT_DrawRGB888Buffer(20, 100, 320, 240, camera_buf, 2);
-      photo_cycle = 10;
-    } else {
-      photo_cycle--;
-    }
-
-    hum_air = si7021_read_humidity();
-    temp_air = si7021_read_temperature();
-
-    // Read soil sensor
-    cap_soil = soil_read_capacitance();
-    temp_soil = soil_read_temperature();
-    hum_air_int = (int)hum_air;
-    temp_air_int = (int)temp_air;
-    temp_soil_int = (int)temp_soil;
-    avg_temp = (temp_air_int + temp_soil_int) / 2;
-    avg_temp_f = (temp_air_int + temp_soil_int) / 2 * 9 / 5 + 32;
-
-    light_value = bh1750_read(BH1750_ADDR);
-
-    // print values of sensors
-    printf("AirRH: %d %%  \r\n", hum_air_int);
-    printf("AirTemp: %d C \r\n", temp_air_int);
-    printf("SoilCap: %u  \r\n", cap_soil);
-    printf("SoilTemp: %d C\r\n", temp_soil_int);
-    printf("Light: %u  \r\n", light_value);
-
-    int moisture_good = 1;
-    if (cap_soil < wet_threshold) {
-      moisture_good = 0;
-    }
-
-    int light_good = 1;
-    if (light_value < light_threshold) {
-      light_good = 0;
-    }
-
-    TFT_PrintfAt(50, 10, COLOR_BLACK, 3, "TAMAGOTCHI FLOWER POT");
-
-    TFT_FillRect(90, 240, 150, 20, COLOR_WHITE);
-    if (moisture_good) {
-      TFT_PrintfAt(10, 240, COLOR_BLACK, 2, "Water: Wet (%d) \r\n", cap_soil);
-    } else {
-      TFT_PrintfAt(10, 240, COLOR_BLACK, 2, "Water: Dry (%d) \r\n", cap_soil);
-    }
-
-    TFT_FillRect(90, 260, 180, 20, COLOR_WHITE);
-    if (light_good) {
-      TFT_PrintfAt(10, 260, COLOR_BLACK, 2, "Light: Bright (%d) \r\n",
-                   light_value);
-    } else {
-      TFT_PrintfAt(10, 260, COLOR_BLACK, 2, "Light: Dim (%d) \r\n",
-                   light_value);
-    }
-
-    TFT_FillRect(120, 280, 60, 20, COLOR_WHITE);
-    TFT_PrintfAt(10, 280, COLOR_BLACK, 2, "Humidity: %d%% \r\n", hum_air_int);
-
-    TFT_FillRect(10, 300, 150, 20, COLOR_WHITE);
-    TFT_PrintfAt(10, 300, COLOR_BLACK, 2, "%d C %d F \r\n", avg_temp,
-                 avg_temp_f);
-
-    // Draw all buttons
-    // Water interval buttons
-    TFT_FillRect(water_interval_minus_x - 1, water_interval_minus_y - 1,
-                 button_width + 2, button_height + 2, COLOR_BLACK);
-    TFT_FillRect(water_interval_minus_x, water_interval_minus_y, button_width,
-                 button_height, COLOR_RED);
-    TFT_PrintfAt(water_interval_minus_x + 15, water_interval_minus_y + 8,
-                 COLOR_BLACK, 2, "-");
-
-    TFT_FillRect(water_interval_plus_x - 1, water_interval_plus_y - 1,
-                 button_width + 2, button_height + 2, COLOR_BLACK);
-    TFT_FillRect(water_interval_plus_x, water_interval_plus_y, button_width,
-                 button_height, COLOR_GREEN);
-    TFT_PrintfAt(water_interval_plus_x + 15, water_interval_plus_y + 8,
-                 COLOR_BLACK, 2, "+");
-
-    // Draw label for water interval
-    TFT_FillRect(water_interval_minus_x + button_width + 5,
-                 water_interval_minus_y, 70, 20, COLOR_WHITE);
-    TFT_PrintfAt(water_interval_minus_x + button_width + 5,
-                 water_interval_minus_y, COLOR_BLACK, 2, "%d days",
-                 water_interval_days);
-
-    // Wet threshold buttons
-    TFT_FillRect(wet_threshold_minus_x - 1, wet_threshold_minus_y - 1,
-                 button_width + 2, button_height + 2, COLOR_BLACK);
-    TFT_FillRect(wet_threshold_minus_x, wet_threshold_minus_y, button_width,
-                 button_height, COLOR_RED);
-    TFT_PrintfAt(wet_threshold_minus_x + 15, wet_threshold_minus_y + 8,
-                 COLOR_BLACK, 2, "-");
-
-    TFT_FillRect(wet_threshold_plus_x - 1, wet_threshold_plus_y - 1,
-                 button_width + 2, button_height + 2, COLOR_BLACK);
-    TFT_FillRect(wet_threshold_plus_x, wet_threshold_plus_y, button_width,
-                 button_height, COLOR_GREEN);
-    TFT_PrintfAt(wet_threshold_plus_x + 15, wet_threshold_plus_y + 8,
-                 COLOR_BLACK, 2, "+");
-
-    // Draw label for wet threshold
-    TFT_FillRect(wet_threshold_minus_x + button_width + 5,
-                 wet_threshold_minus_y, 70, 20, COLOR_WHITE);
-    TFT_PrintfAt(wet_threshold_minus_x + button_width + 5,
-                 wet_threshold_minus_y, COLOR_BLACK, 2, "W: %d", wet_threshold);
-
-    // Light threshold buttons
-    TFT_FillRect(light_threshold_minus_x - 1, light_threshold_minus_y - 1,
-                 button_width + 2, button_height + 2, COLOR_BLACK);
-    TFT_FillRect(light_threshold_minus_x, light_threshold_minus_y, button_width,
-                 button_height, COLOR_RED);
-    TFT_PrintfAt(light_threshold_minus_x + 15, light_threshold_minus_y + 8,
-                 COLOR_BLACK, 2, "-");
-
-    TFT_FillRect(light_threshold_plus_x - 1, light_threshold_plus_y - 1,
-                 button_width + 2, button_height + 2, COLOR_BLACK);
-    TFT_FillRect(light_threshold_plus_x, light_threshold_plus_y, button_width,
-                 button_height, COLOR_GREEN);
-    TFT_PrintfAt(light_threshold_plus_x + 15, light_threshold_plus_y + 8,
-                 COLOR_BLACK, 2, "+");
-
-    // Draw label for light threshold
-    TFT_FillRect(light_threshold_minus_x + button_width + 5,
-                 light_threshold_minus_y, 90, 20, COLOR_WHITE);
-    TFT_PrintfAt(light_threshold_minus_x + button_width + 5,
-                 light_threshold_minus_y, COLOR_BLACK, 2, "L: %d",
-                 light_threshold);
-
-    // Water now button (spans from left of - button to right of + button)
-    int water_button_width =
-        (water_interval_plus_x + button_width) - water_now_x;
-    TFT_FillRect(water_now_x - 1, water_now_y - 1, water_button_width + 2,
-                 button_height + 2, COLOR_BLACK);
-    TFT_FillRect(water_now_x, water_now_y, water_button_width, button_height,
-                 COLOR_GREEN);
-    TFT_PrintfAt(water_now_x + (water_button_width / 2) - 35, water_now_y + 6,
-                 COLOR_BLACK, 2, "Water");
-
-    tamagotchi_feeling = 0;
-    if (light_good) {
-      tamagotchi_feeling = 1;
-    }
-
-    TFT_FillRect(10, 70, 300, 30, COLOR_WHITE);
-    if (tamagotchi_feeling == 1) {
-      TFT_PrintfAt(10, 70, COLOR_BLACK, 3, "Plant is happy :)");
-    } else {
-      TFT_PrintfAt(10, 70, COLOR_BLACK, 3, "Plant is sad :(");
+    if (!sched_run_once()) {
+      // nothing due: sleep until SysTick or an interrupt
+      PROFILE_PHASE("idle");
+      __WFI();
     }
   }
   /* USER CODE END 3 */
@@ -469,93 +669,10 @@ void PeriphCommonClock_Config(void) {
 
 /* USER CODE BEGIN 4 */
 
-// touch callback
+// touch callback: only queues the edge, the touch task does the rest
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
-
-  if (idle == 0) {
-    return;
-  }
   if (GPIO_Pin == TOUCH_INT_Pin) {
-    idle = 0;
-    TOUCH_TouchPoint tp;
-    if (TOUCH_ReadTouch(&tp) == HAL_OK && tp.touched) {
-      printf("Touch: x=%u y=%u\r\n", tp.x, tp.y);
-
-      // Water interval minus button
-      if (tp.x >= water_interval_minus_x &&
-          tp.x <= water_interval_minus_x + button_width &&
-          tp.y >= water_interval_minus_y &&
-          tp.y <= water_interval_minus_y + button_height) {
-        printf("Water interval minus pressed\r\n");
-        if (water_interval_days > 1) {
-          water_interval_days--;
-        }
-        HAL_Delay(200);
-      }
-      // Water interval plus button
-      else if (tp.x >= water_interval_plus_x &&
-               tp.x <= water_interval_plus_x + button_width &&
-               tp.y >= water_interval_plus_y &&
-               tp.y <= water_interval_plus_y + button_height) {
-        printf("Water interval plus pressed\r\n");
-        water_interval_days++;
-        HAL_Delay(200);
-      }
-      // Wet threshold minus button
-      else if (tp.x >= wet_threshold_minus_x &&
-               tp.x <= wet_threshold_minus_x + button_width &&
-               tp.y >= wet_threshold_minus_y &&
-               tp.y <= wet_threshold_minus_y + button_height) {
-        printf("Wet threshold minus pressed\r\n");
-        if (wet_threshold > 100) {
-          wet_threshold -= 50;
-        }
-        HAL_Delay(200);
-      }
-      // Wet threshold plus button
-      else if (tp.x >= wet_threshold_plus_x &&
-               tp.x <= wet_threshold_plus_x + button_width &&
-               tp.y >= wet_threshold_plus_y &&
-               tp.y <= wet_threshold_plus_y + button_height) {
-        printf("Wet threshold plus pressed\r\n");
-        wet_threshold += 50;
-        HAL_Delay(200);
-      }
-      // Light threshold minus button
-      else if (tp.x >= light_threshold_minus_x &&
-               tp.x <= light_threshold_minus_x + button_width &&
-               tp.y >= light_threshold_minus_y &&
-               tp.y <= light_threshold_minus_y + button_height) {
-        printf("Light threshold minus pressed\r\n");
-        if (light_threshold > 100) {
-          light_threshold -= 100;
-        }
-        HAL_Delay(200);
-      }
-      // Light threshold plus button
-      else if (tp.x >= light_threshold_plus_x &&
-               tp.x <= light_threshold_plus_x + button_width &&
-               tp.y >= light_threshold_plus_y &&
-               tp.y <= light_threshold_plus_y + button_height) {
-        printf("Light threshold plus pressed\r\n");
-        light_threshold += 100;
-        HAL_Delay(200);
-      }
-      // Water now button (spans from left of - button to right of + button)
-      else {
-        int water_button_width =
-            (water_interval_plus_x + button_width) - water_now_x;
-        if (tp.x >= water_now_x && tp.x <= water_now_x + water_button_width &&
-            tp.y >= water_now_y && tp.y <= water_now_y + button_height) {
-          printf("Water now pressed\r\n");
-          pump_on();
-          HAL_Delay(2000);
-          pump_off();
-          HAL_Delay(200);
-        }
-      }
-    }
-    idle = 1;
+    TOUCH_PushEvent(DWT->CYCCNT);
   }
 }
 
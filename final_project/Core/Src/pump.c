@@ -7,14 +7,23 @@
 
 #include "pump.h"
 
-void pump_init(void) {
-  // drive GPIO PB2 high, drive pump high for some period of time first (based
-  // on tubing length) to fill the tubing
-  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_2, GPIO_PIN_SET);
-  HAL_Delay(2000);
-  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_2, GPIO_PIN_RESET);
+#include "boot.h"
+
+uint32_t pump_prime_step(uint8_t *phase) {
+  switch ((*phase)++) {
+  case 0:
+    // drive GPIO PB2 high, drive pump high for some period of time first
+    // (based on tubing length) to fill the tubing
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_2, GPIO_PIN_SET);
+    return PUMP_PRIME_MS;
+  default:
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_2, GPIO_PIN_RESET);
+    return BOOT_DONE;
+  }
 }
 
+void pump_init(void) { boot_run_one(pump_prime_step); }
+
 void pump_on(void) {
   // drive GPIO PB2 low
   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_2, GPIO_PIN_SET);
@@ -0,0 +1,107 @@
+/*
+ * scheduler.c
+ *
+ * See scheduler.h. All times are 32-bit microseconds compared by signed
+ * difference, so the clock may wrap (every ~71 minutes).
+ */
+
+#include "scheduler.h"
+
+#include "profile.h"
+
+#include <stdio.h>
+
+#define DUE(t, now) ((int32_t)((now) - (t)) >= 0)
+
+static SchedTask *tasks;
+static uint8_t task_count;
+static uint32_t (*clock_us)(void);
+
+static uint32_t deadline_of(const SchedTask *t) {
+  return t->release_us + (t->deadline_us ? t->deadline_us : t->period_us);
+}
+
+void sched_init(SchedTask *t, uint8_t count, uint32_t (*now_us)(void)) {
+  tasks = t;
+  task_count = count;
+  clock_us = now_us;
+  uint32_t now = clock_us();
+  for (uint8_t i = 0; i < count; i++) {
+    t[i].release_us = now + t[i].offset_us;
+    t[i].runs = t[i].misses = 0;
+    t[i].last_us = t[i].max_us = t[i].max_late_us = 0;
+    t[i].total_us = 0;
+  }
+}
+
+uint8_t sched_run_once(void) {
+  uint32_t now = clock_us();
+  SchedTask *pick = NULL;
+  for (uint8_t i = 0; i < task_count; i++) {
+    SchedTask *t = &tasks[i];
+    if (!DUE(t->release_us, now)) {
+      continue;
+    }
+    if (!pick || t->priority < pick->priority ||
+        (t->priority == pick->priority &&
+         (int32_t)(deadline_of(t) - deadline_of(pick)) < 0)) {
+      pick = t;
+    }
+  }
+  if (!pick) {
+    return 0;
+  }
+
+  PROFILE_PHASE(pick->name);
+  uint32_t start = clock_us();
+  pick->run();
+  uint32_t end = clock_us();
+
+  uint32_t took = end - start;
+  pick->runs++;
+  pick->last_us = took;
+  pick->total_us += took;
+  if (took > pick->max_us) {
+    pick->max_us = took;
+  }
+  if (start - pick->release_us > pick->max_late_us) {
+    pick->max_late_us = start - pick->release_us;
+  }
+  if (!DUE(end, deadline_of(pick))) {
+    pick->misses++;
+  }
+
+  // Next release; whole periods already gone are skipped, not run in a burst
+  pick->release_us += pick->period_us;
+  if (DUE(pick->release_us + pick->period_us, end)) {
+    uint32_t behind = (end - pick->release_us) / pick->period_us;
+    pick->release_us += behind * pick->period_us;
+    pick->misses += behind;
+  }
+  return 1;
+}
+
+uint32_t sched_idle_us(void) {
+  uint32_t now = clock_us();
+  uint32_t idle = UINT32_MAX;
+  for (uint8_t i = 0; i < task_count; i++) {
+    if (DUE(tasks[i].release_us, now)) {
+      return 0;
+    }
+    if (tasks[i].release_us - now < idle) {
+      idle = tasks[i].release_us - now;
+    }
+  }
+  return idle;
+}
+
+void sched_report(void) {
+  printf("task       runs  miss  avg us  max us  late us\r\n");
+  for (uint8_t i = 0; i < task_count; i++) {
+    SchedTask *t = &tasks[i];
+    printf("%-9s %5lu %5lu %7lu %7lu %8lu\r\n", t->name,
+           (unsigned long)t->runs, (unsigned long)t->misses,
+           (unsigned long)(t->runs ? t->total_us / t->runs : 0),
+           (unsigned long)t->max_us, (unsigned long)t->max_late_us);
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * sensor_sweep.c
+ *
+ * See sensor_sweep.h. Each driver stores its own result; this only counts
+ * them in and times the sweep.
+ */
+
+#include "sensor_sweep.h"
+
+#include "i2c_bus.h"
+#include "lightsensor.h"
+#include "si7021.h"
+#include "soil.h"
+
+#define SWEEP_READS 4 // Si7021 RH + temperature count as one
+
+static volatile uint8_t left;
+static uint32_t started;
+static SensorSweepStats stats;
+
+static void count_in(uint8_t ok) {
+  if (!ok) {
+    stats.failed_reads++;
+  }
+  if (--left) {
+    return;
+  }
+  stats.sweeps++;
+  stats.last_ms = HAL_GetTick() - started;
+  if (stats.last_ms > stats.max_ms) {
+    stats.max_ms = stats.last_ms;
+  }
+}
+
+static void read_done(I2cJob *job) { count_in(job->status == I2C_JOB_OK); }
+
+HAL_StatusTypeDef sensor_sweep_start(SensorReadings *out) {
+  if (left) {
+    return HAL_BUSY;
+  }
+  // masked so that no result lands while the count is still being corrected
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  started = HAL_GetTick();
+  left = SWEEP_READS;
+  if (si7021_start_measurement(&out->air_rh, &out->air_temp_c, read_done) !=
+      HAL_OK) {
+    count_in(0);
+  }
+  if (soil_start_capacitance(&out->soil_cap, read_done) != HAL_OK) {
+    count_in(0);
+  }
+  if (soil_start_temperature(&out->soil_temp_c, read_done) != HAL_OK) {
+    count_in(0);
+  }
+  if (bh1750_start_read(BH1750_ADDR, &out->light, read_done) != HAL_OK) {
+    count_in(0);
+  }
+  __set_PRIMASK(primask);
+  return HAL_OK;
+}
+
+uint8_t sensor_sweep_busy(void) { return left != 0; }
+
+const SensorSweepStats *sensor_sweep_stats(void) { return &stats; }
@@ -11,35 +11,137 @@
 #include <stdint.h>   // for uint8_t
 
 
-/* Private buffer to store read values */
-static uint8_t rxbuf[2];
+/* One job per measurement; the command byte and result live with it */
+typedef struct
+{
+    I2cJob job;
+    uint8_t cmd;
+    uint8_t rxbuf[2];
+    float *out;
+    I2cJobDone done;
+} Si7021Read;
+
+static Si7021Read rh_read = {.cmd = SI7021_CMD_MEAS_RH_HOLD};
+static Si7021Read temp_read = {.cmd = SI7021_CMD_MEAS_TEMP_HOLD};
+static Si7021Read meas_rh = {.cmd = SI7021_CMD_MEAS_RH_NOHOLD};
+static Si7021Read meas_temp = {.cmd = SI7021_CMD_READ_PREV_TEMP};
+static uint8_t meas_polls;
+
+static uint16_t raw_of(const Si7021Read *r)
+{
+    return (r->rxbuf[0] << 8) | r->rxbuf[1];
+}
+
+static void humidity_done(I2cJob *job)
+{
+    Si7021Read *r = job->ctx;
+    if (r->out)
+        *r->out = job->status == I2C_JOB_OK
+                      ? ((SI7021_RH_CONV_CONST * raw_of(r)) / 65536.0f) - SI7021_RH_CONV_OFFSET
+                      : 0.0f;
+    if (r->done)
+        r->done(job);
+}
+
+static void temperature_done(I2cJob *job)
+{
+    Si7021Read *r = job->ctx;
+    if (r->out)
+        *r->out = job->status == I2C_JOB_OK
+                      ? ((SI7021_TEMP_CONV_CONST * raw_of(r)) / 65536.0f) - SI7021_TEMP_CONV_OFFSET
+                      : 0.0f;
+    if (r->done)
+        r->done(job);
+}
+
+static HAL_StatusTypeDef submit(Si7021Read *r, uint16_t gap_ms, uint16_t timeout_ms,
+                                I2cJobDone conv, float *out, I2cJobDone done)
+{
+    r->out = out;
+    r->done = done;
+    r->job.addr = SI7021_ADDR;
+    r->job.tx = &r->cmd;
+    r->job.tx_len = 1;
+    r->job.rx = r->rxbuf;
+    r->job.rx_len = 2;
+    r->job.gap_ms = gap_ms;
+    r->job.timeout_ms = timeout_ms;
+    r->job.done = conv;
+    r->job.ctx = r;
+    return i2c_bus_submit(&r->job);
+}
+
+/* Hold master mode: the sensor stretches SCL for the whole conversion, so
+   the read is a single transfer with a timeout that covers it */
+HAL_StatusTypeDef si7021_start_humidity(float *out, I2cJobDone done)
+{
+    return submit(&rh_read, 0, SI7021_HOLD_TIMEOUT_MS, humidity_done, out, done);
+}
+
+HAL_StatusTypeDef si7021_start_temperature(float *out, I2cJobDone done)
+{
+    return submit(&temp_read, 0, SI7021_HOLD_TIMEOUT_MS, temperature_done, out, done);
+}
+
+static void measurement_rh_done(I2cJob *job)
+{
+    /* Still converting: poll with a read-only job */
+    if (job->status == I2C_JOB_NACK && meas_polls < SI7021_NOHOLD_POLLS)
+    {
+        meas_polls++;
+        job->tx_len = 0;
+        job->gap_ms = SI7021_NOHOLD_POLL_MS;
+        if (HAL_OK == i2c_bus_submit(job))
+            return;
+    }
+
+    humidity_done(job);
+
+    if (job->status == I2C_JOB_OK &&
+        HAL_OK == submit(&meas_temp, 0, 0, temperature_done, meas_temp.out, meas_temp.done))
+        return;
+
+    /* No temperature: failed like the RH read, or not submitted */
+    meas_temp.job.status = job->status == I2C_JOB_OK ? I2C_JOB_ERROR : job->status;
+    if (meas_temp.out)
+        *meas_temp.out = 0.0f;
+    if (meas_temp.done)
+        meas_temp.done(&meas_temp.job);
+}
+
+/* No-hold mode: the bus is released for the conversion, which takes the
+   temperature as well, so that comes from READ_PREV_TEMP without waiting */
+HAL_StatusTypeDef si7021_start_measurement(float *rh, float *temp, I2cJobDone done)
+{
+    if (meas_rh.job.status != I2C_JOB_IDLE && !i2c_job_done(&meas_rh.job))
+        return HAL_BUSY;
+    if (meas_temp.job.status != I2C_JOB_IDLE && !i2c_job_done(&meas_temp.job))
+        return HAL_BUSY;
+
+    meas_polls = 0;
+    meas_temp.out = temp;
+    meas_temp.done = done;
+    return submit(&meas_rh, SI7021_NOHOLD_CONV_MS, 0, measurement_rh_done, rh, NULL);
+}
 
 /* Function to read humidity */
 float si7021_read_humidity(void)
 {
-    uint8_t cmd = SI7021_CMD_MEAS_RH_HOLD;
+    float v = 0.0f;
 
-    if (HAL_OK != HAL_I2C_Master_Transmit(&hi2c2, SI7021_ADDR, &cmd, 1, HAL_MAX_DELAY))
-        return 0.0f;
+    if (HAL_OK == si7021_start_humidity(&v, NULL))
+        i2c_bus_wait(&rh_read.job);
 
-    if (HAL_OK != HAL_I2C_Master_Receive(&hi2c2, SI7021_ADDR, rxbuf, 2, HAL_MAX_DELAY))
-        return 0.0f;
-
-    uint16_t raw = (rxbuf[0] << 8) | rxbuf[1];
-    return ((SI7021_RH_CONV_CONST * raw) / 65536.0f) - SI7021_RH_CONV_OFFSET;
+    return v;
 }
 
 /* Function to read temperature */
 float si7021_read_temperature(void)
 {
-    uint8_t cmd = SI7021_CMD_MEAS_TEMP_HOLD;
-
-    if (HAL_OK != HAL_I2C_Master_Transmit(&hi2c2, SI7021_ADDR, &cmd, 1, HAL_MAX_DELAY))
-        return 0.0f;
+    float v = 0.0f;
 
-    if (HAL_OK != HAL_I2C_Master_Receive(&hi2c2, SI7021_ADDR, rxbuf, 2, HAL_MAX_DELAY))
-        return 0.0f;
+    if (HAL_OK == si7021_start_temperature(&v, NULL))
+        i2c_bus_wait(&temp_read.job);
 
-    uint16_t raw = (rxbuf[0] << 8) | rxbuf[1];
-    return ((SI7021_TEMP_CONV_CONST * raw) / 65536.0f) - SI7021_TEMP_CONV_OFFSET;
+    return v;
 }
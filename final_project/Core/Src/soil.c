@@ -15,64 +15,114 @@
 #define SEESAW_STATUS_SWRST     0x7F
 #define SEESAW_TOUCH_BASE       0x0F
 #define SEESAW_TOUCH_CHANNEL_OFFSET  0x10
-#define SEESAW_STATUS_TEMP      0x00
+#define SEESAW_STATUS_TEMP      0x04
 
-/* Private buffer to store read values and to keep track of initialization */
-static uint8_t rxbuf[4];
+/* Jobs on the I2C2 bus manager; the gap after each command is the time the
+   SAMD09 needs before it has the answer (or is back from reset) */
+#define SOIL_RESET_MS           10
+#define SOIL_MEASURE_MS         3
+
+typedef struct
+{
+    I2cJob job;
+    uint8_t cmd[2];
+    uint8_t rxbuf[4];
+    void *out;
+    I2cJobDone done;
+} SoilRead;
+
+static I2cJob reset_job;
+static const uint8_t reset_cmd[2] = {SEESAW_STATUS_BASE, SEESAW_STATUS_SWRST};
+static SoilRead cap_read = {.cmd = {SEESAW_TOUCH_BASE, SEESAW_TOUCH_CHANNEL_OFFSET}};
+static SoilRead temp_read = {.cmd = {SEESAW_STATUS_BASE, SEESAW_STATUS_TEMP}};
 static uint8_t initialized = 0;
 
-/* Private function to initialize the sensor */
-static void soil_init(void)
+/* Private function to queue the software reset ahead of the first read */
+static HAL_StatusTypeDef soil_init(void)
 {
-    if (initialized) return;
+    if (initialized) return HAL_OK;
 
-    // Software reset
-    uint8_t reset_cmd[2] = {SEESAW_STATUS_BASE, SEESAW_STATUS_SWRST};
-    HAL_I2C_Master_Transmit(&hi2c2, SOIL_ADDR, reset_cmd, 2, HAL_MAX_DELAY);
+    reset_job.addr = SOIL_ADDR;
+    reset_job.tx = reset_cmd;
+    reset_job.tx_len = 2;
+    reset_job.gap_ms = SOIL_RESET_MS;   // Wait for reset
 
-    HAL_Delay(10);  	// Wait for reset
+    if (HAL_OK != i2c_bus_submit(&reset_job))
+        return HAL_ERROR;
 
     initialized = 1;	// set once to 1 after first use/initilization
+    return HAL_OK;
 }
 
-/* Function to read capacitance (moisture level) */
-uint16_t soil_read_capacitance(void)
+static void capacitance_done(I2cJob *job)
 {
-    soil_init();
-
-    // Read touch/capacitance: base 0x0F, function 0x10
-    uint8_t cmd[2] = {SEESAW_TOUCH_BASE, SEESAW_TOUCH_CHANNEL_OFFSET};
+    SoilRead *r = job->ctx;
+    if (r->out)
+        *(uint16_t *)r->out = job->status == I2C_JOB_OK ? (r->rxbuf[0] << 8) | r->rxbuf[1] : 0;
+    if (r->done)
+        r->done(job);
+}
 
-    if (HAL_OK != HAL_I2C_Master_Transmit(&hi2c2, SOIL_ADDR, cmd, 2, HAL_MAX_DELAY))
-        return 0;
+static void temperature_done(I2cJob *job)
+{
+    SoilRead *r = job->ctx;
+    int32_t raw = ((int32_t)r->rxbuf[0] << 24) | ((int32_t)r->rxbuf[1] << 16) | ((int32_t)r->rxbuf[2] << 8) | r->rxbuf[3];
 
-    HAL_Delay(3);  // Sensor needs time to measure
+    // Convert: (1.0 / (1UL << 16)) * raw
+    if (r->out)
+        *(float *)r->out = job->status == I2C_JOB_OK ? raw / 65536.0f : 0.0f;
+    if (r->done)
+        r->done(job);
+}
 
-    if (HAL_OK != HAL_I2C_Master_Receive(&hi2c2, SOIL_ADDR, rxbuf, 2, HAL_MAX_DELAY))
-        return 0;
+static HAL_StatusTypeDef submit(SoilRead *r, uint8_t len, I2cJobDone conv, void *out, I2cJobDone done)
+{
+    if (HAL_OK != soil_init())
+        return HAL_ERROR;
+
+    r->out = out;
+    r->done = done;
+    r->job.addr = SOIL_ADDR;
+    r->job.tx = r->cmd;
+    r->job.tx_len = 2;
+    r->job.rx = r->rxbuf;
+    r->job.rx_len = len;
+    r->job.gap_ms = SOIL_MEASURE_MS;  // Sensor needs time to measure
+    r->job.done = conv;
+    r->job.ctx = r;
+    return i2c_bus_submit(&r->job);
+}
 
-    uint16_t capacitance = (rxbuf[0] << 8) | rxbuf[1];
-    return capacitance; // a reading ranging from about 200 (very dry) to 2000 (very wet)
+/* Read touch/capacitance: base 0x0F, function 0x10 */
+HAL_StatusTypeDef soil_start_capacitance(uint16_t *out, I2cJobDone done)
+{
+    return submit(&cap_read, 2, capacitance_done, out, done);
 }
 
-/* Function to read temperature */
-float soil_read_temperature(void)
+/* Read temperature: base 0x00, function 0x04 */
+HAL_StatusTypeDef soil_start_temperature(float *out, I2cJobDone done)
 {
-    soil_init();
+    return submit(&temp_read, 4, temperature_done, out, done);
+}
 
-    // Read temperature: base 0x00, function 0x04
-    uint8_t cmd[2] = {SEESAW_STATUS_BASE, 0x04};
+/* Function to read capacitance (moisture level) */
+uint16_t soil_read_capacitance(void)
+{
+    uint16_t capacitance = 0;
 
-    if (HAL_OK != HAL_I2C_Master_Transmit(&hi2c2, SOIL_ADDR, cmd, 2, HAL_MAX_DELAY))
-        return 0.0f;
+    if (HAL_OK == soil_start_capacitance(&capacitance, NULL))
+        i2c_bus_wait(&cap_read.job);
 
-    HAL_Delay(3);  // Sensor needs time to measure
+    return capacitance; // a reading ranging from about 200 (very dry) to 2000 (very wet)
+}
 
-    if (HAL_OK != HAL_I2C_Master_Receive(&hi2c2, SOIL_ADDR, rxbuf, 4, HAL_MAX_DELAY))
-        return 0.0f;
+/* Function to read temperature */
+float soil_read_temperature(void)
+{
+    float temperature = 0.0f;
 
-    int32_t raw = ((int32_t)rxbuf[0] << 24) | ((int32_t)rxbuf[1] << 16) | ((int32_t)rxbuf[2] << 8) | rxbuf[3];
+    if (HAL_OK == soil_start_temperature(&temperature, NULL))
+        i2c_bus_wait(&temp_read.job);
 
-    // Convert: (1.0 / (1UL << 16)) * raw
-    return raw / 65536.0f;
+    return temperature;
 }
@@ -21,12 +21,39 @@
 #include "spi.h"
 
 /* USER CODE BEGIN 0 */
-
+// DMA for the buses a device can be moved to (spi_bus.h), set up here rather
+// than in the .ioc so SPI1 keeps its generated channels
+DMA_HandleTypeDef hdma_spi2_rx;
+DMA_HandleTypeDef hdma_spi2_tx;
+DMA_HandleTypeDef hdma_spi3_rx;
+DMA_HandleTypeDef hdma_spi3_tx;
+
+// One channel of an SPI bus, configured as SPI1's; Error_Handler on failure
+static void spi_dma_init(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *ch,
+                         uint32_t request, uint32_t direction,
+                         uint32_t priority, IRQn_Type irq) {
+  hdma->Instance = ch;
+  hdma->Init.Request = request;
+  hdma->Init.Direction = direction;
+  hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma->Init.MemInc = DMA_MINC_ENABLE;
+  hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma->Init.Mode = DMA_NORMAL;
+  hdma->Init.Priority = priority;
+  if (HAL_DMA_Init(hdma) != HAL_OK) {
+    Error_Handler();
+  }
+  HAL_NVIC_SetPriority(irq, 0, 0);
+  HAL_NVIC_EnableIRQ(irq);
+}
 /* USER CODE END 0 */
 
 SPI_HandleTypeDef hspi1;
 SPI_HandleTypeDef hspi2;
 SPI_HandleTypeDef hspi3;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
 
 /* SPI1 init function */
 void MX_SPI1_Init(void) {
@@ -146,6 +173,39 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef *spiHandle) {
     GPIO_InitStruct.Alternate = GPIO_AF5_SPI1;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+    /* SPI1 DMA Init */
+    /* SPI1_RX Init */
+    hdma_spi1_rx.Instance = DMA1_Channel2;
+    hdma_spi1_rx.Init.Request = DMA_REQUEST_SPI1_RX;
+    hdma_spi1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_spi1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_rx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&hdma_spi1_rx) != HAL_OK) {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle, hdmarx, hdma_spi1_rx);
+
+    /* SPI1_TX Init */
+    hdma_spi1_tx.Instance = DMA1_Channel1;
+    hdma_spi1_tx.Init.Request = DMA_REQUEST_SPI1_TX;
+    hdma_spi1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_spi1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi1_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi1_tx.Init.Mode = DMA_NORMAL;
+    hdma_spi1_tx.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_spi1_tx) != HAL_OK) {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(spiHandle, hdmatx, hdma_spi1_tx);
+
     /* USER CODE BEGIN SPI1_MspInit 1 */
 
     /* USER CODE END SPI1_MspInit 1 */
@@ -179,7 +239,12 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef *spiHandle) {
     HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
 
     /* USER CODE BEGIN SPI2_MspInit 1 */
-
+    spi_dma_init(&hdma_spi2_rx, DMA1_Channel4, DMA_REQUEST_SPI2_RX,
+                 DMA_PERIPH_TO_MEMORY, DMA_PRIORITY_HIGH, DMA1_Channel4_IRQn);
+    __HAL_LINKDMA(spiHandle, hdmarx, hdma_spi2_rx);
+    spi_dma_init(&hdma_spi2_tx, DMA1_Channel5, DMA_REQUEST_SPI2_TX,
+                 DMA_MEMORY_TO_PERIPH, DMA_PRIORITY_LOW, DMA1_Channel5_IRQn);
+    __HAL_LINKDMA(spiHandle, hdmatx, hdma_spi2_tx);
     /* USER CODE END SPI2_MspInit 1 */
   } else if (spiHandle->Instance == SPI3) {
     /* USER CODE BEGIN SPI3_MspInit 0 */
@@ -211,7 +276,12 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef *spiHandle) {
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
     /* USER CODE BEGIN SPI3_MspInit 1 */
-
+    spi_dma_init(&hdma_spi3_rx, DMA1_Channel6, DMA_REQUEST_SPI3_RX,
+                 DMA_PERIPH_TO_MEMORY, DMA_PRIORITY_HIGH, DMA1_Channel6_IRQn);
+    __HAL_LINKDMA(spiHandle, hdmarx, hdma_spi3_rx);
+    spi_dma_init(&hdma_spi3_tx, DMA1_Channel7, DMA_REQUEST_SPI3_TX,
+                 DMA_MEMORY_TO_PERIPH, DMA_PRIORITY_LOW, DMA1_Channel7_IRQn);
+    __HAL_LINKDMA(spiHandle, hdmatx, hdma_spi3_tx);
     /* USER CODE END SPI3_MspInit 1 */
   }
 }
@@ -233,6 +303,10 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef *spiHandle) {
     */
     HAL_GPIO_DeInit(GPIOA, GPIO_PIN_4 | GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7);
 
+    /* SPI1 DMA DeInit */
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
+
     /* USER CODE BEGIN SPI1_MspDeInit 1 */
 
     /* USER CODE END SPI1_MspDeInit 1 */
@@ -254,7 +328,8 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef *spiHandle) {
     HAL_GPIO_DeInit(GPIOD, GPIO_PIN_3);
 
     /* USER CODE BEGIN SPI2_MspDeInit 1 */
-
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
     /* USER CODE END SPI2_MspDeInit 1 */
   } else if (spiHandle->Instance == SPI3) {
     /* USER CODE BEGIN SPI3_MspDeInit 0 */
@@ -274,7 +349,8 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef *spiHandle) {
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_3 | GPIO_PIN_4 | GPIO_PIN_5);
 
     /* USER CODE BEGIN SPI3_MspDeInit 1 */
-
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
     /* USER CODE END SPI3_MspDeInit 1 */
   }
 }
@@ -0,0 +1,65 @@
+/*
+ * spi_bus.c
+ *
+ * See spi_bus.h. A moved device keeps the SCK it has on SPI1: the SPI2/SPI3
+ * setup in the .ioc runs at half that, which would give back on the wire
+ * what the second bus wins.
+ */
+
+#include "spi_bus.h"
+
+#define BUS_HANDLE_(n) hspi##n
+#define BUS_HANDLE(n) BUS_HANDLE_(n)
+
+#if BOARD_TFT_SPI < 1 || BOARD_TFT_SPI > 3 || BOARD_CAM_SPI < 1 ||            \
+    BOARD_CAM_SPI > 3
+#error "BOARD_TFT_SPI and BOARD_CAM_SPI are SPI instances 1 to 3"
+#endif
+
+static SPI_HandleTypeDef *bus[SPI_DEV_COUNT] = {
+    [SPI_DEV_TFT] = &BUS_HANDLE(BOARD_TFT_SPI),
+    [SPI_DEV_CAMERA] = &BUS_HANDLE(BOARD_CAM_SPI),
+};
+
+// SCK of hspi at its prescaler; SPI1 runs off APB2, SPI2 and SPI3 off APB1
+static uint32_t sck_hz(const SPI_HandleTypeDef *hspi, uint32_t prescaler) {
+  uint32_t pclk = hspi->Instance == SPI1 ? HAL_RCC_GetPCLK2Freq()
+                                         : HAL_RCC_GetPCLK1Freq();
+  return pclk >> ((prescaler >> 3) + 1);
+}
+
+void spi_bus_init(void) {
+  spi_bus_assign(SPI_DEV_TFT, &BUS_HANDLE(BOARD_TFT_SPI));
+  spi_bus_assign(SPI_DEV_CAMERA, &BUS_HANDLE(BOARD_CAM_SPI));
+}
+
+void spi_bus_assign(SpiDev dev, SPI_HandleTypeDef *hspi) {
+  bus[dev] = hspi;
+  if (hspi == &hspi1) {
+    return;
+  }
+  // the fastest prescaler that does not go past SPI1's clock
+  uint32_t want = sck_hz(&hspi1, hspi1.Init.BaudRatePrescaler);
+  uint32_t prescaler = SPI_BAUDRATEPRESCALER_2;
+  while (prescaler < SPI_BAUDRATEPRESCALER_256 &&
+         sck_hz(hspi, prescaler) > want) {
+    prescaler += SPI_BAUDRATEPRESCALER_4; // the next power of two
+  }
+  if (prescaler != hspi->Init.BaudRatePrescaler) {
+    hspi->Init.BaudRatePrescaler = prescaler;
+    if (HAL_SPI_Init(hspi) != HAL_OK) {
+      Error_Handler();
+    }
+  }
+}
+
+SPI_HandleTypeDef *spi_bus_handle(SpiDev dev) { return bus[dev]; }
+
+uint8_t spi_bus_shared(SpiDev dev) {
+  for (int d = 0; d < SPI_DEV_COUNT; d++) {
+    if (d != (int)dev && bus[d] == bus[dev]) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -1,11 +1,22 @@
 #include "touch.h"
+#include "bigdisplay.h"
+#include "boot.h"
+#include "trace.h"
 #include "stm32l4xx_hal.h"
+#include <stdatomic.h>
 #include <stdio.h>
 
 extern I2C_HandleTypeDef hi2c1;
 
 static I2C_HandleTypeDef *TOUCH_hi2c = NULL;
-static volatile uint8_t TOUCH_new_data_flag = 0;
+
+// Free-running indices, masked on access: head is only written by the
+// producer, tail only by the consumer. Release/acquire orders the slot
+// write before the index that publishes it.
+static TOUCH_Event TOUCH_queue[TOUCH_QUEUE_LEN];
+static atomic_uint_fast16_t TOUCH_head;
+static atomic_uint_fast16_t TOUCH_tail;
+static atomic_uint TOUCH_dropped;
 
 /* FT6206 register addresses */
 #define TOUCH_REG_DEV_MODE 0x00
@@ -15,33 +26,44 @@ static volatile uint8_t TOUCH_new_data_flag = 0;
 #define TOUCH_REG_P1_XL 0x04
 #define TOUCH_REG_P1_YH 0x05
 #define TOUCH_REG_P1_YL 0x06
+#define TOUCH_REG_CHIP_ID 0xA3
 
 static HAL_StatusTypeDef TOUCH_ReadReg(uint8_t reg, uint8_t *data,
                                        uint16_t len);
 static void TOUCH_GPIO_Init(void);
 
-HAL_StatusTypeDef TOUCH_Init(void) {
-  TOUCH_hi2c = &hi2c1;
+uint32_t TOUCH_InitStep(uint8_t *phase) {
+  switch ((*phase)++) {
+  case 0:
+    TOUCH_hi2c = &hi2c1;
 
-  TOUCH_GPIO_Init();
+    TOUCH_GPIO_Init();
 
-  HAL_GPIO_WritePin(TOUCH_RST_GPIO_Port, TOUCH_RST_Pin, GPIO_PIN_RESET);
-  HAL_Delay(5);
-  HAL_GPIO_WritePin(TOUCH_RST_GPIO_Port, TOUCH_RST_Pin, GPIO_PIN_SET);
-  HAL_Delay(50);
+    HAL_GPIO_WritePin(TOUCH_RST_GPIO_Port, TOUCH_RST_Pin, GPIO_PIN_RESET);
+    return 5;
+  case 1:
+    HAL_GPIO_WritePin(TOUCH_RST_GPIO_Port, TOUCH_RST_Pin, GPIO_PIN_SET);
+    return 50;
+  default: {
+    uint8_t chip_id = 0;
+    HAL_StatusTypeDef st;
 
-  uint8_t chip_id = 0;
-  HAL_StatusTypeDef st;
+    st = TOUCH_ReadReg(TOUCH_REG_CHIP_ID, &chip_id, 1);
+    if (st != HAL_OK) {
+      TRACE(LOG_ERR, "[TOUCH][ERR] Failed to read CHIP_ID (status=%d)\r\n",
+            (int)st);
+      return BOOT_FAILED;
+    }
 
-  st = TOUCH_ReadReg(TOUCH_REG_CHIP_ID, &chip_id, 1);
-  if (st != HAL_OK) {
-    printf("[TOUCH][ERR] Failed to read CHIP_ID (status=%d)\r\n", (int)st);
-    return st;
-  }
+    printf("[TOUCH] Chip ID: 0x%02X\r\n", chip_id);
 
-  printf("[TOUCH] Chip ID: 0x%02X\r\n", chip_id);
+    return BOOT_DONE;
+  }
+  }
+}
 
-  return HAL_OK;
+HAL_StatusTypeDef TOUCH_Init(void) {
+  return boot_run_one(TOUCH_InitStep) ? HAL_OK : HAL_ERROR;
 }
 
 HAL_StatusTypeDef TOUCH_ReadTouch(TOUCH_TouchPoint *p) {
@@ -74,12 +96,49 @@ HAL_StatusTypeDef TOUCH_ReadTouch(TOUCH_TouchPoint *p) {
 
     p->x = y;
     p->y = 320 - x;
+    if (TFT_Rotation180()) {
+      // the touch layer turns with the panel it is glued to
+      p->x = TFT_WIDTH - p->x;
+      p->y = TFT_HEIGHT - p->y;
+    }
     p->touched = 1;
   }
   return HAL_OK;
 }
 
-uint8_t TOUCH_HasNewData(void) { return TOUCH_new_data_flag; }
+uint8_t TOUCH_HasNewData(void) {
+  return atomic_load_explicit(&TOUCH_head, memory_order_acquire) !=
+         atomic_load_explicit(&TOUCH_tail, memory_order_relaxed);
+}
+
+uint8_t TOUCH_PushEvent(uint32_t stamp) {
+  uint_fast16_t head = atomic_load_explicit(&TOUCH_head, memory_order_relaxed);
+  uint_fast16_t tail = atomic_load_explicit(&TOUCH_tail, memory_order_acquire);
+  if ((uint16_t)(head - tail) >= TOUCH_QUEUE_LEN) {
+    atomic_fetch_add_explicit(&TOUCH_dropped, 1, memory_order_relaxed);
+    return 0;
+  }
+  TOUCH_queue[head & (TOUCH_QUEUE_LEN - 1)].stamp = stamp;
+  atomic_store_explicit(&TOUCH_head, (uint16_t)(head + 1),
+                        memory_order_release);
+  return 1;
+}
+
+uint8_t TOUCH_PopEvent(TOUCH_Event *e) {
+  uint_fast16_t tail = atomic_load_explicit(&TOUCH_tail, memory_order_relaxed);
+  uint_fast16_t head = atomic_load_explicit(&TOUCH_head, memory_order_acquire);
+  if (head == tail) {
+    return 0;
+  }
+  *e = TOUCH_queue[tail & (TOUCH_QUEUE_LEN - 1)];
+  atomic_store_explicit(&TOUCH_tail, (uint16_t)(tail + 1),
+                        memory_order_release);
+  return 1;
+}
+
+uint32_t TOUCH_DroppedEvents(void) {
+  return atomic_load_explicit(&TOUCH_dropped, memory_order_relaxed);
+}
 
 static void TOUCH_GPIO_Init(void) {
   GPIO_InitTypeDef gi = {0};
@@ -115,8 +174,9 @@ static HAL_StatusTypeDef TOUCH_ReadReg(uint8_t reg, uint8_t *data,
                        data, len, HAL_MAX_DELAY);
 
   if (st != HAL_OK) {
-    printf("[TOUCH][ERR] I2C Mem Read fail: reg=0x%02X, status=%d\r\n", reg,
-           (int)st);
+    TRACE(LOG_ERR,
+          "[TOUCH][ERR] I2C Mem Read fail: reg=0x%02X, status=%d\r\n",
+          reg, (int)st);
   }
   return st;
 }
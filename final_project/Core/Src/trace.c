@@ -0,0 +1,148 @@
+/*
+ * trace.c
+ *
+ * See trace.h. Records are appended to one of two frame buffers; when it is
+ * full, or on trace_flush, the buffers swap and the full one is sent with
+ * a single log_write, so an interrupt that writes meanwhile fills the other.
+ * Each buffer keeps room in front of its records for the frame header,
+ * which is written right-aligned against them when the frame goes out.
+ */
+
+#include "trace.h"
+
+#include <string.h>
+
+#define HEADER_MAX 16 // start byte and four varints
+#define RECORD_MAX (5 * (TRACE_ARGS_MAX + 2))
+
+typedef struct {
+  uint8_t data[HEADER_MAX + TRACE_FRAME_MAX];
+  uint16_t len; // record bytes after the header room
+  uint16_t records;
+  uint32_t lost; // reported in this frame's header
+  uint32_t base; // CYCCNT the first record's delta counts from
+  uint8_t busy;  // swapped out, being sent
+} TraceBuffer;
+
+// Offsets of the format strings are taken from here; the linker provides
+// the symbol as the section's name is a C identifier
+extern const char __start_trace_fmt[] __attribute__((weak));
+
+static TraceBuffer buffers[2];
+static uint8_t active;
+static uint32_t last_cycles;
+static uint32_t lost_reported;
+static TraceStats stats;
+
+static uint8_t put_varint(uint8_t *p, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+// With interrupts masked: hands out the active buffer for sending if it
+// holds records and the other one is free
+static TraceBuffer *swap(void) {
+  TraceBuffer *full = &buffers[active];
+  if (!full->records || buffers[active ^ 1].busy) {
+    return NULL;
+  }
+  full->busy = 1;
+  full->lost = stats.lost - lost_reported;
+  lost_reported = stats.lost;
+  active ^= 1;
+  return full;
+}
+
+static void send(TraceBuffer *b) {
+  uint8_t head[HEADER_MAX];
+  uint8_t fields = put_varint(head, SystemCoreClock / 1000);
+  fields += put_varint(head + fields, b->lost);
+  fields += put_varint(head + fields, b->base);
+  uint8_t *start = b->data + HEADER_MAX - fields;
+  memcpy(start, head, fields);
+  uint8_t len_bytes = put_varint(head, fields + b->len);
+  start -= len_bytes;
+  memcpy(start, head, len_bytes);
+  *--start = TRACE_FRAME_START;
+
+  // LOG_ERR so the level filter, already applied per record, passes it
+  uint8_t sent = log_write(LOG_ERR, (const char *)start,
+                           (uint32_t)(b->data + HEADER_MAX + b->len - start));
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (sent) {
+    stats.frames++;
+  } else {
+    stats.lost += b->records;
+    lost_reported -= b->lost; // for the next frame to report
+  }
+  b->len = b->records = 0;
+  b->busy = 0;
+  __set_PRIMASK(primask);
+}
+
+void trace_record(const char *fmt, const uint32_t *args, uint32_t count) {
+  uint8_t body[RECORD_MAX];
+  uint8_t head = put_varint(body, (uint32_t)(fmt - __start_trace_fmt) << 3 |
+                                      count);
+  uint8_t len = 0;
+  uint8_t *arg_bytes = body + head + 5; // room for the time delta
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t v = args[i];
+    len += put_varint(arg_bytes + len, v << 1 ^ (uint32_t)((int32_t)v >> 31));
+  }
+
+  TraceBuffer *full = NULL;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t now = DWT->CYCCNT;
+  uint8_t delta[5];
+  uint8_t delta_len = put_varint(delta, now - last_cycles);
+  uint16_t size = head + delta_len + len;
+  TraceBuffer *b = &buffers[active];
+  if (b->len + size > TRACE_FRAME_MAX) {
+    full = swap();
+    b = &buffers[active];
+  }
+  if (b->len + size <= TRACE_FRAME_MAX) {
+    if (!b->records) {
+      b->base = last_cycles;
+    }
+    uint8_t *p = b->data + HEADER_MAX + b->len;
+    memcpy(p, body, head);
+    memcpy(p + head, delta, delta_len);
+    memcpy(p + head + delta_len, arg_bytes, len);
+    b->len += size;
+    b->records++;
+    last_cycles = now;
+    stats.records++;
+    stats.bytes += size;
+  } else {
+    stats.lost++;
+  }
+  __set_PRIMASK(primask);
+
+  if (full) {
+    send(full);
+  }
+}
+
+void trace_flush(void) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  TraceBuffer *full = swap();
+  __set_PRIMASK(primask);
+  if (full) {
+    send(full);
+  }
+}
+
+const TraceStats *trace_stats(void) { return &stats; }
+
+void trace_check_format(const char *fmt, ...) { (void)fmt; }
@@ -0,0 +1,129 @@
+/*
+ * widget.c
+ *
+ * See widget.h.
+ */
+
+#include "widget.h"
+
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define GLYPH_W(scale) (TFT_CHAR_WIDTH_PIXELS * (scale))
+#define GLYPH_H(scale) (TFT_CHAR_HEIGHT_PIXELS * (scale))
+
+static uint8_t inside(const Widget *w, uint16_t x, uint16_t y) {
+  return x >= w->x && x < w->x + w->w && y >= w->y && y < w->y + w->h;
+}
+
+uint8_t widget_screen_init(WidgetScreen *s, Widget *widgets, uint8_t count,
+                           uint16_t bg) {
+  uint8_t overflow = 0;
+  s->widgets = widgets;
+  s->count = count;
+  s->bg = bg;
+  memset(s->cell, WIDGET_NONE, sizeof(s->cell));
+  for (uint8_t i = 0; i < count; i++) {
+    Widget *w = &widgets[i];
+    w->drawn = 0;
+    if (w->kind != WIDGET_BUTTON || !w->w || !w->h) {
+      continue;
+    }
+    uint16_t cx1 = (w->x + w->w - 1) / WIDGET_CELL;
+    uint16_t cy1 = (w->y + w->h - 1) / WIDGET_CELL;
+    uint8_t placed = 1;
+    for (uint16_t cy = w->y / WIDGET_CELL; cy <= cy1 && cy < WIDGET_GRID_H;
+         cy++) {
+      for (uint16_t cx = w->x / WIDGET_CELL; cx <= cx1 && cx < WIDGET_GRID_W;
+           cx++) {
+        uint8_t *slot = s->cell[cy][cx];
+        uint8_t k = 0;
+        while (k < WIDGET_CELL_SLOTS && slot[k] != WIDGET_NONE) {
+          k++;
+        }
+        if (k == WIDGET_CELL_SLOTS) {
+          placed = 0;
+          continue;
+        }
+        slot[k] = i;
+      }
+    }
+    if (!placed) {
+      log_printf(LOG_ERR,
+                 "[UI][ERR] %s: more than %d buttons share a cell\r\n",
+                 w->name, WIDGET_CELL_SLOTS);
+      overflow++;
+    }
+  }
+  return overflow;
+}
+
+Widget *widget_hit(const WidgetScreen *s, uint16_t x, uint16_t y) {
+  if (x >= TFT_WIDTH || y >= TFT_HEIGHT) {
+    return NULL;
+  }
+  const uint8_t *slot = s->cell[y / WIDGET_CELL][x / WIDGET_CELL];
+  for (uint8_t k = 0; k < WIDGET_CELL_SLOTS && slot[k] != WIDGET_NONE; k++) {
+    Widget *w = &s->widgets[slot[k]];
+    if (inside(w, x, y)) {
+      return w;
+    }
+  }
+  return NULL;
+}
+
+void widget_invalidate(WidgetScreen *s) {
+  for (uint8_t i = 0; i < s->count; i++) {
+    s->widgets[i].drawn = 0;
+  }
+}
+
+static void widget_text(const Widget *w, char *out) {
+  if (w->kind == WIDGET_VALUE && w->format) {
+    w->format(out, WIDGET_TEXT_MAX);
+  } else if (w->kind == WIDGET_VALUE && w->value) {
+    snprintf(out, WIDGET_TEXT_MAX, w->text, *w->value);
+  } else {
+    snprintf(out, WIDGET_TEXT_MAX, "%s", w->text ? w->text : "");
+  }
+}
+
+static void widget_draw(const WidgetScreen *s, const Widget *w,
+                        const char *text) {
+  switch (w->kind) {
+  case WIDGET_BUTTON: {
+    TFT_FillRect(w->x - 1, w->y - 1, w->w + 2, w->h + 2, COLOR_BLACK);
+    TFT_FillRect(w->x, w->y, w->w, w->h, w->color);
+    uint16_t tw = strlen(text) * GLYPH_W(w->scale);
+    uint16_t tx = w->x + (tw < w->w ? (w->w - tw) / 2 : 0);
+    uint16_t ty = w->y + (GLYPH_H(w->scale) < w->h
+                              ? (w->h - GLYPH_H(w->scale)) / 2
+                              : 0);
+    TFT_DrawStringAt(tx, ty, text, COLOR_BLACK, w->scale);
+    break;
+  }
+  case WIDGET_VALUE:
+    TFT_FillRect(w->x, w->y, w->w, w->h, s->bg);
+    TFT_DrawStringAt(w->x, w->y, text, w->color, w->scale);
+    break;
+  default:
+    TFT_DrawStringAt(w->x, w->y, text, w->color, w->scale);
+    break;
+  }
+}
+
+void widget_render(WidgetScreen *s) {
+  char text[WIDGET_TEXT_MAX];
+  for (uint8_t i = 0; i < s->count; i++) {
+    Widget *w = &s->widgets[i];
+    widget_text(w, text);
+    if (w->drawn && !strcmp(text, w->shown)) {
+      continue; // the panel already shows it
+    }
+    widget_draw(s, w, text);
+    memcpy(w->shown, text, sizeof(w->shown));
+    w->drawn = 1;
+  }
+}
@@ -0,0 +1,56 @@
+/*
+ * bench.h
+ *
+ * Host benchmarks of firmware hot paths. Each bench brings up the simulated
+ * board itself, measures bus traffic and virtual time around the code under
+ * test and returns non-zero if one of its sanity checks failed.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "sim.h"
+
+#include <stdint.h>
+
+typedef struct {
+  uint64_t transactions;
+  uint64_t bytes;
+  uint64_t ns;
+} BenchCost;
+
+// Fresh simulator, 32 MHz clock tree, GPIO, DMA, SPI1-3 and an initialised
+// TFT; the TFT and camera on the buses sim_config wires them to
+void bench_board_up(void);
+// bench_board_up plus I2C4, LPUART1 and an initialised OV5642 in YCbCr mode
+void bench_camera_up(void);
+
+// The firmware's handle for a simulated bus, NULL being SPI1
+SPI_HandleTypeDef *bench_spi(SPI_TypeDef *bus);
+
+BenchCost bench_cost_now(int bus);
+BenchCost bench_cost_since(int bus, BenchCost start);
+
+int bench_text(void);
+int bench_dma(void);
+int bench_yuv(void);
+int bench_stream(void);
+int bench_fifo(void);
+int bench_capture(void);
+int bench_sched(void);
+int bench_touch(void);
+int bench_widget(void);
+int bench_i2c(void);
+int bench_log(void);
+int bench_trace(void);
+int bench_imgstream(void);
+int bench_jpeg(void);
+int bench_window(void);
+int bench_regload(void);
+int bench_boot(void);
+int bench_format(void);
+int bench_orient(void);
+int bench_preview(void);
+int bench_spibus(void);
+
+#endif /* BENCH_H */
@@ -0,0 +1,65 @@
+/*
+ * img_receiver.h
+ *
+ * Host side of Core/Inc/imgstream.h: picks image packets out of a captured
+ * LPUART1 stream, checks their CRCs and sequence numbers, decompresses the
+ * chunks and hands on each frame that arrived whole and matches its END
+ * CRC. Everything that is not a packet (log text, trace frames) is passed
+ * through in order. Implemented in C++; used by plantpot_imgrecv and the
+ * imgstream bench.
+ */
+
+#ifndef IMG_RECEIVER_H
+#define IMG_RECEIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint16_t id;
+  uint16_t width;
+  uint16_t height;
+  uint8_t format;     // ImgFormat
+  const uint8_t *raw; // the pixels as sent
+  uint32_t raw_len;
+  const uint8_t *rgb; // width * height RGB888 triples, top row first
+} ImgRxFrame;
+
+typedef struct {
+  uint32_t packets;    // with a good CRC
+  uint32_t frames;     // complete and passed on
+  uint32_t bad_crc;    // plausible headers whose CRC did not match
+  uint32_t missing;    // packets skipped in the sequence
+  uint32_t incomplete; // frames ended with chunks missing or a bad CRC
+  uint32_t undecodable; // chunks that did not decompress to their length
+  uint64_t text_bytes; // passed through
+} ImgRxStats;
+
+typedef void (*ImgRxFrameOut)(const ImgRxFrame *frame, void *ctx);
+typedef void (*ImgRxTextOut)(const uint8_t *data, size_t len, void *ctx);
+
+typedef struct ImgReceiver ImgReceiver;
+
+ImgReceiver *img_receiver_new(ImgRxFrameOut frame_out, ImgRxTextOut text_out,
+                              void *ctx);
+void img_receiver_feed(ImgReceiver *r, const uint8_t *data, size_t len);
+// End of stream: passes on bytes held back as a possible packet start
+void img_receiver_flush(ImgReceiver *r);
+const ImgRxStats *img_receiver_stats(const ImgReceiver *r);
+void img_receiver_free(ImgReceiver *r);
+
+// 0 on success
+int img_write_ppm(const char *path, const ImgRxFrame *frame);
+#ifdef PLANTPOT_HAVE_PNG
+int img_write_png(const char *path, const ImgRxFrame *frame);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMG_RECEIVER_H */
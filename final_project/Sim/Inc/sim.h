@@ -0,0 +1,207 @@
+/*
+ * sim.h
+ *
+ * Host simulator for final_project: virtual clock, bus routing and the
+ * virtual devices hanging off the simulated HAL (see stm32l4xx_hal.h).
+ *
+ * Time only moves inside HAL calls. Every bus transfer is charged its wire
+ * time at the configured prescaler / I2C Timing / baud rate plus a fixed CPU
+ * cost per HAL call, and HAL_Delay jumps the clock forward exactly the way
+ * the SysTick based HAL_Delay would.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "stm32l4xx_hal.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/********/
+// Virtual time
+/*******/
+#define SIM_NS_PER_US 1000ULL
+#define SIM_NS_PER_MS 1000000ULL
+
+uint64_t sim_time_ns(void);
+void sim_advance_ns(uint64_t ns);
+void sim_advance_to_ns(uint64_t t);
+void sim_cpu_cycles(uint32_t cycles); // charge CPU work at SYSCLK
+
+typedef void (*sim_event_fn)(void *arg);
+void sim_event_at(uint64_t t, sim_event_fn fn, void *arg);
+
+/********/
+// Run control
+/*******/
+typedef struct {
+  uint64_t stop_ns;  // 0 = run forever
+  double cpu_scale;  // host CPU ns -> virtual ns between HAL calls, 0 = off
+  int uart_echo;     // copy LPUART1 TX to stdout
+  int profile;       // per-loop phase lines and per-caller tables on stderr
+  // SPI the TFT / ArduCHIP are wired to at sim_init, NULL = SPI1; must match
+  // the firmware's BOARD_TFT_SPI / BOARD_CAM_SPI or spi_bus_assign
+  SPI_TypeDef *tft_spi;
+  SPI_TypeDef *cam_spi;
+  // The Nth SPI RX DMA transfer from now ends in an overrun instead of
+  // completing, 0 = none; counts down as transfers finish
+  uint32_t spi_rx_overrun;
+} SimConfig;
+
+extern SimConfig sim_config;
+
+void sim_init(void);
+// Runs entry() until it returns or virtual time reaches sim_config.stop_ns.
+// Returns 1 if the run was stopped by the time limit.
+int sim_run(void (*entry)(void));
+void sim_stop(void);
+void sim_report(void);
+
+/********/
+// Cost model (CPU cycles at SYSCLK)
+/*******/
+typedef struct {
+  uint32_t gpio_write_cycles;
+  uint32_t spi_call_cycles;
+  uint32_t spi_poll_byte_cycles; // polled HAL_SPI_Transmit per byte
+  uint32_t spi_xfer_byte_cycles; // polled Receive/TransmitReceive per byte
+  uint32_t i2c_call_cycles;
+  uint32_t uart_call_cycles;
+  uint32_t dma_setup_cycles; // HAL_xxx_DMA call up to the channel enable
+} SimCosts;
+
+extern SimCosts sim_costs;
+
+/********/
+// Buses
+/*******/
+enum { SIM_BUS_SPI1, SIM_BUS_SPI2, SIM_BUS_SPI3, SIM_BUS_I2C1, SIM_BUS_I2C2,
+       SIM_BUS_I2C3, SIM_BUS_I2C4, SIM_BUS_LPUART1, SIM_BUS_COUNT };
+
+typedef struct {
+  const char *name;
+  uint64_t transactions;
+  uint64_t bytes;
+  uint64_t busy_ns; // wire time plus HAL call overhead
+  uint64_t errors;
+} SimBusStats;
+
+extern SimBusStats sim_bus_stats[SIM_BUS_COUNT];
+extern uint64_t sim_delay_ns; // total time spent in HAL_Delay
+extern uint64_t sim_delay_calls;
+
+uint64_t sim_spi_byte_ns(const SPI_HandleTypeDef *hspi);
+uint64_t sim_i2c_bit_ns(const I2C_HandleTypeDef *hi2c);
+uint64_t sim_uart_byte_ns(const UART_HandleTypeDef *huart);
+
+// LPUART1 TX goes to stdout (uart_echo), to the pty once one is opened and
+// to sim_uart_tap if set. The pty's slave path is written to name.
+int sim_uart_open_pty(char *name, size_t size);
+extern void (*sim_uart_tap)(const uint8_t *data, uint16_t len);
+
+typedef struct SimSpiDevice {
+  const char *name;
+  GPIO_TypeDef *cs_port;
+  uint16_t cs_pin;
+  void (*select)(int selected);
+  uint8_t (*exchange)(uint8_t mosi);
+  struct SimSpiDevice *next;
+} SimSpiDevice;
+
+void sim_spi_attach(SPI_TypeDef *bus, SimSpiDevice *dev);
+
+typedef struct SimI2cDevice {
+  const char *name;
+  uint16_t addr; // HAL style, 7-bit address << 1
+  // Return 0 on ACK, -1 on NACK. *stretch_ns may be set to hold SCL low.
+  int (*write)(const uint8_t *data, uint16_t len, uint64_t *stretch_ns);
+  int (*read)(uint8_t *data, uint16_t len, uint64_t *stretch_ns);
+  struct SimI2cDevice *next;
+} SimI2cDevice;
+
+void sim_i2c_attach(I2C_TypeDef *bus, SimI2cDevice *dev);
+
+// Called on every level change of a watched output pin
+typedef void (*sim_pin_fn)(GPIO_PinState state);
+void sim_gpio_watch(GPIO_TypeDef *port, uint16_t pin, sim_pin_fn fn);
+void sim_gpio_drive(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+
+// Raises the EXTI line of pin as the NVIC would, deferred while in an ISR
+void sim_exti_raise(GPIO_TypeDef *port, uint16_t pin);
+int sim_in_isr(void);
+
+/********/
+// Profiler
+/*******/
+// Bus traffic is attributed to the calling function (see SIM_TAG in
+// stm32l4xx_hal.h) and to the main-loop phase set with PROFILE_PHASE()
+// from Core/Inc/profile.h. Wire time is the bare bit time on the bus;
+// busy time adds HAL call overhead and clock stretching.
+void sim_profile_reset(void);
+void sim_profile_bus(int bus, const char *caller, uint32_t bytes,
+                     uint64_t wire_ns, uint64_t busy_ns);
+void sim_profile_delay(const char *caller, uint64_t ns);
+void sim_profile_phase(const char *name);
+void sim_profile_loop_end(void);
+void sim_profile_report(void);
+
+/********/
+// Virtual devices
+/*******/
+typedef struct {
+  float air_rh;      // Si7021 relative humidity, %
+  float air_temp_c;  // Si7021 temperature
+  uint16_t soil_cap; // Seesaw capacitance, ~200 dry .. 2000 wet
+  float soil_temp_c; // Seesaw temperature
+  float lux;         // BH1750 illuminance
+} SimEnvironment;
+
+extern SimEnvironment sim_env;
+
+void sim_board_init(void); // attaches every device below
+
+// TFT (480x320 RGB565, SPI1 or sim_config.tft_spi, CS PD0, DC PD1, RST PF2)
+void sim_tft_attach(void);
+const uint16_t *sim_tft_framebuffer(void);
+int sim_tft_dump_ppm(const char *path);
+uint64_t sim_tft_pixels_written(void);
+
+// ArduCHIP FIFO on SPI1 or sim_config.cam_spi (CS PA4) + OV5642 on I2C4
+void sim_arducam_attach(void);
+int sim_arducam_load_ppm(const char *path);
+uint32_t sim_arducam_captures(void);
+uint64_t sim_arducam_fifo_bytes_read(void);
+const uint8_t *sim_arducam_fifo(uint32_t *len); // the last frame as captured
+uint32_t sim_ov5642_register_writes(void);
+uint32_t sim_ov5642_window_errors(void); // frames from an impossible setting
+uint8_t sim_ov5642_register(uint16_t reg);
+void sim_ov5642_set_present(int present); // 0 until the next sim_init
+
+// FT6206 (I2C1, INT PF9), Si7021 / Seesaw / BH1750 (I2C2), pump (PB2)
+void sim_sensors_attach(void);
+int sim_touch_script(uint32_t at_ms, uint16_t x, uint16_t y);
+uint64_t sim_pump_on_ns(void);
+uint32_t sim_sensors_early_reads(void); // reads before a conversion finished
+
+/********/
+// Internal: shared between the simulator translation units
+/*******/
+uint32_t sim_sysclk_hz(void);
+void sim_hal_reset(void);
+void sim_hal_enter(void);
+void sim_hal_leave(void);
+void sim_isr_enter(void);
+void sim_isr_leave(void);
+void sim_exti_dispatch_pending(void);
+const char *sim_hal_take_caller(void);
+void sim_hal_caller_override(const char *name); // NULL clears
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_H */
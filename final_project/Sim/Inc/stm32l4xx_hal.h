@@ -0,0 +1,767 @@
+/*
+ * stm32l4xx_hal.h (host simulator)
+ *
+ * Stand-in for the STM32CubeL4 HAL used when final_project/Core is built on
+ * Linux. Only the types, constants and calls that Core/Src actually uses are
+ * declared here. Peripheral instances are plain structs instead of memory
+ * mapped registers; the HAL calls in Sim/Src/sim_hal.c route bytes to the
+ * virtual devices and advance the simulator's virtual clock.
+ */
+
+#ifndef SIM_STM32L4XX_HAL_H
+#define SIM_STM32L4XX_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/********/
+// Common
+/*******/
+typedef enum {
+  HAL_OK = 0x00,
+  HAL_ERROR = 0x01,
+  HAL_BUSY = 0x02,
+  HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+#define UNUSED(X) (void)(X)
+
+#define __disable_irq() sim_disable_irq()
+#define __enable_irq() sim_enable_irq()
+#define __get_PRIMASK() sim_get_primask()
+#define __set_PRIMASK(m) sim_set_primask(m)
+#define __WFI() sim_wfi()
+
+void sim_disable_irq(void);
+void sim_enable_irq(void);
+uint32_t sim_get_primask(void);
+void sim_set_primask(uint32_t mask);
+void sim_wfi(void); // sleeps until the next event, like WFI with SysTick on
+
+// DWT cycle counter: CYCCNT follows virtual time at SystemCoreClock while
+// TRCENA and CYCCNTENA are set; firmware writes to it are honoured
+typedef struct {
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+typedef struct {
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+DWT_Type *sim_dwt(void);
+extern CoreDebug_Type sim_core_debug;
+#define DWT (sim_dwt())
+#define CoreDebug (&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+HAL_StatusTypeDef HAL_Init(void);
+void HAL_MspInit(void);
+void HAL_IncTick(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+/********/
+// RCC / PWR / FLASH
+/*******/
+#define RCC_OSCILLATORTYPE_NONE 0x00000000U
+#define RCC_OSCILLATORTYPE_HSE 0x00000001U
+#define RCC_OSCILLATORTYPE_HSI 0x00000002U
+#define RCC_OSCILLATORTYPE_LSE 0x00000004U
+#define RCC_OSCILLATORTYPE_LSI 0x00000008U
+#define RCC_OSCILLATORTYPE_MSI 0x00000010U
+
+#define RCC_LSE_ON 0x00000001U
+#define RCC_MSI_ON 0x00000001U
+#define RCC_LSEDRIVE_LOW 0x00000000U
+
+// MSIRANGE_n selects 100 kHz .. 48 MHz, see sim_hal.c for the table
+#define RCC_MSIRANGE_0 0x00000000U
+#define RCC_MSIRANGE_1 0x00000010U
+#define RCC_MSIRANGE_2 0x00000020U
+#define RCC_MSIRANGE_3 0x00000030U
+#define RCC_MSIRANGE_4 0x00000040U
+#define RCC_MSIRANGE_5 0x00000050U
+#define RCC_MSIRANGE_6 0x00000060U
+#define RCC_MSIRANGE_7 0x00000070U
+#define RCC_MSIRANGE_8 0x00000080U
+#define RCC_MSIRANGE_9 0x00000090U
+#define RCC_MSIRANGE_10 0x000000A0U
+#define RCC_MSIRANGE_11 0x000000B0U
+
+#define RCC_PLL_NONE 0x00000000U
+#define RCC_PLL_OFF 0x00000001U
+#define RCC_PLL_ON 0x00000002U
+#define RCC_PLLSOURCE_MSI 0x00000001U
+
+#define RCC_PLLP_DIV2 0x00000002U
+#define RCC_PLLQ_DIV2 0x00000002U
+#define RCC_PLLR_DIV2 0x00000002U
+
+#define RCC_CLOCKTYPE_SYSCLK 0x00000001U
+#define RCC_CLOCKTYPE_HCLK 0x00000002U
+#define RCC_CLOCKTYPE_PCLK1 0x00000004U
+#define RCC_CLOCKTYPE_PCLK2 0x00000008U
+
+#define RCC_SYSCLKSOURCE_MSI 0x00000000U
+#define RCC_SYSCLKSOURCE_PLLCLK 0x00000003U
+
+// Dividers are stored as the divide ratio itself
+#define RCC_SYSCLK_DIV1 1U
+#define RCC_SYSCLK_DIV2 2U
+#define RCC_HCLK_DIV1 1U
+#define RCC_HCLK_DIV2 2U
+#define RCC_HCLK_DIV4 4U
+
+#define RCC_PERIPHCLK_USART1 0x00000001U
+#define RCC_PERIPHCLK_LPUART1 0x00000020U
+#define RCC_PERIPHCLK_I2C1 0x00000040U
+#define RCC_PERIPHCLK_I2C2 0x00000080U
+#define RCC_PERIPHCLK_I2C3 0x00000100U
+#define RCC_PERIPHCLK_USB 0x00002000U
+#define RCC_PERIPHCLK_ADC 0x00004000U
+#define RCC_PERIPHCLK_I2C4 0x00020000U
+
+#define RCC_ADCCLKSOURCE_PLLSAI1 0x10000000U
+#define RCC_USBCLKSOURCE_PLLSAI1 0x00000000U
+#define RCC_LPUART1CLKSOURCE_PCLK1 0x00000000U
+#define RCC_I2C1CLKSOURCE_PCLK1 0x00000000U
+#define RCC_I2C2CLKSOURCE_PCLK1 0x00000000U
+#define RCC_I2C3CLKSOURCE_PCLK1 0x00000000U
+#define RCC_I2C4CLKSOURCE_PCLK1 0x00000000U
+#define RCC_PLLSAI1_48M2CLK 0x00100000U
+#define RCC_PLLSAI1_ADC1CLK 0x10000000U
+
+#define FLASH_LATENCY_0 0U
+#define FLASH_LATENCY_1 1U
+#define FLASH_LATENCY_2 2U
+#define FLASH_LATENCY_3 3U
+#define FLASH_LATENCY_4 4U
+
+#define PWR_REGULATOR_VOLTAGE_SCALE1 0x00000200U
+
+typedef struct {
+  uint32_t PLLState;
+  uint32_t PLLSource;
+  uint32_t PLLM;
+  uint32_t PLLN;
+  uint32_t PLLP;
+  uint32_t PLLQ;
+  uint32_t PLLR;
+} RCC_PLLInitTypeDef;
+
+typedef struct {
+  uint32_t OscillatorType;
+  uint32_t HSEState;
+  uint32_t LSEState;
+  uint32_t HSIState;
+  uint32_t HSICalibrationValue;
+  uint32_t LSIState;
+  uint32_t MSIState;
+  uint32_t MSICalibrationValue;
+  uint32_t MSIClockRange;
+  uint32_t HSI48State;
+  RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+
+typedef struct {
+  uint32_t ClockType;
+  uint32_t SYSCLKSource;
+  uint32_t AHBCLKDivider;
+  uint32_t APB1CLKDivider;
+  uint32_t APB2CLKDivider;
+} RCC_ClkInitTypeDef;
+
+typedef struct {
+  uint32_t PLLSAI1Source;
+  uint32_t PLLSAI1M;
+  uint32_t PLLSAI1N;
+  uint32_t PLLSAI1P;
+  uint32_t PLLSAI1Q;
+  uint32_t PLLSAI1R;
+  uint32_t PLLSAI1ClockOut;
+} RCC_PLLSAI1InitTypeDef;
+
+typedef struct {
+  uint32_t PeriphClockSelection;
+  RCC_PLLSAI1InitTypeDef PLLSAI1;
+  uint32_t Usart1ClockSelection;
+  uint32_t Lpuart1ClockSelection;
+  uint32_t I2c1ClockSelection;
+  uint32_t I2c2ClockSelection;
+  uint32_t I2c3ClockSelection;
+  uint32_t I2c4ClockSelection;
+  uint32_t UsbClockSelection;
+  uint32_t AdcClockSelection;
+} RCC_PeriphCLKInitTypeDef;
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct);
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct,
+                                      uint32_t FLatency);
+HAL_StatusTypeDef
+HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit);
+void HAL_RCCEx_EnableMSIPLLMode(void);
+uint32_t HAL_RCC_GetSysClockFreq(void);
+uint32_t HAL_RCC_GetHCLKFreq(void);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+
+HAL_StatusTypeDef HAL_PWREx_ControlVoltageScaling(uint32_t VoltageScaling);
+void HAL_PWREx_EnableVddIO2(void);
+void HAL_PWR_EnableBkUpAccess(void);
+
+extern uint32_t SystemCoreClock;
+
+// Clock gating has no effect in the simulator
+#define __HAL_RCC_LSEDRIVE_CONFIG(__LSEDRIVE__) ((void)(__LSEDRIVE__))
+#define __HAL_RCC_SYSCFG_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_PWR_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOE_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOF_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOG_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOH_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_SPI1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_SPI2_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_SPI3_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_SPI1_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_SPI2_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_SPI3_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_I2C1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_I2C2_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_I2C3_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_I2C4_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_I2C1_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_I2C2_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_I2C3_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_I2C4_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_LPUART1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_LPUART1_CLK_DISABLE() ((void)0)
+#define __HAL_RCC_DMA1_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_DMA2_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_DMAMUX1_CLK_ENABLE() ((void)0)
+
+/********/
+// NVIC
+/*******/
+typedef enum {
+  EXTI0_IRQn = 6,
+  EXTI1_IRQn = 7,
+  EXTI2_IRQn = 8,
+  EXTI3_IRQn = 9,
+  EXTI4_IRQn = 10,
+  DMA1_Channel1_IRQn = 11,
+  DMA1_Channel2_IRQn = 12,
+  DMA1_Channel3_IRQn = 13,
+  DMA1_Channel4_IRQn = 14,
+  DMA1_Channel5_IRQn = 15,
+  DMA1_Channel6_IRQn = 16,
+  DMA1_Channel7_IRQn = 17,
+  EXTI9_5_IRQn = 23,
+  I2C1_EV_IRQn = 31,
+  I2C1_ER_IRQn = 32,
+  I2C2_EV_IRQn = 33,
+  I2C2_ER_IRQn = 34,
+  EXTI15_10_IRQn = 40,
+  LPUART1_IRQn = 70 // above the 64 lines the model tracks; never raised
+} IRQn_Type;
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority,
+                          uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+/********/
+// GPIO
+/*******/
+typedef struct {
+  const char *name;
+  uint16_t odr; // output data register
+  uint16_t idr; // input data register (driven by virtual devices)
+  uint16_t it_mask; // pins configured as EXTI sources
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef sim_gpio[8];
+#define GPIOA (&sim_gpio[0])
+#define GPIOB (&sim_gpio[1])
+#define GPIOC (&sim_gpio[2])
+#define GPIOD (&sim_gpio[3])
+#define GPIOE (&sim_gpio[4])
+#define GPIOF (&sim_gpio[5])
+#define GPIOG (&sim_gpio[6])
+#define GPIOH (&sim_gpio[7])
+
+typedef enum { GPIO_PIN_RESET = 0U, GPIO_PIN_SET } GPIO_PinState;
+
+typedef struct {
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+  uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+#define GPIO_PIN_All ((uint16_t)0xFFFF)
+
+#define GPIO_MODE_INPUT 0x00000000U
+#define GPIO_MODE_OUTPUT_PP 0x00000001U
+#define GPIO_MODE_OUTPUT_OD 0x00000011U
+#define GPIO_MODE_AF_PP 0x00000002U
+#define GPIO_MODE_AF_OD 0x00000012U
+#define GPIO_MODE_ANALOG 0x00000003U
+#define GPIO_MODE_IT_RISING 0x10110000U
+#define GPIO_MODE_IT_FALLING 0x10210000U
+#define GPIO_MODE_IT_RISING_FALLING 0x10310000U
+#define GPIO_MODE_IT_MASK 0x10000000U
+
+#define GPIO_NOPULL 0x00000000U
+#define GPIO_PULLUP 0x00000001U
+#define GPIO_PULLDOWN 0x00000002U
+
+#define GPIO_SPEED_FREQ_LOW 0x00000000U
+#define GPIO_SPEED_FREQ_MEDIUM 0x00000001U
+#define GPIO_SPEED_FREQ_HIGH 0x00000002U
+#define GPIO_SPEED_FREQ_VERY_HIGH 0x00000003U
+
+#define GPIO_AF4_I2C1 ((uint8_t)0x04)
+#define GPIO_AF4_I2C2 ((uint8_t)0x04)
+#define GPIO_AF4_I2C3 ((uint8_t)0x04)
+#define GPIO_AF4_I2C4 ((uint8_t)0x04)
+#define GPIO_AF5_SPI1 ((uint8_t)0x05)
+#define GPIO_AF5_SPI2 ((uint8_t)0x05)
+#define GPIO_AF6_SPI3 ((uint8_t)0x06)
+#define GPIO_AF7_USART2 ((uint8_t)0x07)
+#define GPIO_AF7_USART3 ((uint8_t)0x07)
+#define GPIO_AF8_LPUART1 ((uint8_t)0x08)
+#define GPIO_AF9_CAN1 ((uint8_t)0x09)
+#define GPIO_AF10_OTG_FS ((uint8_t)0x0A)
+#define GPIO_AF12_SDMMC1 ((uint8_t)0x0C)
+#define GPIO_AF13_SAI1 ((uint8_t)0x0D)
+#define GPIO_AF13_SAI2 ((uint8_t)0x0D)
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+
+/********/
+// DMA
+/*******/
+// Only the handle plumbing: transfers are started by the peripheral drivers
+// (HAL_SPI_Transmit_DMA, HAL_SPI_Receive_DMA, HAL_UART_Transmit_DMA) and
+// completed by the engine in sim_hal.c.
+typedef struct {
+  const char *name;
+  IRQn_Type irqn;
+} DMA_Channel_TypeDef;
+
+extern DMA_Channel_TypeDef sim_dma1[7];
+#define DMA1_Channel1 (&sim_dma1[0])
+#define DMA1_Channel2 (&sim_dma1[1])
+#define DMA1_Channel3 (&sim_dma1[2])
+#define DMA1_Channel4 (&sim_dma1[3])
+#define DMA1_Channel5 (&sim_dma1[4])
+#define DMA1_Channel6 (&sim_dma1[5])
+#define DMA1_Channel7 (&sim_dma1[6])
+
+typedef struct {
+  uint32_t Request;
+  uint32_t Direction;
+  uint32_t PeriphInc;
+  uint32_t MemInc;
+  uint32_t PeriphDataAlignment;
+  uint32_t MemDataAlignment;
+  uint32_t Mode;
+  uint32_t Priority;
+} DMA_InitTypeDef;
+
+typedef enum {
+  HAL_DMA_STATE_RESET = 0x00U,
+  HAL_DMA_STATE_READY = 0x01U,
+  HAL_DMA_STATE_BUSY = 0x02U
+} HAL_DMA_StateTypeDef;
+
+typedef struct __DMA_HandleTypeDef {
+  DMA_Channel_TypeDef *Instance;
+  DMA_InitTypeDef Init;
+  HAL_DMA_StateTypeDef State;
+  void *Parent;
+  void (*XferCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+  void (*XferErrorCallback)(struct __DMA_HandleTypeDef *hdma);
+} DMA_HandleTypeDef;
+
+#define DMA_REQUEST_SPI1_RX 10U
+#define DMA_REQUEST_SPI1_TX 11U
+#define DMA_REQUEST_SPI2_RX 12U
+#define DMA_REQUEST_SPI2_TX 13U
+#define DMA_REQUEST_SPI3_RX 14U
+#define DMA_REQUEST_SPI3_TX 15U
+#define DMA_REQUEST_LPUART1_RX 35U
+#define DMA_REQUEST_LPUART1_TX 36U
+#define DMA_PERIPH_TO_MEMORY 0x00000000U
+#define DMA_MEMORY_TO_PERIPH 0x00000010U
+#define DMA_PINC_ENABLE 0x00000040U
+#define DMA_PINC_DISABLE 0x00000000U
+#define DMA_MINC_ENABLE 0x00000080U
+#define DMA_MINC_DISABLE 0x00000000U
+#define DMA_PDATAALIGN_BYTE 0x00000000U
+#define DMA_MDATAALIGN_BYTE 0x00000000U
+#define DMA_NORMAL 0x00000000U
+#define DMA_CIRCULAR 0x00000020U
+#define DMA_PRIORITY_LOW 0x00000000U
+#define DMA_PRIORITY_MEDIUM 0x00001000U
+#define DMA_PRIORITY_HIGH 0x00002000U
+#define DMA_PRIORITY_VERY_HIGH 0x00003000U
+
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__)          \
+  do {                                                                        \
+    (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__);                      \
+    (__DMA_HANDLE__).Parent = (__HANDLE__);                                   \
+  } while (0)
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+/********/
+// SPI
+/*******/
+typedef struct {
+  const char *name;
+  int enabled; // SPE bit
+} SPI_TypeDef;
+
+extern SPI_TypeDef sim_spi[3];
+#define SPI1 (&sim_spi[0])
+#define SPI2 (&sim_spi[1])
+#define SPI3 (&sim_spi[2])
+
+typedef struct {
+  uint32_t Mode;
+  uint32_t Direction;
+  uint32_t DataSize;
+  uint32_t CLKPolarity;
+  uint32_t CLKPhase;
+  uint32_t NSS;
+  uint32_t BaudRatePrescaler;
+  uint32_t FirstBit;
+  uint32_t TIMode;
+  uint32_t CRCCalculation;
+  uint32_t CRCPolynomial;
+  uint32_t CRCLength;
+  uint32_t NSSPMode;
+} SPI_InitTypeDef;
+
+typedef enum {
+  HAL_SPI_STATE_RESET = 0x00U,
+  HAL_SPI_STATE_READY = 0x01U,
+  HAL_SPI_STATE_BUSY = 0x02U,
+  HAL_SPI_STATE_BUSY_TX = 0x03U,
+  HAL_SPI_STATE_BUSY_RX = 0x04U,
+  HAL_SPI_STATE_BUSY_TX_RX = 0x05U
+} HAL_SPI_StateTypeDef;
+
+typedef struct __SPI_HandleTypeDef {
+  SPI_TypeDef *Instance;
+  SPI_InitTypeDef Init;
+  DMA_HandleTypeDef *hdmatx;
+  DMA_HandleTypeDef *hdmarx;
+  volatile HAL_SPI_StateTypeDef State;
+  uint32_t ErrorCode;
+} SPI_HandleTypeDef;
+
+#define SPI_MODE_SLAVE 0x00000000U
+#define SPI_MODE_MASTER 0x00000104U
+#define SPI_DIRECTION_2LINES 0x00000000U
+#define SPI_DATASIZE_8BIT 0x00000700U
+#define SPI_POLARITY_LOW 0x00000000U
+#define SPI_PHASE_1EDGE 0x00000000U
+#define SPI_NSS_SOFT 0x00000200U
+#define SPI_NSS_HARD_INPUT 0x00000000U
+#define SPI_NSS_HARD_OUTPUT 0x00040000U
+// BR[2:0] field of SPI_CR1; the divider is 2 << (value >> 3)
+#define SPI_BAUDRATEPRESCALER_2 0x00000000U
+#define SPI_BAUDRATEPRESCALER_4 0x00000008U
+#define SPI_BAUDRATEPRESCALER_8 0x00000010U
+#define SPI_BAUDRATEPRESCALER_16 0x00000018U
+#define SPI_BAUDRATEPRESCALER_32 0x00000020U
+#define SPI_BAUDRATEPRESCALER_64 0x00000028U
+#define SPI_BAUDRATEPRESCALER_128 0x00000030U
+#define SPI_BAUDRATEPRESCALER_256 0x00000038U
+#define SPI_FIRSTBIT_MSB 0x00000000U
+#define SPI_TIMODE_DISABLE 0x00000000U
+#define SPI_CRCCALCULATION_DISABLE 0x00000000U
+#define SPI_CRC_LENGTH_DATASIZE 0x00000000U
+#define SPI_NSS_PULSE_DISABLE 0x00000000U
+
+#define HAL_SPI_ERROR_NONE 0x00000000U
+#define HAL_SPI_ERROR_OVR 0x00000004U
+
+#define __HAL_SPI_ENABLE(__HANDLE__) ((__HANDLE__)->Instance->enabled = 1)
+#define __HAL_SPI_DISABLE(__HANDLE__) ((__HANDLE__)->Instance->enabled = 0)
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi);
+void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi);
+void HAL_SPI_MspDeInit(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                   uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                  uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi,
+                                          uint8_t *pTxData, uint8_t *pRxData,
+                                          uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                       uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                      uint16_t Size);
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
+
+/********/
+// I2C
+/*******/
+typedef struct {
+  const char *name;
+} I2C_TypeDef;
+
+extern I2C_TypeDef sim_i2c[4];
+#define I2C1 (&sim_i2c[0])
+#define I2C2 (&sim_i2c[1])
+#define I2C3 (&sim_i2c[2])
+#define I2C4 (&sim_i2c[3])
+
+typedef struct {
+  uint32_t Timing;
+  uint32_t OwnAddress1;
+  uint32_t AddressingMode;
+  uint32_t DualAddressMode;
+  uint32_t OwnAddress2;
+  uint32_t OwnAddress2Masks;
+  uint32_t GeneralCallMode;
+  uint32_t NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef enum {
+  HAL_I2C_STATE_RESET = 0x00U,
+  HAL_I2C_STATE_READY = 0x20U,
+  HAL_I2C_STATE_BUSY_TX = 0x21U,
+  HAL_I2C_STATE_BUSY_RX = 0x22U,
+  HAL_I2C_STATE_ABORT = 0x60U
+} HAL_I2C_StateTypeDef;
+
+typedef struct __I2C_HandleTypeDef {
+  I2C_TypeDef *Instance;
+  I2C_InitTypeDef Init;
+  volatile HAL_I2C_StateTypeDef State;
+  volatile uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+#define I2C_ADDRESSINGMODE_7BIT 0x00000001U
+#define I2C_DUALADDRESS_DISABLE 0x00000000U
+#define I2C_OA2_NOMASK 0x00U
+#define I2C_GENERALCALL_DISABLE 0x00000000U
+#define I2C_NOSTRETCH_DISABLE 0x00000000U
+#define I2C_ANALOGFILTER_ENABLE 0x00000000U
+#define I2C_MEMADD_SIZE_8BIT 0x00000001U
+#define I2C_MEMADD_SIZE_16BIT 0x00000002U
+
+#define HAL_I2C_ERROR_NONE 0x00000000U
+#define HAL_I2C_ERROR_AF 0x00000004U
+#define HAL_I2C_ERROR_TIMEOUT 0x00000020U
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MspDeInit(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter(I2C_HandleTypeDef *hi2c,
+                                               uint32_t AnalogFilter);
+HAL_StatusTypeDef HAL_I2CEx_ConfigDigitalFilter(I2C_HandleTypeDef *hi2c,
+                                                uint32_t DigitalFilter);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c,
+                                          uint16_t DevAddress, uint8_t *pData,
+                                          uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c,
+                                         uint16_t DevAddress, uint8_t *pData,
+                                         uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c,
+                                    uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t *pData,
+                                    uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c,
+                                   uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t *pData,
+                                   uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c,
+                                        uint16_t DevAddress, uint32_t Trials,
+                                        uint32_t Timeout);
+// Interrupt mode, I2C1 and I2C2 only (the IRQ lines the model knows about)
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c,
+                                             uint16_t DevAddress,
+                                             uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c,
+                                            uint16_t DevAddress,
+                                            uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c,
+                                          uint16_t DevAddress);
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c);
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c);
+
+/********/
+// UART
+/*******/
+typedef struct {
+  const char *name;
+} USART_TypeDef;
+
+extern USART_TypeDef sim_lpuart1;
+#define LPUART1 (&sim_lpuart1)
+
+typedef struct {
+  uint32_t BaudRate;
+  uint32_t WordLength;
+  uint32_t StopBits;
+  uint32_t Parity;
+  uint32_t Mode;
+  uint32_t HwFlowCtl;
+  uint32_t OneBitSampling;
+  uint32_t ClockPrescaler;
+} UART_InitTypeDef;
+
+typedef struct {
+  uint32_t AdvFeatureInit;
+} UART_AdvFeatureInitTypeDef;
+
+typedef enum {
+  HAL_UART_STATE_RESET = 0x00U,
+  HAL_UART_STATE_READY = 0x20U,
+  HAL_UART_STATE_BUSY_TX = 0x21U
+} HAL_UART_StateTypeDef;
+
+typedef struct __UART_HandleTypeDef {
+  USART_TypeDef *Instance;
+  UART_InitTypeDef Init;
+  UART_AdvFeatureInitTypeDef AdvancedInit;
+  uint32_t FifoMode;
+  DMA_HandleTypeDef *hdmatx;
+  volatile HAL_UART_StateTypeDef gState;
+  uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define UART_WORDLENGTH_8B 0x00000000U
+#define UART_STOPBITS_1 0x00000000U
+#define UART_PARITY_NONE 0x00000000U
+#define UART_MODE_TX_RX 0x0000000CU
+#define UART_HWCONTROL_NONE 0x00000000U
+#define UART_ONE_BIT_SAMPLE_DISABLE 0x00000000U
+#define UART_PRESCALER_DIV1 0x00000000U
+#define UART_ADVFEATURE_NO_INIT 0x00000000U
+#define UART_FIFOMODE_DISABLE 0x00000000U
+#define UART_TXFIFO_THRESHOLD_1_8 0x00000000U
+#define UART_RXFIFO_THRESHOLD_1_8 0x00000000U
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+void HAL_UART_MspInit(UART_HandleTypeDef *huart);
+void HAL_UART_MspDeInit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UARTEx_SetTxFifoThreshold(UART_HandleTypeDef *huart,
+                                                uint32_t Threshold);
+HAL_StatusTypeDef HAL_UARTEx_SetRxFifoThreshold(UART_HandleTypeDef *huart,
+                                                uint32_t Threshold);
+HAL_StatusTypeDef HAL_UARTEx_DisableFifoMode(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout);
+// Completes from the TX DMA channel's interrupt; on target the HAL finishes
+// in HAL_UART_IRQHandler on the TC flag, which the model folds into the DMA
+// completion (the handler is a no-op here)
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart,
+                                        const uint8_t *pData, uint16_t Size);
+HAL_UART_StateTypeDef HAL_UART_GetState(UART_HandleTypeDef *huart);
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+
+/********/
+// ADC / TIM (configured by CubeMX but not exercised by the application)
+/*******/
+typedef struct {
+  void *Instance;
+} ADC_HandleTypeDef;
+
+typedef struct {
+  void *Instance;
+} TIM_HandleTypeDef;
+
+/********/
+// Caller tagging for the bus profiler
+/*******/
+// Every bus call and HAL_Delay records the function it was made from, so the
+// profile can say "tft_writeData" instead of just "SPI1". Sim/Src defines
+// SIM_HAL_IMPL to see the plain declarations.
+extern const char *sim_hal_caller;
+
+#ifndef SIM_HAL_IMPL
+#define SIM_TAG(call) (sim_hal_caller = __func__, call)
+#define HAL_Delay(...) SIM_TAG(HAL_Delay(__VA_ARGS__))
+#define HAL_SPI_Transmit(...) SIM_TAG(HAL_SPI_Transmit(__VA_ARGS__))
+#define HAL_SPI_Receive(...) SIM_TAG(HAL_SPI_Receive(__VA_ARGS__))
+#define HAL_SPI_TransmitReceive(...)                                          \
+  SIM_TAG(HAL_SPI_TransmitReceive(__VA_ARGS__))
+#define HAL_SPI_Transmit_DMA(...) SIM_TAG(HAL_SPI_Transmit_DMA(__VA_ARGS__))
+#define HAL_SPI_Receive_DMA(...) SIM_TAG(HAL_SPI_Receive_DMA(__VA_ARGS__))
+#define HAL_I2C_Master_Transmit(...)                                          \
+  SIM_TAG(HAL_I2C_Master_Transmit(__VA_ARGS__))
+#define HAL_I2C_Master_Receive(...)                                           \
+  SIM_TAG(HAL_I2C_Master_Receive(__VA_ARGS__))
+#define HAL_I2C_Mem_Write(...) SIM_TAG(HAL_I2C_Mem_Write(__VA_ARGS__))
+#define HAL_I2C_Mem_Read(...) SIM_TAG(HAL_I2C_Mem_Read(__VA_ARGS__))
+#define HAL_I2C_IsDeviceReady(...) SIM_TAG(HAL_I2C_IsDeviceReady(__VA_ARGS__))
+#define HAL_I2C_Master_Transmit_IT(...)                                       \
+  SIM_TAG(HAL_I2C_Master_Transmit_IT(__VA_ARGS__))
+#define HAL_I2C_Master_Receive_IT(...)                                        \
+  SIM_TAG(HAL_I2C_Master_Receive_IT(__VA_ARGS__))
+#define HAL_UART_Transmit(...) SIM_TAG(HAL_UART_Transmit(__VA_ARGS__))
+#define HAL_UART_Transmit_DMA(...) SIM_TAG(HAL_UART_Transmit_DMA(__VA_ARGS__))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_STM32L4XX_HAL_H */
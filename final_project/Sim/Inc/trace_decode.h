@@ -0,0 +1,55 @@
+/*
+ * trace_decode.h
+ *
+ * Host side of Core/Inc/trace.h: splits a captured LPUART1 stream into log
+ * text, passed through as is, and trace frames, which are formatted back
+ * into text with the format strings from the firmware ELF's trace_fmt
+ * section. Used by plantpot_tracedump and by the simulator's stdout echo.
+ */
+
+#ifndef TRACE_DECODE_H
+#define TRACE_DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_DECODE_FRAME_MAX 512
+
+typedef void (*TraceDecodeOut)(const char *text, size_t len, void *ctx);
+
+typedef struct {
+  char *fmt; // the trace_fmt section, NUL terminated
+  size_t fmt_size;
+  int stamps; // prefix records with [seconds]
+
+  // stream position
+  uint8_t state;
+  uint32_t frame_len;
+  uint8_t len_shift;
+  uint8_t frame[TRACE_DECODE_FRAME_MAX];
+  uint32_t frame_at;
+
+  uint64_t cycles; // time of the last record, unwrapped
+  uint8_t have_time;
+
+  uint32_t frames;
+  uint32_t records;
+  uint32_t lost;     // reported by the firmware
+  uint32_t bad;      // frames that did not decode
+} TraceDecoder;
+
+// 0 on success; the file may be an ARM firmware image or a host build
+int trace_decoder_load_elf(TraceDecoder *d, const char *path);
+void trace_decoder_feed(TraceDecoder *d, const uint8_t *data, size_t len,
+                        TraceDecodeOut out, void *ctx);
+void trace_decoder_free(TraceDecoder *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_DECODE_H */
@@ -0,0 +1,167 @@
+/*
+ * bench_boot.c
+ *
+ * Cold start of the camera, pump, TFT and touch controller: one after the
+ * other with blocking inits, in main.c's old order, against the boot
+ * sequencer running their step functions side by side. The dashboard can go
+ * up once the TFT is ready, so that time is reported beside the whole boot.
+ * Both boots must leave the devices in the same state, checked with one
+ * capture to the TFT, and a camera that never answers must cost no more
+ * than its bounded probes while everything else still comes up.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "boot.h"
+#include "camera.h"
+#include "dma.h"
+#include "gpio.h"
+#include "i2c.h"
+#include "pump.h"
+#include "spi.h"
+#include "spi_bus.h"
+#include "touch.h"
+#include "usart.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void SystemClock_Config(void);
+
+enum { DEV_CAMERA, DEV_PUMP, DEV_TFT, DEV_TOUCH, DEV_COUNT };
+
+static BootTask devices[DEV_COUNT] = {
+    [DEV_CAMERA] = {"camera", ArduCam_InitStep_YCbCr},
+    [DEV_PUMP] = {"pump", pump_prime_step},
+    [DEV_TFT] = {"tft", TFT_InitStep},
+    [DEV_TOUCH] = {"touch", TOUCH_InitStep},
+};
+
+static uint16_t serial_frame[TFT_WIDTH * TFT_HEIGHT];
+
+// Clocks and buses only; every device is left to the boot under test
+static void board(void) {
+  sim_config.stop_ns = 0;
+  sim_config.uart_echo = 0;
+  sim_init();
+  HAL_Init();
+  SystemClock_Config();
+  MX_GPIO_Init();
+  MX_DMA_Init();
+  MX_SPI1_Init();
+  spi_bus_init();
+  MX_I2C1_Init();
+  MX_I2C4_Init();
+  MX_LPUART1_UART_Init();
+}
+
+typedef struct {
+  uint32_t done_ms[DEV_COUNT];
+  uint8_t ok[DEV_COUNT];
+  uint32_t total_ms;
+} Boot;
+
+static Boot boot_serial(void) {
+  Boot b = {0};
+  uint32_t start = HAL_GetTick();
+  for (int i = 0; i < DEV_COUNT; i++) {
+    b.ok[i] = boot_run_one(devices[i].step);
+    b.done_ms[i] = HAL_GetTick() - start;
+  }
+  b.total_ms = HAL_GetTick() - start;
+  return b;
+}
+
+static Boot boot_sequenced(void) {
+  Boot b = {0};
+  boot_start(devices, DEV_COUNT);
+  while (boot_poll()) {
+    __WFI();
+  }
+  for (int i = 0; i < DEV_COUNT; i++) {
+    b.ok[i] = devices[i].status == BOOT_OK;
+    b.done_ms[i] = devices[i].done_ms;
+  }
+  b.total_ms = boot_elapsed_ms();
+  return b;
+}
+
+static void row(const char *what, Boot b) {
+  fprintf(stdout, "  %-18s", what);
+  for (int i = 0; i < DEV_COUNT; i++) {
+    fprintf(stdout, " %6lu%s", (unsigned long)b.done_ms[i],
+            b.ok[i] ? " " : "!");
+  }
+  fprintf(stdout, " %8lu\n", (unsigned long)b.total_ms);
+}
+
+static int all_up(Boot b, int except) {
+  for (int i = 0; i < DEV_COUNT; i++) {
+    if (i != except && !b.ok[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int bench_boot(void) {
+  int failed = 0;
+
+  fprintf(stdout, "%-20s", "done at, ms");
+  for (int i = 0; i < DEV_COUNT; i++) {
+    fprintf(stdout, " %7s", devices[i].name);
+  }
+  fprintf(stdout, " %8s\n", "boot");
+
+  board();
+  Boot serial = boot_serial();
+  row("one after another", serial);
+  SingleCapStream_YCbCr(0, 0, 1);
+  memcpy(serial_frame, sim_tft_framebuffer(), sizeof(serial_frame));
+
+  board();
+  Boot seq = boot_sequenced();
+  row("sequencer", seq);
+  SingleCapStream_YCbCr(0, 0, 1);
+  uint32_t differ = 0;
+  const uint16_t *fb = sim_tft_framebuffer();
+  for (uint32_t i = 0; i < TFT_WIDTH * TFT_HEIGHT; i++) {
+    differ += fb[i] != serial_frame[i];
+  }
+  fprintf(stdout, "  dashboard possible after %lu ms instead of %lu, boot "
+                  "%.1fx faster; first capture: %lu pixels differ\n",
+          (unsigned long)seq.done_ms[DEV_TFT],
+          (unsigned long)serial.done_ms[DEV_TFT],
+          (double)serial.total_ms / seq.total_ms, (unsigned long)differ);
+  if (!all_up(serial, -1) || !all_up(seq, -1)) {
+    fprintf(stdout, "  FAIL: a device did not come up\n");
+    failed = 1;
+  }
+  if (differ) {
+    fprintf(stdout, "  FAIL: devices are set up differently\n");
+    failed = 1;
+  }
+  // Nothing waits for anything else: the boot is the slowest device, the
+  // pump, plus at most the camera's table load holding it up
+  if (seq.total_ms > PUMP_PRIME_MS + 100 ||
+      seq.done_ms[DEV_TFT] >= serial.done_ms[DEV_TFT]) {
+    fprintf(stdout, "  FAIL: bring-ups did not overlap\n");
+    failed = 1;
+  }
+
+  // The OV5642 unplugged: the chip id probe gives up, the others come up
+  board();
+  sim_ov5642_set_present(0);
+  Boot missing = boot_sequenced();
+  row("sequencer, no OV5642", missing);
+  uint32_t probe_ms = 200 + CAM_PROBE_TRIES * CAM_PROBE_RETRY_MS;
+  if (missing.ok[DEV_CAMERA] || !all_up(missing, DEV_CAMERA) ||
+      missing.done_ms[DEV_CAMERA] > probe_ms + 50 ||
+      missing.total_ms > seq.total_ms) {
+    fprintf(stdout, "  FAIL: missing camera not given up on in %lu ms\n",
+            (unsigned long)probe_ms);
+    failed = 1;
+  }
+  return failed;
+}
@@ -0,0 +1,97 @@
+/*
+ * bench_capture.c
+ *
+ * Capture latency of the cam_capture_* state machine against the fixed
+ * sleeps it replaced (CAP_DONE polled once a second, then 755 ms). The
+ * state machine is stepped from a stand-in main loop that spends LOOP_MS
+ * on other work per iteration; the longest single step is how long the
+ * loop was held up. Every run starts from a fresh board so all see the
+ * same frame, and the stepped picture must match the blocking one.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PHOTO_X 20
+#define PHOTO_Y 100
+#define LOOP_MS 5
+
+static uint16_t snapshot[TFT_WIDTH * TFT_HEIGHT];
+
+// The old capture_frame wait, for reference
+static uint64_t fixed_sleeps_ns(void) {
+  bench_camera_up();
+  uint64_t t0 = sim_time_ns();
+  flush_fifo();
+  clear_fifo_flag();
+  start_capture();
+  while (!get_bit(ARDUCHIP_TRIG, CAP_DONE_MASK)) {
+    HAL_Delay(1000);
+  }
+  HAL_Delay(5);
+  HAL_Delay(750);
+  return sim_time_ns() - t0;
+}
+
+static uint64_t blocking_ns(void) {
+  bench_camera_up();
+  TFT_FillScreen(COLOR_WHITE);
+  uint64_t t0 = sim_time_ns();
+  SingleCapStream_YCbCr(PHOTO_X, PHOTO_Y, 2);
+  return sim_time_ns() - t0;
+}
+
+int bench_capture(void) {
+  int failed = 0;
+
+  uint64_t fixed = fixed_sleeps_ns();
+  uint64_t blocking = blocking_ns();
+  memcpy(snapshot, sim_tft_framebuffer(), sizeof(snapshot));
+
+  bench_camera_up();
+  TFT_FillScreen(COLOR_WHITE);
+  uint64_t t0 = sim_time_ns(), longest = 0;
+  unsigned loops = 0;
+  cam_capture_start(PHOTO_X, PHOTO_Y, 2);
+  uint8_t done = 0;
+  while (!done && loops < 10000) {
+    uint64_t s = sim_time_ns();
+    done = cam_capture_step();
+    if (sim_time_ns() - s > longest) {
+      longest = sim_time_ns() - s;
+    }
+    HAL_Delay(LOOP_MS); // the rest of the main loop
+    loops++;
+  }
+  uint64_t stepped = sim_time_ns() - t0;
+  const CamCaptureStats *cs = cam_capture_stats();
+
+  if (!done) {
+    fprintf(stdout, "  capture never finished\n");
+    failed = 1;
+  }
+  if (memcmp(snapshot, sim_tft_framebuffer(), sizeof(snapshot))) {
+    fprintf(stdout, "  stepped picture differs from blocking\n");
+    failed = 1;
+  }
+  if (longest / 1000000 > CAM_DRAIN_BUDGET_MS + 10) {
+    fprintf(stdout, "  a step held the loop for %.1f ms\n", longest / 1e6);
+    failed = 1;
+  }
+
+  fprintf(stdout, "%-26s %10s\n", "capture to TFT", "ms");
+  fprintf(stdout, "%-26s %10.1f\n", "fixed sleeps (wait only)", fixed / 1e6);
+  fprintf(stdout, "%-26s %10.1f\n", "SingleCapStream_YCbCr", blocking / 1e6);
+  fprintf(stdout, "%-26s %10.1f  (%u loops, longest step %.1f ms)\n",
+          "stepped, 5 ms loop", stepped / 1e6, loops, longest / 1e6);
+  fprintf(stdout, "stats: exposure %u ms, first pixel %u ms, total %u ms, "
+                  "%u CAP_DONE polls\n",
+          (unsigned)cs->wait_ms, (unsigned)cs->first_pixel_ms,
+          (unsigned)cs->total_ms, (unsigned)cs->polls);
+  return failed;
+}
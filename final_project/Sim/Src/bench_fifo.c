@@ -0,0 +1,149 @@
+/*
+ * bench_fifo.c
+ *
+ * Reading one captured frame out of the ArduCHIP FIFO three ways: 4-byte
+ * HAL_SPI_Receive calls (the original loop), one blocking receive per sensor
+ * line, and the cam_fifo_* SPI1 RX DMA ring. Each reader converts what it
+ * got with yuyv_to_rgb565, with host CPU time charged at BENCH_CPU_SCALE, so
+ * the DMA ring can overlap the conversion with the next burst. Every run
+ * starts from a fresh board so all three read the same frame, which must
+ * come out byte for byte the same. Last, an RX overrun injected into the
+ * DMA ring's third chunk must end the read there with the bus free, and the
+ * next frame must read whole again.
+ */
+
+#include "bench.h"
+
+#include "camera.h"
+#include "spi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_CPU_SCALE 40.0
+#define LINE_BYTES (CAM_FRAME_W * 2)
+
+static uint8_t yuyv[yuyv_data_length];
+static uint8_t reference[yuyv_data_length];
+static uint8_t rgb[rgb565_data_length];
+
+static uint32_t capture(void) {
+  bench_camera_up();
+  flush_fifo();
+  clear_fifo_flag();
+  start_capture();
+  while (!get_bit(ARDUCHIP_TRIG, CAP_DONE_MASK)) {
+    HAL_Delay(1);
+  }
+  uint32_t length = read_fifo_length();
+  return length > yuyv_data_length ? yuyv_data_length : length;
+}
+
+static void convert(uint32_t at, uint32_t n) {
+  yuyv_to_rgb565(yuyv + at, rgb + at, n / 2);
+}
+
+static void read_blocking(uint32_t length, uint16_t step) {
+  CS_LOW();
+  set_fifo_burst();
+  for (uint32_t at = 0; at < length; at += step) {
+    uint16_t n = length - at < step ? length - at : step;
+    HAL_SPI_Receive(&hspi1, yuyv + at, n, HAL_MAX_DELAY);
+    convert(at, n);
+  }
+  CS_HIGH();
+}
+
+static void read_quads(uint32_t length) { read_blocking(length, 4); }
+
+static void read_lines(uint32_t length) { read_blocking(length, LINE_BYTES); }
+
+// Bytes read before the ring gave NULL
+static uint32_t read_ring(uint32_t length) {
+  const uint8_t *chunk;
+  uint16_t n;
+  uint32_t at = 0;
+  cam_fifo_open(length, CAM_FIFO_CHUNK);
+  while ((chunk = cam_fifo_read(&n)) != NULL) {
+    memcpy(yuyv + at, chunk, n);
+    convert(at, n);
+    at += n;
+  }
+  cam_fifo_close();
+  return at;
+}
+
+static void read_dma(uint32_t length) { read_ring(length); }
+
+static const struct {
+  const char *name;
+  void (*read)(uint32_t length);
+} readers[] = {
+    {"4-byte receives", read_quads},
+    {"line receives", read_lines},
+    {"DMA chunk ring", read_dma},
+};
+
+int bench_fifo(void) {
+  int failed = 0;
+
+  fprintf(stdout, "%-16s %8s %8s | %9s %8s\n", "reader", "bytes", "xfers",
+          "ms", "MB/s");
+  for (unsigned i = 0; i < sizeof(readers) / sizeof(readers[0]); i++) {
+    uint32_t length = capture();
+    memset(yuyv, 0, sizeof(yuyv));
+    uint64_t errors = sim_bus_stats[SIM_BUS_SPI1].errors;
+
+    sim_config.cpu_scale = BENCH_CPU_SCALE;
+    sim_hal_leave();
+    BenchCost start = bench_cost_now(SIM_BUS_SPI1);
+    readers[i].read(length);
+    BenchCost cost = bench_cost_since(SIM_BUS_SPI1, start);
+    sim_config.cpu_scale = 0.0;
+
+    if (i == 0) {
+      memcpy(reference, yuyv, sizeof(reference));
+    } else if (memcmp(reference, yuyv, sizeof(reference))) {
+      fprintf(stdout, "  %s: frame differs from 4-byte receives\n",
+              readers[i].name);
+      failed = 1;
+    }
+    if (sim_bus_stats[SIM_BUS_SPI1].errors != errors ||
+        HAL_SPI_GetState(&hspi1) != HAL_SPI_STATE_READY) {
+      fprintf(stdout, "  %s: SPI1 left busy or used while busy\n",
+              readers[i].name);
+      failed = 1;
+    }
+    if (length != yuyv_data_length) {
+      fprintf(stdout, "  FIFO holds %u bytes, expected a full frame\n",
+              (unsigned)length);
+      failed = 1;
+    }
+
+    fprintf(stdout, "%-16s %8llu %8llu | %9.2f %8.2f\n", readers[i].name,
+            (unsigned long long)cost.bytes,
+            (unsigned long long)cost.transactions, cost.ns / 1e6,
+            length / (cost.ns / 1e9) / 1e6);
+  }
+
+  // An overrun on the third chunk
+  uint64_t errors = sim_bus_stats[SIM_BUS_SPI1].errors;
+  sim_config.spi_rx_overrun = 3;
+  uint32_t got = read_ring(capture());
+  uint64_t overruns = sim_bus_stats[SIM_BUS_SPI1].errors - errors;
+  sim_config.spi_rx_overrun = 0;
+  memset(yuyv, 0, sizeof(yuyv));
+  uint32_t again = read_ring(capture());
+  fprintf(stdout, "overrun: %lu bytes, then %lu\n", (unsigned long)got,
+          (unsigned long)again);
+  if (got != 2 * CAM_FIFO_CHUNK || overruns != 1 ||
+      HAL_SPI_GetState(&hspi1) != HAL_SPI_STATE_READY) {
+    fprintf(stdout, "  overrun did not end the read at the third chunk\n");
+    failed = 1;
+  }
+  if (again != yuyv_data_length || memcmp(reference, yuyv, sizeof(yuyv))) {
+    fprintf(stdout, "  the frame after the overrun came out wrong\n");
+    failed = 1;
+  }
+  return failed;
+}
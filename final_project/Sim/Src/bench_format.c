@@ -0,0 +1,192 @@
+/*
+ * bench_format.c
+ *
+ * One 320x240 capture streamed to the TFT in each raw output format, YUV422,
+ * RGB565 and Y8, upright and turned on the sensor. The FIFO must hold exactly
+ * the bytes the format promises, and every TFT pixel must be the matching
+ * FIFO pixel, in order: the RGB565 word as sent, the YUYV pair through
+ * yuyv_to_rgb565, Y as grey.
+ * Then the format negotiation: JPEG is refused on the YCbCr bring-up and
+ * the raw formats on the JPEG one, neither touching the sensor, and the
+ * JPEG bring-up's frame decodes.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define W CAM_FRAME_W
+#define H CAM_FRAME_H
+
+static const struct {
+  const char *name;
+  CamFormat fmt;
+  uint8_t bpp, r4300, r501f;
+} formats[] = {
+    {"YUV422", CAM_FMT_YUV422, 2, 0x30, 0x00},
+    {"RGB565", CAM_FMT_RGB565, 2, 0x61, 0x01},
+    {"Y8", CAM_FMT_Y8, 1, 0x10, 0x00},
+};
+
+static uint16_t expect_line[W];
+
+// Frame pixel (x, y) of the FIFO as the TFT should show it
+static uint16_t expected(CamFormat fmt, const uint8_t *fifo, uint32_t x,
+                         uint32_t y) {
+  const uint8_t *p;
+  switch (fmt) {
+  case CAM_FMT_RGB565:
+    p = fifo + (y * W + x) * 2;
+    return (uint16_t)(p[0] << 8 | p[1]);
+  case CAM_FMT_Y8: {
+    uint8_t v = fifo[y * W + x];
+    return (uint16_t)((v >> 3) << 11 | (v >> 2) << 5 | v >> 3);
+  }
+  default: {
+    uint8_t be[4];
+    p = fifo + (y * W + (x & ~1u)) * 2;
+    yuyv_to_rgb565(p, be, 2);
+    return (uint16_t)(be[(x & 1) * 2] << 8 | be[(x & 1) * 2 + 1]);
+  }
+  }
+}
+
+// TFT pixels at the origin that are not the FIFO pixel they should show
+static uint32_t mismatches(CamFormat fmt) {
+  uint32_t len;
+  const uint8_t *fifo = sim_arducam_fifo(&len);
+  const uint16_t *fb = sim_tft_framebuffer();
+  uint32_t bad = 0;
+  for (uint32_t y = 0; y < H; y++) {
+    for (uint32_t x = 0; x < W; x++) {
+      expect_line[x] = expected(fmt, fifo, x, y);
+    }
+    for (uint32_t x = 0; x < W; x++) {
+      bad += fb[y * TFT_WIDTH + x] != expect_line[x];
+    }
+  }
+  return bad;
+}
+
+static int check_negotiation(void) {
+  int failed = 0;
+  bench_camera_up();
+  uint32_t writes = sim_ov5642_register_writes();
+  CamFormat got = cam_set_format(CAM_FMT_JPEG);
+  if (got != CAM_FMT_YUV422 || sim_ov5642_register_writes() != writes) {
+    fprintf(stdout, "  FAIL: JPEG granted on the YCbCr bring-up\n");
+    failed = 1;
+  }
+
+  ArduCam_Init_JPEG(OV5642_320x240);
+  writes = sim_ov5642_register_writes();
+  got = cam_set_format(CAM_FMT_RGB565);
+  CamCaptureState state = cam_capture_state();
+  uint64_t fifo_read = sim_arducam_fifo_bytes_read();
+  uint8_t started = cam_capture_start(0, 0, 1);
+  SingleCapStream_YCbCr(0, 0, 1); // must return, not wait for a capture
+  SingleCapTransfer_YCbCr(0, 0, camera_buf);
+  if (got != CAM_FMT_JPEG || sim_ov5642_register_writes() != writes ||
+      started || cam_capture_state() != state ||
+      sim_arducam_fifo_bytes_read() != fifo_read) {
+    fprintf(stdout, "  FAIL: raw format granted on the JPEG bring-up\n");
+    failed = 1;
+  }
+  JpegDecInfo info;
+  JpegDecResult r = SingleCapJpeg(0, 0, TFT_WIDTH, TFT_HEIGHT, &info);
+  uint32_t len;
+  const uint8_t *fifo = sim_arducam_fifo(&len);
+  fprintf(stdout, "  %-8s %-7s %8lu  %ux%u decoded: %s\n", "JPEG", "",
+          (unsigned long)len, info.out_w, info.out_h,
+          r == JPEGDEC_OK ? "ok" : "FAILED");
+  if (r != JPEGDEC_OK || len < 2 || fifo[0] != 0xff || fifo[1] != 0xd8) {
+    fprintf(stdout, "  FAIL: JPEG format capture\n");
+    failed = 1;
+  }
+  fprintf(stdout, "negotiation      JPEG refused on YCbCr, raw refused on "
+                  "JPEG, no register writes\n");
+  return failed;
+}
+
+int bench_format(void) {
+  int failed = 0;
+  static uint16_t yuv_picture[TFT_WIDTH * TFT_HEIGHT];
+
+  fprintf(stdout, "%-10s %-7s %8s %9s %9s %9s\n", "format", "turned",
+          "FIFO B", "SPI1 ms", "0x4300", "mismatch");
+  for (unsigned i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+    for (uint8_t rotate180 = 0; rotate180 < 2; rotate180++) {
+      bench_camera_up();
+      TFT_FillScreen(COLOR_WHITE);
+      cam_set_orientation(rotate180 ? CAM_ORIENT_ROTATE180
+                                    : CAM_ORIENT_UPRIGHT);
+      if (cam_set_format(formats[i].fmt) != formats[i].fmt) {
+        fprintf(stdout, "  FAIL: %s refused\n", formats[i].name);
+        failed = 1;
+        continue;
+      }
+      BenchCost spi = bench_cost_now(SIM_BUS_SPI1);
+      uint64_t fifo = sim_arducam_fifo_bytes_read();
+      SingleCapStream_YCbCr(0, 0, 1);
+      spi = bench_cost_since(SIM_BUS_SPI1, spi);
+      fifo = sim_arducam_fifo_bytes_read() - fifo;
+
+      uint32_t len;
+      sim_arducam_fifo(&len);
+      uint32_t bad = mismatches(formats[i].fmt);
+      uint8_t r4300 = sim_ov5642_register(0x4300);
+      fprintf(stdout, "  %-8s %-7s %8llu %9.1f %9s %9lu\n", formats[i].name,
+              rotate180 ? "180" : "no", (unsigned long long)fifo,
+              spi.ns / 1e6 - cam_capture_stats()->wait_ms,
+              r4300 == formats[i].r4300 &&
+                      sim_ov5642_register(0x501f) == formats[i].r501f
+                  ? "as set"
+                  : "WRONG",
+              (unsigned long)bad);
+      if (bad || len != (uint32_t)W * H * formats[i].bpp || fifo != len ||
+          r4300 != formats[i].r4300 ||
+          sim_ov5642_register(0x501f) != formats[i].r501f) {
+        fprintf(stdout, "  FAIL: %s stream is not what the format gives\n",
+                formats[i].name);
+        failed = 1;
+      }
+
+      // RGB565 from the ISP is the same view as YUV422 converted here
+      if (rotate180) {
+        continue;
+      }
+      const uint16_t *fb = sim_tft_framebuffer();
+      if (formats[i].fmt == CAM_FMT_YUV422) {
+        for (uint32_t p = 0; p < TFT_WIDTH * TFT_HEIGHT; p++) {
+          yuv_picture[p] = fb[p];
+        }
+      } else if (formats[i].fmt == CAM_FMT_RGB565) {
+        uint64_t total = 0;
+        for (uint32_t y = 0; y < H; y++) {
+          for (uint32_t x = 0; x < W; x++) {
+            uint16_t a = fb[y * TFT_WIDTH + x];
+            uint16_t b = yuv_picture[y * TFT_WIDTH + x];
+            total += abs((a >> 11) - (b >> 11)) +
+                     abs((a >> 5 & 63) - (b >> 5 & 63)) +
+                     abs((a & 31) - (b & 31));
+          }
+        }
+        double mean = (double)total / (3.0 * W * H);
+        fprintf(stdout, "  RGB565 vs YUV422 picture: mean %.3f steps\n",
+                mean);
+        if (mean > 1.0) {
+          fprintf(stdout, "  FAIL: RGB565 shows another picture\n");
+          failed = 1;
+        }
+      }
+    }
+  }
+
+  cam_set_orientation(CAM_ORIENT_UPRIGHT);
+  failed |= check_negotiation();
+  return failed;
+}
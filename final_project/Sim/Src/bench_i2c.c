@@ -0,0 +1,326 @@
+/*
+ * bench_i2c.c
+ *
+ * The I2C2 bus manager on the simulated sensors. A mixed queue (a NACKing
+ * address and hold-master reads among them) must keep each device's jobs
+ * in submission order, let other devices in while one sits in its gap and
+ * give the right outcome per job; a clock stretch longer than its job's
+ * timeout must be aborted without stalling the jobs behind it. Then the
+ * sensor sweep is run the old blocking way, as the five serial hold-master
+ * reads through the drivers' start calls, and through the overlapped
+ * sweep planner, comparing latency, how long the main context was kept
+ * from sleeping and how much of the sweep the bus was in use.
+ */
+
+#include "bench.h"
+
+#include "i2c.h"
+#include "i2c_bus.h"
+#include "lightsensor.h"
+#include "sensor_sweep.h"
+#include "si7021.h"
+#include "soil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MISSING_ADDR (0x50 << 1)
+#define ORDER_JOBS 7
+
+// Si7021 jobs 0 and 4 hold the bus; the BH1750 and the missing address get
+// in after the first, and soil job 3 sits in its gap across the second
+static const uint8_t want_order[ORDER_JOBS] = {0, 1, 2, 4, 3, 5, 6};
+
+static uint8_t order[ORDER_JOBS];
+static uint8_t finished;
+
+static void record(I2cJob *job) { order[finished++] = *(uint8_t *)job->ctx; }
+
+static const char *status_name(I2cJobStatus st) {
+  switch (st) {
+  case I2C_JOB_OK:
+    return "ok";
+  case I2C_JOB_NACK:
+    return "nack";
+  case I2C_JOB_TIMEOUT:
+    return "timeout";
+  default:
+    return "error";
+  }
+}
+
+static void sensors_up(void) {
+  bench_board_up();
+  MX_I2C2_Init();
+  i2c_bus_init(&hi2c2);
+  bh1750_init(BH1750_ADDR);
+  HAL_Delay(200); // first continuous H-res result
+}
+
+static void wait_all(uint8_t n) {
+  uint32_t t0 = HAL_GetTick();
+  while (finished < n && HAL_GetTick() - t0 < 1000) {
+    __WFI();
+  }
+}
+
+static int check_order(void) {
+  static const uint8_t rh = 0xE5, temp = 0xE3;
+  static const uint8_t soil_cap[2] = {0x0F, 0x10}, soil_hwid[2] = {0x00, 0x01};
+  static uint8_t rx[ORDER_JOBS][4];
+  static uint8_t id[ORDER_JOBS];
+  static I2cJob jobs[ORDER_JOBS];
+  static const I2cJobStatus want[ORDER_JOBS] = {
+      I2C_JOB_OK, I2C_JOB_OK,   I2C_JOB_NACK, I2C_JOB_OK,
+      I2C_JOB_OK, I2C_JOB_NACK, I2C_JOB_OK};
+  int failed = 0;
+
+  sensors_up();
+  uint32_t jobs0 = i2c_bus_stats()->jobs; // bh1750_init's two commands
+  memset(jobs, 0, sizeof(jobs));
+  jobs[0] = (I2cJob){.addr = SI7021_ADDR, .tx = &rh, .tx_len = 1,
+                     .rx = rx[0], .rx_len = 2, .timeout_ms = 50};
+  jobs[1] = (I2cJob){.addr = BH1750_ADDR, .rx = rx[1], .rx_len = 2};
+  jobs[2] = (I2cJob){.addr = MISSING_ADDR, .rx = rx[2], .rx_len = 1};
+  jobs[3] = (I2cJob){.addr = SOIL_ADDR, .tx = soil_cap, .tx_len = 2,
+                     .rx = rx[3], .rx_len = 2, .gap_ms = 3};
+  jobs[4] = (I2cJob){.addr = SI7021_ADDR, .tx = &temp, .tx_len = 1,
+                     .rx = rx[4], .rx_len = 2, .timeout_ms = 50};
+  jobs[5] = (I2cJob){.addr = MISSING_ADDR, .tx = &rh, .tx_len = 1};
+  jobs[6] = (I2cJob){.addr = SOIL_ADDR, .tx = soil_hwid, .tx_len = 2,
+                     .rx = rx[6], .rx_len = 1, .gap_ms = 1};
+  finished = 0;
+  for (uint8_t i = 0; i < ORDER_JOBS; i++) {
+    id[i] = i;
+    jobs[i].done = record;
+    jobs[i].ctx = &id[i];
+    if (i2c_bus_submit(&jobs[i]) != HAL_OK) {
+      fprintf(stdout, "  job %u refused\n", i);
+      failed = 1;
+    }
+  }
+  if (i2c_bus_submit(&jobs[3]) != HAL_BUSY) {
+    fprintf(stdout, "  a queued job was accepted twice\n");
+    failed = 1;
+  }
+  wait_all(ORDER_JOBS);
+
+  fprintf(stdout, "order:");
+  for (uint8_t i = 0; i < finished; i++) {
+    fprintf(stdout, " %u:%s", order[i], status_name(jobs[order[i]].status));
+    if (order[i] != want_order[i] || jobs[i].status != want[i]) {
+      failed = 1;
+    }
+  }
+  fprintf(stdout, "\n");
+  if (finished != ORDER_JOBS) {
+    fprintf(stdout, "  %u of %u jobs finished\n", finished, ORDER_JOBS);
+    failed = 1;
+  }
+  uint16_t cap = (uint16_t)(rx[3][0] << 8 | rx[3][1]);
+  if (cap != sim_env.soil_cap || rx[6][0] != 0x55) {
+    fprintf(stdout, "  soil reads wrong: cap %u, hw id 0x%02X\n", cap,
+            rx[6][0]);
+    failed = 1;
+  }
+  const I2cBusStats *bs = i2c_bus_stats();
+  if (bs->jobs - jobs0 != ORDER_JOBS || bs->nacks != 2 ||
+      bs->max_depth != ORDER_JOBS) {
+    fprintf(stdout, "  stats: %lu jobs, %lu nacks, depth %u\n",
+            (unsigned long)(bs->jobs - jobs0), (unsigned long)bs->nacks,
+            bs->max_depth);
+    failed = 1;
+  }
+  return failed;
+}
+
+// RH conversion holds SCL for ~23 ms; a 5 ms timeout has to cut it short
+static int check_timeout(void) {
+  static const uint8_t rh = 0xE5;
+  static const uint8_t soil_cap[2] = {0x0F, 0x10};
+  static uint8_t rx[2][2];
+  static uint8_t id[2] = {0, 1};
+  static I2cJob jobs[2];
+  int failed = 0;
+
+  sensors_up();
+  jobs[0] = (I2cJob){.addr = SI7021_ADDR, .tx = &rh, .tx_len = 1,
+                     .rx = rx[0], .rx_len = 2, .timeout_ms = 5,
+                     .done = record, .ctx = &id[0]};
+  jobs[1] = (I2cJob){.addr = SOIL_ADDR, .tx = soil_cap, .tx_len = 2,
+                     .rx = rx[1], .rx_len = 2, .gap_ms = 3,
+                     .done = record, .ctx = &id[1]};
+  finished = 0;
+  uint32_t t0 = HAL_GetTick();
+  i2c_bus_submit(&jobs[0]);
+  i2c_bus_submit(&jobs[1]);
+  wait_all(2);
+  uint32_t took = HAL_GetTick() - t0;
+
+  fprintf(stdout, "timeout: stretched read %s, next job %s, %lu ms\n",
+          status_name(jobs[0].status), status_name(jobs[1].status),
+          (unsigned long)took);
+  if (finished != 2 || jobs[0].status != I2C_JOB_TIMEOUT ||
+      jobs[1].status != I2C_JOB_OK || took >= 23) {
+    failed = 1;
+  }
+  if (i2c_bus_stats()->timeouts != 1) {
+    failed = 1;
+  }
+  return failed;
+}
+
+typedef struct {
+  float rh, temp, soil_temp;
+  uint16_t cap, lux;
+} Sweep;
+
+typedef struct {
+  uint64_t latency_ns;
+  uint64_t main_ns; // main context not asleep in WFI
+  uint64_t bus_ns;  // I2C2 busy, stretching included
+} SweepCost;
+
+// The sweep as task_sensors did it before the bus manager
+static Sweep blocking_sweep(void) {
+  uint8_t cmd = SI7021_CMD_MEAS_RH_HOLD, rx[4];
+  Sweep s;
+  HAL_I2C_Master_Transmit(&hi2c2, SI7021_ADDR, &cmd, 1, HAL_MAX_DELAY);
+  HAL_I2C_Master_Receive(&hi2c2, SI7021_ADDR, rx, 2, HAL_MAX_DELAY);
+  s.rh = SI7021_RH_CONV_CONST * (rx[0] << 8 | rx[1]) / 65536.0f -
+         SI7021_RH_CONV_OFFSET;
+  cmd = SI7021_CMD_MEAS_TEMP_HOLD;
+  HAL_I2C_Master_Transmit(&hi2c2, SI7021_ADDR, &cmd, 1, HAL_MAX_DELAY);
+  HAL_I2C_Master_Receive(&hi2c2, SI7021_ADDR, rx, 2, HAL_MAX_DELAY);
+  s.temp = SI7021_TEMP_CONV_CONST * (rx[0] << 8 | rx[1]) / 65536.0f -
+           SI7021_TEMP_CONV_OFFSET;
+  uint8_t cap_cmd[2] = {0x0F, 0x10};
+  HAL_I2C_Master_Transmit(&hi2c2, SOIL_ADDR, cap_cmd, 2, HAL_MAX_DELAY);
+  HAL_Delay(3);
+  HAL_I2C_Master_Receive(&hi2c2, SOIL_ADDR, rx, 2, HAL_MAX_DELAY);
+  s.cap = (uint16_t)(rx[0] << 8 | rx[1]);
+  uint8_t temp_cmd[2] = {0x00, 0x04};
+  HAL_I2C_Master_Transmit(&hi2c2, SOIL_ADDR, temp_cmd, 2, HAL_MAX_DELAY);
+  HAL_Delay(3);
+  HAL_I2C_Master_Receive(&hi2c2, SOIL_ADDR, rx, 4, HAL_MAX_DELAY);
+  s.soil_temp = (int32_t)((uint32_t)rx[0] << 24 | (uint32_t)rx[1] << 16 |
+                          (uint32_t)rx[2] << 8 | rx[3]) /
+                65536.0f;
+  s.lux = I2C2_read(BH1750_ADDR);
+  return s;
+}
+
+static void sweep_done(I2cJob *job) {
+  (void)job;
+  finished++;
+}
+
+static void sleep_until_finished(uint8_t n, uint64_t *slept_ns) {
+  while (finished < n) {
+    uint64_t t = sim_time_ns();
+    __WFI();
+    *slept_ns += sim_time_ns() - t;
+  }
+}
+
+// Five hold-master reads, one conversion after the other
+static Sweep serial_sweep(uint64_t *slept_ns) {
+  Sweep s;
+  finished = 0;
+  si7021_start_humidity(&s.rh, sweep_done);
+  si7021_start_temperature(&s.temp, sweep_done);
+  soil_start_capacitance(&s.cap, sweep_done);
+  soil_start_temperature(&s.soil_temp, sweep_done);
+  bh1750_start_read(BH1750_ADDR, &s.lux, sweep_done);
+  sleep_until_finished(5, slept_ns);
+  return s;
+}
+
+static Sweep planned_sweep(uint64_t *slept_ns) {
+  static SensorReadings r;
+  sensor_sweep_start(&r);
+  while (sensor_sweep_busy()) {
+    uint64_t t = sim_time_ns();
+    __WFI();
+    *slept_ns += sim_time_ns() - t;
+  }
+  return (Sweep){r.air_rh, r.air_temp_c, r.soil_temp_c, r.soil_cap, r.light};
+}
+
+static int same(const Sweep *a, const Sweep *b) {
+  return a->cap == b->cap && a->lux == b->lux && (int)a->rh == (int)b->rh &&
+         (int)a->temp == (int)b->temp &&
+         (int)a->soil_temp == (int)b->soil_temp;
+}
+
+typedef Sweep (*SweepFn)(uint64_t *slept_ns);
+
+static SweepCost measure(SweepFn fn, Sweep *out) {
+  uint64_t slept = 0;
+  uint64_t bus0 = sim_bus_stats[SIM_BUS_I2C2].busy_ns;
+  uint64_t t0 = sim_time_ns();
+  *out = fn(&slept);
+  uint64_t took = sim_time_ns() - t0;
+  return (SweepCost){took, took - slept,
+                     sim_bus_stats[SIM_BUS_I2C2].busy_ns - bus0};
+}
+
+static Sweep blocking_fn(uint64_t *slept_ns) {
+  (void)slept_ns;
+  return blocking_sweep();
+}
+
+static void print_cost(const char *name, SweepCost c) {
+  fprintf(stdout, "%-22s %10.2f %10.2f %10.2f %8.1f%%\n", name,
+          c.latency_ns / 1e6, c.main_ns / 1e6, c.bus_ns / 1e6,
+          100.0 * c.bus_ns / c.latency_ns);
+}
+
+int bench_i2c(void) {
+  int failed = check_order();
+  failed |= check_timeout();
+
+  // All three on a board whose soil probe has been reset and whose BH1750
+  // has a result, so the sweeps read the same values
+  sensors_up();
+  uint64_t slept = 0;
+  serial_sweep(&slept); // queues the soil reset
+
+  Sweep a, b, c;
+  SweepCost blocking = measure(blocking_fn, &a);
+  SweepCost serial = measure(serial_sweep, &b);
+  SweepCost planned = measure(planned_sweep, &c);
+
+  fprintf(stdout, "%-22s %10s %10s %10s %9s\n", "sweep", "ms", "main ms",
+          "bus ms", "bus use");
+  print_cost("blocking HAL calls", blocking);
+  print_cost("serial hold jobs", serial);
+  print_cost("overlapped planner", planned);
+
+  if (!same(&a, &b) || !same(&a, &c)) {
+    fprintf(stdout, "  sweeps disagree\n");
+    failed = 1;
+  }
+  if (c.cap != sim_env.soil_cap || sensor_sweep_stats()->failed_reads) {
+    fprintf(stdout, "  planner read wrong: cap %u, %lu failed\n", c.cap,
+            (unsigned long)sensor_sweep_stats()->failed_reads);
+    failed = 1;
+  }
+  // The no-hold gap covers the whole conversion, so nothing reads early
+  if (sim_sensors_early_reads()) {
+    fprintf(stdout, "  %lu reads before a conversion finished\n",
+            (unsigned long)sim_sensors_early_reads());
+    failed = 1;
+  }
+  // The CPU only sets up transfers; the bus does the waiting
+  if (serial.main_ns * 10 > serial.latency_ns ||
+      planned.main_ns * 10 > planned.latency_ns) {
+    failed = 1;
+  }
+  // Overlapped, a sweep is as long as the Si7021 conversion plus its reads
+  if (planned.latency_ns >= serial.latency_ns ||
+      planned.latency_ns > 26 * SIM_NS_PER_MS) {
+    failed = 1;
+  }
+  return failed;
+}
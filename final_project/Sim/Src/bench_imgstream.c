@@ -0,0 +1,236 @@
+/*
+ * bench_imgstream.c
+ *
+ * One captured frame over LPUART1 three ways: the RGB888 dump the
+ * debug_python path used to make, three bytes per HAL_UART_Transmit, and
+ * imgstream packets without and with DRLE. The packets go through the
+ * receiver plantpot_imgrecv uses, which must give back camera_buf byte for
+ * byte and pass the log text around them through unchanged. The synthetic
+ * scene is flatter than a photo, so it goes out again with a step of grain
+ * in every channel. A frame of noise must not cost more than framing it
+ * raw, and a damaged or a missing packet must cost the frame, not produce
+ * a wrong one.
+ */
+
+#include "bench.h"
+
+#include "camera.h"
+#include "img_receiver.h"
+#include "imgstream.h"
+#include "log.h"
+#include "usart.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAP_SIZE (512u * 1024u)
+#define NOISE_SEED 17u
+
+static uint8_t tap[TAP_SIZE];
+static uint32_t tap_len;
+
+static void tap_bytes(const uint8_t *data, uint16_t len) {
+  if (tap_len + len <= TAP_SIZE) {
+    memcpy(tap + tap_len, data, len);
+    tap_len += len;
+  }
+}
+
+typedef struct {
+  uint32_t frames;
+  uint8_t same; // last frame equal to camera_buf
+  char text[64];
+  size_t text_len;
+} Received;
+
+static void got_frame(const ImgRxFrame *f, void *ctx) {
+  Received *r = ctx;
+  r->frames++;
+  r->same = f->format == IMG_RGB565 && f->width == CAM_FRAME_W &&
+            f->height == CAM_FRAME_H && f->raw_len == rgb565_data_length &&
+            !memcmp(f->raw, camera_buf, rgb565_data_length);
+}
+
+static void got_text(const uint8_t *data, size_t len, void *ctx) {
+  Received *r = ctx;
+  if (r->text_len + len <= sizeof(r->text)) {
+    memcpy(r->text + r->text_len, data, len);
+    r->text_len += len;
+  }
+}
+
+// The tap through a fresh receiver, fed in uneven pieces
+static ImgRxStats receive(const uint8_t *data, uint32_t len, Received *r) {
+  memset(r, 0, sizeof(*r));
+  ImgReceiver *rx = img_receiver_new(got_frame, got_text, r);
+  for (uint32_t at = 0, step = 1; at < len; at += step, step = step * 7 % 997) {
+    img_receiver_feed(rx, data + at, step < len - at ? step : len - at);
+  }
+  img_receiver_flush(rx);
+  ImgRxStats s = *img_receiver_stats(rx);
+  img_receiver_free(rx);
+  return s;
+}
+
+/********/
+// Transfers
+/*******/
+// The old debug_python dump: RGB888, one blocking call per pixel
+static BenchCost raw_dump(void) {
+  BenchCost start = bench_cost_now(SIM_BUS_LPUART1);
+  HAL_UART_Transmit(&hlpuart1, (uint8_t *)"START\n", 6, HAL_MAX_DELAY);
+  for (uint32_t i = 0; i < rgb565_data_length; i += 2) {
+    uint16_t px = (uint16_t)(camera_buf[i] << 8 | camera_buf[i + 1]);
+    uint8_t rgb[3] = {(uint8_t)(px >> 8 & 0xF8), (uint8_t)(px >> 3 & 0xFC),
+                      (uint8_t)(px << 3)};
+    HAL_UART_Transmit(&hlpuart1, rgb, 3, HAL_MAX_DELAY);
+  }
+  HAL_UART_Transmit(&hlpuart1, (uint8_t *)"END\n", 4, HAL_MAX_DELAY);
+  return bench_cost_since(SIM_BUS_LPUART1, start);
+}
+
+// Framed between two log lines, on the wire until the ring is empty
+static BenchCost framed(ImgCodec codec) {
+  tap_len = 0;
+  BenchCost start = bench_cost_now(SIM_BUS_LPUART1);
+  printf("before\r\n");
+  imgstream_send(camera_buf, CAM_FRAME_W, CAM_FRAME_H, IMG_RGB565, codec);
+  printf("after\r\n");
+  log_flush();
+  return bench_cost_since(SIM_BUS_LPUART1, start);
+}
+
+static int check_received(const char *what) {
+  Received r;
+  ImgRxStats s = receive(tap, tap_len, &r);
+  int ok = r.frames == 1 && r.same && !s.bad_crc && !s.missing &&
+           !s.incomplete && r.text_len == 15 &&
+           !memcmp(r.text, "before\r\nafter\r\n", 15);
+  if (!ok) {
+    fprintf(stdout,
+            "  FAIL: %s: %lu frames (%s), %lu bad CRC, %lu missing, "
+            "text \"%.*s\"\n",
+            what, (unsigned long)r.frames, r.same ? "same" : "differs",
+            (unsigned long)s.bad_crc, (unsigned long)s.missing,
+            (int)r.text_len, r.text);
+  }
+  return !ok;
+}
+
+static void row(const char *what, BenchCost c, BenchCost base) {
+  fprintf(stdout, "  %-22s %8llu %9.2f %6.1fx\n", what,
+          (unsigned long long)c.bytes, c.ns / 1e9, (double)base.ns / c.ns);
+}
+
+/********/
+// Damage
+/*******/
+// Offset of the n-th packet of the given type in the tap
+static uint32_t find_packet(uint8_t type, uint32_t nth) {
+  for (uint32_t i = 0; i + IMG_HEADER_SIZE <= tap_len; i++) {
+    if (tap[i] == IMG_SYNC0 && tap[i + 1] == IMG_SYNC1 && tap[i + 2] == type &&
+        !nth--) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+static int run_damage(void) {
+  int failed = 0;
+  static uint8_t copy[TAP_SIZE];
+  Received r;
+
+  // one payload byte of the 100th line flipped
+  memcpy(copy, tap, tap_len);
+  uint32_t at = find_packet(IMG_CHUNK, 100);
+  copy[at + IMG_HEADER_SIZE + 9] ^= 0x10;
+  ImgRxStats flipped = receive(copy, tap_len, &r);
+  uint32_t flipped_frames = r.frames;
+
+  // the 50th line left out
+  at = find_packet(IMG_CHUNK, 50);
+  uint32_t next = find_packet(IMG_CHUNK, 51);
+  memcpy(copy, tap, at);
+  memcpy(copy + at, tap + next, tap_len - next);
+  ImgRxStats dropped = receive(copy, tap_len - (next - at), &r);
+
+  fprintf(stdout,
+          "damage           flipped byte: %lu bad CRC, %lu frames; "
+          "lost packet: %lu missing, %lu frames\n",
+          (unsigned long)flipped.bad_crc, (unsigned long)flipped_frames,
+          (unsigned long)dropped.missing, (unsigned long)r.frames);
+  if (flipped.bad_crc != 1 || flipped.incomplete != 1 || flipped_frames ||
+      dropped.missing != 1 || dropped.incomplete != 1 || r.frames) {
+    fprintf(stdout, "  FAIL: damaged frame not rejected\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+// Sensor noise on the scene, one step either way in every channel
+static void add_grain(void) {
+  srand(NOISE_SEED);
+  for (uint32_t i = 0; i < rgb565_data_length; i += 2) {
+    uint16_t px = (uint16_t)(camera_buf[i] << 8 | camera_buf[i + 1]);
+    int r = (px >> 11) + rand() % 3 - 1;
+    int g = (px >> 5 & 0x3F) + rand() % 3 - 1;
+    int b = (px & 0x1F) + rand() % 3 - 1;
+    r = r < 0 ? 0 : r > 31 ? 31 : r;
+    g = g < 0 ? 0 : g > 63 ? 63 : g;
+    b = b < 0 ? 0 : b > 31 ? 31 : b;
+    px = (uint16_t)(r << 11 | g << 5 | b);
+    camera_buf[i] = (uint8_t)(px >> 8);
+    camera_buf[i + 1] = (uint8_t)px;
+  }
+}
+
+int bench_imgstream(void) {
+  int failed = 0;
+  bench_camera_up();
+  log_init(&hlpuart1);
+  SingleCapTransfer_YCbCr(0, 0, camera_buf);
+  log_flush();
+
+  BenchCost dump = raw_dump();
+  sim_uart_tap = tap_bytes;
+  BenchCost raw = framed(IMG_CODEC_RAW);
+  failed |= check_received("raw");
+  BenchCost drle = framed(IMG_CODEC_DRLE);
+  failed |= check_received("DRLE");
+  failed |= run_damage(); // on the DRLE capture
+  add_grain();
+  BenchCost grain = framed(IMG_CODEC_DRLE);
+  failed |= check_received("grain");
+
+  fprintf(stdout, "%-24s %8s %9s %7s\n", "320x240 frame", "bytes", "s",
+          "speedup");
+  row("RGB888 dump", dump, dump);
+  row("packets, raw", raw, dump);
+  row("packets, DRLE", drle, dump);
+  row("packets, DRLE, grain", grain, dump);
+  if (drle.ns * 4 > dump.ns || grain.ns > raw.ns) {
+    fprintf(stdout, "  FAIL: DRLE frames not faster\n");
+    failed = 1;
+  }
+
+  // Noise: every chunk falls back to raw, so no worse than framing raw
+  srand(NOISE_SEED);
+  for (uint32_t i = 0; i < rgb565_data_length; i++) {
+    camera_buf[i] = (uint8_t)rand();
+  }
+  BenchCost noise_raw = framed(IMG_CODEC_RAW);
+  BenchCost noise = framed(IMG_CODEC_DRLE);
+  failed |= check_received("noise");
+  fprintf(stdout, "noise            %llu bytes with DRLE, %llu raw\n",
+          (unsigned long long)noise.bytes,
+          (unsigned long long)noise_raw.bytes);
+  if (noise.bytes > noise_raw.bytes) {
+    fprintf(stdout, "  FAIL: DRLE made noise bigger\n");
+    failed = 1;
+  }
+
+  sim_uart_tap = NULL;
+  return failed;
+}
@@ -0,0 +1,507 @@
+/*
+ * bench_jpeg.c
+ *
+ * jpegdec against libjpeg, then the JPEG capture path on the board against
+ * the YCbCr one. At full size the decoder must give libjpeg's own output
+ * (islow IDCT, chroma replicated rather than interpolated) pixel for pixel,
+ * for the OV5642's 4:2:2 and the other samplings it takes, restart
+ * intervals, sizes off the MCU grid and input cut into odd pieces; scaled
+ * output is held to libjpeg's scaled decode. Streams it cannot take must be
+ * refused with the right result, not half drawn.
+ *
+ * On the board each size is captured once and shown on the TFT: the FIFO
+ * bytes read and the virtual time per displayed frame, against the 153600
+ * YUYV bytes SingleCapStream_YCbCr reads for one 320x240 picture. The sim
+ * models bus time, not the decoder's CPU time; that is the host ns above.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+#include "i2c.h"
+#include "jpegdec.h"
+#include "usart.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <jpeglib.h>
+
+#define MAX_W 2592
+#define MAX_H 1944
+
+/********/
+// Encoding and reference decoding with libjpeg
+/*******/
+typedef struct {
+  uint16_t w, h;
+  uint8_t h_samp, v_samp; // luma; 0 for greyscale
+  uint8_t quality;
+  uint16_t restart; // MCUs, 0 for none
+  uint8_t progressive;
+} Encoding;
+
+// Gradients, hard edges and a little texture, so every coefficient band is
+// busy and the chroma moves across MCUs
+static void test_rgb(uint16_t w, uint16_t h, uint8_t *rgb) {
+  uint32_t seed = 1;
+  for (uint32_t y = 0; y < h; y++) {
+    for (uint32_t x = 0; x < w; x++, rgb += 3) {
+      seed = seed * 1103515245u + 12345u;
+      int grain = (int)(seed >> 27) - 16;
+      int r = (int)(255 * x / w), g = (int)(255 * y / h), b = 128;
+      if (((x / 23) + (y / 17)) & 1) {
+        b = 230;
+        g = 255 - g;
+      }
+      if ((x - w / 2) * (x - w / 2) + (y - h / 2) * (y - h / 2) <
+          (w / 5) * (w / 5)) {
+        r = 200;
+        g = 40 + (int)(x % 8) * 20;
+        b = 30;
+      }
+      rgb[0] = (uint8_t)(r + grain < 0 ? 0 : r + grain > 255 ? 255 : r + grain);
+      rgb[1] = (uint8_t)(g < 0 ? 0 : g > 255 ? 255 : g);
+      rgb[2] = (uint8_t)b;
+    }
+  }
+}
+
+static unsigned char *encode(const Encoding *e, unsigned long *len) {
+  uint8_t *rgb = malloc((size_t)e->w * e->h * 3);
+  test_rgb(e->w, e->h, rgb);
+  unsigned char *out = NULL;
+  *len = 0;
+  struct jpeg_compress_struct c;
+  struct jpeg_error_mgr err;
+  c.err = jpeg_std_error(&err);
+  jpeg_create_compress(&c);
+  jpeg_mem_dest(&c, &out, len);
+  c.image_width = e->w;
+  c.image_height = e->h;
+  c.input_components = 3;
+  c.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&c);
+  if (!e->h_samp) {
+    jpeg_set_colorspace(&c, JCS_GRAYSCALE);
+  } else {
+    c.comp_info[0].h_samp_factor = e->h_samp;
+    c.comp_info[0].v_samp_factor = e->v_samp;
+  }
+  jpeg_set_quality(&c, e->quality, TRUE);
+  c.restart_interval = e->restart;
+  if (e->progressive) {
+    jpeg_simple_progression(&c);
+  }
+  jpeg_start_compress(&c, TRUE);
+  while (c.next_scanline < c.image_height) {
+    JSAMPROW row = rgb + (size_t)c.next_scanline * e->w * 3;
+    jpeg_write_scanlines(&c, &row, 1);
+  }
+  jpeg_finish_compress(&c);
+  jpeg_destroy_compress(&c);
+  free(rgb);
+  return out;
+}
+
+// libjpeg with the choices jpegdec makes, RGB out, scaled by 1/scale
+static uint8_t *reference(const uint8_t *jpg, uint32_t len, uint8_t scale,
+                          uint16_t *w, uint16_t *h) {
+  struct jpeg_decompress_struct c;
+  struct jpeg_error_mgr err;
+  c.err = jpeg_std_error(&err);
+  jpeg_create_decompress(&c);
+  jpeg_mem_src(&c, (unsigned char *)jpg, len);
+  jpeg_read_header(&c, TRUE);
+  c.out_color_space = JCS_RGB;
+  c.dct_method = JDCT_ISLOW;
+  c.do_fancy_upsampling = FALSE;
+  c.scale_num = 1;
+  c.scale_denom = scale;
+  jpeg_start_decompress(&c);
+  *w = (uint16_t)c.output_width;
+  *h = (uint16_t)c.output_height;
+  uint8_t *rgb = malloc((size_t)*w * *h * 3);
+  while (c.output_scanline < c.output_height) {
+    JSAMPROW row = rgb + (size_t)c.output_scanline * *w * 3;
+    jpeg_read_scanlines(&c, &row, 1);
+  }
+  jpeg_finish_decompress(&c);
+  jpeg_destroy_decompress(&c);
+  return rgb;
+}
+
+static uint16_t rgb565(const uint8_t *p) {
+  return (uint16_t)((p[0] >> 3) << 11 | (p[1] >> 2) << 5 | p[2] >> 3);
+}
+
+/********/
+// jpegdec on the host
+/*******/
+static const uint8_t *src;
+static uint32_t src_len, src_at;
+static uint16_t src_piece;
+
+static const uint8_t *read_memory(uint16_t *len) {
+  if (src_at >= src_len) {
+    return NULL;
+  }
+  *len = src_len - src_at < src_piece ? (uint16_t)(src_len - src_at)
+                                      : src_piece;
+  src_at += *len;
+  return src + src_at - *len;
+}
+
+static uint16_t picture[MAX_W * MAX_H / 4];
+static uint16_t next_y, strip_w;
+static uint8_t strips_ok;
+
+static void to_picture(uint16_t y, uint16_t w, uint16_t h,
+                       const uint8_t *rgb) {
+  strips_ok &= y == next_y && (!strip_w || w == strip_w);
+  strip_w = w;
+  next_y = y + h;
+  for (uint32_t i = 0; i < (uint32_t)w * h; i++) {
+    picture[(uint32_t)y * w + i] = (uint16_t)(rgb[2 * i] << 8 | rgb[2 * i + 1]);
+  }
+}
+
+static JpegDecResult decode(const uint8_t *jpg, uint32_t len, uint16_t piece,
+                            uint16_t max_w, uint16_t max_h,
+                            JpegDecInfo *info) {
+  src = jpg;
+  src_len = len;
+  src_at = 0;
+  src_piece = piece;
+  next_y = strip_w = 0;
+  strips_ok = 1;
+  return jpegdec_decode(read_memory, max_w, max_h, to_picture, info);
+}
+
+typedef struct {
+  uint32_t differ; // pixels
+  uint32_t max;    // 565 steps, worst channel
+  double mean;     // 565 steps per channel
+} Diff;
+
+// out against libjpeg's RGB, both w x h
+static Diff compare(const uint16_t *out, const uint8_t *ref, uint16_t w,
+                    uint16_t h) {
+  Diff d = {0, 0, 0};
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < (uint32_t)w * h; i++) {
+    uint16_t a = rgb565(ref + 3 * i), b = out[i];
+    int dr = abs((a >> 11) - (b >> 11));
+    int dg = abs((a >> 5 & 63) - (b >> 5 & 63));
+    int db = abs((a & 31) - (b & 31));
+    int m = dr > dg ? dr : dg;
+    m = m > db ? m : db;
+    d.differ += a != b;
+    d.max = (uint32_t)m > d.max ? (uint32_t)m : d.max;
+    total += (uint64_t)dr + dg + db;
+  }
+  d.mean = (double)total / (3.0 * w * h);
+  return d;
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/********/
+// Correctness
+/*******/
+// libjpeg's own output at the same scale. Full size and 1/8 (the DC terms)
+// are the same arithmetic; at 1/2 and 1/4 libjpeg runs a reduced IDCT where
+// jpegdec averages the full one, which rounds differently by a step at
+// most. 4:2:0 is only compared at full size: scaled, libjpeg widens the
+// chroma IDCT instead of replicating chroma samples.
+static int scaled_ok(uint8_t scale, Diff d) {
+  if (scale == 1 || scale == 8) {
+    return d.differ == 0;
+  }
+  return d.max <= 1 && d.mean < 0.1;
+}
+
+typedef struct {
+  const char *name;
+  Encoding e;
+  uint16_t max_w, max_h;
+  uint16_t piece;
+} Case;
+
+static const Case cases[] = {
+    {"320x240 4:2:2 q84", {320, 240, 2, 1, 84, 0, 0}, 480, 320, 1280},
+    {"320x240 4:2:0 q75", {320, 240, 2, 2, 75, 0, 0}, 480, 320, 1280},
+    {"301x199 4:4:4 q90", {301, 199, 1, 1, 90, 0, 0}, 480, 320, 7},
+    {"257x131 grey q80", {257, 131, 0, 0, 80, 0, 0}, 480, 320, 1},
+    {"322x241 4:2:2 DRI 7", {322, 241, 2, 1, 84, 7, 0}, 480, 320, 333},
+    {"640x480 4:2:2 /2", {640, 480, 2, 1, 84, 0, 0}, 480, 320, 1280},
+    {"1280x960 4:2:2 DRI /4", {1280, 960, 2, 1, 84, 3, 0}, 480, 320, 1280},
+    {"2592x1944 4:2:2 /8", {2592, 1944, 2, 1, 84, 0, 0}, 480, 320, 1280},
+    {"1001x755 4:2:2 /4", {1001, 755, 2, 1, 70, 0, 0}, 480, 320, 1280},
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static int run_case(const Case *c) {
+  unsigned long len;
+  unsigned char *jpg = encode(&c->e, &len);
+  JpegDecInfo info;
+  JpegDecResult r = decode(jpg, (uint32_t)len, c->piece, c->max_w, c->max_h,
+                           &info);
+  uint16_t w, h;
+  uint8_t *ref =
+      reference(jpg, (uint32_t)len, info.scale ? info.scale : 1, &w, &h);
+  Diff d = {0, 0, 0};
+  int ok = r == JPEGDEC_OK && strips_ok && next_y == info.out_h &&
+           strip_w == info.out_w;
+  if (ok) {
+    d = compare(picture, ref, w, h);
+    ok = scaled_ok(info.scale, d);
+  }
+  fprintf(stdout, "  %-22s %7lu B  1/%u %3ux%-3u  %6lu px differ, max %lu, "
+          "mean %.3f%s\n",
+          c->name, len, info.scale, info.out_w, info.out_h,
+          (unsigned long)d.differ, (unsigned long)d.max, d.mean,
+          ok ? "" : "  FAIL");
+  if (r != JPEGDEC_OK) {
+    fprintf(stdout, "    decode returned %d\n", (int)r);
+  }
+  free(ref);
+  free(jpg);
+  return !ok;
+}
+
+static int run_refusals(void) {
+  int failed = 0;
+  JpegDecInfo info;
+  unsigned long len;
+  Encoding e = {320, 240, 2, 1, 84, 0, 0};
+  unsigned char *jpg = encode(&e, &len);
+
+  // cut in the middle of the scan
+  JpegDecResult cut = decode(jpg, (uint32_t)len / 2, 1280, 480, 320, &info);
+  // the whole stream, but bounds no scale can meet
+  JpegDecResult small = decode(jpg, (uint32_t)len, 1280, 30, 20, &info);
+  // a broken Huffman table length
+  unsigned char *bad = malloc(len);
+  memcpy(bad, jpg, len);
+  for (unsigned long i = 0; i + 1 < len; i++) {
+    if (bad[i] == 0xFF && bad[i + 1] == 0xC4) {
+      bad[i + 5] = 0xFF; // a 1-bit code count of 255
+      break;
+    }
+  }
+  JpegDecResult broken = decode(bad, (uint32_t)len, 1280, 480, 320, &info);
+  free(bad);
+  free(jpg);
+
+  e.progressive = 1;
+  jpg = encode(&e, &len);
+  JpegDecResult prog = decode(jpg, (uint32_t)len, 1280, 480, 320, &info);
+  free(jpg);
+
+  fprintf(stdout, "  truncated %d, too small %d, bad DHT %d, progressive %d\n",
+          (int)cut, (int)small, (int)broken, (int)prog);
+  if (cut != JPEGDEC_ERR_INPUT || small != JPEGDEC_ERR_SIZE ||
+      broken != JPEGDEC_ERR_DATA || prog != JPEGDEC_ERR_UNSUPPORTED) {
+    fprintf(stdout, "  FAIL: stream not refused as expected\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Speed
+/*******/
+static void run_speed(void) {
+  static const Encoding sizes[] = {
+      {320, 240, 2, 1, 84, 0, 0},
+      {640, 480, 2, 1, 84, 0, 0},
+      {1280, 960, 2, 1, 84, 0, 0},
+      {2592, 1944, 2, 1, 84, 0, 0},
+  };
+  fprintf(stdout, "  %-10s %8s %5s %11s %9s %11s\n", "host", "bytes", "scale",
+          "jpegdec us", "ns/px out", "libjpeg us");
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    unsigned long len;
+    unsigned char *jpg = encode(&sizes[i], &len);
+    JpegDecInfo info;
+    int reps = sizes[i].w > 1000 ? 5 : 40;
+    double t0 = now_ns();
+    for (int r = 0; r < reps; r++) {
+      decode(jpg, (uint32_t)len, 1280, TFT_WIDTH, TFT_HEIGHT, &info);
+    }
+    double ours = (now_ns() - t0) / reps;
+
+    // libjpeg at the same scale, its own DCT scaling
+    t0 = now_ns();
+    for (int r = 0; r < reps; r++) {
+      struct jpeg_decompress_struct c;
+      struct jpeg_error_mgr err;
+      c.err = jpeg_std_error(&err);
+      jpeg_create_decompress(&c);
+      jpeg_mem_src(&c, jpg, len);
+      jpeg_read_header(&c, TRUE);
+      c.scale_num = 1;
+      c.scale_denom = info.scale;
+      c.dct_method = JDCT_ISLOW;
+      c.do_fancy_upsampling = FALSE;
+      c.out_color_space = JCS_RGB;
+      jpeg_start_decompress(&c);
+      uint8_t line[MAX_W * 3];
+      JSAMPROW row = line;
+      while (c.output_scanline < c.output_height) {
+        jpeg_read_scanlines(&c, &row, 1);
+      }
+      jpeg_finish_decompress(&c);
+      jpeg_destroy_decompress(&c);
+    }
+    double lib = (now_ns() - t0) / reps;
+
+    char name[16];
+    snprintf(name, sizeof(name), "%ux%u", sizes[i].w, sizes[i].h);
+    fprintf(stdout, "  %-10s %8lu   1/%u %11.0f %9.1f %11.0f\n", name, len,
+            info.scale, ours / 1e3, ours / ((double)info.out_w * info.out_h),
+            lib / 1e3);
+    free(jpg);
+  }
+}
+
+/********/
+// On the board
+/*******/
+typedef struct {
+  BenchCost spi;
+  uint64_t fifo_bytes;
+  uint32_t wait_ms;
+} Shot;
+
+static void camera_up(void) {
+  bench_board_up();
+  MX_I2C4_Init();
+  MX_LPUART1_UART_Init();
+}
+
+static Shot shot_begin(void) {
+  Shot s = {bench_cost_now(SIM_BUS_SPI1), sim_arducam_fifo_bytes_read(), 0};
+  return s;
+}
+
+static Shot shot_end(Shot start) {
+  Shot s = {bench_cost_since(SIM_BUS_SPI1, start.spi),
+            sim_arducam_fifo_bytes_read() - start.fifo_bytes,
+            cam_capture_stats()->wait_ms};
+  return s;
+}
+
+static void shot_row(const char *what, Shot s, uint16_t w, uint16_t h) {
+  fprintf(stdout, "  %-10s %8llu %9llu %9.1f %9.1f  %ux%u\n", what,
+          (unsigned long long)s.fifo_bytes, (unsigned long long)s.spi.bytes,
+          s.spi.ns / 1e6, s.spi.ns / 1e6 - s.wait_ms, w, h);
+}
+
+// Mean colour of a TFT rectangle, in 565 steps scaled to 8 bits
+static void mean_colour(uint16_t x0, uint16_t y0, uint16_t w, uint16_t h,
+                        uint32_t rgb[3]) {
+  const uint16_t *fb = sim_tft_framebuffer();
+  rgb[0] = rgb[1] = rgb[2] = 0;
+  for (uint32_t y = y0; y < y0 + h; y++) {
+    for (uint32_t x = x0; x < x0 + w; x++) {
+      uint16_t p = fb[y * TFT_WIDTH + x];
+      rgb[0] += (p >> 11) << 3;
+      rgb[1] += (p >> 5 & 63) << 2;
+      rgb[2] += (p & 31) << 3;
+    }
+  }
+  for (int i = 0; i < 3; i++) {
+    rgb[i] /= (uint32_t)w * h;
+  }
+}
+
+static int run_board(void) {
+  int failed = 0;
+  static const struct {
+    uint8_t size;
+    const char *name;
+  } sizes[] = {
+      {OV5642_320x240, "320x240"},
+      {OV5642_640x480, "640x480"},
+      {OV5642_1280x960, "1280x960"},
+      {OV5642_2592x1944, "2592x1944"},
+  };
+
+  fprintf(stdout, "  %-10s %8s %9s %9s %9s  %s\n", "board", "FIFO B",
+          "SPI1 B", "ms", "after CAP", "shown");
+  camera_up();
+  ArduCam_Init_YCbCr();
+  TFT_FillScreen(COLOR_WHITE);
+  Shot yuv = shot_begin();
+  SingleCapStream_YCbCr(0, 0, 1);
+  yuv = shot_end(yuv);
+  shot_row("YCbCr", yuv, CAM_FRAME_W, CAM_FRAME_H);
+
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    camera_up();
+    ArduCam_Init_JPEG(sizes[i].size);
+    TFT_FillScreen(COLOR_WHITE);
+    JpegDecInfo info;
+    Shot s = shot_begin();
+    JpegDecResult r = SingleCapJpeg(0, 0, TFT_WIDTH, TFT_HEIGHT, &info);
+    s = shot_end(s);
+    shot_row(sizes[i].name, s, info.out_w, info.out_h);
+
+    // the panel against libjpeg's decode of what was in the FIFO
+    uint32_t len;
+    const uint8_t *jpg = sim_arducam_fifo(&len);
+    uint16_t w, h;
+    uint8_t *ref = reference(jpg, len, info.scale, &w, &h);
+    const uint16_t *fb = sim_tft_framebuffer();
+    for (uint32_t y = 0; y < info.out_h; y++) {
+      memcpy(picture + y * info.out_w, fb + y * TFT_WIDTH,
+             info.out_w * sizeof(uint16_t));
+    }
+    Diff d = compare(picture, ref, w, h);
+    free(ref);
+
+    // the pot at the bottom, sky at the top: upright as mounted
+    uint32_t top[3], bottom[3];
+    mean_colour(info.out_w / 2 - 8, 4, 16, 8, top);
+    mean_colour(info.out_w / 2 - 8, info.out_h - 12, 16, 8, bottom);
+    int upright = top[2] > top[0] && bottom[0] > bottom[2];
+
+    // more than a frame's compressed bytes only by the ring read ahead
+    int ok = r == JPEGDEC_OK && info.bytes <= len &&
+             s.fifo_bytes <= len + CAM_FIFO_RING_CHUNKS * CAM_FIFO_CHUNK &&
+             s.fifo_bytes < yuv.fifo_bytes && upright &&
+             scaled_ok(info.scale, d);
+    if (!ok) {
+      fprintf(stdout,
+              "    FAIL: result %d, %lu of %lu bytes decoded, %lu px differ "
+              "(max %lu), %s\n",
+              (int)r, (unsigned long)info.bytes, (unsigned long)len,
+              (unsigned long)d.differ, (unsigned long)d.max,
+              upright ? "upright" : "not upright");
+      failed = 1;
+    }
+  }
+  return failed;
+}
+
+int bench_jpeg(void) {
+  int failed = 0;
+  fprintf(stdout, "  %-22s %9s  scale out\n", "decoder vs libjpeg", "size");
+  for (unsigned i = 0; i < CASE_COUNT; i++) {
+    failed |= run_case(&cases[i]);
+  }
+  failed |= run_refusals();
+  run_speed();
+  failed |= run_board();
+  return failed;
+}
@@ -0,0 +1,400 @@
+/*
+ * bench_log.c
+ *
+ * The LPUART1 log ring. A telemetry burst costs the main loop its wire time
+ * through the old one-byte HAL_UART_Transmit putchar, and a copy plus a DMA
+ * start through the ring; both have to come out of the UART byte for byte.
+ * A flood must be accepted up to the ring size and the rest counted as
+ * dropped. Then writers preempt each other: first a SIGALRM handler plays an
+ * interrupt landing anywhere in a main-context log_write, then simulated
+ * interrupts log from inside the HAL calls the main loop makes. Every line
+ * that was accepted must come out whole and in its writer's order, and
+ * every refused one must be counted as dropped.
+ */
+
+#include "bench.h"
+
+#include "log.h"
+#include "usart.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define TAP_SIZE (4u << 20)
+#define FLOOD_LINES 400
+#define SIGNAL_WRITES_MAX 200000u
+#define SIGNAL_PREEMPTED_MIN 200u
+#define SIGNAL_BURST 8
+#define SIGNAL_PERIOD_US 50
+#define ISR_PERIOD_NS (3 * SIM_NS_PER_MS)
+#define EVENT_LINES 2000u
+
+// LPUART1 as a terminal would see it
+static uint8_t tap[TAP_SIZE];
+static uint32_t tap_len;
+static uint8_t tap_overflow;
+
+static void tap_reset(void) {
+  tap_len = 0;
+  tap_overflow = 0;
+}
+
+static void tap_bytes(const uint8_t *data, uint16_t len) {
+  if (tap_len + len > TAP_SIZE) {
+    tap_overflow = 1;
+    return;
+  }
+  memcpy(tap + tap_len, data, len);
+  tap_len += len;
+}
+
+static double host_ns(const struct timespec *a, const struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+// "<tag> xxxxxxxx\r\n" without printf, which an interrupt must not call
+static uint32_t seq_line(char *out, const char *tag, uint32_t seq) {
+  static const char hex[] = "0123456789abcdef";
+  uint32_t n = 0;
+  while (*tag) {
+    out[n++] = *tag++;
+  }
+  out[n++] = ' ';
+  for (int shift = 28; shift >= 0; shift -= 4) {
+    out[n++] = hex[(seq >> shift) & 0xF];
+  }
+  out[n++] = '\r';
+  out[n++] = '\n';
+  return n;
+}
+
+typedef struct {
+  const char *tag;
+  uint32_t writes;
+  uint32_t accepted; // counted by the writer from log_write's result
+  uint32_t seen;     // lines of this writer in the output
+  uint32_t last;
+  uint32_t disorder;
+} Writer;
+
+// Splits the tap into lines; each must belong to one of the writers and
+// carry a sequence number above that writer's last one
+static uint32_t check_lines(Writer *w, int writers) {
+  uint32_t garbled = 0;
+  uint32_t at = 0;
+  while (at < tap_len) {
+    const uint8_t *end = memchr(tap + at, '\n', tap_len - at);
+    uint32_t len = end ? (uint32_t)(end - (tap + at)) + 1 : tap_len - at;
+    const char *line = (const char *)tap + at;
+    at += len;
+    int k = 0;
+    size_t tag_len = 0;
+    for (; k < writers; k++) {
+      tag_len = strlen(w[k].tag);
+      if (len == tag_len + 11 && !memcmp(line, w[k].tag, tag_len)) {
+        break;
+      }
+    }
+    unsigned long seq;
+    char tail[3] = {0};
+    if (k == writers ||
+        sscanf(line + tag_len, " %8lx%2c", &seq, tail) != 2 ||
+        strcmp(tail, "\r\n")) {
+      garbled++;
+      continue;
+    }
+    if (w[k].seen && seq <= w[k].last) {
+      w[k].disorder++;
+    }
+    w[k].last = (uint32_t)seq;
+    w[k].seen++;
+  }
+  return garbled;
+}
+
+static int check_writers(const char *label, Writer *w, int writers,
+                         uint32_t dropped) {
+  int failed = 0;
+  uint32_t garbled = check_lines(w, writers);
+  uint32_t refused = 0;
+  fprintf(stdout, "%-14s", label);
+  for (int k = 0; k < writers; k++) {
+    fprintf(stdout, " %s %lu/%lu", w[k].tag, (unsigned long)w[k].seen,
+            (unsigned long)w[k].accepted);
+    refused += w[k].writes - w[k].accepted;
+    if (w[k].seen != w[k].accepted || w[k].disorder) {
+      failed = 1;
+    }
+  }
+  fprintf(stdout, ", %lu dropped, %lu garbled\n", (unsigned long)dropped,
+          (unsigned long)garbled);
+  if (garbled || tap_overflow) {
+    failed = 1;
+  }
+  if (failed) {
+    fprintf(stdout, "  FAIL: lost, reordered or torn lines\n");
+  }
+  if (dropped != refused) {
+    fprintf(stdout, "  FAIL: %lu refused writes, %lu counted as dropped\n",
+            (unsigned long)refused, (unsigned long)dropped);
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Telemetry burst
+/*******/
+static uint32_t burst(char *out, uint32_t size) {
+  static const char *const tasks[] = {"ui",     "touch", "sensors", "sweep",
+                                      "camera", "pump",  "widgets",
+                                      "telemetry"};
+  uint32_t n = 0;
+  n += snprintf(out + n, size - n,
+                "\r\nair %.1f C %.1f %%RH, soil %.1f C %u\r\n", 23.4, 41.2,
+                19.8, 612u);
+  n += snprintf(out + n, size - n,
+                "task       runs  miss  avg us  max us  late us\r\n");
+  for (unsigned i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+    n += snprintf(out + n, size - n, "%-9s %6u %5u %7u %7u %8u\r\n",
+                  tasks[i], 1200u + i * 37, i % 2, 40u + i * 13,
+                  900u + i * 71, 150u + i * 9);
+  }
+  n += snprintf(out + n, size - n,
+                "I2C2: sweep 24 ms (max 24), 303 jobs, 0 nacks\r\n");
+  return n;
+}
+
+static int run_burst(void) {
+  int failed = 0, garbled = 0;
+  char text[1024];
+  uint32_t len = burst(text, sizeof(text));
+
+  // Before: every byte through HAL_UART_Transmit, as __io_putchar did
+  tap_reset();
+  BenchCost c0 = bench_cost_now(SIM_BUS_LPUART1);
+  for (uint32_t i = 0; i < len; i++) {
+    HAL_UART_Transmit(&hlpuart1, (uint8_t *)&text[i], 1, 10);
+  }
+  BenchCost blocking = bench_cost_since(SIM_BUS_LPUART1, c0);
+  if (tap_len != len || memcmp(tap, text, len)) {
+    garbled = 1;
+  }
+
+  // After: the same lines into the ring; the caller is back after the copy
+  tap_reset();
+  struct timespec t0, t1;
+  c0 = bench_cost_now(SIM_BUS_LPUART1);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (uint32_t at = 0; at < len;) {
+    const char *eol = memchr(text + at, '\n', len - at);
+    uint32_t n = eol ? (uint32_t)(eol - (text + at)) + 1 : len - at;
+    log_write(LOG_INFO, text + at, n);
+    at += n;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  BenchCost ring = bench_cost_since(SIM_BUS_LPUART1, c0);
+  log_flush();
+  BenchCost drained = bench_cost_since(SIM_BUS_LPUART1, c0);
+  if (tap_len != len || memcmp(tap, text, len)) {
+    garbled = 1;
+  }
+
+  fprintf(stdout, "burst of %lu bytes, main loop blocked for:\n",
+          (unsigned long)len);
+  fprintf(stdout, "  putchar      %10.3f ms  %5llu transfers\n",
+          blocking.ns / 1e6, (unsigned long long)blocking.transactions);
+  fprintf(stdout,
+          "  log ring     %10.3f ms  %5llu transfers started, +%.1f us host "
+          "copy, drained in %.3f ms\n",
+          ring.ns / 1e6, (unsigned long long)ring.transactions,
+          host_ns(&t0, &t1) / 1e3, drained.ns / 1e6);
+  if (ring.ns * 50 > blocking.ns) {
+    fprintf(stdout, "  FAIL: the ring does not take the wire time off the "
+                    "caller\n");
+    failed = 1;
+  }
+  if (garbled) {
+    fprintf(stdout, "  FAIL: UART output differs from the burst\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Flood
+/*******/
+static int run_flood(void) {
+  int failed = 0;
+  LogStats s0 = *log_stats();
+  Writer w = {"flood", FLOOD_LINES, 0, 0, 0, 0};
+  char line[32];
+
+  tap_reset();
+  for (uint32_t seq = 0; seq < FLOOD_LINES; seq++) {
+    uint32_t n = seq_line(line, w.tag, seq);
+    w.accepted += log_write(LOG_INFO, line, n);
+  }
+  // below the level: neither queued nor counted
+  if (log_write(LOG_DEBUG, line, 4)) {
+    failed = 1;
+  }
+  log_flush();
+
+  const LogStats *s = log_stats();
+  uint32_t dropped = s->dropped - s0.dropped;
+  failed |= check_writers("flood", &w, 1, dropped);
+  // a line on the wire keeps its room until its transfer completes
+  uint32_t line_len = strlen(w.tag) + 11;
+  uint32_t expect = LOG_RING_SIZE / line_len;
+  fprintf(stdout, "  %u lines of %lu bytes: %lu accepted (expected %lu), "
+                  "ring max %u of %u\n",
+          FLOOD_LINES, (unsigned long)line_len, (unsigned long)w.accepted,
+          (unsigned long)expect, s->max_used, LOG_RING_SIZE);
+  if (s->dropped_bytes - s0.dropped_bytes !=
+          (FLOOD_LINES - w.accepted) * line_len ||
+      w.accepted != expect || s->max_used > LOG_RING_SIZE) {
+    fprintf(stdout, "  FAIL: drop counters or ring accounting\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Preemption by a signal
+/*******/
+static Writer sig_writers[2] = {{"main", 0, 0, 0, 0, 0},
+                                {"irq", 0, 0, 0, 0, 0}};
+static volatile sig_atomic_t main_writing;
+static volatile uint32_t preempted;
+
+// Stands in for an ISR: it can land between any two instructions of the
+// main context's log_write. It only enters the simulator through kick(),
+// which it cannot reach while the main context holds the DMA.
+static void on_alarm(int sig) {
+  (void)sig;
+  char line[32];
+  if (main_writing) {
+    preempted++;
+  }
+  uint32_t n = seq_line(line, sig_writers[1].tag, sig_writers[1].writes++);
+  sig_writers[1].accepted += log_write(LOG_WARN, line, n);
+}
+
+static int run_signal(void) {
+  LogStats s0 = *log_stats();
+  sigset_t alarm_set;
+  sigemptyset(&alarm_set);
+  sigaddset(&alarm_set, SIGALRM);
+  sigprocmask(SIG_BLOCK, &alarm_set, NULL);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_alarm;
+  sigaction(SIGALRM, &sa, NULL);
+  struct itimerval period = {{0, SIGNAL_PERIOD_US}, {0, SIGNAL_PERIOD_US}};
+  setitimer(ITIMER_REAL, &period, NULL);
+
+  tap_reset();
+  char line[32];
+  uint32_t seq = 0;
+  uint32_t line_ns = (uint32_t)(strlen(sig_writers[0].tag) + 11) *
+                     (uint32_t)sim_uart_byte_ns(&hlpuart1);
+  while (seq < SIGNAL_WRITES_MAX && preempted < SIGNAL_PREEMPTED_MIN) {
+    // the signal is only let in while no simulator code is on the stack
+    sigprocmask(SIG_UNBLOCK, &alarm_set, NULL);
+    for (int k = 0; k < SIGNAL_BURST; k++, seq++) {
+      uint32_t n = seq_line(line, sig_writers[0].tag, seq);
+      main_writing = 1;
+      uint8_t ok = log_write(LOG_INFO, line, n);
+      main_writing = 0;
+      sig_writers[0].writes++;
+      sig_writers[0].accepted += ok;
+    }
+    sigprocmask(SIG_BLOCK, &alarm_set, NULL);
+    // roughly the wire time of the burst, so the ring neither idles nor
+    // stays full
+    sim_advance_ns((uint64_t)SIGNAL_BURST * line_ns);
+  }
+
+  struct itimerval off = {{0, 0}, {0, 0}};
+  setitimer(ITIMER_REAL, &off, NULL);
+  sigprocmask(SIG_UNBLOCK, &alarm_set, NULL); // a pending alarm runs here
+  signal(SIGALRM, SIG_DFL);
+  log_flush();
+
+  int failed = check_writers("signal", sig_writers, 2,
+                             log_stats()->dropped - s0.dropped);
+  fprintf(stdout, "  %lu main writes, %lu interrupted by the handler\n",
+          (unsigned long)seq, (unsigned long)preempted);
+  if (!preempted) {
+    fprintf(stdout, "  FAIL: no write was ever preempted\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Simulated interrupts
+/*******/
+static Writer ev_writers[2] = {{"main", 0, 0, 0, 0, 0}, {"isr", 0, 0, 0, 0, 0}};
+static uint8_t isr_stop;
+
+// A timer interrupt: raised between the main loop's HAL calls, including
+// while kick() is starting a transfer
+static void isr_event(void *arg) {
+  (void)arg;
+  if (isr_stop) {
+    return;
+  }
+  sim_isr_enter();
+  ev_writers[1].accepted += log_printf(LOG_WARN, "%s %08lx\r\n",
+                                       ev_writers[1].tag,
+                                       (unsigned long)ev_writers[1].writes++);
+  sim_isr_leave();
+  sim_event_at(sim_time_ns() + ISR_PERIOD_NS, isr_event, NULL);
+}
+
+static int run_events(void) {
+  LogStats s0 = *log_stats();
+  tap_reset();
+  isr_stop = 0;
+  sim_event_at(sim_time_ns() + ISR_PERIOD_NS, isr_event, NULL);
+  for (uint32_t seq = 0; seq < EVENT_LINES; seq++) {
+    ev_writers[0].writes++;
+    ev_writers[0].accepted += log_printf(LOG_INFO, "%s %08lx\r\n",
+                                         ev_writers[0].tag,
+                                         (unsigned long)seq);
+    HAL_Delay(2); // with the interrupt's lines, about the wire rate
+  }
+  isr_stop = 1;
+  log_flush();
+
+  const LogStats *s = log_stats();
+  int failed = check_writers("sim isr", ev_writers, 2, s->dropped - s0.dropped);
+  fprintf(stdout, "  %lu DMA transfers for %lu lines\n",
+          (unsigned long)(s->transfers - s0.transfers),
+          (unsigned long)(s->messages - s0.messages));
+  return failed;
+}
+
+int bench_log(void) {
+  int failed = 0;
+  bench_board_up();
+  MX_LPUART1_UART_Init();
+  log_init(&hlpuart1);
+  log_flush(); // whatever other benches printed before the UART was up
+  sim_uart_tap = tap_bytes;
+
+  failed |= run_burst();
+  failed |= run_flood();
+  failed |= run_signal();
+  failed |= run_events();
+
+  log_flush();
+  sim_uart_tap = NULL;
+  return failed;
+}
@@ -0,0 +1,137 @@
+/*
+ * bench_main.c
+ *
+ * Runs the host benchmarks by name, or all of them. Results go to stdout
+ * with fprintf: printf itself is wrapped onto the simulated LPUART1.
+ *
+ *   plantpot_bench [--list] [NAME]...
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+#include "dma.h"
+#include "gpio.h"
+#include "i2c.h"
+#include "spi.h"
+#include "spi_bus.h"
+#include "usart.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void SystemClock_Config(void);
+
+static const struct {
+  const char *name;
+  int (*run)(void);
+  const char *what;
+} benches[] = {
+    {"text", bench_text, "SPI cost of TFT_PrintfAt, per-pixel vs glyph runs"},
+    {"dma", bench_dma, "TFT draw time, blocking SPI vs DMA strips"},
+    {"yuv", bench_yuv, "YUYV->RGB565 vs float convert_24, golden + Mpixel/s"},
+    {"stream", bench_stream, "camera to TFT, camera_buf + blit vs streaming"},
+    {"fifo", bench_fifo, "FIFO read + convert, 4 B / line receives vs DMA ring"},
+    {"capture", bench_capture, "capture latency, fixed sleeps vs state machine"},
+    {"sched", bench_sched, "cooperative scheduler on a virtual clock"},
+    {"touch", bench_touch, "touch event queue, producer thread as EXTI"},
+    {"widget", bench_widget, "widget hit grid vs linear scan, cached render"},
+    {"i2c", bench_i2c, "I2C2 job queue order/timeouts, serial vs overlapped sweep"},
+    {"log", bench_log, "LPUART1 log ring vs putchar, drops, ISR writers"},
+    {"trace", bench_trace, "TRACE records vs printf text, decoder round trip"},
+    {"imgstream", bench_imgstream,
+     "camera frame over LPUART1: RGB888 dump vs checked packets"},
+    {"jpeg", bench_jpeg, "JPEG decode vs libjpeg, FIFO bytes per shown frame"},
+    {"window", bench_window, "160x120 photo, MCU decimation vs ISP scaling/zoom"},
+    {"regload", bench_regload, "OV5642 tables, one write per entry vs bursts"},
+    {"boot", bench_boot, "cold start, blocking inits vs boot sequencer"},
+    {"format", bench_format, "YUV422 / RGB565 / Y8 / JPEG output, byte streams"},
+    {"orient", bench_orient, "sensor mirror/flip and panel rotation"},
+    {"preview", bench_preview, "live preview, capture then draw vs overlapped"},
+    {"spibus", bench_spibus, "TFT and camera on one SPI bus vs one each"},
+};
+
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+/********/
+// Helpers
+/*******/
+SPI_HandleTypeDef *bench_spi(SPI_TypeDef *bus) {
+  return bus == SPI2 ? &hspi2 : bus == SPI3 ? &hspi3 : &hspi1;
+}
+
+void bench_board_up(void) {
+  sim_config.stop_ns = 0;
+  sim_config.uart_echo = 0;
+  sim_init();
+  HAL_Init();
+  SystemClock_Config();
+  MX_GPIO_Init();
+  MX_DMA_Init();
+  MX_SPI1_Init();
+  MX_SPI2_Init();
+  MX_SPI3_Init();
+  spi_bus_assign(SPI_DEV_TFT, bench_spi(sim_config.tft_spi));
+  spi_bus_assign(SPI_DEV_CAMERA, bench_spi(sim_config.cam_spi));
+  TFT_Init();
+}
+
+void bench_camera_up(void) {
+  bench_board_up();
+  MX_I2C4_Init();
+  MX_LPUART1_UART_Init();
+  ArduCam_Init_YCbCr();
+}
+
+BenchCost bench_cost_now(int bus) {
+  BenchCost c = {sim_bus_stats[bus].transactions, sim_bus_stats[bus].bytes,
+                 sim_time_ns()};
+  return c;
+}
+
+BenchCost bench_cost_since(int bus, BenchCost start) {
+  BenchCost now = bench_cost_now(bus);
+  BenchCost d = {now.transactions - start.transactions,
+                 now.bytes - start.bytes, now.ns - start.ns};
+  return d;
+}
+
+/********/
+// Main
+/*******/
+static int run_bench(unsigned i) {
+  fprintf(stdout, "=== %s: %s ===\n", benches[i].name, benches[i].what);
+  int rc = benches[i].run();
+  fprintf(stdout, "%s: %s\n\n", benches[i].name, rc ? "FAIL" : "ok");
+  return rc;
+}
+
+int main(int argc, char **argv) {
+  int failed = 0;
+
+  if (argc == 2 && !strcmp(argv[1], "--list")) {
+    for (unsigned i = 0; i < BENCH_COUNT; i++) {
+      fprintf(stdout, "%-10s %s\n", benches[i].name, benches[i].what);
+    }
+    return 0;
+  }
+  if (argc == 1) {
+    for (unsigned i = 0; i < BENCH_COUNT; i++) {
+      failed |= run_bench(i);
+    }
+    return failed;
+  }
+  for (int a = 1; a < argc; a++) {
+    unsigned i = 0;
+    while (i < BENCH_COUNT && strcmp(benches[i].name, argv[a])) {
+      i++;
+    }
+    if (i == BENCH_COUNT) {
+      fprintf(stderr, "unknown bench '%s' (try --list)\n", argv[a]);
+      return 2;
+    }
+    failed |= run_bench(i);
+  }
+  return failed;
+}
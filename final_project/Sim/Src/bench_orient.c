@@ -0,0 +1,170 @@
+/*
+ * bench_orient.c
+ *
+ * Orientation at the source. A 320x240 capture in each sensor orientation
+ * must be exactly the upright one mirrored and/or flipped, with the same
+ * FIFO bytes and SPI1 time: the capture path copies lines in order whatever
+ * the setting. Turned by 180 degrees the sensor sends what the preview table
+ * leaves it sending, so that row also stands for the old pipeline before its
+ * reversed write loop. Then the panel: everything drawn after
+ * TFT_SetRotation180 must land as the 180 degree turn of the same drawing,
+ * and a touch on the glass must come back in the turned coordinates.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+#include "i2c.h"
+#include "touch.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define W CAM_FRAME_W
+#define H CAM_FRAME_H
+
+static uint16_t upright[TFT_WIDTH * TFT_HEIGHT];
+static uint16_t normal[TFT_WIDTH * TFT_HEIGHT];
+static uint8_t pattern[64 * 48 * 2];
+
+static const struct {
+  const char *name;
+  CamOrientation o;
+} orients[] = {
+    {"upright", CAM_ORIENT_UPRIGHT},
+    {"mirror", CAM_ORIENT_MIRROR},
+    {"flip", CAM_ORIENT_FLIP},
+    {"rotate 180", CAM_ORIENT_ROTATE180},
+};
+
+// Capture pixels at the TFT origin that are not the upright capture's pixel
+// mirrored and/or flipped as o says
+static uint32_t mismatches(CamOrientation o) {
+  const uint16_t *fb = sim_tft_framebuffer();
+  uint32_t bad = 0;
+  for (uint32_t y = 0; y < H; y++) {
+    uint32_t uy = o & CAM_ORIENT_FLIP ? H - 1 - y : y;
+    for (uint32_t x = 0; x < W; x++) {
+      uint32_t ux = o & CAM_ORIENT_MIRROR ? W - 1 - x : x;
+      bad += fb[y * TFT_WIDTH + x] != upright[uy * TFT_WIDTH + ux];
+    }
+  }
+  return bad;
+}
+
+static int check_camera(void) {
+  int failed = 0;
+  BenchCost first = {0};
+  uint64_t first_fifo = 0;
+
+  fprintf(stdout, "%-12s %7s %7s %8s %9s %9s\n", "sensor", "0x3818",
+          "I2C tx", "FIFO B", "SPI1 ms", "mismatch");
+  for (unsigned i = 0; i < sizeof(orients) / sizeof(orients[0]); i++) {
+    bench_camera_up();
+    TFT_FillScreen(COLOR_WHITE);
+    BenchCost i2c = bench_cost_now(SIM_BUS_I2C4);
+    cam_set_orientation(orients[i].o);
+    i2c = bench_cost_since(SIM_BUS_I2C4, i2c);
+
+    BenchCost spi = bench_cost_now(SIM_BUS_SPI1);
+    uint64_t fifo = sim_arducam_fifo_bytes_read();
+    SingleCapStream_YCbCr(0, 0, 1);
+    spi = bench_cost_since(SIM_BUS_SPI1, spi);
+    fifo = sim_arducam_fifo_bytes_read() - fifo;
+    spi.ns -= cam_capture_stats()->wait_ms * 1000000ull;
+
+    if (orients[i].o == CAM_ORIENT_UPRIGHT) {
+      memcpy(upright, sim_tft_framebuffer(), sizeof(upright));
+      first = spi;
+      first_fifo = fifo;
+    }
+    uint32_t bad = mismatches(orients[i].o);
+    uint8_t r3818 = sim_ov5642_register(0x3818);
+    fprintf(stdout, "  %-10s %#7x %7llu %8llu %9.1f %9lu\n", orients[i].name,
+            r3818, (unsigned long long)i2c.transactions,
+            (unsigned long long)fifo, spi.ns / 1e6, (unsigned long)bad);
+    if (bad || fifo != first_fifo || spi.bytes != first.bytes ||
+        cam_orientation() != orients[i].o) {
+      fprintf(stdout, "  FAIL: %s is not the upright frame turned\n",
+              orients[i].name);
+      failed = 1;
+    }
+  }
+  // The preview table's readout, which the old loop turned in software
+  if (sim_ov5642_register(0x3818) != 0xc1) {
+    fprintf(stdout, "  FAIL: rotate 180 is not the preview table's 0xc1\n");
+    failed = 1;
+  }
+  cam_set_orientation(CAM_ORIENT_UPRIGHT);
+  return failed;
+}
+
+// A pattern, a rectangle and some text, the same each time
+static void draw(void) {
+  TFT_FillScreen(COLOR_WHITE);
+  for (uint32_t p = 0; p < 64 * 48; p++) {
+    uint16_t c = RGB565(p % 64 / 2, p / 64, (p * 7) & 31);
+    pattern[2 * p] = (uint8_t)(c >> 8);
+    pattern[2 * p + 1] = (uint8_t)c;
+  }
+  TFT_DrawRGB565Buffer(30, 20, 64, 48, pattern, 1);
+  TFT_DrawRGB565Buffer(200, 150, 64, 48, pattern, 2);
+  TFT_FillRect(400, 10, 50, 30, COLOR_RED);
+  TFT_DrawStringAt(10, 280, "turned", COLOR_BLUE, 2);
+}
+
+// Panel reads of a touch at (x, y) on the glass
+static TOUCH_TouchPoint touch_at(uint16_t x, uint16_t y) {
+  TOUCH_TouchPoint p = {0};
+  sim_touch_script(HAL_GetTick() + 2, x, y);
+  HAL_Delay(5);
+  TOUCH_ReadTouch(&p);
+  HAL_Delay(200); // lifted again
+  return p;
+}
+
+static int check_panel(void) {
+  int failed = 0;
+  bench_board_up();
+  MX_I2C1_Init();
+  TOUCH_Init();
+  draw();
+  memcpy(normal, sim_tft_framebuffer(), sizeof(normal));
+  TOUCH_TouchPoint p0 = touch_at(100, 50);
+
+  TFT_SetRotation180(1);
+  BenchCost spi = bench_cost_now(SIM_BUS_SPI1);
+  draw();
+  spi = bench_cost_since(SIM_BUS_SPI1, spi);
+  const uint16_t *fb = sim_tft_framebuffer();
+  uint32_t bad = 0;
+  for (uint32_t i = 0; i < TFT_WIDTH * TFT_HEIGHT; i++) {
+    bad += fb[i] != normal[TFT_WIDTH * TFT_HEIGHT - 1 - i];
+  }
+  TOUCH_TouchPoint p1 = touch_at(100, 50);
+  TFT_SetRotation180(0);
+
+  fprintf(stdout, "panel turned   %lu pixels not the 180 degree turn, "
+                  "drawn in %.1f ms\n",
+          (unsigned long)bad, spi.ns / 1e6);
+  fprintf(stdout, "touch at 100,50 on the glass: %u,%u upright, %u,%u "
+                  "turned\n",
+          p0.x, p0.y, p1.x, p1.y);
+  if (bad) {
+    fprintf(stdout, "  FAIL: turned drawing does not match\n");
+    failed = 1;
+  }
+  if (!p0.touched || !p1.touched || p0.x != 100 || p0.y != 50 ||
+      p1.x != TFT_WIDTH - 100 || p1.y != TFT_HEIGHT - 50) {
+    fprintf(stdout, "  FAIL: touch does not follow the panel\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+int bench_orient(void) {
+  int failed = check_camera();
+  failed |= check_panel();
+  return failed;
+}
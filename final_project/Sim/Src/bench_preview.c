@@ -0,0 +1,233 @@
+/*
+ * bench_preview.c
+ *
+ * Frames per second and latency for a live picture, two ways: single
+ * captures back to back, each one exposing, then draining to the TFT, and
+ * the continuous preview, where the next frame exposes while the previous
+ * one goes out of camera_buf. Both run for the same virtual time at the
+ * app's 160x120 RGB565 and at 320x240 YUV422. Every preview frame must be
+ * the sensor's next frame, none skipped, and show on the TFT pixel for pixel
+ * as it left the FIFO; no step may hold SPI1 much past its budget. Single
+ * captures, a second start and a new output size, format or orientation
+ * asked for halfway through must be refused without touching the sensor,
+ * the FIFO or camera_buf.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RUN_MS 4000
+
+static const struct {
+  const char *name;
+  uint16_t w, h, x, y;
+  CamFormat fmt;
+} setups[] = {
+    {"160x120 RGB565", CAM_FRAME_W / 2, CAM_FRAME_H / 2, 20, 100,
+     CAM_FMT_RGB565},
+    {"320x240 YUV422", CAM_FRAME_W, CAM_FRAME_H, 0, 0, CAM_FMT_YUV422},
+};
+
+// Frames the sensor model has finished and the preview not yet shown: the
+// one in camera_buf and the one in the FIFO
+static uint8_t pending[2][rgb565_data_length];
+static uint32_t pending_id[2];
+static uint8_t pending_count;
+static uint16_t line[CAM_FRAME_W];
+
+typedef struct {
+  uint32_t frames;
+  double fps;
+  double latency_ms, max_latency_ms;
+  uint32_t max_step_ms;
+} Run;
+
+static void setup(unsigned i) {
+  bench_camera_up();
+  TFT_FillScreen(COLOR_WHITE);
+  cam_set_output_size(setups[i].w, setups[i].h);
+  cam_set_format(setups[i].fmt);
+}
+
+static Run sequential(unsigned i) {
+  Run r = {0};
+  setup(i);
+  uint32_t start = HAL_GetTick(), first = 0, last = 0;
+  double total = 0;
+  while (HAL_GetTick() - start < RUN_MS) {
+    if (cam_capture_state() == CAM_CAPTURE_IDLE) {
+      cam_capture_start(setups[i].x, setups[i].y, 1);
+    }
+    uint32_t t0 = HAL_GetTick();
+    uint8_t done = cam_capture_step();
+    if (HAL_GetTick() - t0 > r.max_step_ms) {
+      r.max_step_ms = HAL_GetTick() - t0;
+    }
+    if (done) {
+      const CamCaptureStats *cs = cam_capture_stats();
+      last = HAL_GetTick();
+      first = r.frames++ ? first : last;
+      total += cs->total_ms;
+      if (cs->total_ms > r.max_latency_ms) {
+        r.max_latency_ms = cs->total_ms;
+      }
+    }
+    HAL_Delay(1);
+  }
+  while (cam_capture_state() != CAM_CAPTURE_IDLE) {
+    cam_capture_step(); // the one in flight, so the preview may start
+    HAL_Delay(1);
+  }
+  r.fps = r.frames > 1 ? (r.frames - 1) * 1000.0 / (last - first) : 0;
+  r.latency_ms = r.frames ? total / r.frames : 0;
+  return r;
+}
+
+// The TFT area of the preview against the oldest pending frame
+static uint32_t mismatches(unsigned i) {
+  const uint16_t *fb = sim_tft_framebuffer();
+  const uint8_t *frame = pending[0];
+  uint16_t w = setups[i].w;
+  uint32_t bad = 0;
+  for (uint32_t y = 0; y < setups[i].h; y++) {
+    const uint8_t *in = frame + y * w * 2;
+    if (setups[i].fmt == CAM_FMT_YUV422) {
+      yuyv_to_rgb565(in, (uint8_t *)line, w);
+      in = (const uint8_t *)line;
+    }
+    for (uint32_t x = 0; x < w; x++) {
+      uint16_t want = (uint16_t)(in[2 * x] << 8 | in[2 * x + 1]);
+      bad += fb[(setups[i].y + y) * TFT_WIDTH + setups[i].x + x] != want;
+    }
+  }
+  return bad;
+}
+
+static uint8_t buf_before[rgb565_data_length];
+
+// 1 if single captures and reconfiguration left the running preview alone
+static int captures_refused(unsigned i) {
+  uint32_t captures = sim_arducam_captures();
+  uint64_t fifo_read = sim_arducam_fifo_bytes_read();
+  uint32_t writes = sim_ov5642_register_writes();
+  CamOrientation orient = cam_orientation();
+  memcpy(buf_before, camera_buf, sizeof(buf_before));
+  uint8_t started = cam_capture_start(0, 0, 1);
+  SingleCapStream_YCbCr(0, 0, 1); // must return, not wait for a capture
+  SingleCapTransfer_YCbCr(0, 0, camera_buf);
+  started |= cam_preview_start(0, 0, 2, 0);
+  uint8_t resized = cam_set_output_size(setups[i].w / 2, setups[i].h / 2);
+  CamFormat fmt = cam_set_format(setups[i].fmt == CAM_FMT_RGB565
+                                     ? CAM_FMT_YUV422
+                                     : CAM_FMT_RGB565);
+  cam_set_orientation(orient ^ CAM_ORIENT_ROTATE180);
+  uint16_t w, h;
+  cam_output_size(&w, &h);
+  return !started && !resized && w == setups[i].w && h == setups[i].h &&
+         fmt == setups[i].fmt && cam_orientation() == orient &&
+         sim_ov5642_register_writes() == writes &&
+         sim_arducam_captures() == captures &&
+         sim_arducam_fifo_bytes_read() == fifo_read &&
+         !memcmp(buf_before, camera_buf, sizeof(buf_before));
+}
+
+static Run pipelined(unsigned i, uint32_t *bad_frames, uint32_t *skipped,
+                     int *refused) {
+  Run r = {0};
+  setup(i);
+  pending_count = 0;
+  *bad_frames = *skipped = 0;
+  uint32_t seen = sim_arducam_captures(), last_id = 0;
+  cam_preview_start(setups[i].x, setups[i].y, 1, 0);
+  uint32_t start = HAL_GetTick();
+  double total = 0;
+  *refused = -1;
+  while (HAL_GetTick() - start < RUN_MS) {
+    if (*refused < 0 && HAL_GetTick() - start >= RUN_MS / 2) {
+      *refused = captures_refused(i);
+    }
+    uint8_t shown = cam_preview_step();
+    // A frame finishes inside a CAP_DONE poll; keep it until it is shown
+    if (sim_arducam_captures() != seen) {
+      seen = sim_arducam_captures();
+      uint32_t len;
+      const uint8_t *fifo = sim_arducam_fifo(&len);
+      if (pending_count == 2) {
+        fprintf(stdout, "  FAIL: a third frame finished\n");
+        pending_count = 1;
+        (*bad_frames)++;
+      }
+      memcpy(pending[pending_count], fifo, len);
+      pending_id[pending_count++] = seen;
+    }
+    if (shown) {
+      const CamPreviewStats *ps = cam_preview_stats();
+      total += ps->latency_ms;
+      if (!pending_count || mismatches(i)) {
+        (*bad_frames)++;
+      } else {
+        *skipped += last_id && pending_id[0] != last_id + 1;
+        last_id = pending_id[0];
+        memmove(pending[0], pending[1], sizeof(pending[0]));
+        pending_id[0] = pending_id[1];
+        pending_count--;
+      }
+    }
+    HAL_Delay(1);
+  }
+  cam_preview_stop();
+  const CamPreviewStats *ps = cam_preview_stats();
+  r.frames = ps->frames;
+  r.fps = ps->fps_x10 / 10.0;
+  r.latency_ms = r.frames ? total / r.frames : 0;
+  r.max_latency_ms = ps->max_latency_ms;
+  r.max_step_ms = ps->max_step_ms;
+  return r;
+}
+
+static void row(const char *what, Run r) {
+  fprintf(stdout, "  %-18s %7lu %7.2f %9.1f %9.0f %9lu\n", what,
+          (unsigned long)r.frames, r.fps, r.latency_ms, r.max_latency_ms,
+          (unsigned long)r.max_step_ms);
+}
+
+int bench_preview(void) {
+  int failed = 0;
+  fprintf(stdout, "%-20s %7s %7s %9s %9s %9s\n", "4 s of frames", "frames",
+          "fps", "lat. ms", "max ms", "step ms");
+  for (unsigned i = 0; i < sizeof(setups) / sizeof(setups[0]); i++) {
+    fprintf(stdout, "%s\n", setups[i].name);
+    Run seq = sequential(i);
+    row("capture, then draw", seq);
+    uint32_t bad, skipped;
+    int refused;
+    Run pre = pipelined(i, &bad, &skipped, &refused);
+    row("preview", pre);
+    fprintf(stdout, "  %.2fx the frame rate; %lu frame(s) wrong, %lu "
+                    "skipped\n",
+            pre.fps / seq.fps, (unsigned long)bad, (unsigned long)skipped);
+    if (bad || skipped || pre.frames < 2) {
+      fprintf(stdout, "  FAIL: preview frames are not the sensor's\n");
+      failed = 1;
+    }
+    if (refused != 1) {
+      fprintf(stdout, "  FAIL: a capture or new setting got past the preview\n");
+      failed = 1;
+    }
+    if (pre.fps <= seq.fps) {
+      fprintf(stdout, "  FAIL: the preview did not overlap\n");
+      failed = 1;
+    }
+    if (pre.max_step_ms > CAM_DRAIN_BUDGET_MS + 10) {
+      fprintf(stdout, "  FAIL: a preview step held SPI1 for %lu ms\n",
+              (unsigned long)pre.max_step_ms);
+      failed = 1;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,163 @@
+/*
+ * bench_regload.c
+ *
+ * OV5642 register tables loaded the old way, one I2C write and a 1 ms delay
+ * per entry, against wrSensorRegs16_8's bursts. Both start from a software
+ * reset and must leave the sensor model with the same 64 K register image;
+ * a made-up table covers what the shipped ones do not: gaps, rewrites on
+ * either side of a barrier, a reset mid table, address 0xffff and more
+ * distinct registers than the loader holds at once.
+ */
+
+#include "bench.h"
+
+#include "camera.h"
+#include "i2c.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define IMAGE_SIZE 0x10000
+#define MADE_UP_MAX 400
+
+static uint8_t image_old[IMAGE_SIZE];
+static uint8_t image_new[IMAGE_SIZE];
+static struct sensor_reg made_up[MADE_UP_MAX];
+
+// wrSensorRegs16_8 as it was
+static void load_one_by_one(const struct sensor_reg *regs) {
+  uint16_t reg_addr = regs->reg;
+  uint8_t reg_val = regs->val;
+
+  while ((reg_addr != 0xffff) || (reg_val != 0xff)) {
+    HAL_I2C_Mem_Write(&hi2c4, OV5642_I2C_ADDR, reg_addr, I2C_MEMADD_SIZE_16BIT,
+                      &reg_val, 1, HAL_MAX_DELAY);
+    HAL_Delay(1);
+    regs++;
+    reg_addr = regs->reg;
+    reg_val = regs->val;
+  }
+}
+
+static void build_made_up(void) {
+  static const struct sensor_reg head[] = {
+      {0x5180, 0x11}, {0x5182, 0x22}, {0x5181, 0x33}, {0x5180, 0x44},
+      {0x3002, 0x0c}, {0x5180, 0x55}, {0x3002, 0x00}, {0x4000, 0x01},
+      {0x3008, 0x82}, {0x4001, 0x02}, {0x3008, 0x02}, {0x4001, 0x03},
+      {0xffff, 0x01}, {0xfffe, 0x02}, {0x3212, 0x03}, {0x3a00, 0x78},
+      {0x3212, 0x13}, {0x3212, 0xa3}, {0x3a00, 0x7c},
+  };
+  unsigned n = sizeof(head) / sizeof(head[0]);
+  memcpy(made_up, head, sizeof(head));
+  // 300 distinct registers, every seventh one skipped, then some rewritten
+  for (unsigned i = 0; i < 300; i++) {
+    if (i % 7) {
+      made_up[n].reg = (uint16_t)(0x5800 + i);
+      made_up[n++].val = (uint8_t)(i * 13);
+    }
+  }
+  for (unsigned i = 0; i < 300; i += 11) {
+    made_up[n].reg = (uint16_t)(0x5800 + i);
+    made_up[n++].val = (uint8_t)~i;
+  }
+  made_up[n].reg = 0xffff;
+  made_up[n].val = 0xff;
+}
+
+static uint32_t entries(const struct sensor_reg *regs) {
+  uint32_t n = 0;
+  while (regs[n].reg != 0xffff || regs[n].val != 0xff) {
+    n++;
+  }
+  return n;
+}
+
+typedef struct {
+  BenchCost i2c;
+  uint32_t sensor_writes;
+} Load;
+
+// Tables in order after a software reset, then the register image
+static Load load(void (*loader)(const struct sensor_reg *),
+                 const struct sensor_reg *const *tables, uint8_t *image) {
+  bench_board_up();
+  MX_I2C4_Init();
+  wrSensorReg16_8(0x3008, 0x80);
+  HAL_Delay(100);
+
+  BenchCost i2c = bench_cost_now(SIM_BUS_I2C4);
+  uint32_t writes = sim_ov5642_register_writes();
+  for (; *tables; tables++) {
+    loader(*tables);
+  }
+  Load l = {bench_cost_since(SIM_BUS_I2C4, i2c),
+            sim_ov5642_register_writes() - writes};
+  for (uint32_t r = 0; r < IMAGE_SIZE; r++) {
+    image[r] = sim_ov5642_register((uint16_t)r);
+  }
+  return l;
+}
+
+static void row(const char *what, Load l) {
+  fprintf(stdout, "  %-18s %6llu %7llu %7lu %9.1f\n", what,
+          (unsigned long long)l.i2c.transactions,
+          (unsigned long long)l.i2c.bytes, (unsigned long)l.sensor_writes,
+          l.i2c.ns / 1e6);
+}
+
+int bench_regload(void) {
+  static const struct sensor_reg *const preview[] = {OV5642_QVGA_Preview,
+                                                     NULL};
+  static const struct sensor_reg *const jpeg[] = {
+      OV5642_QVGA_Preview, OV5642_JPEG_Capture_QSXGA, NULL};
+  static const struct sensor_reg *const odd[] = {made_up, NULL};
+  static const struct {
+    const char *what;
+    const struct sensor_reg *const *tables;
+  } cases[] = {
+      {"QVGA preview", preview},
+      {"preview + JPEG", jpeg},
+      {"made up", odd},
+  };
+  int failed = 0;
+
+  build_made_up();
+  fprintf(stdout, "%-20s %6s %7s %7s %9s\n", "table(s)", "I2C tx", "I2C B",
+          "regs", "ms");
+  for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    uint32_t n = 0;
+    for (const struct sensor_reg *const *t = cases[i].tables; *t; t++) {
+      n += entries(*t);
+    }
+    fprintf(stdout, "%s, %lu entries\n", cases[i].what, (unsigned long)n);
+    Load old = load(load_one_by_one, cases[i].tables, image_old);
+    row("one by one", old);
+    Load now = load(wrSensorRegs16_8, cases[i].tables, image_new);
+    row("bursts", now);
+
+    uint32_t differ = 0, first = 0;
+    for (uint32_t r = IMAGE_SIZE; r-- > 0;) {
+      if (image_old[r] != image_new[r]) {
+        differ++;
+        first = r;
+      }
+    }
+    fprintf(stdout, "  register image: %lu differ; %.1fx fewer transactions, "
+                    "%.1fx faster\n",
+            (unsigned long)differ,
+            (double)old.i2c.transactions / now.i2c.transactions,
+            (double)old.i2c.ns / now.i2c.ns);
+    if (differ) {
+      fprintf(stdout, "  FAIL: first at 0x%04lx, %02x one by one, %02x "
+                      "bursts\n",
+              (unsigned long)first, image_old[first], image_new[first]);
+      failed = 1;
+    }
+    if (now.i2c.transactions >= old.i2c.transactions ||
+        now.i2c.ns * 4 > old.i2c.ns) {
+      fprintf(stdout, "  FAIL: bursts are not faster\n");
+      failed = 1;
+    }
+  }
+  return failed;
+}
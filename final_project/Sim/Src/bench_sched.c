@@ -0,0 +1,117 @@
+/*
+ * bench_sched.c
+ *
+ * The scheduler on a virtual microsecond clock, no board. Tasks stand in
+ * for the firmware's jobs by advancing the clock by their cost. Checks:
+ * released tasks run in priority order, a fast task never waits longer
+ * than the longest single run of another task, deadline misses and skipped
+ * releases are counted (touch skips releases while sensors runs), and the
+ * clock may wrap. The fast task's worst latency is compared with running
+ * every job back to back in one loop.
+ */
+
+#include "bench.h"
+
+#include "scheduler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RUN_US 10000000u // 10 s
+
+static uint32_t now;
+static char order[16];
+static unsigned order_len;
+
+static uint32_t virtual_clock(void) { return now; }
+
+// Records each task's first run only
+static void note(char c) {
+  if (!strchr(order, c) && order_len < sizeof(order) - 1) {
+    order[order_len++] = c;
+  }
+}
+
+// Costs in us; the camera alternates short polls and long drain steps
+static void job_touch(void) { note('t'); now += 200; }
+static void job_ui(void) { note('u'); now += 5000; }
+static void job_camera(void) {
+  static unsigned n;
+  note('c');
+  now += (n++ % 4 == 3) ? 20000 : 300;
+}
+static void job_sensors(void) { note('s'); now += 45000; }
+static void job_overrun(void) { note('o'); now += 30000; }
+
+static SchedTask tasks[] = {
+    {"touch", job_touch, 10000, 0, 0, 0},
+    {"ui", job_ui, 50000, 0, 0, 1},
+    {"camera", job_camera, 20000, 50000, 0, 2},
+    {"sensors", job_sensors, 1000000, 0, 0, 3},
+    {"overrun", job_overrun, 1000000, 10000, 0, 4},
+};
+#define TASK_COUNT (sizeof(tasks) / sizeof(tasks[0]))
+
+static void run_until(uint32_t end) {
+  while ((int32_t)(end - now) > 0) {
+    if (!sched_run_once()) {
+      uint32_t idle = sched_idle_us();
+      now += (int32_t)(end - now) < (int32_t)idle ? end - now : idle;
+    }
+  }
+}
+
+static int run(uint32_t start, const char *label) {
+  int failed = 0;
+  now = start;
+  order_len = 0;
+  memset(order, 0, sizeof(order));
+  sched_init(tasks, TASK_COUNT, virtual_clock);
+  run_until(start + RUN_US);
+
+  if (strncmp(order, "tucso", 5)) {
+    fprintf(stdout, "  %s: first releases ran as '%.5s', not by priority\n",
+            label, order);
+    failed = 1;
+  }
+  // Non-preemptive bound: one run of the longest other job
+  if (tasks[0].max_late_us > 45000) {
+    fprintf(stdout, "  %s: touch waited %u us\n", label,
+            (unsigned)tasks[0].max_late_us);
+    failed = 1;
+  }
+  if (tasks[4].misses != tasks[4].runs || tasks[1].misses ||
+      tasks[3].misses) {
+    fprintf(stdout, "  %s: deadline misses not where expected\n", label);
+    failed = 1;
+  }
+  uint32_t expect = RUN_US / tasks[3].period_us;
+  if (tasks[3].runs < expect || tasks[3].runs > expect + 1) {
+    fprintf(stdout, "  %s: sensors ran %u times in 10 s\n", label,
+            (unsigned)tasks[3].runs);
+    failed = 1;
+  }
+  return failed;
+}
+
+int bench_sched(void) {
+  int failed = run(0, "from 0");
+  fprintf(stdout, "%-8s %6s %6s %8s %8s %8s\n", "task", "runs", "misses",
+          "avg us", "max us", "late us");
+  for (unsigned i = 0; i < TASK_COUNT; i++) {
+    SchedTask *t = &tasks[i];
+    fprintf(stdout, "%-8s %6u %6u %8llu %8u %8u\n", t->name,
+            (unsigned)t->runs, (unsigned)t->misses,
+            (unsigned long long)(t->total_us / t->runs), (unsigned)t->max_us,
+            (unsigned)t->max_late_us);
+  }
+  // Same load with the clock crossing 2^32 us a second in
+  failed |= run(0u - 1000000u, "wrapping clock");
+
+  // The monolithic loop: touch is only looked at once per pass
+  uint32_t serial = 200 + 5000 + 20000 + 45000 + 30000;
+  fprintf(stdout, "touch worst wait: scheduled %.1f ms, one serial loop "
+                  "%.1f ms\n",
+          tasks[0].max_late_us / 1e3, serial / 1e3);
+  return failed;
+}
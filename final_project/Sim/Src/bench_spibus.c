@@ -0,0 +1,194 @@
+/*
+ * bench_spibus.c
+ *
+ * The TFT and the ArduCHIP on one SPI bus, as the board is built, against
+ * either of them moved to a bus of its own: the camera on SPI3, the TFT on
+ * SPI2, and the camera on SPI3 at the .ioc's 8 MHz rather than SPI1's
+ * clock. For the app's 160x120 RGB565 and for 320x240 YUV422 it times one
+ * capture from CAP_DONE to its last pixel on the TFT, then counts frames
+ * for a few seconds of captures back to back and of the live preview.
+ * Every wiring must put the same first frame on the glass as the shared bus,
+ * with no two chip selects low on one bus, and a bus of its own must not be
+ * slower than sharing one.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+#include "spi_bus.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RUN_MS 3000
+
+static const struct {
+  const char *name;
+  SPI_TypeDef *tft, *cam; // NULL = SPI1
+  uint8_t ioc_clock;      // leave the moved bus at the .ioc's prescaler
+} wirings[] = {
+    {"shared SPI1", NULL, NULL, 0},
+    {"camera on SPI3", NULL, SPI3, 0},
+    {"TFT on SPI2", SPI2, NULL, 0},
+    {"camera SPI3 8 MHz", NULL, SPI3, 1},
+};
+
+#define WIRINGS (sizeof(wirings) / sizeof(wirings[0]))
+
+static const struct {
+  const char *name;
+  uint16_t w, h, x, y;
+  CamFormat fmt;
+} setups[] = {
+    {"160x120 RGB565", CAM_FRAME_W / 2, CAM_FRAME_H / 2, 20, 100,
+     CAM_FMT_RGB565},
+    {"320x240 YUV422", CAM_FRAME_W, CAM_FRAME_H, 0, 0, CAM_FMT_YUV422},
+};
+
+static uint16_t shared_frame[TFT_WIDTH * TFT_HEIGHT];
+
+typedef struct {
+  double drain_ms;  // CAP_DONE to the last pixel, one capture
+  uint64_t bytes[3]; // per SPI bus, that capture
+  uint32_t differ;   // pixels unlike the shared bus's first frame
+  double capture_fps, preview_fps;
+} Run;
+
+static void setup(unsigned w, unsigned s) {
+  sim_config.tft_spi = wirings[w].tft;
+  sim_config.cam_spi = wirings[w].cam;
+  bench_camera_up();
+  if (wirings[w].ioc_clock) {
+    SPI_HandleTypeDef *moved = bench_spi(wirings[w].cam ? wirings[w].cam
+                                                        : wirings[w].tft);
+    moved->Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_4;
+    HAL_SPI_Init(moved);
+  }
+  TFT_FillScreen(COLOR_WHITE);
+  cam_set_output_size(setups[s].w, setups[s].h);
+  cam_set_format(setups[s].fmt);
+}
+
+static void one_capture(unsigned s, Run *r) {
+  BenchCost before[3];
+  for (int b = 0; b < 3; b++) {
+    before[b] = bench_cost_now(SIM_BUS_SPI1 + b);
+  }
+  uint64_t drain_start = 0;
+  cam_capture_start(setups[s].x, setups[s].y, 1);
+  for (;;) {
+    uint64_t t = sim_time_ns();
+    uint8_t done = cam_capture_step();
+    CamCaptureState st = cam_capture_state();
+    if (!drain_start && st != CAM_CAPTURE_START && st != CAM_CAPTURE_WAIT) {
+      drain_start = t; // the step that saw CAP_DONE
+    }
+    if (done) {
+      break;
+    }
+    if (st == CAM_CAPTURE_WAIT) {
+      HAL_Delay(1);
+    }
+  }
+  r->drain_ms = (sim_time_ns() - drain_start) / 1e6;
+  cam_capture_step(); // back to idle
+  for (int b = 0; b < 3; b++) {
+    r->bytes[b] = bench_cost_since(SIM_BUS_SPI1 + b, before[b]).bytes;
+  }
+}
+
+static double capture_fps(unsigned s) {
+  uint32_t start = HAL_GetTick(), first = 0, last = 0, frames = 0;
+  while (HAL_GetTick() - start < RUN_MS) {
+    if (cam_capture_state() == CAM_CAPTURE_IDLE) {
+      cam_capture_start(setups[s].x, setups[s].y, 1);
+    }
+    if (cam_capture_step()) {
+      last = HAL_GetTick();
+      first = frames++ ? first : last;
+    }
+    HAL_Delay(1);
+  }
+  while (cam_capture_state() != CAM_CAPTURE_IDLE) {
+    cam_capture_step(); // the one in flight, so the preview may start
+    HAL_Delay(1);
+  }
+  return frames > 1 ? (frames - 1) * 1000.0 / (last - first) : 0;
+}
+
+static double preview_fps(unsigned s) {
+  cam_preview_start(setups[s].x, setups[s].y, 1, 0);
+  uint32_t start = HAL_GetTick();
+  while (HAL_GetTick() - start < RUN_MS) {
+    cam_preview_step();
+    HAL_Delay(1);
+  }
+  cam_preview_stop();
+  return cam_preview_stats()->fps_x10 / 10.0;
+}
+
+static uint32_t bus_errors(void) {
+  uint32_t errors = 0;
+  for (int b = 0; b < 3; b++) {
+    errors += (uint32_t)sim_bus_stats[SIM_BUS_SPI1 + b].errors;
+  }
+  return errors;
+}
+
+static Run run(unsigned w, unsigned s, uint32_t *errors) {
+  Run r = {0};
+  setup(w, s);
+  one_capture(s, &r);
+  const uint16_t *fb = sim_tft_framebuffer();
+  if (w == 0) {
+    memcpy(shared_frame, fb, sizeof(shared_frame));
+  }
+  for (uint32_t i = 0; i < TFT_WIDTH * TFT_HEIGHT; i++) {
+    r.differ += fb[i] != shared_frame[i];
+  }
+  r.capture_fps = capture_fps(s);
+  r.preview_fps = preview_fps(s);
+  *errors = bus_errors();
+  return r;
+}
+
+int bench_spibus(void) {
+  int failed = 0;
+  fprintf(stdout, "%-21s %8s %8s %8s %9s %9s %9s\n", "wiring", "drain ms",
+          "cap fps", "pv fps", "SPI1 B", "SPI2 B", "SPI3 B");
+  for (unsigned s = 0; s < sizeof(setups) / sizeof(setups[0]); s++) {
+    fprintf(stdout, "%s\n", setups[s].name);
+    Run shared = {0};
+    for (unsigned w = 0; w < WIRINGS; w++) {
+      uint32_t errors;
+      Run r = run(w, s, &errors);
+      shared = w ? shared : r;
+      fprintf(stdout, "  %-19s %8.1f %8.2f %8.2f %9llu %9llu %9llu\n",
+              wirings[w].name, r.drain_ms, r.capture_fps, r.preview_fps,
+              (unsigned long long)r.bytes[0], (unsigned long long)r.bytes[1],
+              (unsigned long long)r.bytes[2]);
+      if (r.differ || errors) {
+        fprintf(stdout, "  FAIL: %lu pixels differ, %lu bus errors\n",
+                (unsigned long)r.differ, (unsigned long)errors);
+        failed = 1;
+      }
+      // the moved device's traffic is all on its own bus
+      int moved = wirings[w].cam ? 2 : wirings[w].tft ? 1 : 0;
+      if (w && (!r.bytes[moved] || r.bytes[0] >= shared.bytes[0])) {
+        fprintf(stdout, "  FAIL: %s did not move\n", wirings[w].name);
+        failed = 1;
+      }
+      if (w && !wirings[w].ioc_clock &&
+          (r.drain_ms >= shared.drain_ms ||
+           r.capture_fps < shared.capture_fps ||
+           r.preview_fps < shared.preview_fps)) {
+        fprintf(stdout, "  FAIL: %s is slower than the shared bus\n",
+                wirings[w].name);
+        failed = 1;
+      }
+    }
+  }
+  sim_config.tft_spi = sim_config.cam_spi = NULL;
+  return failed;
+}
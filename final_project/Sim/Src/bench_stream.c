@@ -0,0 +1,63 @@
+/*
+ * bench_stream.c
+ *
+ * One capture shown on the TFT two ways: SingleCapTransfer_YCbCr into
+ * camera_buf followed by TFT_DrawRGB565Buffer, and SingleCapStream_YCbCr
+ * pushing converted lines straight to the panel. Each run starts from a
+ * fresh board so both see the same frame; the panels must match.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PHOTO_X 20
+#define PHOTO_Y 100
+
+static uint16_t snapshot[TFT_WIDTH * TFT_HEIGHT];
+
+static BenchCost full_buffer(uint8_t scale) {
+  bench_camera_up();
+  TFT_FillScreen(COLOR_WHITE);
+  BenchCost start = bench_cost_now(SIM_BUS_SPI1);
+  SingleCapTransfer_YCbCr(0, 0, camera_buf);
+  TFT_DrawRGB565Buffer(PHOTO_X, PHOTO_Y, CAM_FRAME_W, CAM_FRAME_H, camera_buf,
+                       scale);
+  return bench_cost_since(SIM_BUS_SPI1, start);
+}
+
+static BenchCost streamed(uint8_t scale) {
+  bench_camera_up();
+  TFT_FillScreen(COLOR_WHITE);
+  BenchCost start = bench_cost_now(SIM_BUS_SPI1);
+  SingleCapStream_YCbCr(PHOTO_X, PHOTO_Y, scale);
+  return bench_cost_since(SIM_BUS_SPI1, start);
+}
+
+int bench_stream(void) {
+  int failed = 0;
+
+  fprintf(stdout, "%-6s | %9s %9s %8s | %9s %9s %8s\n", "scale", "buf ms",
+          "buf B", "buf RAM", "stream ms", "stream B", "RAM");
+  for (uint8_t scale = 1; scale <= 2; scale++) {
+    BenchCost buf = full_buffer(scale);
+    memcpy(snapshot, sim_tft_framebuffer(), sizeof(snapshot));
+    BenchCost str = streamed(scale);
+    if (memcmp(snapshot, sim_tft_framebuffer(), sizeof(snapshot))) {
+      fprintf(stdout, "  scale %u: streamed picture differs\n", scale);
+      failed = 1;
+    }
+    // RAM: the frame buffer vs the FIFO chunk ring plus the RGB565 line ring
+    fprintf(stdout, "%-6u | %9.1f %9llu %8u | %9.1f %9llu %8u\n", scale,
+            buf.ns / 1e6, (unsigned long long)buf.bytes,
+            (unsigned)rgb565_data_length, str.ns / 1e6,
+            (unsigned long long)str.bytes,
+            (unsigned)(CAM_FIFO_RING_CHUNKS * CAM_FIFO_CHUNK +
+                       CAM_FRAME_W * 2 * CAM_STREAM_RING_LINES));
+  }
+  return failed;
+}
@@ -0,0 +1,113 @@
+/*
+ * bench_text.c
+ *
+ * SPI1 cost of drawing one string. "per-pixel" replays the old rasteriser,
+ * which set a 1x1 address window and sent one RAMWR for every pixel of every
+ * lit font dot (every cell pixel with a background); "glyph runs" is the
+ * current TFT_TextPrintf. The two are checked against each other, and the
+ * direct and retained paths against each other, pixel for pixel.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEXT_X 10
+#define TEXT_Y 100
+#define TEXT_FG COLOR_BLACK
+#define TEXT_BG COLOR_YELLOW
+#define PAPER COLOR_WHITE
+
+static const struct {
+  const char *text;
+  uint8_t scale;
+  uint8_t use_bg;
+} cases[] = {
+    {"TAMAGOTCHI FLOWER POT", 3, 0},
+    {"Plant is happy :)", 3, 0},
+    {"Humidity: 45%", 2, 0},
+    {"+", 2, 0},
+    {"Light: Bright (1440)", 2, 1},
+    {"W: 600", 1, 1},
+};
+
+static uint16_t snapshot[TFT_WIDTH * TFT_HEIGHT];
+
+static void draw(const char *text, uint8_t scale, uint8_t use_bg) {
+  TFT_TextCfg cfg;
+  TFT_TextInit(&cfg);
+  TFT_TextSetCursor(&cfg, TEXT_X, TEXT_Y);
+  TFT_TextSetScale(&cfg, scale);
+  TFT_TextSetWrap(&cfg, 0);
+  TFT_TextSetColors(&cfg, TEXT_FG, TEXT_BG, use_bg);
+  TFT_TextPrintf(&cfg, "%s", text);
+}
+
+static int screen_matches_snapshot(void) {
+  return !memcmp(sim_tft_framebuffer(), snapshot, sizeof(snapshot));
+}
+
+int bench_text(void) {
+  int failed = 0;
+
+  bench_board_up();
+  fprintf(stdout, "%-24s %5s %3s | %8s %9s %9s | %6s %7s %8s | %6s\n", "text",
+          "scale", "bg", "pp xfers", "pp bytes", "pp us", "xfers", "bytes",
+          "us", "xfer x");
+
+  for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const char *text = cases[i].text;
+    uint8_t scale = cases[i].scale;
+    uint8_t use_bg = cases[i].use_bg;
+
+    // Glyph runs, straight to the panel
+    TFT_FillScreen(PAPER);
+    BenchCost start = bench_cost_now(SIM_BUS_SPI1);
+    draw(text, scale, use_bg);
+    BenchCost runs = bench_cost_since(SIM_BUS_SPI1, start);
+    memcpy(snapshot, sim_tft_framebuffer(), sizeof(snapshot));
+
+    // Per-pixel replay of the same dots
+    TFT_FillScreen(PAPER);
+    uint16_t w = (uint16_t)(strlen(text) * TFT_CHAR_WIDTH_PIXELS * scale);
+    uint16_t h = TFT_CHAR_HEIGHT_PIXELS * scale;
+    start = bench_cost_now(SIM_BUS_SPI1);
+    for (uint16_t y = TEXT_Y; y < TEXT_Y + h && y < TFT_HEIGHT; y++) {
+      for (uint16_t x = TEXT_X; x < TEXT_X + w && x < TFT_WIDTH; x++) {
+        uint16_t c = snapshot[y * TFT_WIDTH + x];
+        if (c == TEXT_FG || (use_bg && c == TEXT_BG)) {
+          TFT_DrawPixel(x, y, c);
+        }
+      }
+    }
+    BenchCost pixels = bench_cost_since(SIM_BUS_SPI1, start);
+    if (!screen_matches_snapshot()) {
+      fprintf(stdout, "  '%s': per-pixel replay differs\n", text);
+      failed = 1;
+    }
+
+    // Glyph runs into the tile shadow
+    TFT_SetRetained(1);
+    TFT_FillScreen(PAPER);
+    draw(text, scale, use_bg);
+    TFT_Flush();
+    TFT_SetRetained(0);
+    if (!screen_matches_snapshot()) {
+      fprintf(stdout, "  '%s': retained output differs from direct\n", text);
+      failed = 1;
+    }
+
+    fprintf(stdout,
+            "%-24s %5u %3s | %8llu %9llu %9.1f | %6llu %7llu %8.1f | %6.1f\n",
+            text, scale, use_bg ? "yes" : "no",
+            (unsigned long long)pixels.transactions,
+            (unsigned long long)pixels.bytes, pixels.ns / 1e3,
+            (unsigned long long)runs.transactions,
+            (unsigned long long)runs.bytes, runs.ns / 1e3,
+            (double)pixels.transactions / runs.transactions);
+  }
+  return failed;
+}
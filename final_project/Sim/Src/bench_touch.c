@@ -0,0 +1,100 @@
+/*
+ * bench_touch.c
+ *
+ * Stress test of the touch event queue. A producer thread stands in for the
+ * EXTI line and pushes numbered events as fast as it can while this thread
+ * drains them. First the producer retries a full ring, so every event has
+ * to come out exactly once and in order; then it gives up like the ISR does
+ * while the consumer keeps stalling, and each event must come out once, in
+ * order, or be counted as dropped by both sides.
+ */
+
+#include "bench.h"
+
+#include "touch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+#define EVENTS 2000000u
+
+static atomic_int producer_done;
+static uint32_t producer_drops; // refused pushes
+static int producer_retries;
+
+static void *producer(void *arg) {
+  (void)arg;
+  for (uint32_t seq = 1; seq <= EVENTS; seq++) {
+    while (!TOUCH_PushEvent(seq)) {
+      producer_drops++;
+      if (!producer_retries) {
+        break;
+      }
+      sched_yield(); // let the consumer in on a single core
+    }
+    if (!producer_retries && seq % 24 == 0) {
+      sched_yield(); // bursts a little longer than the ring
+    }
+  }
+  atomic_store(&producer_done, 1);
+  return NULL;
+}
+
+static int run(const char *label, int retries, uint32_t stall_every) {
+  int failed = 0;
+  uint32_t dropped0 = TOUCH_DroppedEvents();
+  producer_drops = 0;
+  producer_retries = retries;
+  atomic_store(&producer_done, 0);
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  pthread_t thread;
+  pthread_create(&thread, NULL, producer, NULL);
+
+  uint32_t popped = 0, last = 0, disorder = 0;
+  TOUCH_Event e;
+  for (;;) {
+    int done = atomic_load(&producer_done);
+    while (TOUCH_PopEvent(&e)) {
+      if (e.stamp <= last || e.stamp > EVENTS) {
+        disorder++;
+      }
+      last = e.stamp;
+      popped++;
+      if (stall_every && popped % stall_every == 0) {
+        struct timespec nap = {0, 20000};
+        nanosleep(&nap, NULL);
+      }
+    }
+    if (done) {
+      break; // emptied after the producer finished
+    }
+    sched_yield();
+  }
+  pthread_join(thread, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  uint32_t dropped = TOUCH_DroppedEvents() - dropped0;
+  uint32_t lost = retries ? EVENTS - popped : EVENTS - popped - dropped;
+  if (disorder || lost || dropped != producer_drops) {
+    fprintf(stdout, "  %s: %u popped, %u refused of %u, %u out of order\n",
+            label, popped, dropped, EVENTS, disorder);
+    failed = 1;
+  }
+  double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  fprintf(stdout, "%-18s %10u %10u %10.1f\n", label, popped, dropped,
+          EVENTS / s / 1e6);
+  return failed;
+}
+
+int bench_touch(void) {
+  fprintf(stdout, "%-18s %10s %10s %10s\n", "run", "popped", "refused",
+          "Mevent/s");
+  int failed = run("retry when full", 1, 0);
+  failed |= run("drop, stalling", 0, 64);
+  return failed;
+}
@@ -0,0 +1,318 @@
+/*
+ * bench_trace.c
+ *
+ * Deferred formatting against printf. The telemetry lines go out once as
+ * printf text and once as TRACE records; decoded with the format strings
+ * read back from this executable, the records must give the same text,
+ * byte for byte, in fewer bytes and less time per call. Argument edge
+ * cases are checked against the host's snprintf, a burst without a drain
+ * must report exactly the records it lost, and records made in simulated
+ * interrupts between main-context ones must come out in time order.
+ */
+
+#include "bench.h"
+
+#include "trace.h"
+#include "trace_decode.h"
+#include "usart.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TAP_SIZE (256u * 1024u)
+#define COST_ROUNDS 2000
+#define BURST_RECORDS 400
+#define ISR_PERIOD_NS (1900 * SIM_NS_PER_US)
+#define ISR_MAIN_RECORDS 3000
+
+static uint8_t tap[TAP_SIZE];
+static uint32_t tap_len;
+
+static void tap_bytes(const uint8_t *data, uint16_t len) {
+  if (tap_len + len <= TAP_SIZE) {
+    memcpy(tap + tap_len, data, len);
+    tap_len += len;
+  }
+}
+
+static char text[TAP_SIZE];
+static size_t text_len;
+
+static void to_text(const char *s, size_t len, void *ctx) {
+  (void)ctx;
+  if (text_len + len <= sizeof(text)) {
+    memcpy(text + text_len, s, len);
+    text_len += len;
+  }
+}
+
+static TraceDecoder dec;
+
+// The tap so far through a fresh decoder state
+static void decode_tap(int stamps) {
+  char *fmt = dec.fmt;
+  size_t fmt_size = dec.fmt_size;
+  memset(&dec, 0, sizeof(dec));
+  dec.fmt = fmt;
+  dec.fmt_size = fmt_size;
+  dec.stamps = stamps;
+  text_len = 0;
+  trace_decoder_feed(&dec, tap, tap_len, to_text, NULL);
+}
+
+static double host_ns(const struct timespec *a, const struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/********/
+// Telemetry, printf vs TRACE
+/*******/
+static int hum = 44, temp = -3, soil_temp = 20;
+static uint16_t cap = 950, light = 1440;
+
+static void telemetry_printf(void) {
+  printf("AirRH: %d %%  \r\n", hum);
+  printf("AirTemp: %d C \r\n", temp);
+  printf("SoilCap: %u  \r\n", cap);
+  printf("SoilTemp: %d C\r\n", soil_temp);
+  printf("Light: %u  \r\n", light);
+}
+
+static void telemetry_trace(void) {
+  TRACE(LOG_INFO, "AirRH: %d %%  \r\n", hum);
+  TRACE(LOG_INFO, "AirTemp: %d C \r\n", temp);
+  TRACE(LOG_INFO, "SoilCap: %u  \r\n", cap);
+  TRACE(LOG_INFO, "SoilTemp: %d C\r\n", soil_temp);
+  TRACE(LOG_INFO, "Light: %u  \r\n", light);
+}
+
+// Host time per telemetry run, the log ring drained between rounds
+static double per_run_ns(void (*run)(void), uint8_t traced) {
+  double ns = 0;
+  for (int r = 0; r < COST_ROUNDS; r++) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    run();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns += host_ns(&t0, &t1);
+    if (traced) {
+      trace_flush();
+    }
+    log_flush();
+  }
+  return ns / COST_ROUNDS;
+}
+
+static int run_telemetry(void) {
+  int failed = 0;
+
+  tap_len = 0;
+  telemetry_printf();
+  log_flush();
+  uint32_t text_bytes = tap_len;
+  char want[512];
+  memcpy(want, tap, tap_len);
+
+  tap_len = 0;
+  telemetry_trace();
+  trace_flush();
+  log_flush();
+  uint32_t trace_bytes = tap_len;
+  decode_tap(0);
+  if (text_len != text_bytes || memcmp(text, want, text_len) || dec.bad) {
+    fprintf(stdout, "  FAIL: decoded records differ from the printf text\n");
+    failed = 1;
+  }
+
+  sim_uart_tap = NULL;
+  double printf_ns = per_run_ns(telemetry_printf, 0);
+  double trace_ns = per_run_ns(telemetry_trace, 1);
+  sim_uart_tap = tap_bytes;
+
+  fprintf(stdout, "telemetry run   %5s %9s\n", "bytes", "host ns");
+  fprintf(stdout, "  printf        %5lu %9.0f\n", (unsigned long)text_bytes,
+          printf_ns);
+  fprintf(stdout, "  TRACE         %5lu %9.0f   (one frame)\n",
+          (unsigned long)trace_bytes, trace_ns);
+  if (trace_bytes * 2 > text_bytes) {
+    fprintf(stdout, "  FAIL: records not at least 2x smaller than text\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Arguments
+/*******/
+static int run_args(void) {
+  int failed = 0;
+  int32_t neg = -123456789;
+  uint32_t big = 0xFFFFFFFFu;
+  char want[512];
+  int n = 0;
+
+  tap_len = 0;
+  TRACE(LOG_INFO, "[%d|%i|%u|%x|%X|%o]\r\n", (int)neg, 0, (unsigned)big,
+        0xBEEFu, 0xCAFEu, 8u);
+  n += snprintf(want + n, sizeof(want) - n, "[%d|%i|%u|%x|%X|%o]\r\n",
+                (int)neg, 0, (unsigned)big, 0xBEEFu, 0xCAFEu, 8u);
+  TRACE(LOG_INFO, "%5d|%-5d|%05u|%02X|%#x|%c|100%%\r\n", -42, 7, 31u, 0xAu,
+        255u, 'Z');
+  n += snprintf(want + n, sizeof(want) - n,
+                "%5d|%-5d|%05u|%02X|%#x|%c|100%%\r\n", -42, 7, 31u, 0xAu,
+                255u, 'Z');
+  TRACE(LOG_INFO, "%lu %ld %hu %u %u %u %u\r\n", 4000000000ul, -1l,
+        (unsigned short)65535, 1u, 2u, 3u, 4u);
+  n += snprintf(want + n, sizeof(want) - n, "%lu %ld %hu %u %u %u %u\r\n",
+                4000000000ul, -1l, (unsigned short)65535, 1u, 2u, 3u, 4u);
+  TRACE(LOG_INFO, "no arguments\r\n");
+  n += snprintf(want + n, sizeof(want) - n, "no arguments\r\n");
+  TRACE(LOG_DEBUG, "below the level %d\r\n", 1); // not recorded
+  trace_flush();
+  log_flush();
+  decode_tap(0);
+
+  int ok = text_len == (size_t)n && !memcmp(text, want, n) && !dec.bad;
+  fprintf(stdout, "arguments       %s (%lu record bytes for %d text)\n",
+          ok ? "match snprintf" : "DIFFER", (unsigned long)tap_len, n);
+  if (!ok) {
+    fprintf(stdout, "  got:\n%.*s  want:\n%s", (int)text_len, text, want);
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Lost records
+/*******/
+static int run_lost(void) {
+  int failed = 0;
+  TraceStats s0 = *trace_stats();
+
+  // With no completion interrupts the log ring is never drained: once it
+  // is full, frames are refused and their records counted as lost
+  tap_len = 0;
+  __disable_irq();
+  for (uint32_t i = 0; i < BURST_RECORDS; i++) {
+    TRACE(LOG_INFO, "burst %lu of %u\r\n", (unsigned long)i, BURST_RECORDS);
+  }
+  __enable_irq();
+  trace_flush();
+  log_flush();
+  TRACE(LOG_INFO, "after the burst\r\n"); // reports the losses
+  trace_flush();
+  log_flush();
+  decode_tap(0);
+
+  uint32_t lost = trace_stats()->lost - s0.lost;
+  fprintf(stdout,
+          "burst           %u records masked: %lu decoded, %lu lost, "
+          "%lu reported lost\n",
+          BURST_RECORDS, (unsigned long)dec.records, (unsigned long)lost,
+          (unsigned long)dec.lost);
+  if (dec.records + dec.lost != BURST_RECORDS + 1 || dec.lost != lost ||
+      !lost || dec.bad) {
+    fprintf(stdout, "  FAIL: records neither decoded nor reported lost\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+/********/
+// Interrupts
+/*******/
+static uint8_t isr_stop;
+static uint32_t isr_seq;
+
+static void isr_event(void *arg) {
+  (void)arg;
+  if (isr_stop) {
+    return;
+  }
+  sim_isr_enter();
+  TRACE(LOG_INFO, "isr %lu\r\n", (unsigned long)isr_seq++);
+  sim_isr_leave();
+  sim_event_at(sim_time_ns() + ISR_PERIOD_NS, isr_event, NULL);
+}
+
+static int run_isr(void) {
+  int failed = 0;
+  TraceStats s0 = *trace_stats();
+  tap_len = 0;
+  isr_stop = 0;
+  isr_seq = 0;
+  sim_event_at(sim_time_ns() + ISR_PERIOD_NS, isr_event, NULL);
+  for (uint32_t i = 0; i < ISR_MAIN_RECORDS; i++) {
+    TRACE(LOG_INFO, "main %lu\r\n", (unsigned long)i);
+    if (i % 8 == 7) {
+      trace_flush();
+    }
+    HAL_Delay(1);
+  }
+  isr_stop = 1;
+  trace_flush();
+  log_flush();
+  decode_tap(1);
+
+  // "[   seconds] main|isr n": both sequences and the time must rise
+  uint32_t main_next = 0, isr_next = 0, disorder = 0;
+  double last_t = -1;
+  for (char *line = text; line < text + text_len;) {
+    char *end = memchr(line, '\n', text + text_len - line);
+    if (!end) {
+      break;
+    }
+    double t;
+    char who[8];
+    unsigned long seq;
+    if (sscanf(line, "[%lf] %7s %lu", &t, who, &seq) != 3 || t < last_t ||
+        seq != (!strcmp(who, "main") ? main_next : isr_next)) {
+      disorder++;
+    }
+    if (!strcmp(who, "main")) {
+      main_next = seq + 1;
+    } else {
+      isr_next = seq + 1;
+    }
+    last_t = t;
+    line = end + 1;
+  }
+  uint32_t lost = trace_stats()->lost - s0.lost;
+  fprintf(stdout,
+          "interrupts      %lu main, %lu isr records, %lu out of order, "
+          "%lu lost\n",
+          (unsigned long)main_next, (unsigned long)isr_next,
+          (unsigned long)disorder, (unsigned long)lost);
+  if (disorder || lost || main_next != ISR_MAIN_RECORDS ||
+      isr_next != isr_seq || dec.bad) {
+    fprintf(stdout, "  FAIL: records missing or out of order\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+int bench_trace(void) {
+  int failed = 0;
+  bench_board_up();
+  MX_LPUART1_UART_Init();
+  log_init(&hlpuart1);
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  trace_flush();
+  log_flush(); // whatever earlier benches left
+  if (trace_decoder_load_elf(&dec, "/proc/self/exe") != 0) {
+    fprintf(stdout, "FAIL: no trace_fmt section in this executable\n");
+    return 1;
+  }
+  sim_uart_tap = tap_bytes;
+
+  failed |= run_telemetry();
+  failed |= run_args();
+  failed |= run_lost();
+  failed |= run_isr();
+
+  sim_uart_tap = NULL;
+  trace_decoder_free(&dec);
+  return failed;
+}
@@ -0,0 +1,147 @@
+/*
+ * bench_widget.c
+ *
+ * Widget hit testing and rendering. Screens of 8 to 255 buttons are hit
+ * tested at every pixel through the grid and by a linear scan (what the old
+ * if/else chain did); both must agree, and the grid's cost must not grow
+ * with the widget count. Then a screen is rendered on the simulated TFT in
+ * retained mode three times: the first draw, an unchanged frame that must
+ * not touch SPI1, and a frame where one value field changed.
+ */
+
+#include "bench.h"
+
+#include "widget.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_WIDGETS 256
+#define HITS 2000000u
+
+static Widget widgets[MAX_WIDGETS];
+static WidgetScreen screen;
+static int presses;
+static int counter;
+
+static void press(void) { presses++; }
+
+static Widget *linear_hit(uint16_t x, uint16_t y) {
+  for (uint16_t i = 0; i < screen.count; i++) {
+    Widget *w = &widgets[i];
+    if (w->on_press && x >= w->x && x < w->x + w->w && y >= w->y &&
+        y < w->y + w->h) {
+      return w;
+    }
+  }
+  return NULL;
+}
+
+// n buttons of 22x14 on a 24x16 pitch, filling rows from the top left
+static void build(unsigned n) {
+  memset(widgets, 0, sizeof(widgets));
+  for (unsigned i = 0; i < n; i++) {
+    Widget *w = &widgets[i];
+    w->name = "button";
+    w->kind = WIDGET_BUTTON;
+    w->x = (uint16_t)(1 + (i % 20) * 24);
+    w->y = (uint16_t)(1 + (i / 20) * 16);
+    w->w = 22;
+    w->h = 14;
+    w->color = (uint16_t)(i * 0x0841);
+    w->scale = 1;
+    w->text = "ok";
+    w->on_press = press;
+  }
+  widget_screen_init(&screen, widgets, (uint8_t)n,
+                     COLOR_WHITE);
+}
+
+static double host_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double time_hits(Widget *(*hit)(uint16_t, uint16_t)) {
+  uint32_t seed = 7;
+  volatile uintptr_t sink = 0;
+  double t0 = host_s();
+  for (uint32_t i = 0; i < HITS; i++) {
+    seed = seed * 1103515245u + 12345u;
+    sink += (uintptr_t)hit((uint16_t)((seed >> 8) % TFT_WIDTH),
+                           (uint16_t)((seed >> 20) % TFT_HEIGHT));
+  }
+  (void)sink;
+  return (host_s() - t0) / HITS * 1e9;
+}
+
+static Widget *grid_hit(uint16_t x, uint16_t y) {
+  return widget_hit(&screen, x, y);
+}
+
+static uint64_t render_bytes(void) {
+  BenchCost start = bench_cost_now(SIM_BUS_SPI1);
+  widget_render(&screen);
+  TFT_Flush();
+  return bench_cost_since(SIM_BUS_SPI1, start).bytes;
+}
+
+int bench_widget(void) {
+  int failed = 0;
+  static const unsigned sizes[] = {8, 64, 255};
+
+  fprintf(stdout, "%-8s %12s %12s\n", "buttons", "grid ns/hit",
+          "linear ns/hit");
+  for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    build(sizes[s]);
+    uint32_t wrong = 0;
+    for (uint16_t y = 0; y < TFT_HEIGHT; y++) {
+      for (uint16_t x = 0; x < TFT_WIDTH; x++) {
+        wrong += widget_hit(&screen, x, y) != linear_hit(x, y);
+      }
+    }
+    if (wrong) {
+      fprintf(stdout, "  %u buttons: grid and scan disagree at %u pixels\n",
+              sizes[s], wrong);
+      failed = 1;
+    }
+    double grid = time_hits(grid_hit);
+    double linear = time_hits(linear_hit);
+    fprintf(stdout, "%-8u %12.1f %12.1f\n", sizes[s], grid, linear);
+  }
+
+  // Rendering: 64 buttons and one value field
+  bench_board_up();
+  TFT_SetRetained(1);
+  TFT_FillScreen(COLOR_WHITE);
+  TFT_Flush();
+  build(64);
+  Widget *v = &widgets[64];
+  v->name = "counter";
+  v->kind = WIDGET_VALUE;
+  v->x = 10;
+  v->y = 280;
+  v->w = 120;
+  v->h = 20;
+  v->color = COLOR_BLACK;
+  v->scale = 2;
+  v->text = "n = %d";
+  v->value = &counter;
+  widget_screen_init(&screen, widgets, 65, COLOR_WHITE);
+
+  uint64_t first = render_bytes();
+  uint64_t same = render_bytes();
+  counter++;
+  uint64_t changed = render_bytes();
+  fprintf(stdout, "render SPI1 bytes: first %llu, unchanged %llu, one value "
+                  "changed %llu\n",
+          (unsigned long long)first, (unsigned long long)same,
+          (unsigned long long)changed);
+  if (same || !changed || changed * 10 > first) {
+    failed = 1;
+  }
+  TFT_SetRetained(0);
+  return failed;
+}
@@ -0,0 +1,204 @@
+/*
+ * bench_window.c
+ *
+ * The 160x120 photo two ways: the full 320x240 sensor output decimated by 2
+ * on the MCU, as main.c used to show it, and the OV5642 ISP scaling the
+ * field down to 160x120 so only those pixels leave the sensor. The pictures
+ * must agree, and a 2x digital zoom (a 640x480 window scaled to 160x120)
+ * must be exactly the matching crop of a full 320x240 capture, which pins
+ * the window registers to the sensor model's array coordinates. Settings
+ * the sensor cannot produce must be refused without touching it, and the
+ * model must flag them when written behind cam_set_output's back.
+ */
+
+#include "bench.h"
+
+#include "bigdisplay.h"
+#include "camera.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OUT_W (CAM_FRAME_W / 2)
+#define OUT_H (CAM_FRAME_H / 2)
+
+static uint16_t full[TFT_WIDTH * TFT_HEIGHT];
+
+typedef struct {
+  BenchCost spi;
+  uint64_t fifo_bytes;
+  uint32_t wait_ms;
+} Shot;
+
+// One capture to the TFT origin from a fresh board, so every shot sees the
+// same frame of the scene
+static Shot shoot(uint8_t scale) {
+  BenchCost spi = bench_cost_now(SIM_BUS_SPI1);
+  uint64_t fifo = sim_arducam_fifo_bytes_read();
+  SingleCapStream_YCbCr(0, 0, scale);
+  Shot s = {bench_cost_since(SIM_BUS_SPI1, spi),
+            sim_arducam_fifo_bytes_read() - fifo,
+            cam_capture_stats()->wait_ms};
+  return s;
+}
+
+static void fresh(void) {
+  bench_camera_up();
+  TFT_FillScreen(COLOR_WHITE);
+}
+
+static void row(const char *what, Shot s) {
+  fprintf(stdout, "  %-22s %8llu %9llu %9.1f %9.1f\n", what,
+          (unsigned long long)s.fifo_bytes, (unsigned long long)s.spi.bytes,
+          s.spi.ns / 1e6 - s.wait_ms, s.spi.ns / 1e6);
+}
+
+// Mean difference per channel in 565 steps, TFT area at the origin against
+// the same size area of ref at (cx, cy)
+static double differ(const uint16_t *ref, uint16_t cx, uint16_t cy,
+                     uint32_t *pixels) {
+  const uint16_t *fb = sim_tft_framebuffer();
+  uint64_t total = 0;
+  *pixels = 0;
+  for (uint32_t y = 0; y < OUT_H; y++) {
+    for (uint32_t x = 0; x < OUT_W; x++) {
+      uint16_t a = fb[y * TFT_WIDTH + x];
+      uint16_t b = ref[(cy + y) * TFT_WIDTH + cx + x];
+      *pixels += a != b;
+      total += abs((a >> 11) - (b >> 11)) + abs((a >> 5 & 63) - (b >> 5 & 63)) +
+               abs((a & 31) - (b & 31));
+    }
+  }
+  return (double)total / (3.0 * OUT_W * OUT_H);
+}
+
+static int check_registers(void) {
+  static const uint8_t want[12] = {0x00, 0x50, 0x00, 0x08, 0x05, 0x00,
+                                   0x03, 0xc0, 0x00, 0xa0, 0x00, 0x78};
+  fresh();
+  BenchCost i2c = bench_cost_now(SIM_BUS_I2C4);
+  uint8_t ok = cam_set_output_size(OUT_W, OUT_H);
+  i2c = bench_cost_since(SIM_BUS_I2C4, i2c);
+  for (int i = 0; i < 12; i++) {
+    ok &= sim_ov5642_register((uint16_t)(0x3800 + i)) == want[i];
+  }
+  fprintf(stdout, "registers        0x3800-0x380b in %llu I2C transaction(s), "
+                  "%llu bytes, %s\n",
+          (unsigned long long)i2c.transactions, (unsigned long long)i2c.bytes,
+          ok ? "as expected" : "WRONG");
+  return !ok || i2c.transactions != 1;
+}
+
+static int check_refusals(void) {
+  static const struct {
+    const char *what;
+    uint16_t out_w, out_h, x, y, w, h;
+  } bad[] = {
+      {"wider than camera_buf", 322, 240, 0, 0, 1280, 960},
+      {"odd width", 161, 120, 0, 0, 1280, 960},
+      {"upscaled", 320, 240, 0, 0, 160, 120},
+      {"off the field", 160, 120, 700, 0, 640, 480},
+      {"empty", 0, 120, 0, 0, 1280, 960},
+  };
+  int failed = 0;
+  fresh();
+  for (unsigned i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    uint32_t writes = sim_ov5642_register_writes();
+    if (cam_set_output(bad[i].out_w, bad[i].out_h, bad[i].x, bad[i].y,
+                       bad[i].w, bad[i].h) ||
+        sim_ov5642_register_writes() != writes) {
+      fprintf(stdout, "  FAIL: %s accepted\n", bad[i].what);
+      failed = 1;
+    }
+  }
+  uint16_t w, h;
+  cam_output_size(&w, &h);
+  if (w != CAM_FRAME_W || h != CAM_FRAME_H) {
+    fprintf(stdout, "  FAIL: output size changed to %ux%u\n", w, h);
+    failed = 1;
+  }
+
+  // The model's own check: a 160x120 window cannot give 320x240
+  uint32_t before = sim_ov5642_window_errors();
+  wrSensorReg16_8(0x3804, 0x00);
+  wrSensorReg16_8(0x3805, 0xa0);
+  wrSensorReg16_8(0x3806, 0x00);
+  wrSensorReg16_8(0x3807, 0x78);
+  shoot(1);
+  uint32_t flagged = sim_ov5642_window_errors() - before;
+  fprintf(stdout, "refused          %u settings; upscale written directly: "
+                  "%lu window error(s) in the model\n",
+          (unsigned)(sizeof(bad) / sizeof(bad[0])), (unsigned long)flagged);
+  if (flagged != 1) {
+    fprintf(stdout, "  FAIL: sensor model missed the upscale\n");
+    failed = 1;
+  }
+  return failed;
+}
+
+int bench_window(void) {
+  int failed = 0;
+
+  failed |= check_registers();
+
+  fprintf(stdout, "%-24s %8s %9s %9s %9s\n", "160x120 photo", "FIFO B",
+          "SPI1 B", "drain ms", "total ms");
+  fresh();
+  Shot mcu = shoot(2);
+  row("320x240, MCU /2", mcu);
+  static uint16_t decimated[TFT_WIDTH * TFT_HEIGHT];
+  memcpy(decimated, sim_tft_framebuffer(), sizeof(decimated));
+
+  fresh();
+  cam_set_output_size(OUT_W, OUT_H);
+  Shot isp = shoot(1);
+  row("160x120, ISP scaled", isp);
+  uint32_t pixels;
+  double mean = differ(decimated, 0, 0, &pixels);
+  fprintf(stdout, "  ISP vs MCU picture: %lu pixels differ, mean %.3f steps\n",
+          (unsigned long)pixels, mean);
+  if (mean > 0.5) {
+    fprintf(stdout, "  FAIL: ISP scaled picture is not the same view\n");
+    failed = 1;
+  }
+  if (isp.fifo_bytes * 4 != mcu.fifo_bytes ||
+      isp.spi.ns - isp.wait_ms * 1000000ull >=
+          mcu.spi.ns - mcu.wait_ms * 1000000ull) {
+    fprintf(stdout, "  FAIL: ISP scaling did not cut the transfer\n");
+    failed = 1;
+  }
+  if (sim_ov5642_window_errors()) {
+    fprintf(stdout, "  FAIL: sensor model saw a bad window\n");
+    failed = 1;
+  }
+
+  // 2x zoom on a window at (x, y) of the field against a 320x240 frame:
+  // the sensor reads the array the right way up, so window (x, y) shows at
+  // x / 4, y / 4 of the frame
+  fresh();
+  shoot(1);
+  memcpy(full, sim_tft_framebuffer(), sizeof(full));
+  static const struct {
+    const char *what;
+    uint16_t x, y;
+  } zooms[] = {{"zoom 2x, centre", 320, 240}, {"zoom 2x, corner", 0, 0},
+               {"zoom 2x, 64,88", 64, 88}};
+  for (unsigned i = 0; i < sizeof(zooms) / sizeof(zooms[0]); i++) {
+    fresh();
+    cam_set_output(OUT_W, OUT_H, zooms[i].x, zooms[i].y, CAM_FIELD_W / 2,
+                   CAM_FIELD_H / 2);
+    Shot zoom = shoot(1);
+    row(zooms[i].what, zoom);
+    differ(full, zooms[i].x / 4, zooms[i].y / 4, &pixels);
+    if (pixels || zoom.fifo_bytes != isp.fifo_bytes ||
+        sim_ov5642_window_errors()) {
+      fprintf(stdout, "  FAIL: %lu pixels differ from the 320x240 crop\n",
+              (unsigned long)pixels);
+      failed = 1;
+    }
+  }
+
+  failed |= check_refusals();
+  return failed;
+}
@@ -0,0 +1,133 @@
+/*
+ * bench_yuv.c
+ *
+ * yuyv_to_rgb565 against the float convert_24 it replaced. Every (Y, Cb, Cr)
+ * is swept, then a synthetic 320x240 frame is converted both ways and
+ * compared pixel for pixel. The reference is convert_24 reduced to
+ * RGB565 the way TFT_DrawRGB888Buffer did it. Channels may differ by one
+ * RGB565 step where the float result sits right on an integer boundary.
+ * Both converters are then timed on the host in pixels per second.
+ */
+
+#include "bench.h"
+
+#include "camera.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAME_W 320
+#define FRAME_H 240
+#define FRAME_PIXELS (FRAME_W * FRAME_H)
+#define TIMED_FRAMES 20
+
+static uint8_t yuyv[FRAME_PIXELS * 2];
+static uint8_t golden[FRAME_PIXELS * 2];
+static uint8_t fast[FRAME_PIXELS * 2];
+
+static uint16_t reference_565(uint8_t y, uint8_t cb, uint8_t cr) {
+  uint8_t rgb[3];
+  convert_24(y, cb, cr, rgb);
+  return ((rgb[0] & 0xF8) << 8) | ((rgb[1] & 0xFC) << 3) | (rgb[2] >> 3);
+}
+
+// Largest per-channel difference between two RGB565 pixels, in RGB565 steps
+static int channel_diff(uint16_t a, uint16_t b) {
+  int dr = (a >> 11) - (b >> 11);
+  int dg = ((a >> 5) & 0x3F) - ((b >> 5) & 0x3F);
+  int db = (a & 0x1F) - (b & 0x1F);
+  int d = dr < 0 ? -dr : dr;
+  d = dg > d ? dg : -dg > d ? -dg : d;
+  return db > d ? db : -db > d ? -db : d;
+}
+
+// The old loop body, minus the SPI read: float conversion per pixel
+static void reference_frame(const uint8_t *in, uint8_t *out) {
+  for (uint32_t p = 0; p < FRAME_PIXELS; p += 2, in += 4) {
+    uint16_t px[2] = {reference_565(in[0], in[1], in[3]),
+                      reference_565(in[2], in[1], in[3])};
+    for (int k = 0; k < 2; k++) {
+      uint8_t *o = out + (p + k) * 2;
+      o[0] = (uint8_t)(px[k] >> 8);
+      o[1] = (uint8_t)px[k];
+    }
+  }
+}
+
+static double host_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int bench_yuv(void) {
+  int failed = 0;
+
+  // Every input triple
+  uint32_t inexact = 0;
+  int worst = 0;
+  for (uint32_t v = 0; v < (1u << 24); v++) {
+    uint8_t q[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)v,
+                    (uint8_t)(v >> 16)};
+    uint8_t o[4];
+    yuyv_to_rgb565(q, o, 2);
+    uint16_t got = (uint16_t)(o[0] << 8 | o[1]);
+    int d = channel_diff(got, reference_565(q[0], q[1], q[3]));
+    if (d) {
+      inexact++;
+      worst = d > worst ? d : worst;
+    }
+  }
+  fprintf(stdout, "sweep: %u of %u inputs off by up to %d RGB565 step(s)\n",
+          inexact, 1u << 24, worst);
+  if (worst > 1) {
+    failed = 1;
+  }
+
+  // Golden frame: smooth gradients plus noise so every Cb/Cr region is hit
+  uint32_t seed = 1;
+  for (uint32_t p = 0; p < FRAME_PIXELS; p += 2) {
+    uint32_t x = p % FRAME_W, y = p / FRAME_W;
+    seed = seed * 1103515245u + 12345u;
+    yuyv[2 * p + 0] = (uint8_t)(x * 255 / FRAME_W);
+    yuyv[2 * p + 1] = (uint8_t)(y * 255 / FRAME_H + (seed >> 28));
+    yuyv[2 * p + 2] = (uint8_t)(seed >> 16);
+    yuyv[2 * p + 3] = (uint8_t)(255 - y * 255 / FRAME_H);
+  }
+  reference_frame(yuyv, golden);
+  yuyv_to_rgb565(yuyv, fast, FRAME_PIXELS);
+  uint32_t off = 0;
+  worst = 0;
+  for (uint32_t p = 0; p < FRAME_PIXELS; p++) {
+    int d = channel_diff((uint16_t)(golden[2 * p] << 8 | golden[2 * p + 1]),
+                         (uint16_t)(fast[2 * p] << 8 | fast[2 * p + 1]));
+    if (d) {
+      off++;
+      worst = d > worst ? d : worst;
+    }
+  }
+  fprintf(stdout, "golden frame: %u of %u pixels off by up to %d step(s)\n",
+          off, FRAME_PIXELS, worst);
+  if (worst > 1) {
+    failed = 1;
+  }
+
+  // Host throughput
+  double t0 = host_s();
+  for (int f = 0; f < TIMED_FRAMES; f++) {
+    reference_frame(yuyv, golden);
+  }
+  double t1 = host_s();
+  for (int f = 0; f < TIMED_FRAMES; f++) {
+    yuyv_to_rgb565(yuyv, fast, FRAME_PIXELS);
+  }
+  double t2 = host_s();
+  double ref_pps = TIMED_FRAMES * FRAME_PIXELS / (t1 - t0);
+  double fast_pps = TIMED_FRAMES * FRAME_PIXELS / (t2 - t1);
+  fprintf(stdout, "%-28s %12s\n", "converter", "Mpixel/s");
+  fprintf(stdout, "%-28s %12.1f\n", "convert_24 + RGB565 pack", ref_pps / 1e6);
+  fprintf(stdout, "%-28s %12.1f  (%.1fx)\n", "yuyv_to_rgb565", fast_pps / 1e6,
+          fast_pps / ref_pps);
+  return failed;
+}
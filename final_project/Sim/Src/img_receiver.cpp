@@ -0,0 +1,360 @@
+/*
+ * img_receiver.cpp
+ *
+ * See img_receiver.h and the packet layout in Core/Inc/imgstream.h. Bytes
+ * are held back from the text output only while they could still be the
+ * start of a packet; a candidate whose header is implausible or whose CRC
+ * fails gives up its first byte as text and the search goes on from the
+ * next one.
+ */
+
+#include "img_receiver.h"
+
+#include "imgstream.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <vector>
+
+#ifdef PLANTPOT_HAVE_PNG
+#include <png.h>
+#endif
+
+namespace {
+
+constexpr size_t kTrailer = 4;
+
+const std::array<uint32_t, 256> &crc_table() {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      t[i] = c;
+    }
+    return t;
+  }();
+  return table;
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t *p, size_t len) {
+  const auto &t = crc_table();
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = t[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint16_t get16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+
+uint32_t get32(const uint8_t *p) {
+  return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+uint8_t clamp(int v) { return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v); }
+
+// DRLE back to big endian RGB565; false unless it fills out exactly
+bool drle_decode(const uint8_t *in, size_t len, uint8_t *out,
+                 size_t out_len) {
+  uint16_t prev = 0;
+  size_t n = 0;
+  auto put = [&](uint16_t px) {
+    out[n++] = (uint8_t)(px >> 8);
+    out[n++] = (uint8_t)px;
+  };
+  for (size_t i = 0; i < len;) {
+    uint8_t c = in[i++];
+    if (c < 0x80) {
+      unsigned r = ((prev >> 11) + (c >> 5) - 2) & 0x1F;
+      unsigned g = ((prev >> 5) + (c >> 2 & 7) - 4) & 0x3F;
+      unsigned b = (prev + (c & 3) - 2) & 0x1F;
+      prev = (uint16_t)(r << 11 | g << 5 | b);
+      if (n + 2 > out_len) {
+        return false;
+      }
+      put(prev);
+    } else if (c < 0xC0) {
+      size_t run = (c & 0x3F) + 1u;
+      if (n + 2 * run > out_len) {
+        return false;
+      }
+      while (run--) {
+        put(prev);
+      }
+    } else {
+      size_t lit = (c & 0x3F) + 1u;
+      if (i + 2 * lit > len || n + 2 * lit > out_len) {
+        return false;
+      }
+      std::copy(in + i, in + i + 2 * lit, out + n);
+      n += 2 * lit;
+      i += 2 * lit;
+      prev = (uint16_t)(in[i - 2] << 8 | in[i - 1]);
+    }
+  }
+  return n == out_len;
+}
+
+} // namespace
+
+struct ImgReceiver {
+  ImgRxFrameOut frame_out;
+  ImgRxTextOut text_out;
+  void *ctx;
+  ImgRxStats stats{};
+
+  std::vector<uint8_t> pending; // fed, not yet passed on or parsed
+  bool have_seq = false;
+  uint16_t next_seq = 0;
+
+  // the frame being assembled
+  bool open = false;
+  uint16_t id = 0, width = 0, height = 0;
+  uint8_t format = 0;
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> got; // per raw byte: arrived
+  uint32_t got_bytes = 0;
+  uint16_t chunks = 0;
+  std::vector<uint8_t> rgb;
+
+  void text(const uint8_t *p, size_t len) {
+    if (len) {
+      stats.text_bytes += len;
+      if (text_out) {
+        text_out(p, len, ctx);
+      }
+    }
+  }
+
+  void feed(const uint8_t *data, size_t len);
+  void packet(const uint8_t *p);
+  void begin(const uint8_t *payload, uint16_t len, uint16_t frame);
+  void chunk(const uint8_t *payload, uint16_t len, uint16_t frame);
+  void end(const uint8_t *payload, uint16_t len, uint16_t frame);
+  void convert();
+};
+
+void ImgReceiver::feed(const uint8_t *data, size_t len) {
+  pending.insert(pending.end(), data, data + len);
+  const uint8_t *buf = pending.data();
+  size_t size = pending.size(), at = 0;
+  while (at < size) {
+    const uint8_t *s = std::find(buf + at, buf + size, IMG_SYNC0);
+    text(buf + at, (size_t)(s - buf) - at);
+    at = (size_t)(s - buf);
+    if (at + IMG_HEADER_SIZE > size) {
+      break; // wait for the header
+    }
+    const uint8_t *p = buf + at;
+    uint16_t payload = get16(p + 8);
+    bool plausible = p[1] == IMG_SYNC1 && p[2] >= IMG_BEGIN &&
+                     p[2] <= IMG_END && p[3] == 0 &&
+                     payload <= IMG_PAYLOAD_MAX;
+    if (!plausible) {
+      text(p, 1);
+      at++;
+      continue;
+    }
+    size_t total = IMG_HEADER_SIZE + payload + kTrailer;
+    if (at + total > size) {
+      break; // wait for the rest
+    }
+    if (crc32(0, p + 2, IMG_HEADER_SIZE - 2 + payload) !=
+        get32(p + IMG_HEADER_SIZE + payload)) {
+      stats.bad_crc++;
+      text(p, 1);
+      at++;
+      continue;
+    }
+    packet(p);
+    at += total;
+  }
+  pending.erase(pending.begin(), pending.begin() + (ptrdiff_t)at);
+}
+
+void ImgReceiver::packet(const uint8_t *p) {
+  stats.packets++;
+  uint16_t seq = get16(p + 4);
+  if (have_seq && seq != next_seq) {
+    stats.missing += (uint16_t)(seq - next_seq);
+  }
+  have_seq = true;
+  next_seq = (uint16_t)(seq + 1);
+
+  uint16_t frame = get16(p + 6), len = get16(p + 8);
+  const uint8_t *payload = p + IMG_HEADER_SIZE;
+  switch (p[2]) {
+  case IMG_BEGIN:
+    begin(payload, len, frame);
+    break;
+  case IMG_CHUNK:
+    chunk(payload, len, frame);
+    break;
+  case IMG_END:
+    end(payload, len, frame);
+    break;
+  }
+}
+
+void ImgReceiver::begin(const uint8_t *payload, uint16_t len, uint16_t frame) {
+  if (open) {
+    stats.incomplete++; // its END never came
+  }
+  open = false;
+  if (len < 12) {
+    return;
+  }
+  uint8_t fmt = payload[4];
+  uint32_t bytes = get32(payload + 8);
+  width = get16(payload);
+  height = get16(payload + 2);
+  if ((fmt != IMG_RGB565 && fmt != IMG_YUYV) ||
+      bytes != (uint32_t)width * height * 2 || (width & 1)) {
+    stats.incomplete++;
+    return;
+  }
+  open = true;
+  id = frame;
+  format = fmt;
+  raw.assign(bytes, 0);
+  got.assign(bytes, 0);
+  got_bytes = 0;
+  chunks = 0;
+}
+
+void ImgReceiver::chunk(const uint8_t *payload, uint16_t len, uint16_t frame) {
+  if (!open || frame != id || len < 7) {
+    return;
+  }
+  uint32_t offset = get32(payload);
+  uint16_t raw_len = get16(payload + 4);
+  uint8_t codec = payload[6];
+  const uint8_t *data = payload + 7;
+  size_t data_len = len - 7u;
+  if ((uint64_t)offset + raw_len > raw.size()) {
+    stats.undecodable++;
+    return;
+  }
+  uint8_t *out = raw.data() + offset;
+  bool ok;
+  if (codec == IMG_CODEC_RAW) {
+    ok = data_len == raw_len;
+    if (ok) {
+      std::copy(data, data + data_len, out);
+    }
+  } else {
+    ok = codec == IMG_CODEC_DRLE && format == IMG_RGB565 &&
+         drle_decode(data, data_len, out, raw_len);
+  }
+  if (!ok) {
+    stats.undecodable++;
+    return;
+  }
+  for (uint32_t i = offset; i < offset + raw_len; i++) {
+    got_bytes += !got[i];
+    got[i] = 1;
+  }
+  chunks++;
+}
+
+void ImgReceiver::end(const uint8_t *payload, uint16_t len, uint16_t frame) {
+  if (!open || frame != id) {
+    return;
+  }
+  open = false;
+  if (len < 6 || got_bytes != raw.size() || get16(payload + 4) != chunks ||
+      crc32(0, raw.data(), raw.size()) != get32(payload)) {
+    stats.incomplete++;
+    return;
+  }
+  convert();
+  stats.frames++;
+  if (frame_out) {
+    ImgRxFrame f = {id,         width,      height,    format,
+                    raw.data(), (uint32_t)raw.size(), rgb.data()};
+    frame_out(&f, ctx);
+  }
+}
+
+void ImgReceiver::convert() {
+  size_t pixels = (size_t)width * height;
+  rgb.resize(pixels * 3);
+  const uint8_t *in = raw.data();
+  uint8_t *out = rgb.data();
+  if (format == IMG_RGB565) {
+    for (size_t i = 0; i < pixels; i++, in += 2, out += 3) {
+      unsigned px = (unsigned)in[0] << 8 | in[1];
+      unsigned r = px >> 11, g = px >> 5 & 0x3F, b = px & 0x1F;
+      out[0] = (uint8_t)(r << 3 | r >> 2);
+      out[1] = (uint8_t)(g << 2 | g >> 4);
+      out[2] = (uint8_t)(b << 3 | b >> 2);
+    }
+    return;
+  }
+  // YUYV, BT.601 full range as the OV5642 sends it
+  for (size_t i = 0; i < pixels; i += 2, in += 4) {
+    int cb = in[1] - 128, cr = in[3] - 128;
+    for (int k = 0; k < 2; k++, out += 3) {
+      int y = in[2 * k];
+      out[0] = clamp(y + (int)(1.402 * cr));
+      out[1] = clamp(y - (int)(0.344 * cb + 0.714 * cr));
+      out[2] = clamp(y + (int)(1.772 * cb));
+    }
+  }
+}
+
+extern "C" {
+
+ImgReceiver *img_receiver_new(ImgRxFrameOut frame_out, ImgRxTextOut text_out,
+                              void *ctx) {
+  ImgReceiver *r = new ImgReceiver;
+  r->frame_out = frame_out;
+  r->text_out = text_out;
+  r->ctx = ctx;
+  return r;
+}
+
+void img_receiver_feed(ImgReceiver *r, const uint8_t *data, size_t len) {
+  r->feed(data, len);
+}
+
+void img_receiver_flush(ImgReceiver *r) {
+  r->text(r->pending.data(), r->pending.size());
+  r->pending.clear();
+}
+
+const ImgRxStats *img_receiver_stats(const ImgReceiver *r) {
+  return &r->stats;
+}
+
+void img_receiver_free(ImgReceiver *r) { delete r; }
+
+int img_write_ppm(const char *path, const ImgRxFrame *frame) {
+  FILE *f = std::fopen(path, "wb");
+  if (!f) {
+    return -1;
+  }
+  size_t bytes = (size_t)frame->width * frame->height * 3;
+  std::fprintf(f, "P6\n%u %u\n255\n", frame->width, frame->height);
+  bool ok = std::fwrite(frame->rgb, 1, bytes, f) == bytes;
+  return std::fclose(f) == 0 && ok ? 0 : -1;
+}
+
+#ifdef PLANTPOT_HAVE_PNG
+int img_write_png(const char *path, const ImgRxFrame *frame) {
+  png_image image{};
+  image.version = PNG_IMAGE_VERSION;
+  image.width = frame->width;
+  image.height = frame->height;
+  image.format = PNG_FORMAT_RGB;
+  int ok = png_image_write_to_file(&image, path, 0, frame->rgb, 0, nullptr);
+  png_image_free(&image);
+  return ok ? 0 : -1;
+}
+#endif
+
+} // extern "C"
@@ -0,0 +1,109 @@
+/*
+ * imgrecv.cpp
+ *
+ * Writes the camera frames in a captured LPUART1 stream (Core/Inc/
+ * imgstream.h) to image files and copies everything else to stdout, so the
+ * log text and trace frames can go on to plantpot_tracedump.
+ *
+ *   plantpot_imgrecv [-o PREFIX] [-f ppm|png] [CAPTURE]
+ *
+ * Frames are written to PREFIX-NNNN.ppm (default PREFIX "frame"), NNNN
+ * being the frame number the firmware gave it. Without CAPTURE the stream
+ * is read from stdin, e.g. from the pty of plantpot_sim --uart-pty or a
+ * serial port.
+ */
+
+#include "img_receiver.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+
+struct Options {
+  std::string prefix = "frame";
+  bool png = false;
+};
+
+void to_stdout(const uint8_t *data, size_t len, void *ctx) {
+  (void)ctx;
+  std::fwrite(data, 1, len, stdout);
+}
+
+void to_file(const ImgRxFrame *frame, void *ctx) {
+  const Options *opt = static_cast<const Options *>(ctx);
+  char name[32];
+  std::snprintf(name, sizeof(name), "-%04u.%s", frame->id,
+                opt->png ? "png" : "ppm");
+  std::string path = opt->prefix + name;
+#ifdef PLANTPOT_HAVE_PNG
+  int rc = opt->png ? img_write_png(path.c_str(), frame)
+                    : img_write_ppm(path.c_str(), frame);
+#else
+  int rc = img_write_ppm(path.c_str(), frame);
+#endif
+  std::fprintf(stderr, "%s: %ux%u %s\n", path.c_str(), frame->width,
+               frame->height, rc ? "not written" : "written");
+}
+
+int usage(const char *argv0) {
+  std::fprintf(stderr, "usage: %s [-o PREFIX] [-f ppm|png] [CAPTURE]\n",
+               argv0);
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  int a = 1;
+  for (; a + 1 < argc && argv[a][0] == '-'; a += 2) {
+    if (!std::strcmp(argv[a], "-o")) {
+      opt.prefix = argv[a + 1];
+    } else if (!std::strcmp(argv[a], "-f") &&
+               (!std::strcmp(argv[a + 1], "ppm") ||
+                !std::strcmp(argv[a + 1], "png"))) {
+      opt.png = !std::strcmp(argv[a + 1], "png");
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if (argc - a > 1) {
+    return usage(argv[0]);
+  }
+#ifndef PLANTPOT_HAVE_PNG
+  if (opt.png) {
+    std::fprintf(stderr, "%s: built without libpng\n", argv[0]);
+    return 2;
+  }
+#endif
+  FILE *in = a < argc ? std::fopen(argv[a], "rb") : stdin;
+  if (!in) {
+    std::fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[a]);
+    return 1;
+  }
+
+  ImgReceiver *r = img_receiver_new(to_file, to_stdout, &opt);
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), in)) > 0) {
+    img_receiver_feed(r, buf, n);
+    std::fflush(stdout);
+  }
+  img_receiver_flush(r);
+  const ImgRxStats *s = img_receiver_stats(r);
+  std::fprintf(stderr,
+               "%lu frames, %lu packets, %lu bad CRC, %lu missing, "
+               "%lu incomplete frames\n",
+               (unsigned long)s->frames, (unsigned long)s->packets,
+               (unsigned long)s->bad_crc, (unsigned long)s->missing,
+               (unsigned long)s->incomplete);
+  int failed = s->bad_crc || s->missing || s->incomplete;
+
+  if (in != stdin) {
+    std::fclose(in);
+  }
+  img_receiver_free(r);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,526 @@
+/*
+ * sim_arducam.c
+ *
+ * Virtual ArduCAM: the ArduCHIP SPI register file and frame FIFO (SPI1 or
+ * sim_config.cam_spi, CS PA4) plus an OV5642 register model on I2C4.
+ *
+ * The sensor renders a scripted scene (a synthetic potted plant, or a PPM
+ * loaded with sim_arducam_load_ppm) at the output size programmed in
+ * 0x3808-0x380b, cropped by the array window in 0x3800-0x3807, and encodes
+ * it as YUYV when 0x4300 selects YUV422 (0x3X), RGB565 (0x6X, byte order
+ * by sequence X = 0..3) or Y8 (0x1X), or as a baseline 4:2:2 JPEG (by
+ * libjpeg, quality following the 0x4407 quantisation scale) when 0x3818
+ * enables compression. RGB565 needs the ISP's RGB output selected in 0x501f
+ * and the YUV formats its YUV output; anything else arrives as mid grey.
+ * The window is in binned preview array units when 0x3818 bit 0 is set,
+ * full array units otherwise. A frame rendered from a window outside the
+ * array, an output larger than the window (the ISP scaler only shrinks) or
+ * an odd YUYV width counts as a window error. Frames complete on VSYNC
+ * boundaries derived from the HTS/VTS registers (0x380c-0x380f).
+ *
+ * The module is mounted upside down: with the preview table's mirror/flip
+ * setting (0x3818 = 0xc1) the scene arrives rotated by 180 degrees. Bit 6
+ * mirrors and bit 5 flips the array readout; the window registers stay in
+ * array coordinates either way.
+ */
+
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+
+#define OV5642_ADDR (0x3C << 1)
+#define FIFO_MAX (8u * 1024u * 1024u) // 8 MByte frame buffer on the module
+#define SENSOR_PCLK_HZ 48000000ULL
+// Array coordinates addressed by the 0x3800-0x3807 window registers
+#define ARRAY_W 1440
+#define ARRAY_H 976
+#define FULL_ARRAY_W 3456 // the QSXGA window (432, 10, 2592, 1944) centred
+#define FULL_ARRAY_H 1964
+#define PREVIEW_3818 0xc1
+
+/********/
+// OV5642
+/*******/
+static uint8_t regs[0x10000];
+static uint16_t reg_ptr;
+static uint64_t stream_t0;
+static uint32_t sensor_writes;
+static uint32_t window_errors;
+static int sensor_present = 1; // 0: NACKs everything, as if unplugged
+
+static uint16_t reg16(uint16_t hi) {
+  return (uint16_t)(regs[hi] << 8 | regs[hi + 1]);
+}
+
+static void ov5642_defaults(void) {
+  memset(regs, 0, sizeof(regs));
+  regs[0x300a] = 0x56;
+  regs[0x300b] = 0x42;
+  regs[0x3808] = 0x0a; // 2592 x 1944 output after reset
+  regs[0x3809] = 0x20;
+  regs[0x380a] = 0x07;
+  regs[0x380b] = 0x98;
+  regs[0x380c] = 0x0c; // HTS 3200
+  regs[0x380d] = 0x80;
+  regs[0x380e] = 0x07; // VTS 2000
+  regs[0x380f] = 0xd0;
+  regs[0x3818] = 0x80;
+  regs[0x4300] = 0xf8;
+  stream_t0 = sim_time_ns();
+}
+
+static uint64_t frame_ns(void) {
+  uint64_t hts = reg16(0x380c), vts = reg16(0x380e);
+  if (!hts || !vts) {
+    hts = 3200;
+    vts = 1000;
+  }
+  return hts * vts * 1000000000ULL / SENSOR_PCLK_HZ;
+}
+
+static int ov5642_write(const uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  if (!sensor_present) {
+    return -1;
+  }
+  if (len < 2) {
+    return len ? -1 : 0;
+  }
+  reg_ptr = (uint16_t)(data[0] << 8 | data[1]);
+  for (uint16_t i = 2; i < len; i++) {
+    uint8_t v = data[i];
+    sensor_writes++;
+    if (reg_ptr == 0x3008 && (v & 0x80)) {
+      ov5642_defaults(); // software reset
+    } else {
+      regs[reg_ptr] = v;
+    }
+    reg_ptr++;
+  }
+  return 0;
+}
+
+static int ov5642_read(uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  if (!sensor_present) {
+    return -1;
+  }
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = regs[reg_ptr++];
+  }
+  return 0;
+}
+
+static SimI2cDevice ov5642_dev = {
+    .name = "OV5642",
+    .addr = OV5642_ADDR,
+    .write = ov5642_write,
+    .read = ov5642_read,
+};
+
+/********/
+// Scene
+/*******/
+static uint8_t *ppm;
+static int ppm_w, ppm_h;
+
+int sim_arducam_load_ppm(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return -1;
+  }
+  int w, h, maxv;
+  if (fscanf(f, "P6 %d %d %d", &w, &h, &maxv) != 3 || maxv != 255) {
+    fclose(f);
+    return -1;
+  }
+  fgetc(f);
+  uint8_t *p = malloc((size_t)w * h * 3);
+  if (!p || fread(p, 3, (size_t)w * h, f) != (size_t)w * h) {
+    free(p);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  free(ppm);
+  ppm = p;
+  ppm_w = w;
+  ppm_h = h;
+  return 0;
+}
+
+// u, v in [0, 1): the upright scene as a person in front of the pot sees it
+static void scene_rgb(double u, double v, uint32_t frame, uint8_t rgb[3]) {
+  if (ppm) {
+    const uint8_t *p = ppm + ((size_t)(v * ppm_h) * ppm_w + (size_t)(u * ppm_w)) * 3;
+    memcpy(rgb, p, 3);
+    return;
+  }
+  // sky gradient
+  rgb[0] = (uint8_t)(120 + 100 * v);
+  rgb[1] = (uint8_t)(170 + 60 * v);
+  rgb[2] = 235;
+  // sun drifting across the sky, one step per frame
+  double su = 0.1 + 0.02 * (frame % 40), sv = 0.15;
+  if ((u - su) * (u - su) + (v - sv) * (v - sv) < 0.004) {
+    rgb[0] = 250;
+    rgb[1] = 220;
+    rgb[2] = 60;
+  }
+  // leaves
+  double lu = (u - 0.5) / 0.22, lv = (v - 0.42) / 0.25;
+  if (lu * lu + lv * lv < 1.0) {
+    rgb[0] = (uint8_t)(30 + 40 * v);
+    rgb[1] = (uint8_t)(110 + 80 * (1.0 - lv * lv));
+    rgb[2] = 40;
+  }
+  // terracotta pot
+  double half = 0.18 - 0.06 * (v - 0.65) / 0.35;
+  if (v > 0.65 && u > 0.5 - half && u < 0.5 + half) {
+    rgb[0] = 190;
+    rgb[1] = 95;
+    rgb[2] = 55;
+  }
+}
+
+static uint8_t clamp_u8(double x) {
+  return x < 0 ? 0 : x > 255 ? 255 : (uint8_t)(x + 0.5);
+}
+
+// Inverse of the OV5642 application note conversion used by convert_24
+static void rgb_to_ycbcr(const uint8_t rgb[3], double *y, double *cb,
+                         double *cr) {
+  *y = 0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2];
+  *cb = 128.0 + (rgb[2] - *y) / 1.732;
+  *cr = 128.0 + (rgb[0] - *y) / 1.371;
+}
+
+/********/
+// ArduCHIP
+/*******/
+static uint8_t *fifo;
+static uint32_t fifo_len, fifo_rd;
+static uint8_t chip_regs[0x80];
+static int capturing;
+static uint64_t cap_done_at;
+static uint32_t captures;
+static uint64_t fifo_bytes_read;
+
+static struct {
+  enum { AC_ADDR, AC_WRITE, AC_READ, AC_BURST, AC_DONE } state;
+  uint8_t reg;
+} spi;
+
+// The array the window registers address: binned in preview, else full
+static void array_size(uint32_t *w, uint32_t *h) {
+  int binned = regs[0x3818] & 0x01;
+  *w = binned ? ARRAY_W : FULL_ARRAY_W;
+  *h = binned ? ARRAY_H : FULL_ARRAY_H;
+}
+
+static int window_valid(uint32_t ow, uint32_t oh, int yuyv) {
+  uint32_t aw, ah;
+  array_size(&aw, &ah);
+  uint32_t hs = reg16(0x3800) & 0x0FFF, vs = reg16(0x3802) & 0x0FFF;
+  uint32_t hw = reg16(0x3804) & 0x0FFF, vh = reg16(0x3806) & 0x0FFF;
+  return ow && oh && hw && vh && hs + hw <= aw && vs + vh <= ah && ow <= hw &&
+         oh <= vh && !(yuyv && (ow & 1));
+}
+
+// Sensor output pixel (ox, oy) -> scene coordinates via window and mounting
+static void sensor_pixel(uint32_t ox, uint32_t oy, uint32_t ow, uint32_t oh,
+                         uint32_t frame, uint8_t rgb[3]) {
+  uint32_t hs = reg16(0x3800) & 0x0FFF, vs = reg16(0x3802) & 0x0FFF;
+  uint32_t hw = reg16(0x3804) & 0x0FFF, vh = reg16(0x3806) & 0x0FFF;
+  uint8_t r3818 = regs[0x3818];
+  uint32_t array_w, array_h;
+  array_size(&array_w, &array_h);
+  if (!hw || !vh) {
+    hs = vs = 0;
+    hw = array_w;
+    vh = array_h;
+  }
+  double ax = hs + (ox + 0.5) * hw / ow;
+  double ay = vs + (oy + 0.5) * vh / oh;
+  double u = ax / array_w, v = ay / array_h;
+  int mirror = ((r3818 ^ PREVIEW_3818) & 0x40) == 0;
+  int flip = ((r3818 ^ PREVIEW_3818) & 0x20) == 0;
+  if (mirror) {
+    u = 1.0 - u;
+  }
+  if (flip) {
+    v = 1.0 - v;
+  }
+  if (u < 0) u = 0;
+  if (u > 0.999) u = 0.999;
+  if (v < 0) v = 0;
+  if (v > 0.999) v = 0.999;
+  scene_rgb(u, v, frame, rgb);
+}
+
+// The compression engine's output: the frame as one JPEG, 2x1 luma
+// sampling as the OV5642 produces
+static void render_jpeg(uint32_t ow, uint32_t oh) {
+  if (!ow || !oh) {
+    fifo_len = 0;
+    return;
+  }
+  uint8_t *rgb = malloc((size_t)ow * 3);
+  unsigned char *out = NULL;
+  unsigned long out_len = 0;
+  struct jpeg_compress_struct c;
+  struct jpeg_error_mgr err;
+  c.err = jpeg_std_error(&err);
+  jpeg_create_compress(&c);
+  jpeg_mem_dest(&c, &out, &out_len);
+  c.image_width = ow;
+  c.image_height = oh;
+  c.input_components = 3;
+  c.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&c);
+  int quality = 100 - 4 * (regs[0x4407] & 0x3F);
+  jpeg_set_quality(&c, quality < 10 ? 10 : quality > 95 ? 95 : quality, TRUE);
+  c.comp_info[0].h_samp_factor = 2;
+  c.comp_info[0].v_samp_factor = 1;
+  jpeg_start_compress(&c, TRUE);
+  for (uint32_t y = 0; y < oh; y++) {
+    for (uint32_t x = 0; x < ow; x++) {
+      sensor_pixel(x, y, ow, oh, captures, rgb + 3 * x);
+    }
+    JSAMPROW row = rgb;
+    jpeg_write_scanlines(&c, &row, 1);
+  }
+  jpeg_finish_compress(&c);
+  jpeg_destroy_compress(&c);
+  free(rgb);
+
+  fifo_len = out_len < FIFO_MAX ? (uint32_t)out_len : FIFO_MAX;
+  memcpy(fifo, out, fifo_len);
+  free(out);
+}
+
+static void render_frame(void) {
+  uint32_t ow = reg16(0x3808) & 0x0FFF, oh = reg16(0x380a) & 0x0FFF;
+  uint8_t fmt = regs[0x4300];
+  fifo_rd = 0;
+  int jpeg = regs[0x3818] & 0x08;
+  uint8_t kind = fmt >> 4;
+  int isp_rgb = (regs[0x501f] & 0x0f) == 0x01;
+  if (!window_valid(ow, oh, !jpeg && kind == 0x3)) {
+    window_errors++;
+  }
+  if (jpeg) {
+    render_jpeg(ow, oh);
+    return;
+  }
+  uint32_t bpp = kind == 0x1 ? 1 : 2;
+  uint64_t len = (uint64_t)ow * oh * bpp;
+  if (len > FIFO_MAX) {
+    len = FIFO_MAX; // the module FIFO simply stops filling
+  }
+  fifo_len = (uint32_t)len;
+  uint32_t i = 0;
+  if (kind == 0x6 && isp_rgb) {
+    for (uint32_t y = 0; y < oh && i + 2 <= fifo_len; y++) {
+      for (uint32_t x = 0; x < ow && i + 2 <= fifo_len; x++) {
+        uint8_t a[3];
+        sensor_pixel(x, y, ow, oh, captures, a);
+        if ((fmt & 0x0f) == 0 || (fmt & 0x0f) == 3) {
+          uint8_t t = a[0]; // B in the top bits
+          a[0] = a[2];
+          a[2] = t;
+        }
+        uint16_t px = (uint16_t)((a[0] & 0xF8) << 8 | (a[1] & 0xFC) << 3 |
+                                 a[2] >> 3);
+        int little = (fmt & 0x0f) >= 2;
+        fifo[i++] = (uint8_t)(little ? px : px >> 8);
+        fifo[i++] = (uint8_t)(little ? px >> 8 : px);
+      }
+    }
+    return;
+  }
+  if (kind == 0x1 && !isp_rgb) {
+    for (uint32_t y = 0; y < oh && i < fifo_len; y++) {
+      for (uint32_t x = 0; x < ow && i < fifo_len; x++) {
+        uint8_t a[3];
+        double y0, cb0, cr0;
+        sensor_pixel(x, y, ow, oh, captures, a);
+        rgb_to_ycbcr(a, &y0, &cb0, &cr0);
+        fifo[i++] = clamp_u8(y0);
+      }
+    }
+    return;
+  }
+  if (kind != 0x3 || isp_rgb) {
+    // formats and ISP selections not modelled: deliver a mid-grey frame
+    memset(fifo, 0x80, fifo_len);
+    return;
+  }
+  for (uint32_t y = 0; y < oh && i + 4 <= fifo_len; y++) {
+    for (uint32_t x = 0; x + 1 < ow && i + 4 <= fifo_len; x += 2) {
+      uint8_t a[3], b[3];
+      double y0, cb0, cr0, y1, cb1, cr1;
+      sensor_pixel(x, y, ow, oh, captures, a);
+      sensor_pixel(x + 1, y, ow, oh, captures, b);
+      rgb_to_ycbcr(a, &y0, &cb0, &cr0);
+      rgb_to_ycbcr(b, &y1, &cb1, &cr1);
+      fifo[i++] = clamp_u8(y0);
+      fifo[i++] = clamp_u8((cb0 + cb1) / 2);
+      fifo[i++] = clamp_u8(y1);
+      fifo[i++] = clamp_u8((cr0 + cr1) / 2);
+    }
+  }
+}
+
+static void capture_poll(void) {
+  if (capturing && sim_time_ns() >= cap_done_at) {
+    capturing = 0;
+    render_frame();
+    captures++;
+    chip_regs[0x41] |= 0x08; // CAP_DONE
+  }
+}
+
+static void start_capture(void) {
+  // The frame in flight is skipped; capture spans the next full frame
+  uint64_t period = frame_ns();
+  uint64_t since = sim_time_ns() - stream_t0;
+  uint64_t next_vsync = stream_t0 + (since / period + 1) * period;
+  cap_done_at = next_vsync + period;
+  capturing = 1;
+  chip_regs[0x41] &= (uint8_t)~0x08;
+}
+
+static void chip_write(uint8_t reg, uint8_t v) {
+  switch (reg) {
+  case 0x04: // FIFO control
+    if (v & 0x01) {
+      chip_regs[0x41] &= (uint8_t)~0x08;
+    }
+    if (v & 0x02) {
+      start_capture();
+    }
+    if (v & 0x10) {
+      fifo_len = 0;
+    }
+    if (v & 0x20) {
+      fifo_rd = 0;
+    }
+    break;
+  case 0x07: // bit 7 resets the CPLD
+    if (v & 0x80) {
+      memset(chip_regs, 0, sizeof(chip_regs));
+      capturing = 0;
+    }
+    break;
+  case 0x41: // status is read only
+    break;
+  default:
+    chip_regs[reg & 0x7F] = v;
+    break;
+  }
+}
+
+static uint8_t fifo_pop(void) {
+  fifo_bytes_read++;
+  return fifo_rd < fifo_len ? fifo[fifo_rd++] : 0x00;
+}
+
+static uint8_t chip_read(uint8_t reg) {
+  capture_poll();
+  switch (reg) {
+  case 0x3D:
+    return fifo_pop();
+  case 0x42:
+    return (uint8_t)(fifo_len & 0xFF);
+  case 0x43:
+    return (uint8_t)((fifo_len >> 8) & 0xFF);
+  case 0x44:
+    return (uint8_t)((fifo_len >> 16) & 0x7F);
+  default:
+    return chip_regs[reg & 0x7F];
+  }
+}
+
+static void arducam_select(int selected) {
+  if (selected) {
+    spi.state = AC_ADDR;
+  }
+}
+
+static uint8_t arducam_exchange(uint8_t mosi) {
+  switch (spi.state) {
+  case AC_ADDR:
+    if (mosi & 0x80) {
+      spi.reg = mosi & 0x7F;
+      spi.state = AC_WRITE;
+    } else if (mosi == 0x3C) {
+      capture_poll();
+      spi.state = AC_BURST;
+    } else {
+      spi.reg = mosi;
+      spi.state = AC_READ;
+    }
+    return 0x00;
+  case AC_WRITE:
+    chip_write(spi.reg, mosi);
+    spi.state = AC_DONE;
+    return 0x00;
+  case AC_READ:
+    spi.state = AC_DONE;
+    return chip_read(spi.reg);
+  case AC_BURST:
+    return fifo_pop();
+  default:
+    return 0x00;
+  }
+}
+
+static SimSpiDevice arducam_dev = {
+    .name = "ArduCHIP",
+    .select = arducam_select,
+    .exchange = arducam_exchange,
+};
+
+void sim_arducam_attach(void) {
+  if (!fifo) {
+    fifo = malloc(FIFO_MAX);
+  }
+  ov5642_defaults();
+  memset(chip_regs, 0, sizeof(chip_regs));
+  memset(&spi, 0, sizeof(spi));
+  fifo_len = fifo_rd = 0;
+  capturing = 0;
+  captures = 0;
+  fifo_bytes_read = 0;
+  sensor_writes = 0;
+  window_errors = 0;
+  sensor_present = 1;
+  arducam_dev.cs_port = GPIOA;
+  arducam_dev.cs_pin = GPIO_PIN_4;
+  GPIOA->odr |= GPIO_PIN_4;
+  sim_spi_attach(sim_config.cam_spi ? sim_config.cam_spi : SPI1,
+                 &arducam_dev);
+  sim_i2c_attach(I2C4, &ov5642_dev);
+}
+
+uint32_t sim_arducam_captures(void) { return captures; }
+
+uint64_t sim_arducam_fifo_bytes_read(void) { return fifo_bytes_read; }
+
+const uint8_t *sim_arducam_fifo(uint32_t *len) {
+  *len = fifo_len;
+  return fifo;
+}
+
+uint32_t sim_ov5642_register_writes(void) { return sensor_writes; }
+
+uint32_t sim_ov5642_window_errors(void) { return window_errors; }
+
+uint8_t sim_ov5642_register(uint16_t reg) { return regs[reg]; }
+
+void sim_ov5642_set_present(int present) { sensor_present = present; }
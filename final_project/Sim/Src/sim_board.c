@@ -0,0 +1,34 @@
+/*
+ * sim_board.c
+ *
+ * Board level glue for the host build: stand-ins for the CubeMX peripherals
+ * the simulator does not model (ADC, timers, USB) and the wiring of every
+ * virtual device to its bus and pins.
+ */
+
+#include "sim.h"
+
+#include "adc.h"
+#include "tim.h"
+#include "usb_otg.h"
+
+ADC_HandleTypeDef hadc1;
+TIM_HandleTypeDef htim1;
+TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim3;
+TIM_HandleTypeDef htim4;
+
+void MX_ADC1_Init(void) {}
+void MX_TIM1_Init(void) {}
+void MX_TIM2_Init(void) {}
+void MX_TIM3_Init(void) {}
+void MX_TIM4_Init(void) {}
+void MX_USB_OTG_FS_USB_Init(void) {}
+
+void HAL_TIM_MspPostInit(TIM_HandleTypeDef *timHandle) { (void)timHandle; }
+
+void sim_board_init(void) {
+  sim_tft_attach();
+  sim_arducam_attach();
+  sim_sensors_attach();
+}
@@ -0,0 +1,209 @@
+/*
+ * sim_core.c
+ *
+ * Virtual clock, timed events, interrupt context and run control for the
+ * host simulator.
+ */
+
+#include "sim.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_MAX_EVENTS 64
+
+typedef struct {
+  uint64_t at;
+  sim_event_fn fn;
+  void *arg;
+} SimEvent;
+
+SimConfig sim_config = {
+    .stop_ns = 0,
+    .cpu_scale = 0.0,
+    .uart_echo = 1,
+};
+
+static uint64_t now_ns = 0;
+static SimEvent events[SIM_MAX_EVENTS];
+static int event_count = 0;
+static int isr_depth = 0;
+static int running = 0;
+static jmp_buf stop_env;
+static uint64_t host_cpu_mark = 0;
+
+uint64_t sim_time_ns(void) { return now_ns; }
+
+void sim_event_at(uint64_t t, sim_event_fn fn, void *arg) {
+  if (event_count >= SIM_MAX_EVENTS) {
+    fprintf(stderr, "[SIM][ERR] event queue full\n");
+    return;
+  }
+  events[event_count].at = t;
+  events[event_count].fn = fn;
+  events[event_count].arg = arg;
+  event_count++;
+}
+
+// Pops the earliest event due at or before t, if any
+static int pop_event(uint64_t t, SimEvent *out) {
+  int best = -1;
+  for (int i = 0; i < event_count; i++) {
+    if (events[i].at <= t && (best < 0 || events[i].at < events[best].at)) {
+      best = i;
+    }
+  }
+  if (best < 0) {
+    return 0;
+  }
+  *out = events[best];
+  events[best] = events[--event_count];
+  return 1;
+}
+
+static void check_stop(void) {
+  if (running && sim_config.stop_ns && now_ns >= sim_config.stop_ns) {
+    longjmp(stop_env, 1);
+  }
+}
+
+void sim_advance_to_ns(uint64_t t) {
+  SimEvent ev;
+  while (isr_depth == 0 && pop_event(t, &ev)) {
+    if (ev.at > now_ns) {
+      now_ns = ev.at;
+    }
+    ev.fn(ev.arg);
+  }
+  if (t > now_ns) {
+    now_ns = t;
+  }
+  check_stop();
+}
+
+void sim_advance_ns(uint64_t ns) {
+  // Busy time of the current context: anything that preempts it pushes the
+  // end of the work out by the time the preempting handler consumed.
+  uint64_t end = now_ns + ns;
+  SimEvent ev;
+  while (isr_depth == 0 && pop_event(end, &ev)) {
+    if (ev.at > now_ns) {
+      now_ns = ev.at;
+    }
+    uint64_t before = now_ns;
+    ev.fn(ev.arg);
+    end += now_ns - before;
+  }
+  if (end > now_ns) {
+    now_ns = end;
+  }
+  check_stop();
+}
+
+// WFI: the core sleeps until the next event or the next SysTick interrupt
+void sim_wfi(void) {
+  sim_hal_enter();
+  uint64_t t = now_ns - now_ns % SIM_NS_PER_MS + SIM_NS_PER_MS;
+  for (int i = 0; i < event_count; i++) {
+    if (events[i].at < t) {
+      t = events[i].at > now_ns ? events[i].at : now_ns;
+    }
+  }
+  sim_advance_to_ns(t);
+  sim_hal_leave();
+}
+
+void sim_cpu_cycles(uint32_t cycles) {
+  sim_advance_ns((uint64_t)cycles * 1000000000ULL / sim_sysclk_hz());
+}
+
+static uint64_t host_cpu_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Called on entry to every simulated HAL call: charges the application code
+// that ran since the previous HAL call, scaled from host CPU time.
+void sim_hal_enter(void) {
+  if (sim_config.cpu_scale > 0.0) {
+    uint64_t t = host_cpu_ns();
+    if (host_cpu_mark) {
+      sim_advance_ns((uint64_t)((double)(t - host_cpu_mark) *
+                                sim_config.cpu_scale));
+    }
+  }
+}
+
+void sim_hal_leave(void) {
+  if (sim_config.cpu_scale > 0.0) {
+    host_cpu_mark = host_cpu_ns();
+  }
+}
+
+void sim_isr_enter(void) { isr_depth++; }
+
+void sim_isr_leave(void) {
+  if (--isr_depth == 0) {
+    sim_exti_dispatch_pending();
+    sim_advance_ns(0);
+  }
+}
+
+int sim_in_isr(void) { return isr_depth > 0; }
+
+void sim_init(void) {
+  now_ns = 0;
+  event_count = 0;
+  isr_depth = 0;
+  sim_hal_reset();
+  sim_board_init();
+  sim_profile_reset();
+}
+
+int sim_run(void (*entry)(void)) {
+  running = 1;
+  host_cpu_mark = 0;
+  if (setjmp(stop_env) == 0) {
+    entry();
+    running = 0;
+    return 0;
+  }
+  running = 0;
+  isr_depth = 0;
+  return 1;
+}
+
+void sim_stop(void) {
+  if (running) {
+    longjmp(stop_env, 1);
+  }
+}
+
+void sim_report(void) {
+  fprintf(stderr, "\n=== simulator report ===\n");
+  fprintf(stderr, "virtual time      : %.3f ms\n", now_ns / 1e6);
+  fprintf(stderr, "HAL_Delay         : %llu calls, %.3f ms\n",
+          (unsigned long long)sim_delay_calls, sim_delay_ns / 1e6);
+  fprintf(stderr, "%-8s %12s %12s %12s %8s\n", "bus", "xfers", "bytes",
+          "busy ms", "errors");
+  for (int i = 0; i < SIM_BUS_COUNT; i++) {
+    SimBusStats *b = &sim_bus_stats[i];
+    if (b->transactions == 0) {
+      continue;
+    }
+    fprintf(stderr, "%-8s %12llu %12llu %12.3f %8llu\n", b->name,
+            (unsigned long long)b->transactions, (unsigned long long)b->bytes,
+            b->busy_ns / 1e6, (unsigned long long)b->errors);
+  }
+  fprintf(stderr, "TFT pixels written: %llu\n",
+          (unsigned long long)sim_tft_pixels_written());
+  fprintf(stderr, "camera captures   : %u (%llu FIFO bytes read)\n",
+          sim_arducam_captures(),
+          (unsigned long long)sim_arducam_fifo_bytes_read());
+  fprintf(stderr, "sensor early reads: %u\n", sim_sensors_early_reads());
+  fprintf(stderr, "pump on time      : %.3f ms\n", sim_pump_on_ns() / 1e6);
+  sim_profile_report();
+}
@@ -0,0 +1,1379 @@
+/*
+ * sim_hal.c
+ *
+ * Simulated STM32L4 HAL: RCC clock tree, GPIO/EXTI, DMA, SPI, I2C and
+ * LPUART. Transfers are routed to the virtual devices attached in
+ * sim_board.c and charged against the virtual clock in sim_core.c.
+ */
+
+#define _GNU_SOURCE // posix_openpt, ptsname_r
+#define SIM_HAL_IMPL
+#include "sim.h"
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+GPIO_TypeDef sim_gpio[8] = {{"GPIOA", 0, 0, 0}, {"GPIOB", 0, 0, 0},
+                            {"GPIOC", 0, 0, 0}, {"GPIOD", 0, 0, 0},
+                            {"GPIOE", 0, 0, 0}, {"GPIOF", 0, 0, 0},
+                            {"GPIOG", 0, 0, 0}, {"GPIOH", 0, 0, 0}};
+SPI_TypeDef sim_spi[3] = {{"SPI1", 0}, {"SPI2", 0}, {"SPI3", 0}};
+DMA_Channel_TypeDef sim_dma1[7] = {
+    {"DMA1_Channel1", DMA1_Channel1_IRQn}, {"DMA1_Channel2", DMA1_Channel2_IRQn},
+    {"DMA1_Channel3", DMA1_Channel3_IRQn}, {"DMA1_Channel4", DMA1_Channel4_IRQn},
+    {"DMA1_Channel5", DMA1_Channel5_IRQn}, {"DMA1_Channel6", DMA1_Channel6_IRQn},
+    {"DMA1_Channel7", DMA1_Channel7_IRQn}};
+I2C_TypeDef sim_i2c[4] = {{"I2C1"}, {"I2C2"}, {"I2C3"}, {"I2C4"}};
+USART_TypeDef sim_lpuart1 = {"LPUART1"};
+
+uint32_t SystemCoreClock = 4000000U;
+
+SimCosts sim_costs = {
+    .gpio_write_cycles = 12,
+    .spi_call_cycles = 150,
+    .spi_poll_byte_cycles = 20,
+    .spi_xfer_byte_cycles = 40,
+    .i2c_call_cycles = 300,
+    .uart_call_cycles = 100,
+    .dma_setup_cycles = 120,
+};
+
+SimBusStats sim_bus_stats[SIM_BUS_COUNT] = {
+    {"SPI1", 0, 0, 0, 0},  {"SPI2", 0, 0, 0, 0}, {"SPI3", 0, 0, 0, 0},
+    {"I2C1", 0, 0, 0, 0},  {"I2C2", 0, 0, 0, 0}, {"I2C3", 0, 0, 0, 0},
+    {"I2C4", 0, 0, 0, 0},  {"LPUART1", 0, 0, 0, 0},
+};
+uint64_t sim_delay_ns = 0;
+uint64_t sim_delay_calls = 0;
+
+/********/
+// Clock tree
+/*******/
+static const uint32_t msi_range_hz[12] = {
+    100000,  200000,   400000,   800000,   1000000,  2000000,
+    4000000, 8000000, 16000000, 24000000, 32000000, 48000000};
+
+static uint32_t sysclk_hz = 4000000U; // MSI range 6 after reset
+static uint32_t hclk_div = 1, pclk1_div = 1, pclk2_div = 1;
+static RCC_OscInitTypeDef osc_cfg;
+
+uint32_t sim_sysclk_hz(void) { return sysclk_hz; }
+
+static uint64_t cycles_ns(uint32_t cycles) {
+  return (uint64_t)cycles * 1000000000ULL / sysclk_hz;
+}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct) {
+  osc_cfg = *RCC_OscInitStruct;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct,
+                                      uint32_t FLatency) {
+  (void)FLatency;
+  uint32_t msi = msi_range_hz[(osc_cfg.MSIClockRange >> 4) % 12];
+  if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_SYSCLK) {
+    if (RCC_ClkInitStruct->SYSCLKSource == RCC_SYSCLKSOURCE_PLLCLK &&
+        osc_cfg.PLL.PLLState == RCC_PLL_ON && osc_cfg.PLL.PLLM &&
+        osc_cfg.PLL.PLLR) {
+      sysclk_hz = (uint32_t)((uint64_t)msi * osc_cfg.PLL.PLLN /
+                             osc_cfg.PLL.PLLM / osc_cfg.PLL.PLLR);
+    } else {
+      sysclk_hz = msi;
+    }
+  }
+  if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_HCLK) {
+    hclk_div = RCC_ClkInitStruct->AHBCLKDivider ? RCC_ClkInitStruct->AHBCLKDivider : 1;
+  }
+  if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_PCLK1) {
+    pclk1_div = RCC_ClkInitStruct->APB1CLKDivider ? RCC_ClkInitStruct->APB1CLKDivider : 1;
+  }
+  if (RCC_ClkInitStruct->ClockType & RCC_CLOCKTYPE_PCLK2) {
+    pclk2_div = RCC_ClkInitStruct->APB2CLKDivider ? RCC_ClkInitStruct->APB2CLKDivider : 1;
+  }
+  SystemCoreClock = HAL_RCC_GetHCLKFreq();
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef *PeriphClkInit) {
+  (void)PeriphClkInit;
+  return HAL_OK;
+}
+
+void HAL_RCCEx_EnableMSIPLLMode(void) {}
+uint32_t HAL_RCC_GetSysClockFreq(void) { return sysclk_hz; }
+uint32_t HAL_RCC_GetHCLKFreq(void) { return sysclk_hz / hclk_div; }
+uint32_t HAL_RCC_GetPCLK1Freq(void) { return HAL_RCC_GetHCLKFreq() / pclk1_div; }
+uint32_t HAL_RCC_GetPCLK2Freq(void) { return HAL_RCC_GetHCLKFreq() / pclk2_div; }
+
+HAL_StatusTypeDef HAL_PWREx_ControlVoltageScaling(uint32_t VoltageScaling) {
+  (void)VoltageScaling;
+  return HAL_OK;
+}
+
+void HAL_PWREx_EnableVddIO2(void) {}
+void HAL_PWR_EnableBkUpAccess(void) {}
+
+/********/
+// Core
+/*******/
+__attribute__((weak)) void HAL_MspInit(void) {}
+
+HAL_StatusTypeDef HAL_Init(void) {
+  HAL_MspInit();
+  return HAL_OK;
+}
+
+void HAL_IncTick(void) {} // the tick is derived from the virtual clock
+
+CoreDebug_Type sim_core_debug;
+static DWT_Type dwt;
+static uint32_t dwt_seen;
+static uint64_t dwt_origin;
+
+DWT_Type *sim_dwt(void) {
+  uint64_t cycles = sim_time_ns() * (sysclk_hz / 1000000) / 1000;
+  int running = (sim_core_debug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk) &&
+                (dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk);
+  if (!running || dwt.CYCCNT != dwt_seen) {
+    dwt_origin = cycles - dwt.CYCCNT; // stopped, or written by firmware
+  }
+  dwt.CYCCNT = (uint32_t)(cycles - dwt_origin);
+  dwt_seen = dwt.CYCCNT;
+  return &dwt;
+}
+
+uint32_t HAL_GetTick(void) {
+  return (uint32_t)(sim_time_ns() / SIM_NS_PER_MS);
+}
+
+void HAL_Delay(uint32_t Delay) {
+  const char *caller = sim_hal_take_caller();
+  sim_hal_enter();
+  // Same rounding as the SysTick based HAL: wait for Delay + 1 tick edges
+  uint64_t tickstart = sim_time_ns() / SIM_NS_PER_MS;
+  uint64_t wait = Delay;
+  if (wait < HAL_MAX_DELAY) {
+    wait++;
+  }
+  uint64_t t0 = sim_time_ns();
+  sim_advance_to_ns((tickstart + wait) * SIM_NS_PER_MS);
+  sim_delay_ns += sim_time_ns() - t0;
+  sim_delay_calls++;
+  sim_profile_delay(caller, sim_time_ns() - t0);
+  sim_hal_leave();
+}
+
+/********/
+// NVIC / EXTI
+/*******/
+static uint64_t nvic_enabled = 0;
+static int irq_masked = 0;
+static uint16_t exti_pending[8];
+static uint8_t dma_pending; // DMA1 channels with an undelivered interrupt
+static uint8_t systick_pending;
+
+void sim_disable_irq(void) { irq_masked = 1; }
+
+void sim_enable_irq(void) {
+  irq_masked = 0;
+  sim_exti_dispatch_pending();
+}
+
+uint32_t sim_get_primask(void) { return (uint32_t)irq_masked; }
+
+void sim_set_primask(uint32_t mask) {
+  if (mask) {
+    sim_disable_irq();
+  } else {
+    sim_enable_irq();
+  }
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority,
+                          uint32_t SubPriority) {
+  (void)IRQn;
+  (void)PreemptPriority;
+  (void)SubPriority;
+}
+
+// Lines from 64 up (LPUART1) are accepted but never raised
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+  if (IRQn < 64) {
+    nvic_enabled |= 1ULL << IRQn;
+  }
+  sim_exti_dispatch_pending();
+}
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+  if (IRQn < 64) {
+    nvic_enabled &= ~(1ULL << IRQn);
+  }
+}
+
+__attribute__((weak)) void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+  (void)GPIO_Pin;
+}
+
+void HAL_GPIO_EXTI_IRQHandler(uint16_t GPIO_Pin) {
+  HAL_GPIO_EXTI_Callback(GPIO_Pin);
+}
+
+// Vector table entries, provided by Core/Src/stm32l4xx_it.c when linked
+extern void EXTI0_IRQHandler(void) __attribute__((weak));
+extern void EXTI1_IRQHandler(void) __attribute__((weak));
+extern void EXTI2_IRQHandler(void) __attribute__((weak));
+extern void EXTI3_IRQHandler(void) __attribute__((weak));
+extern void EXTI4_IRQHandler(void) __attribute__((weak));
+extern void EXTI9_5_IRQHandler(void) __attribute__((weak));
+extern void EXTI15_10_IRQHandler(void) __attribute__((weak));
+
+static IRQn_Type exti_irqn(int line, void (**handler)(void)) {
+  static void (*const low[5])(void) = {EXTI0_IRQHandler, EXTI1_IRQHandler,
+                                       EXTI2_IRQHandler, EXTI3_IRQHandler,
+                                       EXTI4_IRQHandler};
+  if (line < 5) {
+    *handler = low[line];
+    return (IRQn_Type)(EXTI0_IRQn + line);
+  }
+  if (line < 10) {
+    *handler = EXTI9_5_IRQHandler;
+    return EXTI9_5_IRQn;
+  }
+  *handler = EXTI15_10_IRQHandler;
+  return EXTI15_10_IRQn;
+}
+
+static void exti_fire(uint16_t pin) {
+  int line = __builtin_ctz(pin);
+  void (*handler)(void) = NULL;
+  IRQn_Type irqn = exti_irqn(line, &handler);
+  if (!(nvic_enabled & (1ULL << irqn))) {
+    return;
+  }
+  sim_isr_enter();
+  if (handler) {
+    handler();
+  } else {
+    HAL_GPIO_EXTI_IRQHandler(pin);
+  }
+  sim_isr_leave();
+}
+
+// SysTick: HAL_GetTick reads the virtual clock, but the handler still runs
+// on every millisecond edge for firmware that hooks it
+extern void SysTick_Handler(void) __attribute__((weak));
+
+static void systick_fire(void *arg) {
+  (void)arg;
+  uint64_t now = sim_time_ns();
+  sim_event_at(now - now % SIM_NS_PER_MS + SIM_NS_PER_MS, systick_fire, NULL);
+  if (!SysTick_Handler) {
+    return;
+  }
+  if (sim_in_isr() || irq_masked) {
+    systick_pending = 1;
+    return;
+  }
+  sim_isr_enter();
+  SysTick_Handler();
+  sim_isr_leave();
+}
+
+void sim_exti_raise(GPIO_TypeDef *port, uint16_t pin) {
+  if (!(port->it_mask & pin)) {
+    return;
+  }
+  if (sim_in_isr() || irq_masked) {
+    exti_pending[port - sim_gpio] |= pin;
+    return;
+  }
+  exti_fire(pin);
+}
+
+static void dma_fire(int ch);
+static void i2c_dispatch_pending(void);
+
+void sim_exti_dispatch_pending(void) {
+  if (sim_in_isr() || irq_masked) {
+    return;
+  }
+  if (systick_pending) {
+    systick_pending = 0;
+    sim_isr_enter();
+    SysTick_Handler();
+    sim_isr_leave();
+  }
+  i2c_dispatch_pending();
+  for (int ch = 0; ch < 7; ch++) {
+    if ((dma_pending & (1u << ch)) &&
+        (nvic_enabled & (1ULL << sim_dma1[ch].irqn))) {
+      dma_pending &= (uint8_t)~(1u << ch);
+      dma_fire(ch);
+    }
+  }
+  for (int p = 0; p < 8; p++) {
+    while (exti_pending[p]) {
+      uint16_t pin = exti_pending[p] & (uint16_t)-exti_pending[p];
+      exti_pending[p] &= (uint16_t)~pin;
+      exti_fire(pin);
+    }
+  }
+}
+
+/********/
+// GPIO
+/*******/
+#define SIM_MAX_WATCHES 16
+
+static struct {
+  GPIO_TypeDef *port;
+  uint16_t pin;
+  sim_pin_fn fn;
+} watches[SIM_MAX_WATCHES];
+static int watch_count = 0;
+
+static SimSpiDevice *spi_devices[3];
+
+void sim_gpio_watch(GPIO_TypeDef *port, uint16_t pin, sim_pin_fn fn) {
+  if (watch_count < SIM_MAX_WATCHES) {
+    watches[watch_count].port = port;
+    watches[watch_count].pin = pin;
+    watches[watch_count].fn = fn;
+    watch_count++;
+  }
+}
+
+void sim_gpio_drive(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state) {
+  uint16_t old = port->idr;
+  if (state == GPIO_PIN_SET) {
+    port->idr |= pin;
+  } else {
+    port->idr &= (uint16_t)~pin;
+  }
+  // Falling edge on an EXTI source (the only trigger the firmware uses)
+  if ((old & pin) && !(port->idr & pin)) {
+    sim_exti_raise(port, pin);
+  }
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+  uint16_t pins = (uint16_t)GPIO_Init->Pin;
+  if (GPIO_Init->Mode & GPIO_MODE_IT_MASK) {
+    GPIOx->it_mask |= pins;
+  } else {
+    GPIOx->it_mask &= (uint16_t)~pins;
+  }
+  if (GPIO_Init->Pull == GPIO_PULLUP) {
+    GPIOx->idr |= pins;
+  }
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin) {
+  GPIOx->it_mask &= (uint16_t)~GPIO_Pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  return (GPIOx->idr & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState) {
+  sim_hal_enter();
+  uint16_t old = GPIOx->odr;
+  if (PinState == GPIO_PIN_SET) {
+    GPIOx->odr |= GPIO_Pin;
+  } else {
+    GPIOx->odr &= (uint16_t)~GPIO_Pin;
+  }
+  uint16_t changed = old ^ GPIOx->odr;
+  if (changed) {
+    for (int b = 0; b < 3; b++) {
+      for (SimSpiDevice *d = spi_devices[b]; d; d = d->next) {
+        if (d->cs_port == GPIOx && (changed & d->cs_pin) && d->select) {
+          d->select(!(GPIOx->odr & d->cs_pin));
+        }
+      }
+    }
+    for (int i = 0; i < watch_count; i++) {
+      if (watches[i].port == GPIOx && (changed & watches[i].pin)) {
+        watches[i].fn((GPIOx->odr & watches[i].pin) ? GPIO_PIN_SET
+                                                    : GPIO_PIN_RESET);
+      }
+    }
+  }
+  sim_advance_ns(cycles_ns(sim_costs.gpio_write_cycles));
+  sim_hal_leave();
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  HAL_GPIO_WritePin(GPIOx, GPIO_Pin,
+                    (GPIOx->odr & GPIO_Pin) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+/********/
+// DMA
+/*******/
+// Vector table entries, provided by Core/Src/stm32l4xx_it.c when linked
+extern void DMA1_Channel1_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel2_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel3_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel4_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel5_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel6_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel7_IRQHandler(void) __attribute__((weak));
+
+static DMA_HandleTypeDef *dma_handle[7]; // last transfer per channel
+static uint8_t dma_tc; // transfer complete flags, cleared by the IRQ handler
+
+static void dma_fire(int ch) {
+  static void (*const vec[7])(void) = {
+      DMA1_Channel1_IRQHandler, DMA1_Channel2_IRQHandler,
+      DMA1_Channel3_IRQHandler, DMA1_Channel4_IRQHandler,
+      DMA1_Channel5_IRQHandler, DMA1_Channel6_IRQHandler,
+      DMA1_Channel7_IRQHandler};
+  sim_isr_enter();
+  if (vec[ch]) {
+    vec[ch]();
+  } else if (dma_handle[ch]) {
+    HAL_DMA_IRQHandler(dma_handle[ch]);
+  }
+  sim_isr_leave();
+}
+
+// Transfer complete on a channel: raise its interrupt, or leave it pending
+// until the NVIC line is enabled and the CPU is not masked or in an ISR
+static void dma_complete(DMA_HandleTypeDef *hdma) {
+  int ch = (int)(hdma->Instance - sim_dma1);
+  dma_handle[ch] = hdma;
+  dma_tc |= (uint8_t)(1u << ch);
+  if (sim_in_isr() || irq_masked ||
+      !(nvic_enabled & (1ULL << sim_dma1[ch].irqn))) {
+    dma_pending |= (uint8_t)(1u << ch);
+    return;
+  }
+  dma_fire(ch);
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) {
+  hdma->State = HAL_DMA_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma) {
+  hdma->State = HAL_DMA_STATE_RESET;
+  return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) {
+  int ch = (int)(hdma->Instance - sim_dma1);
+  if (!(dma_tc & (1u << ch))) {
+    return;
+  }
+  dma_tc &= (uint8_t)~(1u << ch);
+  hdma->State = HAL_DMA_STATE_READY;
+  if (hdma->XferCpltCallback) {
+    hdma->XferCpltCallback(hdma);
+  }
+}
+
+/********/
+// SPI
+/*******/
+static SimI2cDevice *i2c_devices[4];
+static void i2c_it_reset(void);
+
+// Detaches every device and clears pins, statistics and interrupt state
+void sim_hal_reset(void) {
+  memset(spi_devices, 0, sizeof(spi_devices));
+  memset(i2c_devices, 0, sizeof(i2c_devices));
+  watch_count = 0;
+  for (int p = 0; p < 8; p++) {
+    sim_gpio[p].odr = sim_gpio[p].idr = sim_gpio[p].it_mask = 0;
+    exti_pending[p] = 0;
+  }
+  dma_pending = dma_tc = 0;
+  memset(dma_handle, 0, sizeof(dma_handle));
+  i2c_it_reset();
+  systick_pending = 0;
+  sim_event_at(SIM_NS_PER_MS, systick_fire, NULL);
+  for (int b = 0; b < SIM_BUS_COUNT; b++) {
+    sim_bus_stats[b].transactions = 0;
+    sim_bus_stats[b].bytes = 0;
+    sim_bus_stats[b].busy_ns = 0;
+    sim_bus_stats[b].errors = 0;
+  }
+  sim_delay_ns = 0;
+  sim_delay_calls = 0;
+  nvic_enabled = 0;
+  irq_masked = 0;
+  sysclk_hz = 4000000U;
+  hclk_div = pclk1_div = pclk2_div = 1;
+  SystemCoreClock = sysclk_hz;
+  memset(&dwt, 0, sizeof(dwt));
+  memset(&sim_core_debug, 0, sizeof(sim_core_debug));
+  dwt_seen = 0;
+}
+
+void sim_spi_attach(SPI_TypeDef *bus, SimSpiDevice *dev) {
+  int b = (int)(bus - sim_spi);
+  dev->next = spi_devices[b];
+  spi_devices[b] = dev;
+}
+
+__attribute__((weak)) void HAL_SPI_MspInit(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi) {
+  HAL_SPI_MspInit(hspi);
+  hspi->State = HAL_SPI_STATE_READY;
+  return HAL_OK;
+}
+
+uint64_t sim_spi_byte_ns(const SPI_HandleTypeDef *hspi) {
+  // SPI1 sits on APB2, SPI2/SPI3 on APB1
+  uint32_t pclk = hspi->Instance == SPI1 ? HAL_RCC_GetPCLK2Freq()
+                                         : HAL_RCC_GetPCLK1Freq();
+  uint32_t div = 2U << (hspi->Init.BaudRatePrescaler >> 3);
+  return 8ULL * div * 1000000000ULL / pclk;
+}
+
+// The device whose chip select is low; two at once is a bus error
+static SimSpiDevice *spi_selected(int b) {
+  SimSpiDevice *dev = NULL;
+  for (SimSpiDevice *d = spi_devices[b]; d; d = d->next) {
+    if (!(d->cs_port->odr & d->cs_pin)) {
+      if (dev) {
+        // two chip selects low at once: both drive MISO, count it as an error
+        sim_bus_stats[SIM_BUS_SPI1 + b].errors++;
+      }
+      dev = d;
+    }
+  }
+  return dev;
+}
+
+static HAL_StatusTypeDef spi_xfer(SPI_HandleTypeDef *hspi, const uint8_t *tx,
+                                  uint8_t *rx, uint16_t size,
+                                  uint32_t byte_cycles) {
+  const char *caller = sim_hal_take_caller();
+  sim_hal_enter();
+  int b = (int)(hspi->Instance - sim_spi);
+  if (hspi->State > HAL_SPI_STATE_READY) {
+    // a DMA transfer still owns the peripheral
+    sim_bus_stats[SIM_BUS_SPI1 + b].errors++;
+    sim_hal_leave();
+    return HAL_BUSY;
+  }
+  SimSpiDevice *dev = spi_selected(b);
+  hspi->Instance->enabled = 1; // the HAL sets SPE on first use
+  for (uint16_t i = 0; i < size; i++) {
+    uint8_t miso = dev ? dev->exchange(tx ? tx[i] : 0xFF) : 0xFF;
+    if (rx) {
+      rx[i] = miso;
+    }
+  }
+  uint64_t byte_ns = sim_spi_byte_ns(hspi);
+  uint64_t cpu_ns = cycles_ns(byte_cycles);
+  uint64_t ns = cycles_ns(sim_costs.spi_call_cycles) +
+                (uint64_t)size * (byte_ns > cpu_ns ? byte_ns : cpu_ns);
+  SimBusStats *st = &sim_bus_stats[SIM_BUS_SPI1 + b];
+  st->transactions++;
+  st->bytes += size;
+  st->busy_ns += ns;
+  sim_profile_bus(SIM_BUS_SPI1 + b, caller, size, size * byte_ns, ns);
+  sim_advance_ns(ns);
+  sim_hal_leave();
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                   uint16_t Size, uint32_t Timeout) {
+  (void)Timeout;
+  return spi_xfer(hspi, pData, NULL, Size, sim_costs.spi_poll_byte_cycles);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                  uint16_t Size, uint32_t Timeout) {
+  (void)Timeout;
+  // In 2-line master mode the HAL clocks out the receive buffer as dummy data
+  return spi_xfer(hspi, pData, pData, Size, sim_costs.spi_xfer_byte_cycles);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi,
+                                          uint8_t *pTxData, uint8_t *pRxData,
+                                          uint16_t Size, uint32_t Timeout) {
+  (void)Timeout;
+  return spi_xfer(hspi, pTxData, pRxData, Size,
+                  sim_costs.spi_xfer_byte_cycles);
+}
+
+static struct {
+  SPI_HandleTypeDef *hspi;
+  const uint8_t *tx;
+  uint8_t *rx;
+  uint16_t size;
+} spi_dma[3];
+
+// End of a DMA transfer. The bytes are exchanged with the device only now,
+// so a buffer refilled or a D/C pin flipped before completion corrupts the
+// output the same way it would on the wire, and received data is not there
+// before the completion interrupt.
+static void spi_dma_rx_error(DMA_HandleTypeDef *hdma);
+
+static void spi_dma_done(void *arg) {
+  int b = (int)(intptr_t)arg;
+  SimSpiDevice *dev = spi_selected(b);
+  for (uint16_t i = 0; i < spi_dma[b].size; i++) {
+    uint8_t miso = dev ? dev->exchange(spi_dma[b].tx[i]) : 0xFF;
+    if (spi_dma[b].rx) {
+      spi_dma[b].rx[i] = miso;
+    }
+  }
+  SPI_HandleTypeDef *hspi = spi_dma[b].hspi;
+  if (spi_dma[b].rx && sim_config.spi_rx_overrun &&
+      !--sim_config.spi_rx_overrun) {
+    hspi->hdmarx->XferCpltCallback = spi_dma_rx_error;
+  }
+  dma_complete(spi_dma[b].rx ? hspi->hdmarx : hspi->hdmatx);
+}
+
+static void spi_dma_tx_cplt(DMA_HandleTypeDef *hdma) {
+  SPI_HandleTypeDef *hspi = hdma->Parent;
+  hspi->State = HAL_SPI_STATE_READY;
+  HAL_SPI_TxCpltCallback(hspi);
+}
+
+static void spi_dma_rx_cplt(DMA_HandleTypeDef *hdma) {
+  SPI_HandleTypeDef *hspi = hdma->Parent;
+  hspi->State = HAL_SPI_STATE_READY;
+  HAL_SPI_RxCpltCallback(hspi);
+}
+
+// An RX overrun (sim_config.spi_rx_overrun): the HAL stops the transfer and
+// reports it instead of the completion
+static void spi_dma_rx_error(DMA_HandleTypeDef *hdma) {
+  SPI_HandleTypeDef *hspi = hdma->Parent;
+  sim_bus_stats[SIM_BUS_SPI1 + (hspi->Instance - sim_spi)].errors++;
+  hspi->ErrorCode = HAL_SPI_ERROR_OVR;
+  hspi->State = HAL_SPI_STATE_READY;
+  HAL_SPI_ErrorCallback(hspi);
+}
+
+static HAL_StatusTypeDef spi_dma_start(SPI_HandleTypeDef *hspi,
+                                       const uint8_t *tx, uint8_t *rx,
+                                       uint16_t size, const char *caller) {
+  sim_hal_enter();
+  int b = (int)(hspi->Instance - sim_spi);
+  SimBusStats *st = &sim_bus_stats[SIM_BUS_SPI1 + b];
+  if (hspi->State != HAL_SPI_STATE_READY) {
+    st->errors++;
+    sim_hal_leave();
+    return HAL_BUSY;
+  }
+  // Receive in 2-line master mode runs both channels, like the HAL
+  if (!hspi->hdmatx || (rx && !hspi->hdmarx) || !tx || size == 0) {
+    sim_hal_leave();
+    return HAL_ERROR;
+  }
+
+  DMA_HandleTypeDef *hdma = rx ? hspi->hdmarx : hspi->hdmatx;
+  hspi->State = rx ? HAL_SPI_STATE_BUSY_RX : HAL_SPI_STATE_BUSY_TX;
+  hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+  hspi->Instance->enabled = 1;
+  hdma->State = HAL_DMA_STATE_BUSY;
+  hdma->XferCpltCallback = rx ? spi_dma_rx_cplt : spi_dma_tx_cplt;
+  spi_dma[b].hspi = hspi;
+  spi_dma[b].tx = tx;
+  spi_dma[b].rx = rx;
+  spi_dma[b].size = size;
+
+  // The CPU pays for the setup only; the wire time runs in the background
+  uint64_t setup = cycles_ns(sim_costs.dma_setup_cycles);
+  uint64_t wire = (uint64_t)size * sim_spi_byte_ns(hspi);
+  st->transactions++;
+  st->bytes += size;
+  st->busy_ns += setup + wire;
+  sim_profile_bus(SIM_BUS_SPI1 + b, caller, size, wire, setup);
+  sim_advance_ns(setup);
+  sim_event_at(sim_time_ns() + wire, spi_dma_done, (void *)(intptr_t)b);
+  sim_hal_leave();
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                       uint16_t Size) {
+  return spi_dma_start(hspi, pData, NULL, Size, sim_hal_take_caller());
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData,
+                                      uint16_t Size) {
+  // The receive buffer is clocked out as dummy data, as in HAL_SPI_Receive
+  return spi_dma_start(hspi, pData, pData, Size, sim_hal_take_caller());
+}
+
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi) {
+  return hspi->State;
+}
+
+__attribute__((weak)) void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+__attribute__((weak)) void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+__attribute__((weak)) void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+/********/
+// I2C
+/*******/
+static uint8_t i2c_scratch[2 + 65535];
+
+void sim_i2c_attach(I2C_TypeDef *bus, SimI2cDevice *dev) {
+  int b = (int)(bus - sim_i2c);
+  dev->next = i2c_devices[b];
+  i2c_devices[b] = dev;
+}
+
+__attribute__((weak)) void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c) {
+  (void)hi2c;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c) {
+  HAL_I2C_MspInit(hi2c);
+  hi2c->State = HAL_I2C_STATE_READY;
+  hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter(I2C_HandleTypeDef *hi2c,
+                                               uint32_t AnalogFilter) {
+  (void)hi2c;
+  (void)AnalogFilter;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2CEx_ConfigDigitalFilter(I2C_HandleTypeDef *hi2c,
+                                                uint32_t DigitalFilter) {
+  (void)hi2c;
+  (void)DigitalFilter;
+  return HAL_OK;
+}
+
+uint64_t sim_i2c_bit_ns(const I2C_HandleTypeDef *hi2c) {
+  // I2C_TIMINGR: PRESC[31:28] SCLDEL[23:20] SDADEL[19:16] SCLH[15:8] SCLL[7:0]
+  // All four I2C kernels are clocked from PCLK1 (see HAL_I2C_MspInit).
+  uint32_t t = hi2c->Init.Timing;
+  uint64_t presc = ((t >> 28) & 0xF) + 1;
+  uint64_t sclh = ((t >> 8) & 0xFF) + 1;
+  uint64_t scll = (t & 0xFF) + 1;
+  // plus ~3 kernel clocks of SCL synchronisation per edge
+  uint64_t kernel_clocks = (sclh + scll) * presc + 6;
+  return kernel_clocks * 1000000000ULL / HAL_RCC_GetPCLK1Freq();
+}
+
+static SimI2cDevice *i2c_find(I2C_HandleTypeDef *hi2c, uint16_t addr) {
+  for (SimI2cDevice *d = i2c_devices[hi2c->Instance - sim_i2c]; d;
+       d = d->next) {
+    if (d->addr == (addr & 0xFE)) {
+      return d;
+    }
+  }
+  return NULL;
+}
+
+// An interrupt mode transfer still owns the peripheral
+static int i2c_busy(I2C_HandleTypeDef *hi2c) {
+  if (hi2c->State == HAL_I2C_STATE_BUSY_TX ||
+      hi2c->State == HAL_I2C_STATE_BUSY_RX ||
+      hi2c->State == HAL_I2C_STATE_ABORT) {
+    sim_bus_stats[SIM_BUS_I2C1 + (hi2c->Instance - sim_i2c)].errors++;
+    sim_hal_leave();
+    return 1;
+  }
+  return 0;
+}
+
+// Charges bits of wire time plus clock stretching, honouring Timeout
+static HAL_StatusTypeDef i2c_finish(I2C_HandleTypeDef *hi2c, const char *caller,
+                                    uint64_t bits, uint64_t stretch_ns,
+                                    uint32_t payload, HAL_StatusTypeDef st,
+                                    uint32_t Timeout) {
+  int bus = SIM_BUS_I2C1 + (int)(hi2c->Instance - sim_i2c);
+  SimBusStats *s = &sim_bus_stats[bus];
+  uint64_t ns = cycles_ns(sim_costs.i2c_call_cycles) +
+                bits * sim_i2c_bit_ns(hi2c) + stretch_ns;
+  if (Timeout != HAL_MAX_DELAY &&
+      stretch_ns > (uint64_t)Timeout * SIM_NS_PER_MS) {
+    ns = cycles_ns(sim_costs.i2c_call_cycles) +
+         (uint64_t)Timeout * SIM_NS_PER_MS;
+    st = HAL_TIMEOUT;
+  }
+  s->transactions++;
+  s->bytes += payload;
+  s->busy_ns += ns;
+  if (st != HAL_OK) {
+    s->errors++;
+    hi2c->ErrorCode = st == HAL_TIMEOUT ? HAL_I2C_ERROR_TIMEOUT
+                                        : HAL_I2C_ERROR_AF;
+  } else {
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+  }
+  sim_profile_bus(bus, caller, payload, bits * sim_i2c_bit_ns(hi2c), ns);
+  sim_advance_ns(ns);
+  sim_hal_leave();
+  return st;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef *hi2c,
+                                          uint16_t DevAddress, uint8_t *pData,
+                                          uint16_t Size, uint32_t Timeout) {
+  const char *caller = sim_hal_take_caller();
+  sim_hal_enter();
+  if (i2c_busy(hi2c)) {
+    return HAL_BUSY;
+  }
+  SimI2cDevice *d = i2c_find(hi2c, DevAddress);
+  uint64_t stretch = 0;
+  if (!d || d->write(pData, Size, &stretch) != 0) {
+    return i2c_finish(hi2c, caller, 2 + 9, 0, 0, HAL_ERROR, Timeout);
+  }
+  return i2c_finish(hi2c, caller, 2 + 9ULL * (1 + Size), stretch, Size, HAL_OK,
+                    Timeout);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef *hi2c,
+                                         uint16_t DevAddress, uint8_t *pData,
+                                         uint16_t Size, uint32_t Timeout) {
+  const char *caller = sim_hal_take_caller();
+  sim_hal_enter();
+  if (i2c_busy(hi2c)) {
+    return HAL_BUSY;
+  }
+  SimI2cDevice *d = i2c_find(hi2c, DevAddress);
+  uint64_t stretch = 0;
+  if (!d || d->read(pData, Size, &stretch) != 0) {
+    return i2c_finish(hi2c, caller, 2 + 9, 0, 0, HAL_ERROR, Timeout);
+  }
+  return i2c_finish(hi2c, caller, 2 + 9ULL * (1 + Size), stretch, Size, HAL_OK,
+                    Timeout);
+}
+
+static uint16_t put_mem_addr(uint16_t MemAddress, uint16_t MemAddSize) {
+  if (MemAddSize == I2C_MEMADD_SIZE_16BIT) {
+    i2c_scratch[0] = (uint8_t)(MemAddress >> 8);
+    i2c_scratch[1] = (uint8_t)(MemAddress & 0xFF);
+    return 2;
+  }
+  i2c_scratch[0] = (uint8_t)(MemAddress & 0xFF);
+  return 1;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c,
+                                    uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t *pData,
+                                    uint16_t Size, uint32_t Timeout) {
+  const char *caller = sim_hal_take_caller();
+  sim_hal_enter();
+  if (i2c_busy(hi2c)) {
+    return HAL_BUSY;
+  }
+  SimI2cDevice *d = i2c_find(hi2c, DevAddress);
+  uint16_t m = put_mem_addr(MemAddress, MemAddSize);
+  memcpy(i2c_scratch + m, pData, Size);
+  uint64_t stretch = 0;
+  if (!d || d->write(i2c_scratch, (uint16_t)(m + Size), &stretch) != 0) {
+    return i2c_finish(hi2c, caller, 2 + 9, 0, 0, HAL_ERROR, Timeout);
+  }
+  return i2c_finish(hi2c, caller, 2 + 9ULL * (1 + m + Size), stretch, Size, HAL_OK,
+                    Timeout);
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c,
+                                   uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t *pData,
+                                   uint16_t Size, uint32_t Timeout) {
+  const char *caller = sim_hal_take_caller();
+  sim_hal_enter();
+  if (i2c_busy(hi2c)) {
+    return HAL_BUSY;
+  }
+  SimI2cDevice *d = i2c_find(hi2c, DevAddress);
+  uint16_t m = put_mem_addr(MemAddress, MemAddSize);
+  uint64_t stretch = 0;
+  if (!d || d->write(i2c_scratch, m, &stretch) != 0 ||
+      d->read(pData, Size, &stretch) != 0) {
+    return i2c_finish(hi2c, caller, 2 + 9, 0, 0, HAL_ERROR, Timeout);
+  }
+  // START addr memaddr RESTART addr data STOP
+  return i2c_finish(hi2c, caller, 3 + 9ULL * (2 + m + Size), stretch, Size, HAL_OK,
+                    Timeout);
+}
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c,
+                                        uint16_t DevAddress, uint32_t Trials,
+                                        uint32_t Timeout) {
+  const char *caller = sim_hal_take_caller();
+  sim_hal_enter();
+  if (i2c_busy(hi2c)) {
+    return HAL_BUSY;
+  }
+  SimI2cDevice *d = i2c_find(hi2c, DevAddress);
+  uint32_t tries = d ? 1 : Trials;
+  return i2c_finish(hi2c, caller, tries * (2 + 9), 0, 0, d ? HAL_OK : HAL_ERROR,
+                    Timeout);
+}
+
+/********/
+// I2C interrupt mode
+/*******/
+// The device model sees an interrupt mode transfer when it starts: that is
+// when the address phase is ACKed or NACKed and when a hold-master read
+// starts stretching the clock. Received bytes land in the caller's buffer,
+// and the event or error interrupt is raised, only after the wire time plus
+// clock stretching has passed. Only I2C1 and I2C2 have their IRQs modelled.
+#define SIM_I2C_IT_BUSES 2
+#define SIM_I2C_IT_MAX 32
+
+enum { I2C_IT_DONE = 1, I2C_IT_NACK = 2, I2C_IT_ABORT = 4 };
+
+static const IRQn_Type i2c_ev_irqn[SIM_I2C_IT_BUSES] = {I2C1_EV_IRQn,
+                                                        I2C2_EV_IRQn};
+static const IRQn_Type i2c_er_irqn[SIM_I2C_IT_BUSES] = {I2C1_ER_IRQn,
+                                                        I2C2_ER_IRQn};
+
+// Vector table entries, provided by Core/Src/stm32l4xx_it.c when linked
+extern void I2C1_EV_IRQHandler(void) __attribute__((weak));
+extern void I2C1_ER_IRQHandler(void) __attribute__((weak));
+extern void I2C2_EV_IRQHandler(void) __attribute__((weak));
+extern void I2C2_ER_IRQHandler(void) __attribute__((weak));
+
+static struct {
+  I2C_HandleTypeDef *hi2c;
+  uint8_t *rx; // NULL for a transmit
+  uint16_t size;
+  uint8_t data[SIM_I2C_IT_MAX];
+  int nack;
+  uint32_t seq;    // bumped by an abort so the scheduled end is dropped
+  uint64_t end_ns; // STOP condition
+  uint8_t flags;   // raised, not yet serviced by the IRQ handler
+  uint8_t pending; // raised while the CPU could not take the interrupt
+} i2c_it[SIM_I2C_IT_BUSES];
+
+static void i2c_it_reset(void) { memset(i2c_it, 0, sizeof(i2c_it)); }
+
+static IRQn_Type i2c_irqn(int b) {
+  return (i2c_it[b].flags & I2C_IT_NACK) ? i2c_er_irqn[b] : i2c_ev_irqn[b];
+}
+
+static void i2c_fire(int b) {
+  static void (*const ev[SIM_I2C_IT_BUSES])(void) = {I2C1_EV_IRQHandler,
+                                                     I2C2_EV_IRQHandler};
+  static void (*const er[SIM_I2C_IT_BUSES])(void) = {I2C1_ER_IRQHandler,
+                                                     I2C2_ER_IRQHandler};
+  I2C_HandleTypeDef *hi2c = i2c_it[b].hi2c;
+  sim_isr_enter();
+  if (i2c_it[b].flags & I2C_IT_NACK) {
+    if (er[b]) {
+      er[b]();
+    } else {
+      HAL_I2C_ER_IRQHandler(hi2c);
+    }
+  } else if (ev[b]) {
+    ev[b]();
+  } else {
+    HAL_I2C_EV_IRQHandler(hi2c);
+  }
+  sim_isr_leave();
+}
+
+static void i2c_raise(int b, uint8_t flag) {
+  i2c_it[b].flags |= flag;
+  if (sim_in_isr() || irq_masked ||
+      !(nvic_enabled & (1ULL << i2c_irqn(b)))) {
+    i2c_it[b].pending = 1;
+    return;
+  }
+  i2c_fire(b);
+}
+
+static void i2c_dispatch_pending(void) {
+  for (int b = 0; b < SIM_I2C_IT_BUSES; b++) {
+    if (i2c_it[b].pending && (nvic_enabled & (1ULL << i2c_irqn(b)))) {
+      i2c_it[b].pending = 0;
+      i2c_fire(b);
+    }
+  }
+}
+
+static void i2c_it_end(void *arg) {
+  uintptr_t v = (uintptr_t)arg;
+  int b = (int)(v & 1);
+  if ((uint32_t)(v >> 1) != i2c_it[b].seq) {
+    return; // aborted
+  }
+  if (i2c_it[b].rx && !i2c_it[b].nack) {
+    memcpy(i2c_it[b].rx, i2c_it[b].data, i2c_it[b].size);
+  }
+  i2c_raise(b, i2c_it[b].nack ? I2C_IT_NACK : I2C_IT_DONE);
+}
+
+static HAL_StatusTypeDef i2c_it_start(I2C_HandleTypeDef *hi2c, uint16_t addr,
+                                      uint8_t *pData, uint16_t Size, int rx,
+                                      const char *caller) {
+  sim_hal_enter();
+  int b = (int)(hi2c->Instance - sim_i2c);
+  if (b >= SIM_I2C_IT_BUSES || Size > SIM_I2C_IT_MAX) {
+    sim_hal_leave();
+    return HAL_ERROR;
+  }
+  if (i2c_busy(hi2c)) {
+    return HAL_BUSY;
+  }
+  int bus = SIM_BUS_I2C1 + b;
+  SimBusStats *s = &sim_bus_stats[bus];
+  SimI2cDevice *d = i2c_find(hi2c, addr);
+  uint64_t stretch = 0;
+  int nack = !d || (rx ? d->read(i2c_it[b].data, Size, &stretch)
+                       : d->write(pData, Size, &stretch)) != 0;
+  uint64_t wire = (nack ? 2 + 9 : 2 + 9ULL * (1 + Size)) * sim_i2c_bit_ns(hi2c);
+  uint64_t setup = cycles_ns(sim_costs.i2c_call_cycles);
+  if (nack) {
+    stretch = 0;
+    s->errors++;
+  }
+
+  hi2c->State = rx ? HAL_I2C_STATE_BUSY_RX : HAL_I2C_STATE_BUSY_TX;
+  hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+  i2c_it[b].hi2c = hi2c;
+  i2c_it[b].rx = rx ? pData : NULL;
+  i2c_it[b].size = Size;
+  i2c_it[b].nack = nack;
+  i2c_it[b].flags = 0;
+  s->transactions++;
+  s->bytes += nack ? 0 : Size;
+  s->busy_ns += setup + wire + stretch;
+  sim_profile_bus(bus, caller, nack ? 0 : Size, wire, setup);
+
+  // The CPU pays for the setup only; address, data and stretching run on
+  sim_advance_ns(setup);
+  i2c_it[b].end_ns = sim_time_ns() + wire + stretch;
+  sim_event_at(i2c_it[b].end_ns, i2c_it_end,
+               (void *)(uintptr_t)(b | (uintptr_t)i2c_it[b].seq << 1));
+  sim_hal_leave();
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef *hi2c,
+                                             uint16_t DevAddress,
+                                             uint8_t *pData, uint16_t Size) {
+  return i2c_it_start(hi2c, DevAddress, pData, Size, 0, sim_hal_take_caller());
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT(I2C_HandleTypeDef *hi2c,
+                                            uint16_t DevAddress,
+                                            uint8_t *pData, uint16_t Size) {
+  return i2c_it_start(hi2c, DevAddress, pData, Size, 1, sim_hal_take_caller());
+}
+
+// Sends STOP at once; the bus is charged only up to here
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT(I2C_HandleTypeDef *hi2c,
+                                          uint16_t DevAddress) {
+  (void)DevAddress;
+  sim_hal_enter();
+  int b = (int)(hi2c->Instance - sim_i2c);
+  if (b >= SIM_I2C_IT_BUSES || (hi2c->State != HAL_I2C_STATE_BUSY_TX &&
+                                hi2c->State != HAL_I2C_STATE_BUSY_RX)) {
+    sim_hal_leave();
+    return HAL_ERROR;
+  }
+  SimBusStats *s = &sim_bus_stats[SIM_BUS_I2C1 + b];
+  uint64_t now = sim_time_ns();
+  if (i2c_it[b].end_ns > now) {
+    s->busy_ns -= i2c_it[b].end_ns - now;
+  }
+  s->errors++;
+  i2c_it[b].seq++;
+  i2c_it[b].flags = 0;
+  hi2c->State = HAL_I2C_STATE_ABORT;
+  i2c_raise(b, I2C_IT_ABORT);
+  sim_hal_leave();
+  return HAL_OK;
+}
+
+HAL_I2C_StateTypeDef HAL_I2C_GetState(I2C_HandleTypeDef *hi2c) {
+  return hi2c->State;
+}
+
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c) { return hi2c->ErrorCode; }
+
+void HAL_I2C_EV_IRQHandler(I2C_HandleTypeDef *hi2c) {
+  int b = (int)(hi2c->Instance - sim_i2c);
+  if (b >= SIM_I2C_IT_BUSES) {
+    return;
+  }
+  uint8_t f = i2c_it[b].flags;
+  if (f & I2C_IT_ABORT) {
+    i2c_it[b].flags = 0;
+    hi2c->State = HAL_I2C_STATE_READY;
+    HAL_I2C_AbortCpltCallback(hi2c);
+  } else if (f & I2C_IT_DONE) {
+    i2c_it[b].flags &= (uint8_t)~I2C_IT_DONE;
+    HAL_I2C_StateTypeDef was = hi2c->State;
+    hi2c->State = HAL_I2C_STATE_READY;
+    if (was == HAL_I2C_STATE_BUSY_RX) {
+      HAL_I2C_MasterRxCpltCallback(hi2c);
+    } else {
+      HAL_I2C_MasterTxCpltCallback(hi2c);
+    }
+  }
+}
+
+void HAL_I2C_ER_IRQHandler(I2C_HandleTypeDef *hi2c) {
+  int b = (int)(hi2c->Instance - sim_i2c);
+  if (b >= SIM_I2C_IT_BUSES || !(i2c_it[b].flags & I2C_IT_NACK)) {
+    return;
+  }
+  i2c_it[b].flags &= (uint8_t)~I2C_IT_NACK;
+  hi2c->State = HAL_I2C_STATE_READY;
+  hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+  HAL_I2C_ErrorCallback(hi2c);
+}
+
+__attribute__((weak)) void HAL_I2C_MasterTxCpltCallback(
+    I2C_HandleTypeDef *hi2c) {
+  (void)hi2c;
+}
+
+__attribute__((weak)) void HAL_I2C_MasterRxCpltCallback(
+    I2C_HandleTypeDef *hi2c) {
+  (void)hi2c;
+}
+
+__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+  (void)hi2c;
+}
+
+__attribute__((weak)) void HAL_I2C_AbortCpltCallback(I2C_HandleTypeDef *hi2c) {
+  (void)hi2c;
+}
+
+/********/
+// LPUART
+/*******/
+__attribute__((weak)) void HAL_UART_MspInit(UART_HandleTypeDef *huart) {
+  (void)huart;
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart) {
+  HAL_UART_MspInit(huart);
+  huart->gState = HAL_UART_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_SetTxFifoThreshold(UART_HandleTypeDef *huart,
+                                                uint32_t Threshold) {
+  (void)huart;
+  (void)Threshold;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_SetRxFifoThreshold(UART_HandleTypeDef *huart,
+                                                uint32_t Threshold) {
+  (void)huart;
+  (void)Threshold;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_DisableFifoMode(UART_HandleTypeDef *huart) {
+  (void)huart;
+  return HAL_OK;
+}
+
+uint64_t sim_uart_byte_ns(const UART_HandleTypeDef *huart) {
+  uint32_t baud = huart->Init.BaudRate ? huart->Init.BaudRate : 115200;
+  return 10ULL * 1000000000ULL / baud; // 8N1: start + 8 data + stop
+}
+
+void (*sim_uart_tap)(const uint8_t *data, uint16_t len);
+static int uart_pty = -1;
+
+int sim_uart_open_pty(char *name, size_t size) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0 || grantpt(fd) || unlockpt(fd) || ptsname_r(fd, name, size)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  // Raw like a serial port, so the binary trace frames pass unchanged
+  struct termios t;
+  if (tcgetattr(fd, &t) == 0) {
+    cfmakeraw(&t);
+    tcsetattr(fd, TCSANOW, &t);
+  }
+  // A slow reader loses bytes rather than stalling virtual time
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  uart_pty = fd;
+  return 0;
+}
+
+// Bytes leaving the TX pin
+static void uart_out(const uint8_t *data, uint16_t len) {
+  if (sim_config.uart_echo) {
+    fwrite(data, 1, len, stdout);
+  }
+  if (uart_pty >= 0 && write(uart_pty, data, len) != (ssize_t)len) {
+    sim_bus_stats[SIM_BUS_LPUART1].errors++;
+  }
+  if (sim_uart_tap) {
+    sim_uart_tap(data, len);
+  }
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart,
+                                    const uint8_t *pData, uint16_t Size,
+                                    uint32_t Timeout) {
+  const char *caller = sim_hal_take_caller();
+  if (huart->gState != HAL_UART_STATE_READY) {
+    return HAL_BUSY;
+  }
+  sim_hal_enter();
+  uint64_t wire = (uint64_t)Size * sim_uart_byte_ns(huart);
+  HAL_StatusTypeDef st = HAL_OK;
+  if (Timeout != HAL_MAX_DELAY && wire > (uint64_t)Timeout * SIM_NS_PER_MS) {
+    wire = (uint64_t)Timeout * SIM_NS_PER_MS;
+    st = HAL_TIMEOUT;
+  }
+  uart_out(pData, Size);
+  uint64_t ns = cycles_ns(sim_costs.uart_call_cycles) + wire;
+  SimBusStats *s = &sim_bus_stats[SIM_BUS_LPUART1];
+  s->transactions++;
+  s->bytes += Size;
+  s->busy_ns += ns;
+  sim_profile_bus(SIM_BUS_LPUART1, caller, Size, wire, ns);
+  sim_advance_ns(ns);
+  sim_hal_leave();
+  return st;
+}
+
+// As with SPI, the bytes are taken from the buffer only at the end of the
+// wire time, so one rewritten before completion goes out corrupted
+static struct {
+  UART_HandleTypeDef *huart;
+  const uint8_t *data;
+  uint16_t size;
+} uart_dma;
+
+static void uart_dma_done(void *arg) {
+  (void)arg;
+  uart_out(uart_dma.data, uart_dma.size);
+  dma_complete(uart_dma.huart->hdmatx);
+}
+
+static void uart_dma_tx_cplt(DMA_HandleTypeDef *hdma) {
+  UART_HandleTypeDef *huart = hdma->Parent;
+  huart->gState = HAL_UART_STATE_READY;
+  HAL_UART_TxCpltCallback(huart);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart,
+                                        const uint8_t *pData, uint16_t Size) {
+  const char *caller = sim_hal_take_caller();
+  SimBusStats *st = &sim_bus_stats[SIM_BUS_LPUART1];
+  if (huart->gState != HAL_UART_STATE_READY) {
+    st->errors++;
+    return HAL_BUSY;
+  }
+  if (!huart->hdmatx || !pData || Size == 0) {
+    return HAL_ERROR;
+  }
+  sim_hal_enter();
+  huart->gState = HAL_UART_STATE_BUSY_TX;
+  huart->hdmatx->State = HAL_DMA_STATE_BUSY;
+  huart->hdmatx->XferCpltCallback = uart_dma_tx_cplt;
+  uart_dma.huart = huart;
+  uart_dma.data = pData;
+  uart_dma.size = Size;
+
+  uint64_t setup = cycles_ns(sim_costs.dma_setup_cycles);
+  uint64_t wire = (uint64_t)Size * sim_uart_byte_ns(huart);
+  st->transactions++;
+  st->bytes += Size;
+  st->busy_ns += setup + wire;
+  sim_profile_bus(SIM_BUS_LPUART1, caller, Size, wire, setup);
+  sim_advance_ns(setup);
+  sim_event_at(sim_time_ns() + wire, uart_dma_done, NULL);
+  sim_hal_leave();
+  return HAL_OK;
+}
+
+HAL_UART_StateTypeDef HAL_UART_GetState(UART_HandleTypeDef *huart) {
+  return huart->gState;
+}
+
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart) { (void)huart; }
+
+__attribute__((weak)) void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  (void)huart;
+}
+
+/********/
+// printf retargeting
+/*******/
+// On target newlib's printf ends in _write(), whose weak version in
+// syscalls.c hands each byte to __io_putchar(). The host link wraps printf
+// onto the same path, so firmware overriding either one is honoured.
+__attribute__((weak)) int __io_putchar(int ch) {
+  extern UART_HandleTypeDef hlpuart1;
+  HAL_UART_Transmit(&hlpuart1, (uint8_t *)&ch, 1, 10);
+  return ch;
+}
+
+__attribute__((weak)) int _write(int file, char *ptr, int len) {
+  (void)file;
+  for (int i = 0; i < len; i++) {
+    __io_putchar((unsigned char)ptr[i]);
+  }
+  return len;
+}
+
+int __wrap_printf(const char *fmt, ...) {
+  sim_hal_caller_override("printf");
+  char small[256];
+  char *buf = small;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(small, sizeof(small), fmt, ap);
+  va_end(ap);
+  if (n < 0) {
+    sim_hal_caller_override(NULL);
+    return n;
+  }
+  if ((size_t)n >= sizeof(small)) {
+    buf = malloc((size_t)n + 1);
+    if (!buf) {
+      sim_hal_caller_override(NULL);
+      return -1;
+    }
+    va_start(ap, fmt);
+    vsnprintf(buf, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+  }
+  _write(1, buf, n);
+  if (buf != small) {
+    free(buf);
+  }
+  sim_hal_caller_override(NULL);
+  return n;
+}
@@ -0,0 +1,142 @@
+/*
+ * sim_main.c
+ *
+ * Command line front end: runs the unmodified firmware main() (built as
+ * app_main) against the simulated board for a given span of virtual time.
+ *
+ *   plantpot_sim [--ms N] [--fb-out screen.ppm] [--camera-ppm scene.ppm]
+ *                [--touch T:X:Y]... [--cpu-scale F] [--quiet-uart] [--profile]
+ *                [--uart-pty]
+ *                [--rh P] [--temp C] [--soil N] [--soil-temp C] [--lux L]
+ *
+ * --uart-pty sends LPUART1 to a pseudo terminal instead of stdout, so the
+ * log can be followed (cat /dev/pts/N) while the --profile report on
+ * stderr is being read. The pty carries trace frames as sent; pipe it
+ * through plantpot_tracedump with this executable as the ELF. On stdout
+ * they are decoded already.
+ */
+
+#include "sim.h"
+#include "trace_decode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int app_main(void);
+
+static void run_app(void) { app_main(); }
+
+static TraceDecoder trace_decoder;
+
+static void echo_text(const char *text, size_t len, void *ctx) {
+  (void)ctx;
+  fwrite(text, 1, len, stdout);
+}
+
+static void echo_decoded(const uint8_t *data, uint16_t len) {
+  trace_decoder_feed(&trace_decoder, data, len, echo_text, NULL);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--ms N] [--fb-out FILE] [--camera-ppm FILE]\n"
+          "       [--touch T_MS:X:Y]... [--cpu-scale F] [--quiet-uart]\n"
+          "       [--profile] [--uart-pty]\n"
+          "       [--rh P] [--temp C] [--soil N] [--soil-temp C] [--lux L]\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  uint64_t run_ms = 5000;
+  const char *fb_out = NULL;
+  const char *camera_ppm = NULL;
+  uint32_t touch_t[32];
+  unsigned touch_x[32], touch_y[32];
+  int touches = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!strcmp(a, "--quiet-uart")) {
+      sim_config.uart_echo = 0;
+      continue;
+    }
+    if (!strcmp(a, "--profile")) {
+      sim_config.profile = 1;
+      continue;
+    }
+    if (!strcmp(a, "--uart-pty")) {
+      char pty[64];
+      if (sim_uart_open_pty(pty, sizeof(pty)) != 0) {
+        fprintf(stderr, "[SIM][ERR] cannot open a pty for LPUART1\n");
+        return 1;
+      }
+      fprintf(stderr, "[SIM] LPUART1 on %s\n", pty);
+      sim_config.uart_echo = 0;
+      continue;
+    }
+    if (!v) {
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+    if (!strcmp(a, "--ms")) {
+      run_ms = strtoull(v, NULL, 0);
+    } else if (!strcmp(a, "--fb-out")) {
+      fb_out = v;
+    } else if (!strcmp(a, "--camera-ppm")) {
+      camera_ppm = v;
+    } else if (!strcmp(a, "--touch") && touches < 32) {
+      if (sscanf(v, "%u:%u:%u", &touch_t[touches], &touch_x[touches],
+                 &touch_y[touches]) != 3) {
+        usage(argv[0]);
+        return 2;
+      }
+      touches++;
+    } else if (!strcmp(a, "--cpu-scale")) {
+      sim_config.cpu_scale = atof(v);
+    } else if (!strcmp(a, "--rh")) {
+      sim_env.air_rh = (float)atof(v);
+    } else if (!strcmp(a, "--temp")) {
+      sim_env.air_temp_c = (float)atof(v);
+    } else if (!strcmp(a, "--soil")) {
+      sim_env.soil_cap = (uint16_t)atoi(v);
+    } else if (!strcmp(a, "--soil-temp")) {
+      sim_env.soil_temp_c = (float)atof(v);
+    } else if (!strcmp(a, "--lux")) {
+      sim_env.lux = (float)atof(v);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  // the firmware's trace format strings are in this executable
+  if (sim_config.uart_echo &&
+      trace_decoder_load_elf(&trace_decoder, "/proc/self/exe") == 0) {
+    sim_config.uart_echo = 0;
+    sim_uart_tap = echo_decoded;
+  }
+
+  sim_config.stop_ns = run_ms * SIM_NS_PER_MS;
+  sim_init();
+  if (camera_ppm && sim_arducam_load_ppm(camera_ppm) != 0) {
+    fprintf(stderr, "[SIM][ERR] cannot load %s (binary P6, maxval 255)\n",
+            camera_ppm);
+    return 1;
+  }
+  for (int i = 0; i < touches; i++) {
+    sim_touch_script(touch_t[i], (uint16_t)touch_x[i], (uint16_t)touch_y[i]);
+  }
+
+  sim_run(run_app);
+  fflush(stdout);
+  sim_report();
+
+  if (fb_out && sim_tft_dump_ppm(fb_out) != 0) {
+    fprintf(stderr, "[SIM][ERR] cannot write %s\n", fb_out);
+    return 1;
+  }
+  return 0;
+}
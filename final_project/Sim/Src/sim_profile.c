@@ -0,0 +1,252 @@
+/*
+ * sim_profile.c
+ *
+ * Bus-traffic and virtual-time profiler. Every SPI/I2C/UART transfer and
+ * HAL_Delay is booked twice: against the function that issued it and
+ * against the main-loop phase that was active. At each PROFILE_LOOP_END()
+ * the phase breakdown of that iteration is printed when profiling is on.
+ */
+
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROF_MAX_CALLERS 64
+#define PROF_MAX_PHASES 12
+#define PROF_DELAY SIM_BUS_COUNT // pseudo bus index for HAL_Delay
+
+typedef struct {
+  int bus;
+  const char *caller;
+  uint64_t calls;
+  uint64_t bytes;
+  uint64_t wire_ns;
+  uint64_t busy_ns;
+} CallerStat;
+
+typedef struct {
+  const char *name;
+  uint64_t ns;
+  uint64_t bytes[SIM_BUS_COUNT];
+  uint64_t busy_ns[SIM_BUS_COUNT];
+  uint64_t delay_ns;
+} PhaseStat;
+
+const char *sim_hal_caller;
+
+static struct {
+  const char *name;
+  int isr_depth;
+} caller_override;
+
+static CallerStat callers[PROF_MAX_CALLERS];
+static int caller_count;
+static PhaseStat loop_phases[PROF_MAX_PHASES];
+static PhaseStat total_phases[PROF_MAX_PHASES];
+static int phase_count;
+static int cur_phase;
+static uint64_t phase_start_ns;
+static uint64_t loop_start_ns;
+static uint32_t loops;
+static uint64_t loop_ns_total;
+
+/********/
+// Caller tagging
+/*******/
+const char *sim_hal_take_caller(void) {
+  const char *c = sim_hal_caller;
+  // printf tags everything below it, but not an ISR that preempts it
+  if (caller_override.name && caller_override.isr_depth == sim_in_isr()) {
+    c = caller_override.name;
+  }
+  sim_hal_caller = NULL;
+  return c ? c : "?";
+}
+
+void sim_hal_caller_override(const char *name) {
+  caller_override.name = name;
+  caller_override.isr_depth = sim_in_isr();
+}
+
+/********/
+// Phases
+/*******/
+static int phase_index(const char *name) {
+  for (int i = 0; i < phase_count; i++) {
+    if (!strcmp(loop_phases[i].name, name)) {
+      return i;
+    }
+  }
+  if (phase_count == PROF_MAX_PHASES) {
+    return PROF_MAX_PHASES - 1;
+  }
+  loop_phases[phase_count].name = name;
+  total_phases[phase_count].name = name;
+  return phase_count++;
+}
+
+static void close_phase(void) {
+  uint64_t now = sim_time_ns();
+  loop_phases[cur_phase].ns += now - phase_start_ns;
+  phase_start_ns = now;
+}
+
+void sim_profile_reset(void) {
+  memset(callers, 0, sizeof(callers));
+  memset(loop_phases, 0, sizeof(loop_phases));
+  memset(total_phases, 0, sizeof(total_phases));
+  caller_count = 0;
+  phase_count = 0;
+  loops = 0;
+  loop_ns_total = 0;
+  sim_hal_caller = NULL;
+  caller_override.name = NULL;
+  cur_phase = phase_index("init");
+  phase_start_ns = loop_start_ns = sim_time_ns();
+}
+
+void sim_profile_phase(const char *name) {
+  close_phase();
+  if (loops == 0 && cur_phase == 0) {
+    loop_start_ns = sim_time_ns(); // boot ends at the first phase marker
+  }
+  cur_phase = phase_index(name);
+}
+
+static void fold_phase(PhaseStat *dst, const PhaseStat *src) {
+  dst->ns += src->ns;
+  dst->delay_ns += src->delay_ns;
+  for (int b = 0; b < SIM_BUS_COUNT; b++) {
+    dst->bytes[b] += src->bytes[b];
+    dst->busy_ns[b] += src->busy_ns[b];
+  }
+}
+
+static uint64_t phase_bytes(const PhaseStat *p) {
+  uint64_t n = 0;
+  for (int b = 0; b < SIM_BUS_COUNT; b++) {
+    n += p->bytes[b];
+  }
+  return n;
+}
+
+void sim_profile_loop_end(void) {
+  close_phase();
+  uint64_t now = sim_time_ns();
+  if (sim_config.profile) {
+    fprintf(stderr, "[PROF] loop %u: %.1f ms", loops,
+            (now - loop_start_ns) / 1e6);
+    for (int i = 0; i < phase_count; i++) {
+      PhaseStat *p = &loop_phases[i];
+      if (p->ns && i != 0) {
+        fprintf(stderr, " | %s %.1f ms/%.1f kB", p->name, p->ns / 1e6,
+                phase_bytes(p) / 1e3);
+      }
+    }
+    fprintf(stderr, "\n");
+  }
+  for (int i = 0; i < phase_count; i++) {
+    fold_phase(&total_phases[i], &loop_phases[i]);
+    const char *name = loop_phases[i].name;
+    memset(&loop_phases[i], 0, sizeof(loop_phases[i]));
+    loop_phases[i].name = name;
+  }
+  loop_ns_total += now - loop_start_ns;
+  loops++;
+  loop_start_ns = now;
+  cur_phase = phase_index("other");
+}
+
+/********/
+// Recording
+/*******/
+static CallerStat *caller_stat(int bus, const char *caller) {
+  for (int i = 0; i < caller_count; i++) {
+    if (callers[i].bus == bus && !strcmp(callers[i].caller, caller)) {
+      return &callers[i];
+    }
+  }
+  if (caller_count == PROF_MAX_CALLERS) {
+    return NULL;
+  }
+  callers[caller_count].bus = bus;
+  callers[caller_count].caller = caller;
+  return &callers[caller_count++];
+}
+
+void sim_profile_bus(int bus, const char *caller, uint32_t bytes,
+                     uint64_t wire_ns, uint64_t busy_ns) {
+  CallerStat *c = caller_stat(bus, caller);
+  if (c) {
+    c->calls++;
+    c->bytes += bytes;
+    c->wire_ns += wire_ns;
+    c->busy_ns += busy_ns;
+  }
+  loop_phases[cur_phase].bytes[bus] += bytes;
+  loop_phases[cur_phase].busy_ns[bus] += busy_ns;
+}
+
+void sim_profile_delay(const char *caller, uint64_t ns) {
+  CallerStat *c = caller_stat(PROF_DELAY, caller);
+  if (c) {
+    c->calls++;
+    c->busy_ns += ns;
+  }
+  loop_phases[cur_phase].delay_ns += ns;
+}
+
+/********/
+// Report
+/*******/
+static int by_busy_desc(const void *a, const void *b) {
+  const CallerStat *x = a, *y = b;
+  return x->busy_ns < y->busy_ns ? 1 : x->busy_ns > y->busy_ns ? -1 : 0;
+}
+
+void sim_profile_report(void) {
+  if (!sim_config.profile) {
+    return;
+  }
+  CallerStat sorted[PROF_MAX_CALLERS];
+  memcpy(sorted, callers, sizeof(CallerStat) * caller_count);
+  qsort(sorted, caller_count, sizeof(CallerStat), by_busy_desc);
+
+  fprintf(stderr, "\n=== bus traffic by caller ===\n");
+  fprintf(stderr, "%-8s %-26s %9s %10s %10s %10s\n", "bus", "caller", "calls",
+          "bytes", "wire ms", "busy ms");
+  for (int i = 0; i < caller_count; i++) {
+    CallerStat *c = &sorted[i];
+    const char *bus =
+        c->bus == PROF_DELAY ? "delay" : sim_bus_stats[c->bus].name;
+    fprintf(stderr, "%-8s %-26s %9llu %10llu %10.3f %10.3f\n", bus, c->caller,
+            (unsigned long long)c->calls, (unsigned long long)c->bytes,
+            c->wire_ns / 1e6, c->busy_ns / 1e6);
+  }
+
+  if (loops == 0) {
+    return;
+  }
+  fprintf(stderr, "\n=== main loop phases (%u loops, mean per loop) ===\n",
+          loops);
+  fprintf(stderr, "%-10s %9s %6s %9s %9s %9s %9s %9s\n", "phase", "ms", "%",
+          "SPI1 B", "I2C2 B", "I2C4 B", "UART B", "delay ms");
+  for (int i = 0; i < phase_count; i++) {
+    PhaseStat *p = &total_phases[i];
+    if (i == 0 || p->ns == 0) {
+      continue; // "init" is reported once below
+    }
+    fprintf(stderr, "%-10s %9.2f %6.1f %9llu %9llu %9llu %9llu %9.2f\n",
+            p->name, p->ns / 1e6 / loops, 100.0 * p->ns / loop_ns_total,
+            (unsigned long long)(p->bytes[SIM_BUS_SPI1] / loops),
+            (unsigned long long)(p->bytes[SIM_BUS_I2C2] / loops),
+            (unsigned long long)(p->bytes[SIM_BUS_I2C4] / loops),
+            (unsigned long long)(p->bytes[SIM_BUS_LPUART1] / loops),
+            p->delay_ns / 1e6 / loops);
+  }
+  fprintf(stderr, "%-10s %9.2f\n", "loop", loop_ns_total / 1e6 / loops);
+  fprintf(stderr, "%-10s %9.2f (boot, once)\n", "init",
+          total_phases[0].ns / 1e6);
+}
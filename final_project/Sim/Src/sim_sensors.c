@@ -0,0 +1,415 @@
+/*
+ * sim_sensors.c
+ *
+ * Virtual FT6206 touch controller (I2C1, INT on PF9), the three I2C2
+ * sensors (Si7021, Seesaw soil probe, BH1750) and the pump output on PB2.
+ *
+ * Conversion times follow the datasheets so that a driver which reads too
+ * early gets what the real part would give it: a NACK (Si7021 no-hold), a
+ * stretched clock (Si7021 hold master), 0xFF filler (Seesaw) or a stale
+ * register (BH1750). Early reads are counted for the report.
+ */
+
+#include "sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+SimEnvironment sim_env = {
+    .air_rh = 45.0f,
+    .air_temp_c = 22.5f,
+    .soil_cap = 950,
+    .soil_temp_c = 20.0f,
+    .lux = 1200.0f,
+};
+
+static uint32_t early_reads;
+
+uint32_t sim_sensors_early_reads(void) { return early_reads; }
+
+static uint64_t ready_in(uint64_t ready_at) {
+  uint64_t now = sim_time_ns();
+  return ready_at > now ? ready_at - now : 0;
+}
+
+/********/
+// FT6206
+/*******/
+#define FT_ADDR (0x38 << 1)
+#define FT_HOLD_NS (60 * SIM_NS_PER_MS)
+#define FT_MAX_SCRIPT 32
+
+static struct {
+  uint8_t regs[256];
+  uint8_t ptr;
+  int in_reset;
+} ft;
+
+static struct {
+  uint16_t x, y;
+} touch_script[FT_MAX_SCRIPT];
+static int touch_count;
+
+static void ft_defaults(void) {
+  memset(ft.regs, 0, sizeof(ft.regs));
+  ft.regs[0xA3] = 0x06; // chip id: FT6206
+  ft.regs[0xA8] = 0x11; // FocalTech vendor id
+}
+
+static void ft_rst_pin(GPIO_PinState state) {
+  ft.in_reset = state == GPIO_PIN_RESET;
+  if (ft.in_reset) {
+    ft_defaults();
+  }
+}
+
+static int ft_write(const uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  if (ft.in_reset) {
+    return -1;
+  }
+  if (len) {
+    ft.ptr = data[0];
+    for (uint16_t i = 1; i < len; i++) {
+      ft.regs[ft.ptr++] = data[i];
+    }
+  }
+  return 0;
+}
+
+static int ft_read(uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  if (ft.in_reset) {
+    return -1;
+  }
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = ft.regs[ft.ptr++];
+  }
+  return 0;
+}
+
+static SimI2cDevice ft_dev = {
+    .name = "FT6206",
+    .addr = FT_ADDR,
+    .write = ft_write,
+    .read = ft_read,
+};
+
+static void ft_release(void *arg) {
+  (void)arg;
+  ft.regs[0x02] = 0;
+  ft.regs[0x03] = 0x40; // event flag: lift up
+  sim_gpio_drive(GPIOF, GPIO_PIN_9, GPIO_PIN_SET);
+}
+
+static void ft_press(void *arg) {
+  int i = (int)(intptr_t)arg;
+  // touch.c maps panel (raw_x, raw_y) to screen (raw_y, 320 - raw_x)
+  uint16_t raw_x = (uint16_t)(320 - touch_script[i].y);
+  uint16_t raw_y = touch_script[i].x;
+  ft.regs[0x02] = 1;
+  ft.regs[0x03] = (uint8_t)(0x80 | (raw_x >> 8)); // event flag: contact
+  ft.regs[0x04] = (uint8_t)(raw_x & 0xFF);
+  ft.regs[0x05] = (uint8_t)(raw_y >> 8);
+  ft.regs[0x06] = (uint8_t)(raw_y & 0xFF);
+  sim_event_at(sim_time_ns() + FT_HOLD_NS, ft_release, NULL);
+  sim_gpio_drive(GPIOF, GPIO_PIN_9, GPIO_PIN_RESET);
+}
+
+int sim_touch_script(uint32_t at_ms, uint16_t x, uint16_t y) {
+  if (touch_count >= FT_MAX_SCRIPT) {
+    return -1;
+  }
+  touch_script[touch_count].x = x;
+  touch_script[touch_count].y = y;
+  sim_event_at((uint64_t)at_ms * SIM_NS_PER_MS, ft_press,
+               (void *)(intptr_t)touch_count);
+  touch_count++;
+  return 0;
+}
+
+/********/
+// Si7021
+/*******/
+#define SI_ADDR (0x40 << 1)
+#define SI_RH_NS 12000000ULL   // 12-bit RH conversion
+#define SI_TEMP_NS 10800000ULL // 14-bit temperature conversion
+#define SI_RESET_NS 15000000ULL
+
+static struct {
+  uint8_t cmd;
+  int hold;
+  uint64_t ready_at;
+  uint16_t result;
+  uint16_t last_temp; // kept from the last RH conversion for 0xE0
+} si;
+
+static uint16_t si_raw_rh(void) {
+  float v = (sim_env.air_rh + 6.0f) * 65536.0f / 125.0f;
+  return (uint16_t)v & 0xFFFC;
+}
+
+static uint16_t si_raw_temp(void) {
+  float v = (sim_env.air_temp_c + 46.85f) * 65536.0f / 175.72f;
+  return (uint16_t)v & 0xFFFC;
+}
+
+static int si_write(const uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  uint64_t now = sim_time_ns();
+  if (now < si.ready_at && si.cmd == 0xFE) {
+    return -1; // still booting after a reset
+  }
+  if (!len) {
+    return 0;
+  }
+  si.cmd = data[0];
+  switch (si.cmd) {
+  case 0xE5: // RH, hold master
+  case 0xF5: // RH, no hold
+    si.hold = si.cmd == 0xE5;
+    si.ready_at = now + SI_RH_NS + SI_TEMP_NS;
+    si.last_temp = si_raw_temp();
+    si.result = si_raw_rh();
+    break;
+  case 0xE3: // temperature, hold master
+  case 0xF3: // temperature, no hold
+    si.hold = si.cmd == 0xE3;
+    si.ready_at = now + SI_TEMP_NS;
+    si.result = si_raw_temp();
+    break;
+  case 0xE0: // temperature from the previous RH measurement
+    si.hold = 0;
+    si.ready_at = now;
+    si.result = si.last_temp;
+    break;
+  case 0xFE: // reset
+    si.ready_at = now + SI_RESET_NS;
+    break;
+  default:
+    break;
+  }
+  return 0;
+}
+
+static int si_read(uint8_t *data, uint16_t len, uint64_t *stretch) {
+  uint64_t wait = ready_in(si.ready_at);
+  if (wait) {
+    if (!si.hold) {
+      early_reads++;
+      return -1; // no-hold mode NACKs the read header until done
+    }
+    *stretch += wait; // hold master: SCL held low until the result is ready
+  }
+  uint8_t out[3] = {(uint8_t)(si.result >> 8), (uint8_t)(si.result & 0xFF),
+                    0x00};
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = i < 3 ? out[i] : 0xFF;
+  }
+  return 0;
+}
+
+static SimI2cDevice si_dev = {
+    .name = "Si7021",
+    .addr = SI_ADDR,
+    .write = si_write,
+    .read = si_read,
+};
+
+/********/
+// Seesaw soil sensor
+/*******/
+#define SS_ADDR (0x36 << 1)
+#define SS_TOUCH_NS 2500000ULL // capacitive touch measurement
+#define SS_TEMP_NS 1000000ULL
+#define SS_RESET_NS 8000000ULL
+
+static struct {
+  uint8_t base, func;
+  uint64_t ready_at;
+  uint64_t reset_until;
+} ss;
+
+static int ss_write(const uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  uint64_t now = sim_time_ns();
+  if (now < ss.reset_until) {
+    return -1;
+  }
+  if (len < 2) {
+    return 0;
+  }
+  ss.base = data[0];
+  ss.func = data[1];
+  if (ss.base == 0x00 && ss.func == 0x7F) {
+    ss.reset_until = now + SS_RESET_NS;
+  } else if (ss.base == 0x0F) {
+    ss.ready_at = now + SS_TOUCH_NS;
+  } else {
+    ss.ready_at = now + SS_TEMP_NS;
+  }
+  return 0;
+}
+
+static int ss_read(uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  if (sim_time_ns() < ss.reset_until) {
+    return -1;
+  }
+  if (ready_in(ss.ready_at)) {
+    early_reads++;
+    memset(data, 0xFF, len); // the SAMD09 has nothing to put on the bus yet
+    return 0;
+  }
+  uint8_t out[4] = {0};
+  if (ss.base == 0x0F && ss.func == 0x10) {
+    out[0] = (uint8_t)(sim_env.soil_cap >> 8);
+    out[1] = (uint8_t)(sim_env.soil_cap & 0xFF);
+  } else if (ss.base == 0x00 && ss.func == 0x04) {
+    int32_t raw = (int32_t)(sim_env.soil_temp_c * 65536.0f);
+    out[0] = (uint8_t)(raw >> 24);
+    out[1] = (uint8_t)(raw >> 16);
+    out[2] = (uint8_t)(raw >> 8);
+    out[3] = (uint8_t)raw;
+  } else if (ss.base == 0x00 && ss.func == 0x01) {
+    out[0] = 0x55; // hardware id
+  }
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = i < 4 ? out[i] : 0xFF;
+  }
+  return 0;
+}
+
+static SimI2cDevice ss_dev = {
+    .name = "Seesaw",
+    .addr = SS_ADDR,
+    .write = ss_write,
+    .read = ss_read,
+};
+
+/********/
+// BH1750
+/*******/
+#define BH_ADDR (0x23 << 1)
+#define BH_HRES_NS 120000000ULL
+#define BH_LRES_NS 16000000ULL
+
+static struct {
+  int powered;
+  int continuous;
+  uint64_t conv_ns;
+  uint64_t ready_at;
+  uint16_t data;
+  int valid; // a conversion finished since the last mode command
+} bh;
+
+static void bh_update(void) {
+  if (bh.conv_ns && sim_time_ns() >= bh.ready_at) {
+    bh.data = (uint16_t)(sim_env.lux * 1.2f);
+    bh.valid = 1;
+    if (bh.continuous) {
+      uint64_t n = (sim_time_ns() - bh.ready_at) / bh.conv_ns + 1;
+      bh.ready_at += n * bh.conv_ns;
+    } else {
+      bh.conv_ns = 0; // one-time modes power down after the measurement
+      bh.powered = 0;
+    }
+  }
+}
+
+static int bh_write(const uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  bh_update();
+  for (uint16_t i = 0; i < len; i++) {
+    uint8_t op = data[i];
+    switch (op) {
+    case 0x00:
+      bh.powered = 0;
+      bh.conv_ns = 0;
+      break;
+    case 0x01:
+      bh.powered = 1;
+      break;
+    case 0x07:
+      if (bh.powered) {
+        bh.data = 0;
+      }
+      break;
+    case 0x10:
+    case 0x11:
+    case 0x13:
+    case 0x20:
+    case 0x21:
+    case 0x23:
+      bh.powered = 1;
+      bh.continuous = op < 0x20;
+      bh.conv_ns = (op & 0x03) == 0x03 ? BH_LRES_NS : BH_HRES_NS;
+      bh.ready_at = sim_time_ns() + bh.conv_ns;
+      bh.valid = 0;
+      break;
+    default:
+      break;
+    }
+  }
+  return 0;
+}
+
+static int bh_read(uint8_t *data, uint16_t len, uint64_t *stretch) {
+  (void)stretch;
+  bh_update();
+  if (!bh.valid) {
+    early_reads++; // the data register still holds the previous result
+  }
+  uint8_t out[2] = {(uint8_t)(bh.data >> 8), (uint8_t)(bh.data & 0xFF)};
+  for (uint16_t i = 0; i < len; i++) {
+    data[i] = i < 2 ? out[i] : 0xFF;
+  }
+  return 0;
+}
+
+static SimI2cDevice bh_dev = {
+    .name = "BH1750",
+    .addr = BH_ADDR,
+    .write = bh_write,
+    .read = bh_read,
+};
+
+/********/
+// Pump
+/*******/
+static uint64_t pump_on_since;
+static uint64_t pump_total_ns;
+static int pump_running;
+
+static void pump_pin(GPIO_PinState state) {
+  if (state == GPIO_PIN_SET && !pump_running) {
+    pump_running = 1;
+    pump_on_since = sim_time_ns();
+  } else if (state == GPIO_PIN_RESET && pump_running) {
+    pump_running = 0;
+    pump_total_ns += sim_time_ns() - pump_on_since;
+  }
+}
+
+uint64_t sim_pump_on_ns(void) {
+  return pump_total_ns + (pump_running ? sim_time_ns() - pump_on_since : 0);
+}
+
+void sim_sensors_attach(void) {
+  ft_defaults();
+  ft.in_reset = 0;
+  touch_count = 0;
+  memset(&si, 0, sizeof(si));
+  memset(&ss, 0, sizeof(ss));
+  memset(&bh, 0, sizeof(bh));
+  early_reads = 0;
+  pump_total_ns = 0;
+  pump_running = 0;
+  sim_gpio_drive(GPIOF, GPIO_PIN_9, GPIO_PIN_SET); // INT idles high
+  sim_gpio_watch(GPIOF, GPIO_PIN_7, ft_rst_pin);
+  sim_gpio_watch(GPIOB, GPIO_PIN_2, pump_pin);
+  sim_i2c_attach(I2C1, &ft_dev);
+  sim_i2c_attach(I2C2, &si_dev);
+  sim_i2c_attach(I2C2, &ss_dev);
+  sim_i2c_attach(I2C2, &bh_dev);
+}
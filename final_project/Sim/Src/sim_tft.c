@@ -0,0 +1,180 @@
+/*
+ * sim_tft.c
+ *
+ * Virtual 480x320 SPI TFT (ILI9488 style command set) behind SPI1, or the
+ * bus in sim_config.tft_spi, with CS on PD0, D/C on PD1 and reset on PF2. Pixels land in an RGB565
+ * framebuffer in landscape orientation that can be dumped as a PPM.
+ *
+ * The framebuffer is the glass as seen with MADCTL 0x28 (MV | BGR), the
+ * firmware's landscape. With MV set the column address runs along the long
+ * side, so MY reverses x and MX reverses y on top of that.
+ */
+
+#include "sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TFT_W 480
+#define TFT_H 320
+#define MADCTL_LANDSCAPE 0x28
+#define MADCTL_MY 0x80
+#define MADCTL_MX 0x40
+
+static uint16_t fb[TFT_W * TFT_H];
+
+static struct {
+  int selected;
+  uint8_t cmd;
+  uint8_t args[4];
+  int nargs;
+  uint16_t x0, x1, y0, y1; // address window, inclusive
+  uint16_t x, y;           // RAMWR write pointer
+  uint8_t pixel_hi;
+  int have_hi;
+  uint8_t madctl;
+  int sleeping;
+  uint64_t pixels;
+  uint64_t windows;
+  uint64_t ramwr;
+} tft;
+
+static void tft_reset(void) {
+  tft.cmd = 0;
+  tft.nargs = 0;
+  tft.x0 = 0;
+  tft.x1 = TFT_W - 1;
+  tft.y0 = 0;
+  tft.y1 = TFT_H - 1;
+  tft.madctl = 0;
+  tft.sleeping = 1;
+  tft.have_hi = 0;
+}
+
+static void tft_select(int selected) {
+  tft.selected = selected;
+  tft.have_hi = 0;
+}
+
+static void tft_rst_pin(GPIO_PinState state) {
+  if (state == GPIO_PIN_RESET) {
+    tft_reset();
+  }
+}
+
+static void tft_command(uint8_t cmd) {
+  tft.cmd = cmd;
+  tft.nargs = 0;
+  tft.have_hi = 0;
+  switch (cmd) {
+  case 0x11: // SLPOUT
+    tft.sleeping = 0;
+    break;
+  case 0x2C: // RAMWR restarts at the window origin
+    tft.x = tft.x0;
+    tft.y = tft.y0;
+    tft.ramwr++;
+    break;
+  default:
+    break;
+  }
+}
+
+static void tft_pixel(uint16_t color) {
+  if (tft.x < TFT_W && tft.y < TFT_H) {
+    uint8_t turned = tft.madctl ^ MADCTL_LANDSCAPE;
+    uint16_t x = turned & MADCTL_MY ? TFT_W - 1 - tft.x : tft.x;
+    uint16_t y = turned & MADCTL_MX ? TFT_H - 1 - tft.y : tft.y;
+    fb[y * TFT_W + x] = color;
+  }
+  tft.pixels++;
+  if (tft.x >= tft.x1) {
+    tft.x = tft.x0;
+    tft.y = tft.y >= tft.y1 ? tft.y0 : (uint16_t)(tft.y + 1);
+  } else {
+    tft.x++;
+  }
+}
+
+static void tft_data(uint8_t b) {
+  switch (tft.cmd) {
+  case 0x2A: // CASET
+  case 0x2B: // PASET
+    if (tft.nargs < 4) {
+      tft.args[tft.nargs++] = b;
+    }
+    if (tft.nargs == 4) {
+      uint16_t s = (uint16_t)(tft.args[0] << 8 | tft.args[1]);
+      uint16_t e = (uint16_t)(tft.args[2] << 8 | tft.args[3]);
+      if (tft.cmd == 0x2A) {
+        tft.x0 = s;
+        tft.x1 = e;
+      } else {
+        tft.y0 = s;
+        tft.y1 = e;
+        tft.windows++;
+      }
+      tft.nargs = 5; // ignore extra bytes
+    }
+    break;
+  case 0x36: // MADCTL
+    tft.madctl = b;
+    break;
+  case 0x2C:
+  case 0x3C: // RAMWR / RAMWR continue
+    if (tft.have_hi) {
+      tft_pixel((uint16_t)(tft.pixel_hi << 8 | b));
+      tft.have_hi = 0;
+    } else {
+      tft.pixel_hi = b;
+      tft.have_hi = 1;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static uint8_t tft_exchange(uint8_t mosi) {
+  if (!(GPIOD->odr & GPIO_PIN_1)) { // D/C low: command byte
+    tft_command(mosi);
+  } else {
+    tft_data(mosi);
+  }
+  return 0x00; // MISO is not connected on the display module
+}
+
+static SimSpiDevice tft_dev = {
+    .name = "TFT",
+    .select = tft_select,
+    .exchange = tft_exchange,
+};
+
+void sim_tft_attach(void) {
+  tft_reset();
+  tft_dev.cs_port = GPIOD;
+  tft_dev.cs_pin = GPIO_PIN_0;
+  GPIOD->odr |= GPIO_PIN_0; // deselected until the firmware drives CS
+  sim_spi_attach(sim_config.tft_spi ? sim_config.tft_spi : SPI1, &tft_dev);
+  sim_gpio_watch(GPIOF, GPIO_PIN_2, tft_rst_pin);
+}
+
+const uint16_t *sim_tft_framebuffer(void) { return fb; }
+
+uint64_t sim_tft_pixels_written(void) { return tft.pixels; }
+
+int sim_tft_dump_ppm(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return -1;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", TFT_W, TFT_H);
+  for (int i = 0; i < TFT_W * TFT_H; i++) {
+    uint16_t c = fb[i];
+    uint8_t rgb[3] = {(uint8_t)((c >> 11) << 3), (uint8_t)(((c >> 5) & 0x3F) << 2),
+                      (uint8_t)((c & 0x1F) << 3)};
+    fwrite(rgb, 1, 3, f);
+  }
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * trace_decode.c
+ *
+ * See trace_decode.h and the frame layout in Core/Inc/trace.h.
+ */
+
+#include "trace_decode.h"
+
+#include "trace.h"
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { IN_TEXT, IN_LEN, IN_BODY };
+
+/********/
+// ELF
+/*******/
+typedef struct {
+  uint32_t name;
+  uint64_t off, size;
+} Section;
+
+// Section header i of either class, little endian as both targets are
+static Section section(const uint8_t *img, int wide, uint64_t shoff,
+                       uint16_t shentsize, uint16_t i) {
+  const uint8_t *sh = img + shoff + (uint64_t)i * shentsize;
+  Section s;
+  if (wide) {
+    const Elf64_Shdr *h = (const Elf64_Shdr *)sh;
+    s.name = h->sh_name;
+    s.off = h->sh_offset;
+    s.size = h->sh_size;
+  } else {
+    const Elf32_Shdr *h = (const Elf32_Shdr *)sh;
+    s.name = h->sh_name;
+    s.off = h->sh_offset;
+    s.size = h->sh_size;
+  }
+  return s;
+}
+
+static int elf_section(const uint8_t *img, size_t size, const char *want,
+                       Section *found) {
+  if (size < sizeof(Elf64_Ehdr) || memcmp(img, ELFMAG, SELFMAG) ||
+      img[EI_DATA] != ELFDATA2LSB) {
+    return -1;
+  }
+  int wide = img[EI_CLASS] == ELFCLASS64;
+  uint64_t shoff;
+  uint16_t shentsize, shnum, shstrndx;
+  if (wide) {
+    const Elf64_Ehdr *eh = (const Elf64_Ehdr *)img;
+    shoff = eh->e_shoff;
+    shentsize = eh->e_shentsize;
+    shnum = eh->e_shnum;
+    shstrndx = eh->e_shstrndx;
+  } else {
+    const Elf32_Ehdr *eh = (const Elf32_Ehdr *)img;
+    shoff = eh->e_shoff;
+    shentsize = eh->e_shentsize;
+    shnum = eh->e_shnum;
+    shstrndx = eh->e_shstrndx;
+  }
+  if (shoff + (uint64_t)shnum * shentsize > size || shstrndx >= shnum) {
+    return -1;
+  }
+  Section names = section(img, wide, shoff, shentsize, shstrndx);
+  if (names.off + names.size > size) {
+    return -1;
+  }
+  size_t want_len = strlen(want) + 1;
+  for (uint16_t i = 0; i < shnum; i++) {
+    Section s = section(img, wide, shoff, shentsize, i);
+    if (s.name + want_len <= names.size && s.off + s.size <= size &&
+        !memcmp(img + names.off + s.name, want, want_len)) {
+      *found = s;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int trace_decoder_load_elf(TraceDecoder *d, const char *path) {
+  memset(d, 0, sizeof(*d));
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *img = size > 0 ? malloc((size_t)size) : NULL;
+  int rc = -1;
+  Section s;
+  if (img && fread(img, 1, (size_t)size, f) == (size_t)size &&
+      !elf_section(img, (size_t)size, "trace_fmt", &s)) {
+    d->fmt = malloc(s.size + 1);
+    if (d->fmt) {
+      memcpy(d->fmt, img + s.off, s.size);
+      d->fmt[s.size] = 0;
+      d->fmt_size = s.size;
+      rc = 0;
+    }
+  }
+  free(img);
+  fclose(f);
+  return rc;
+}
+
+void trace_decoder_free(TraceDecoder *d) {
+  free(d->fmt);
+  d->fmt = NULL;
+}
+
+/********/
+// Records
+/*******/
+static int get_varint(const uint8_t *p, uint32_t len, uint32_t *at,
+                      uint32_t *v) {
+  uint32_t r = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*at >= len) {
+      return -1;
+    }
+    uint8_t b = p[(*at)++];
+    r |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = r;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Number of arguments fmt takes, -1 for one that cannot be deferred
+static int count_args(const char *fmt) {
+  int n = 0;
+  for (const char *p = fmt; *p; p++) {
+    if (*p != '%') {
+      continue;
+    }
+    p += strspn(p + 1, "-+ #0123456789.hljzt") + 1;
+    if (*p == '%') {
+      continue;
+    }
+    if (!*p || !strchr("diuxXoc", *p)) {
+      return -1;
+    }
+    n++;
+  }
+  return n;
+}
+
+// printf with the arguments as recorded: each conversion is rebuilt with
+// its flags, width and precision, and the length modifier replaced by l
+static size_t format(char *out, size_t size, const char *fmt,
+                     const uint32_t *args) {
+  size_t n = 0;
+  for (const char *p = fmt; *p && n + 1 < size; p++) {
+    if (*p != '%') {
+      out[n++] = *p;
+      continue;
+    }
+    size_t spec_len = strspn(p + 1, "-+ #0123456789.");
+    char spec[32];
+    if (spec_len > sizeof(spec) - 4) {
+      spec_len = sizeof(spec) - 4;
+    }
+    spec[0] = '%';
+    memcpy(spec + 1, p + 1, spec_len);
+    p += spec_len + 1;
+    p += strspn(p, "hljzt");
+    if (*p == '%') {
+      out[n++] = '%';
+      continue;
+    }
+    char conv = *p;
+    uint32_t v = *args++;
+    int w;
+    if (conv == 'c') {
+      memcpy(spec + 1 + spec_len, "c", 2);
+      w = snprintf(out + n, size - n, spec, (int)v);
+    } else if (conv == 'd' || conv == 'i') {
+      memcpy(spec + 1 + spec_len, "ld", 3);
+      w = snprintf(out + n, size - n, spec, (long)(int32_t)v);
+    } else {
+      spec[1 + spec_len] = 'l';
+      spec[2 + spec_len] = conv;
+      spec[3 + spec_len] = 0;
+      w = snprintf(out + n, size - n, spec, (unsigned long)v);
+    }
+    if (w > 0) {
+      n += (size_t)w < size - n ? (size_t)w : size - n - 1;
+    }
+  }
+  out[n] = 0;
+  return n;
+}
+
+static void emit(TraceDecodeOut out, void *ctx, const char *text,
+                 size_t len) {
+  if (len) {
+    out(text, len, ctx);
+  }
+}
+
+static void decode_frame(TraceDecoder *d, TraceDecodeOut out, void *ctx) {
+  const uint8_t *f = d->frame;
+  uint32_t len = d->frame_len, at = 0;
+  uint32_t khz, lost, base;
+  char line[512];
+  if (get_varint(f, len, &at, &khz) || get_varint(f, len, &at, &lost) ||
+      get_varint(f, len, &at, &base) || !khz) {
+    d->bad++;
+    return;
+  }
+  d->frames++;
+  // CYCCNT wraps; take the base as the nearest time after the last record
+  uint64_t t = (d->cycles & ~0xFFFFFFFFull) | base;
+  if (d->have_time && t + 0x80000000ull < d->cycles) {
+    t += 0x100000000ull;
+  }
+  d->cycles = t;
+  d->have_time = 1;
+  if (lost) {
+    d->lost += lost;
+    int n = snprintf(line, sizeof(line), "[trace] %lu records lost\r\n",
+                     (unsigned long)lost);
+    emit(out, ctx, line, (size_t)n);
+  }
+
+  while (at < len) {
+    uint32_t head, delta, args[TRACE_ARGS_MAX];
+    if (get_varint(f, len, &at, &head) || get_varint(f, len, &at, &delta)) {
+      d->bad++;
+      return;
+    }
+    uint32_t id = head >> 3, count = head & 7;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t z;
+      if (get_varint(f, len, &at, &z)) {
+        d->bad++;
+        return;
+      }
+      args[i] = z >> 1 ^ (0u - (z & 1));
+    }
+    d->cycles += delta;
+    d->records++;
+
+    size_t n = 0;
+    if (d->stamps) {
+      n = (size_t)snprintf(line, sizeof(line), "[%12.6f] ",
+                           d->cycles / (khz * 1000.0));
+    }
+    const char *fmt = id < d->fmt_size ? d->fmt + id : NULL;
+    if (!fmt || count_args(fmt) != (int)count) {
+      n += (size_t)snprintf(line + n, sizeof(line) - n,
+                            "[trace] unknown record %lu/%lu\r\n",
+                            (unsigned long)id, (unsigned long)count);
+    } else {
+      n += format(line + n, sizeof(line) - n, fmt, args);
+    }
+    emit(out, ctx, line, n);
+  }
+}
+
+/********/
+// Stream
+/*******/
+void trace_decoder_feed(TraceDecoder *d, const uint8_t *data, size_t len,
+                        TraceDecodeOut out, void *ctx) {
+  size_t text_from = 0; // start of the text not passed on yet
+  for (size_t i = 0; i < len; i++) {
+    uint8_t b = data[i];
+    switch (d->state) {
+    case IN_TEXT:
+      if (b != TRACE_FRAME_START) {
+        continue;
+      }
+      emit(out, ctx, (const char *)data + text_from, i - text_from);
+      d->state = IN_LEN;
+      d->frame_len = 0;
+      d->len_shift = 0;
+      break;
+    case IN_LEN:
+      d->frame_len |= (uint32_t)(b & 0x7F) << d->len_shift;
+      d->len_shift += 7;
+      if (d->frame_len > TRACE_DECODE_FRAME_MAX || d->len_shift > 28) {
+        d->bad++;
+        d->state = IN_TEXT; // not a frame after all
+      } else if (!(b & 0x80)) {
+        d->frame_at = 0;
+        d->state = d->frame_len ? IN_BODY : IN_TEXT;
+      }
+      break;
+    case IN_BODY:
+      d->frame[d->frame_at++] = b;
+      if (d->frame_at == d->frame_len) {
+        decode_frame(d, out, ctx);
+        d->state = IN_TEXT;
+      }
+      break;
+    }
+    text_from = i + 1;
+  }
+  if (d->state == IN_TEXT) {
+    emit(out, ctx, (const char *)data + text_from, len - text_from);
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * tracedump.c
+ *
+ * Decodes a captured LPUART1 stream: log text is copied through, trace
+ * frames come out as the text their TRACE() calls would have printed. The
+ * format strings are read from the firmware ELF the stream came from, the
+ * STM32CubeIDE build or plantpot_sim itself.
+ *
+ *   plantpot_tracedump [-t] FIRMWARE.elf [CAPTURE]
+ *
+ * -t prefixes each record with its time in seconds. Without CAPTURE the
+ * stream is read from stdin, e.g. from the pty of plantpot_sim --uart-pty
+ * or a serial port.
+ */
+
+#include "trace_decode.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void to_stdout(const char *text, size_t len, void *ctx) {
+  (void)ctx;
+  fwrite(text, 1, len, stdout);
+}
+
+int main(int argc, char **argv) {
+  TraceDecoder d;
+  int stamps = 0;
+  int a = 1;
+  if (a < argc && !strcmp(argv[a], "-t")) {
+    stamps = 1;
+    a++;
+  }
+  if (a >= argc || argc - a > 2) {
+    fprintf(stderr, "usage: %s [-t] FIRMWARE.elf [CAPTURE]\n", argv[0]);
+    return 2;
+  }
+  if (trace_decoder_load_elf(&d, argv[a]) != 0) {
+    fprintf(stderr, "%s: no trace_fmt section in %s\n", argv[0], argv[a]);
+    return 1;
+  }
+  d.stamps = stamps;
+  FILE *in = a + 1 < argc ? fopen(argv[a + 1], "rb") : stdin;
+  if (!in) {
+    fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[a + 1]);
+    trace_decoder_free(&d);
+    return 1;
+  }
+
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    trace_decoder_feed(&d, buf, n, to_stdout, NULL);
+    fflush(stdout);
+  }
+  fprintf(stderr, "%lu frames, %lu records, %lu lost, %lu undecodable\n",
+          (unsigned long)d.frames, (unsigned long)d.records,
+          (unsigned long)d.lost, (unsigned long)d.bad);
+
+  if (in != stdin) {
+    fclose(in);
+  }
+  trace_decoder_free(&d);
+  return d.bad ? 1 : 0;
+}